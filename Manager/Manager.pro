@@ -37,11 +37,17 @@ CONFIG -= qt
 TARGET = AkVCamManager
 
 HEADERS = \
-    src/cmdparser.h
+    src/cmdparser.h \
+    src/frameio.h \
+    src/frametap.h \
+    src/loadgen.h
 
 SOURCES = \
     src/main.cpp \
-    src/cmdparser.cpp
+    src/cmdparser.cpp \
+    src/frameio.cpp \
+    src/frametap.cpp \
+    src/loadgen.cpp
 
 INCLUDEPATH += \
     .. \
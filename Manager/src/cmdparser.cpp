@@ -18,16 +18,30 @@
  */
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <codecvt>
 #include <csignal>
 #include <iostream>
 #include <functional>
 #include <locale>
+#include <memory>
 #include <sstream>
+#include <thread>
 
 #include "cmdparser.h"
+#include "frameio.h"
+#include "frametap.h"
+#include "loadgen.h"
+#include "VCamUtils/src/filewatcher.h"
 #include "VCamUtils/src/ipcbridge.h"
+#include "VCamUtils/src/logcontrol.h"
+#include "VCamUtils/src/memoryaccounting.h"
+#include "VCamUtils/src/perfcounters.h"
+#include "VCamUtils/src/recording.h"
 #include "VCamUtils/src/settings.h"
+#include "VCamUtils/src/stats.h"
+#include "VCamUtils/src/image/filtergraph.h"
 #include "VCamUtils/src/image/videoformat.h"
 #include "VCamUtils/src/image/videoframe.h"
 #include "VCamUtils/src/logger.h"
@@ -55,14 +69,39 @@ namespace AkVCam {
         std::vector<CmdParserFlags> flags;
     };
 
+    struct CameraSettings
+    {
+        std::string description;
+        std::vector<VideoFormat> formats;
+        StringMap controls;
+    };
+
+    struct StageTime
+    {
+        std::string name;
+        uint64_t time;
+        uint64_t frames;
+        uint64_t bytes;
+        PerfCounts counts;
+    };
+
+    struct TapContext
+    {
+        std::string deviceId;
+        FrameTap *tap;
+        uint64_t every;
+        uint64_t received;
+    };
+
     class CmdParserPrivate
     {
         public:
             std::vector<CmdParserCommand> m_commands;
-            IpcBridge m_ipcBridge;
+            std::unique_ptr<IpcBridge> m_ipcBridge;
             bool m_parseable {false};
 
             static const std::map<ControlType, std::string> &typeStrMap();
+            IpcBridge &ipcBridge();
             std::string basename(const std::string &path);
             void printFlags(const std::vector<CmdParserFlags> &cmdFlags,
                             size_t indent);
@@ -106,6 +145,16 @@ namespace AkVCam {
             int update(const StringMap &flags, const StringVector &args);
             int loadSettings(const StringMap &flags, const StringVector &args);
             int stream(const StringMap &flags, const StringVector &args);
+            int watchSettings(const StringMap &flags, const StringVector &args);
+            int tap(const StringMap &flags, const StringVector &args);
+            int replay(const StringMap &flags, const StringVector &args);
+            int convert(const StringMap &flags, const StringVector &args);
+            int loadgen(const StringMap &flags, const StringVector &args);
+            bool readSize(const std::string &str, int *width, int *height);
+            static void tapFrame(void *userData,
+                                 const std::string &deviceId,
+                                 const VideoFramePtr &frame,
+                                 uint64_t sequence);
             int showControls(const StringMap &flags, const StringVector &args);
             int readControl(const StringMap &flags, const StringVector &args);
             int writeControls(const StringMap &flags, const StringVector &args);
@@ -114,6 +163,7 @@ namespace AkVCam {
             int logLevel(const StringMap &flags, const StringVector &args);
             int setLogLevel(const StringMap &flags, const StringVector &args);
             int showClients(const StringMap &flags, const StringVector &args);
+            void printStats();
             void loadGenerals(Settings &settings);
             VideoFormatMatrix readFormats(Settings &settings);
             std::vector<VideoFormat> readFormat(Settings &settings);
@@ -126,8 +176,15 @@ namespace AkVCam {
                                const VideoFormatMatrix &availableFormats);
             void createDevice(Settings &settings,
                               const VideoFormatMatrix &availableFormats);
+            bool readCamera(Settings &settings,
+                            const VideoFormatMatrix &availableFormats,
+                            CameraSettings &camera);
             std::vector<VideoFormat> readDeviceFormats(Settings &settings,
                                                        const VideoFormatMatrix &availableFormats);
+            std::vector<VideoFormat> filterSupportedFormats(const std::vector<VideoFormat> &formats);
+            std::map<std::string, int> readDeviceControls(const std::string &deviceId,
+                                                          const StringMap &values);
+            bool applySettings(const std::string &fileName);
     };
 
     std::string operator *(const std::string &str, size_t n);
@@ -206,10 +263,149 @@ AkVCam::CmdParser::CmdParser()
                      "SETTINGS.INI",
                      "Create devices from a setting file.",
                      AKVCAM_BIND_FUNC(CmdParserPrivate::loadSettings));
+    this->addCommand("watch-settings",
+                     "SETTINGS.INI",
+                     "Apply the changes of a setting file while it's edited.",
+                     AKVCAM_BIND_FUNC(CmdParserPrivate::watchSettings));
+    this->addFlags("watch-settings",
+                   {"-d", "--debounce"},
+                   "MSECS",
+                   "Time to wait for the file to stop changing.");
     this->addCommand("stream",
                      "DEVICE FORMAT WIDTH HEIGHT",
                      "Read frames from stdin and send them to the device.",
                      AKVCAM_BIND_FUNC(CmdParserPrivate::stream));
+    this->addFlags("stream",
+                   {"-r", "--record"},
+                   "FILE",
+                   "Save the streamed frames to a recording.");
+    this->addFlags("stream",
+                   {"-s", "--slices"},
+                   "N",
+                   "Send each frame in N horizontal slices.");
+    this->addFlags("stream",
+                   {"-S", "--stats"},
+                   "Show the counters, lock profiles and memory usage "
+                   "when finished.");
+    this->addCommand("replay",
+                     "DEVICE FILE",
+                     "Send the frames of a recording to the device.",
+                     AKVCAM_BIND_FUNC(CmdParserPrivate::replay));
+    this->addFlags("replay",
+                   {"-m", "--max-speed"},
+                   "Send the frames as fast as possible.");
+    this->addFlags("replay",
+                   {"-l", "--loops"},
+                   "N",
+                   "Replay the recording N times.");
+    this->addFlags("replay",
+                   {"-S", "--stats"},
+                   "Show the counters, lock profiles and memory usage "
+                   "when finished.");
+    this->addCommand("tap",
+                     "DEVICE FILE",
+                     "Save the frames sent to the device without capturing "
+                     "from it.",
+                     AKVCAM_BIND_FUNC(CmdParserPrivate::tap));
+    this->addFlags("tap",
+                   {"-e", "--every"},
+                   "N",
+                   "Save one of each N frames.");
+    this->addFlags("tap",
+                   {"-f", "--format"},
+                   "y4m|raw",
+                   "Output file format, y4m by default.");
+    this->addFlags("tap",
+                   {"-b", "--budget"},
+                   "MB",
+                   "Memory for the frames waiting to be written, 64 MB by "
+                   "default.");
+    this->addCommand("convert",
+                     "INPUT OUTPUT",
+                     "Process the frames of a file and show the time "
+                     "spent in each stage.",
+                     AKVCAM_BIND_FUNC(CmdParserPrivate::convert));
+    this->addFlags("convert",
+                   {"-f", "--format"},
+                   "FORMAT",
+                   "Output pixel format.");
+    this->addFlags("convert",
+                   {"-s", "--size"},
+                   "WIDTHxHEIGHT",
+                   "Output frame size.");
+    this->addFlags("convert",
+                   {"-S", "--scaling"},
+                   "fast|linear",
+                   "Scaling mode.");
+    this->addFlags("convert",
+                   {"-a", "--aspect"},
+                   "ignore|keep|expanding",
+                   "Aspect ratio mode.");
+    this->addFlags("convert",
+                   {"-H", "--hflip"},
+                   "Mirror the frames horizontally.");
+    this->addFlags("convert",
+                   {"-V", "--vflip"},
+                   "Mirror the frames vertically.");
+    this->addFlags("convert",
+                   {"-r", "--swap-rgb"},
+                   "Swap red and blue components.");
+    this->addFlags("convert",
+                   {"-A", "--adjust"},
+                   "HUE,SATURATION,LUMINANCE,GAMMA,CONTRAST",
+                   "Adjust the colors of the frames.");
+    this->addFlags("convert",
+                   {"-g", "--gray"},
+                   "Convert the frames to gray scale.");
+    this->addFlags("convert",
+                   {"-i", "--input-format"},
+                   "FORMAT",
+                   "Pixel format of raw input files.");
+    this->addFlags("convert",
+                   {"-I", "--input-size"},
+                   "WIDTHxHEIGHT",
+                   "Frame size of raw input files.");
+    this->addFlags("convert",
+                   {"-n", "--repeat"},
+                   "N",
+                   "Process each frame N times.");
+    this->addCommand("loadgen",
+                     "",
+                     "Send test patterns to several devices and report "
+                     "the statistics of each one.",
+                     AKVCAM_BIND_FUNC(CmdParserPrivate::loadgen));
+    this->addFlags("loadgen",
+                   {"-d", "--devices"},
+                   "N",
+                   "Number of devices to use, 1 by default.");
+    this->addFlags("loadgen",
+                   {"-f", "--format"},
+                   "FORMAT",
+                   "Pixel format of the frames.");
+    this->addFlags("loadgen",
+                   {"-s", "--size"},
+                   "WIDTHxHEIGHT",
+                   "Frame size, 1920x1080 by default.");
+    this->addFlags("loadgen",
+                   {"-r", "--fps"},
+                   "FPS",
+                   "Frame rate, 30 by default.");
+    this->addFlags("loadgen",
+                   {"-t", "--duration"},
+                   "SECONDS",
+                   "Run time, 10 seconds by default.");
+    this->addFlags("loadgen",
+                   {"-m", "--max-misses"},
+                   "PERCENT",
+                   "Late or dropped frames allowed per second, 5% by "
+                   "default.");
+    this->addFlags("loadgen",
+                   {"-x", "--stop-on-miss"},
+                   "Stop as soon as a device misses the target.");
+    this->addFlags("loadgen",
+                   {"-S", "--stats"},
+                   "Show the counters, lock profiles and memory usage "
+                   "when finished.");
     this->addCommand("controls",
                      "DEVICE",
                      "Show device controls.",
@@ -255,10 +451,18 @@ AkVCam::CmdParser::CmdParser()
                      "",
                      "Show current debugging level.",
                      AKVCAM_BIND_FUNC(CmdParserPrivate::logLevel));
+    this->addFlags("loglevel",
+                   {"-m", "--modules"},
+                   "Show the levels of the modules instead.");
     this->addCommand("set-loglevel",
                      "LEVEL",
                      "Set debugging level.",
                      AKVCAM_BIND_FUNC(CmdParserPrivate::setLogLevel));
+    this->addFlags("set-loglevel",
+                   {"-m", "--module"},
+                   "MODULE",
+                   "Only for a source file (ipcbridge) or project (VCamIPC) "
+                   "in the running processes. 'default' removes it.");
     this->addCommand("clients",
                      "",
                      "Show clients using the camera.",
@@ -408,6 +612,15 @@ const std::map<AkVCam::ControlType, std::string> &AkVCam::CmdParserPrivate::type
     return typeStr;
 }
 
+// Connect to the assistant only when a command needs it.
+AkVCam::IpcBridge &AkVCam::CmdParserPrivate::ipcBridge()
+{
+    if (!this->m_ipcBridge)
+        this->m_ipcBridge = std::unique_ptr<IpcBridge>(new IpcBridge);
+
+    return *this->m_ipcBridge;
+}
+
 std::string AkVCam::CmdParserPrivate::basename(const std::string &path)
 {
     auto rit =
@@ -694,7 +907,7 @@ int AkVCam::CmdParserPrivate::showDevices(const StringMap &flags,
     UNUSED(flags);
     UNUSED(args);
 
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
 
     if (devices.empty())
         return 0;
@@ -711,7 +924,7 @@ int AkVCam::CmdParserPrivate::showDevices(const StringMap &flags,
 
         for (auto &device: devices) {
             table.push_back(device);
-            table.push_back(this->m_ipcBridge.description(device));
+            table.push_back(this->ipcBridge().description(device));
         }
 
         this->drawTable(table, columns);
@@ -731,7 +944,7 @@ int AkVCam::CmdParserPrivate::addDevice(const StringMap &flags,
         return -1;
     }
 
-    auto deviceId = this->m_ipcBridge.addDevice(args[1]);
+    auto deviceId = this->ipcBridge().addDevice(args[1]);
 
     if (deviceId.empty()) {
         std::cerr << "Failed to create device." << std::endl;
@@ -759,7 +972,7 @@ int AkVCam::CmdParserPrivate::removeDevice(const StringMap &flags,
     }
 
     auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
     auto it = std::find(devices.begin(), devices.end(), deviceId);
 
     if (it == devices.end()) {
@@ -768,7 +981,7 @@ int AkVCam::CmdParserPrivate::removeDevice(const StringMap &flags,
         return -1;
     }
 
-    this->m_ipcBridge.removeDevice(args[1]);
+    this->ipcBridge().removeDevice(args[1]);
 
     return 0;
 }
@@ -778,10 +991,10 @@ int AkVCam::CmdParserPrivate::removeDevices(const AkVCam::StringMap &flags,
 {
     UNUSED(flags);
     UNUSED(args);
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
 
     for (auto &device: devices)
-        this->m_ipcBridge.removeDevice(device);
+        this->ipcBridge().removeDevice(device);
 
     return 0;
 }
@@ -798,7 +1011,7 @@ int AkVCam::CmdParserPrivate::showDeviceDescription(const StringMap &flags,
     }
 
     auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
     auto it = std::find(devices.begin(), devices.end(), deviceId);
 
     if (it == devices.end()) {
@@ -807,7 +1020,7 @@ int AkVCam::CmdParserPrivate::showDeviceDescription(const StringMap &flags,
         return -1;
     }
 
-    std::cout << this->m_ipcBridge.description(args[1]) << std::endl;
+    std::cout << this->ipcBridge().description(args[1]) << std::endl;
 
     return 0;
 }
@@ -824,7 +1037,7 @@ int AkVCam::CmdParserPrivate::setDeviceDescription(const AkVCam::StringMap &flag
     }
 
     auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
     auto dit = std::find(devices.begin(), devices.end(), deviceId);
 
     if (dit == devices.end()) {
@@ -833,7 +1046,7 @@ int AkVCam::CmdParserPrivate::setDeviceDescription(const AkVCam::StringMap &flag
         return -1;
     }
 
-    this->m_ipcBridge.setDescription(deviceId, args[2]);
+    this->ipcBridge().setDescription(deviceId, args[2]);
 
     return 0;
 }
@@ -847,7 +1060,7 @@ int AkVCam::CmdParserPrivate::showSupportedFormats(const StringMap &flags,
             this->containsFlag(flags, "supported-formats", "-i")?
                 IpcBridge::StreamTypeInput:
                 IpcBridge::StreamTypeOutput;
-    auto formats = this->m_ipcBridge.supportedPixelFormats(type);
+    auto formats = this->ipcBridge().supportedPixelFormats(type);
 
     if (!this->m_parseable) {
         if (type == IpcBridge::StreamTypeInput)
@@ -876,7 +1089,7 @@ int AkVCam::CmdParserPrivate::showFormats(const StringMap &flags,
     }
 
     auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
     auto it = std::find(devices.begin(), devices.end(), deviceId);
 
     if (it == devices.end()) {
@@ -886,7 +1099,7 @@ int AkVCam::CmdParserPrivate::showFormats(const StringMap &flags,
     }
 
     if (this->m_parseable) {
-        for  (auto &format: this->m_ipcBridge.formats(args[1]))
+        for  (auto &format: this->ipcBridge().formats(args[1]))
             std::cout << VideoFormat::stringFromFourcc(format.fourcc())
                       << ' '
                       << format.width()
@@ -900,7 +1113,7 @@ int AkVCam::CmdParserPrivate::showFormats(const StringMap &flags,
     } else {
         int i = 0;
 
-        for  (auto &format: this->m_ipcBridge.formats(args[1])) {
+        for  (auto &format: this->ipcBridge().formats(args[1])) {
             std::cout << i
                       << ": "
                       << VideoFormat::stringFromFourcc(format.fourcc())
@@ -931,7 +1144,7 @@ int AkVCam::CmdParserPrivate::addFormat(const StringMap &flags,
     }
 
     auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
     auto dit = std::find(devices.begin(), devices.end(), deviceId);
 
     if (dit == devices.end()) {
@@ -948,7 +1161,7 @@ int AkVCam::CmdParserPrivate::addFormat(const StringMap &flags,
         return -1;
     }
 
-    auto formats = this->m_ipcBridge.supportedPixelFormats(IpcBridge::StreamTypeOutput);
+    auto formats = this->ipcBridge().supportedPixelFormats(IpcBridge::StreamTypeOutput);
     auto fit = std::find(formats.begin(), formats.end(), format);
 
     if (fit == formats.end()) {
@@ -998,7 +1211,7 @@ int AkVCam::CmdParserPrivate::addFormat(const StringMap &flags,
     }
 
     VideoFormat fmt(format, int(width), int(height), {fps});
-    this->m_ipcBridge.addFormat(deviceId, fmt, index);
+    this->ipcBridge().addFormat(deviceId, fmt, index);
 
     return 0;
 }
@@ -1015,7 +1228,7 @@ int AkVCam::CmdParserPrivate::removeFormat(const StringMap &flags,
     }
 
     auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
     auto dit = std::find(devices.begin(), devices.end(), deviceId);
 
     if (dit == devices.end()) {
@@ -1033,7 +1246,7 @@ int AkVCam::CmdParserPrivate::removeFormat(const StringMap &flags,
         return -1;
     }
 
-    auto formats = this->m_ipcBridge.formats(deviceId);
+    auto formats = this->ipcBridge().formats(deviceId);
 
     if (index >= formats.size()) {
         std::cerr << "Index is out of range." << std::endl;
@@ -1041,7 +1254,7 @@ int AkVCam::CmdParserPrivate::removeFormat(const StringMap &flags,
         return -1;
     }
 
-    this->m_ipcBridge.removeFormat(deviceId, int(index));
+    this->ipcBridge().removeFormat(deviceId, int(index));
 
     return 0;
 }
@@ -1058,7 +1271,7 @@ int AkVCam::CmdParserPrivate::removeFormats(const AkVCam::StringMap &flags,
     }
 
     auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
     auto dit = std::find(devices.begin(), devices.end(), deviceId);
 
     if (dit == devices.end()) {
@@ -1067,7 +1280,7 @@ int AkVCam::CmdParserPrivate::removeFormats(const AkVCam::StringMap &flags,
         return -1;
     }
 
-    this->m_ipcBridge.setFormats(deviceId, {});
+    this->ipcBridge().setFormats(deviceId, {});
 
     return 0;
 }
@@ -1077,7 +1290,7 @@ int AkVCam::CmdParserPrivate::update(const StringMap &flags,
 {
     UNUSED(flags);
     UNUSED(args);
-    this->m_ipcBridge.updateDevices();
+    this->ipcBridge().updateDevices();
 
     return 0;
 }
@@ -1102,10 +1315,10 @@ int AkVCam::CmdParserPrivate::loadSettings(const AkVCam::StringMap &flags,
     }
 
     this->loadGenerals(settings);
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
 
     for (auto &device: devices)
-        this->m_ipcBridge.removeDevice(device);
+        this->ipcBridge().removeDevice(device);
 
     this->createDevices(settings, this->readFormats(settings));
 
@@ -1115,8 +1328,6 @@ int AkVCam::CmdParserPrivate::loadSettings(const AkVCam::StringMap &flags,
 int AkVCam::CmdParserPrivate::stream(const AkVCam::StringMap &flags,
                                      const AkVCam::StringVector &args)
 {
-    UNUSED(flags);
-
     if (args.size() < 5) {
         std::cerr << "Not enough arguments." << std::endl;
 
@@ -1124,7 +1335,7 @@ int AkVCam::CmdParserPrivate::stream(const AkVCam::StringMap &flags,
     }
 
     auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
     auto dit = std::find(devices.begin(), devices.end(), deviceId);
 
     if (dit == devices.end()) {
@@ -1141,7 +1352,7 @@ int AkVCam::CmdParserPrivate::stream(const AkVCam::StringMap &flags,
         return -1;
     }
 
-    auto formats = this->m_ipcBridge.supportedPixelFormats(IpcBridge::StreamTypeOutput);
+    auto formats = this->ipcBridge().supportedPixelFormats(IpcBridge::StreamTypeOutput);
     auto fit = std::find(formats.begin(), formats.end(), format);
 
     if (fit == formats.end()) {
@@ -1168,14 +1379,39 @@ int AkVCam::CmdParserPrivate::stream(const AkVCam::StringMap &flags,
         return -1;
     }
 
+    int slices = 1;
+    auto slicesStr = this->flagValue(flags, "stream", "-s");
+
+    if (!slicesStr.empty()) {
+        p = nullptr;
+        slices = int(strtol(slicesStr.c_str(), &p, 10));
+
+        if (*p || slices < 1) {
+            std::cerr << "N must be a positive integer." << std::endl;
+
+            return -1;
+        }
+    }
+
     VideoFormat fmt(format, int(width), int(height), {{30, 1}});
+    this->ipcBridge().setFrameSlices(deviceId, slices);
 
-    if (!this->m_ipcBridge.deviceStart(deviceId, fmt)) {
+    if (!this->ipcBridge().deviceStart(deviceId, fmt)) {
         std::cerr << "Can't start stream." << std::endl;
 
         return -1;
     }
 
+    auto recordingFile = this->flagValue(flags, "stream", "-r");
+
+    if (!recordingFile.empty()
+        && !this->ipcBridge().setRecording(deviceId, recordingFile)) {
+        std::cerr << "Can't open " << recordingFile << "." << std::endl;
+        this->ipcBridge().deviceStop(deviceId);
+
+        return -1;
+    }
+
     static bool exit = false;
     auto signalHandler = [] (int) {
         exit = true;
@@ -1187,83 +1423,92 @@ int AkVCam::CmdParserPrivate::stream(const AkVCam::StringMap &flags,
     size_t bufferSize = 0;
 
     do {
+        // Don't consume the input while nobody is capturing, the producer
+        // will block until a client starts capturing.
+        if (bufferSize == 0
+            && !this->ipcBridge().waitForListeners(deviceId, 500))
+            continue;
+
         std::cin.read(reinterpret_cast<char *>(frame.data().data()
                                                + bufferSize),
                       std::streamsize(frame.data().size() - bufferSize));
         bufferSize += size_t(std::cin.gcount());
 
         if (bufferSize == frame.data().size()) {
-            this->m_ipcBridge.write(deviceId, frame);
+            this->ipcBridge().write(deviceId, frame);
             bufferSize = 0;
         }
     } while (!std::cin.eof() && !exit);
 
-    this->m_ipcBridge.deviceStop(deviceId);
+    this->ipcBridge().deviceStop(deviceId);
+
+    if (this->containsFlag(flags, "stream", "-S"))
+        this->printStats();
 
     return 0;
 }
 
-int AkVCam::CmdParserPrivate::showControls(const StringMap &flags,
-                                           const StringVector &args)
+int AkVCam::CmdParserPrivate::watchSettings(const AkVCam::StringMap &flags,
+                                            const AkVCam::StringVector &args)
 {
-    UNUSED(flags);
-
     if (args.size() < 2) {
-        std::cerr << "Device not provided." << std::endl;
+        std::cerr << "Settings file not provided." << std::endl;
 
         return -1;
     }
 
-    auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
-    auto dit = std::find(devices.begin(), devices.end(), deviceId);
+    FileWatcher watcher;
+    auto debounceStr = this->flagValue(flags, "watch-settings", "-d");
 
-    if (dit == devices.end()) {
-        std::cerr << "'" << deviceId << "' doesn't exists." << std::endl;
+    if (!debounceStr.empty()) {
+        char *p = nullptr;
+        auto debounce = strtol(debounceStr.c_str(), &p, 10);
 
-        return -1;
+        if (*p) {
+            std::cerr << "Debounce must be an integer." << std::endl;
+
+            return -1;
+        }
+
+        watcher.setDebounce(int(debounce));
     }
 
-    if (this->m_parseable) {
-        for (auto &control: this->m_ipcBridge.controls(deviceId))
-            std::cout << control.id << std::endl;
-    } else {
-        auto typeStr = typeStrMap();
+    if (!this->applySettings(args[1]))
+        return -1;
 
-        std::vector<std::string> table {
-            "Control",
-            "Description",
-            "Type",
-            "Minimum",
-            "Maximum",
-            "Step",
-            "Default",
-            "Value"
-        };
-        auto columns = table.size();
+    static std::atomic<bool> changed(false);
+    watcher.connectFileChanged(nullptr, [] (void *, const std::string &) {
+        changed = true;
+    });
 
-        for (auto &control: this->m_ipcBridge.controls(deviceId)) {
-            table.push_back(control.id);
-            table.push_back(control.description);
-            table.push_back(typeStr[control.type]);
-            table.push_back(std::to_string(control.minimum));
-            table.push_back(std::to_string(control.maximum));
-            table.push_back(std::to_string(control.step));
-            table.push_back(std::to_string(control.defaultValue));
-            table.push_back(std::to_string(control.value));
-        }
+    if (!watcher.start(args[1])) {
+        std::cerr << "Can't watch the settings file." << std::endl;
 
-        this->drawTable(table, columns);
+        return -1;
+    }
+
+    static bool exit = false;
+    auto signalHandler = [] (int) {
+        exit = true;
+    };
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    while (!exit) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        if (changed.exchange(false))
+            this->applySettings(args[1]);
     }
 
+    watcher.stop();
+
     return 0;
 }
 
-int AkVCam::CmdParserPrivate::readControl(const StringMap &flags,
-                                          const StringVector &args)
+int AkVCam::CmdParserPrivate::replay(const AkVCam::StringMap &flags,
+                                     const AkVCam::StringVector &args)
 {
-    UNUSED(flags);
-
     if (args.size() < 3) {
         std::cerr << "Not enough arguments." << std::endl;
 
@@ -1271,7 +1516,7 @@ int AkVCam::CmdParserPrivate::readControl(const StringMap &flags,
     }
 
     auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
     auto dit = std::find(devices.begin(), devices.end(), deviceId);
 
     if (dit == devices.end()) {
@@ -1280,164 +1525,973 @@ int AkVCam::CmdParserPrivate::readControl(const StringMap &flags,
         return -1;
     }
 
-    for (auto &control: this->m_ipcBridge.controls(deviceId))
-        if (control.id == args[2]) {
-            if (flags.empty()) {
-                std::cout << control.value << std::endl;
-            } else {
-                if (this->containsFlag(flags, "get-control", "-c")) {
-                    auto typeStr = typeStrMap();
-                    std::cout << control.description << std::endl;
-                }
-                if (this->containsFlag(flags, "get-control", "-t")) {
-                    auto typeStr = typeStrMap();
-                    std::cout << typeStr[control.type] << std::endl;
-                }
+    size_t loops = 1;
+    auto loopsStr = this->flagValue(flags, "replay", "-l");
 
-                if (this->containsFlag(flags, "get-control", "-m")) {
-                    std::cout << control.minimum << std::endl;
-                }
+    if (!loopsStr.empty()) {
+        char *p = nullptr;
+        loops = strtoul(loopsStr.c_str(), &p, 10);
 
-                if (this->containsFlag(flags, "get-control", "-M")) {
-                    std::cout << control.maximum << std::endl;
-                }
+        if (*p || loops < 1) {
+            std::cerr << "N must be a positive integer." << std::endl;
 
-                if (this->containsFlag(flags, "get-control", "-s")) {
-                    std::cout << control.step << std::endl;
-                }
+            return -1;
+        }
+    }
 
-                if (this->containsFlag(flags, "get-control", "-d")) {
-                    std::cout << control.defaultValue << std::endl;
-                }
+    auto speed = this->containsFlag(flags, "replay", "-m")?
+                     RecordingReader::SpeedMaximum:
+                     RecordingReader::SpeedOriginal;
+    RecordingReader recording;
 
-                if (this->containsFlag(flags, "get-control", "-l")) {
-                    for (size_t i = 0; i< control.menu.size(); i++)
-                        if (this->m_parseable)
-                            std::cout << control.menu[i] << std::endl;
-                        else
-                            std::cout << i << ": " << control.menu[i] << std::endl;
-                }
-            }
+    if (!recording.open(args[2])) {
+        std::cerr << "Can't open " << args[2] << "." << std::endl;
 
-            return 0;
-        }
+        return -1;
+    }
 
-    std::cerr << "'" << args[2] << "' control not available." << std::endl;
+    if (recording.frames() < 1) {
+        std::cerr << "The recording is empty." << std::endl;
 
-    return -1;
+        return -1;
+    }
+
+    auto entry = recording.entry(0);
+    VideoFormat fmt(entry.fourcc,
+                    int(entry.width),
+                    int(entry.height),
+                    {{30, 1}});
+
+    if (!this->ipcBridge().deviceStart(deviceId, fmt)) {
+        std::cerr << "Can't start stream." << std::endl;
+
+        return -1;
+    }
+
+    static bool exit = false;
+    auto signalHandler = [] (int) {
+        exit = true;
+    };
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    auto startTime = std::chrono::steady_clock::now();
+    auto frames =
+            recording.replay([this, &deviceId] (const VideoFrame &frame,
+                                                const RecordingEntry &entry) {
+        UNUSED(entry);
+
+        if (exit)
+            return false;
+
+        this->ipcBridge().write(deviceId, frame);
+
+        return true;
+    }, speed, loops);
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - startTime;
+    this->ipcBridge().deviceStop(deviceId);
+
+    std::cout << "Frames: " << frames << std::endl;
+    std::cout << "Time: " << elapsed.count() << " s" << std::endl;
+
+    if (elapsed.count() > 0)
+        std::cout << "FPS: " << double(frames) / elapsed.count() << std::endl;
+
+    if (this->containsFlag(flags, "replay", "-S"))
+        this->printStats();
+
+    return 0;
 }
 
-int AkVCam::CmdParserPrivate::writeControls(const StringMap &flags,
-                                            const StringVector &args)
+int AkVCam::CmdParserPrivate::convert(const AkVCam::StringMap &flags,
+                                      const AkVCam::StringVector &args)
 {
-    UNUSED(flags);
-
     if (args.size() < 3) {
         std::cerr << "Not enough arguments." << std::endl;
 
         return -1;
     }
 
-    auto deviceId = args[1];
-    auto devices = this->m_ipcBridge.devices();
-    auto dit = std::find(devices.begin(), devices.end(), deviceId);
+    VideoFormat rawFormat;
+    auto inputFormatStr = this->flagValue(flags, "convert", "-i");
+    auto inputSizeStr = this->flagValue(flags, "convert", "-I");
 
-    if (dit == devices.end()) {
-        std::cerr << "'" << deviceId << "' doesn't exists." << std::endl;
+    if (!inputFormatStr.empty() || !inputSizeStr.empty()) {
+        int width = 0;
+        int height = 0;
+        auto fourcc = VideoFormat::fourccFromString(inputFormatStr);
 
-        return -1;
-    }
+        if (!fourcc) {
+            std::cerr << "Invalid input pixel format." << std::endl;
 
-    std::map<std::string, int> controls;
+            return -1;
+        }
 
-    for (size_t i = 2; i < args.size(); i++) {
-        if (args[i].find('=') == std::string::npos) {
-            std::cerr << "Argumment "
-                      << i
-                      << " is not in the form KEY=VALUE."
-                      << std::endl;
+        if (!this->readSize(inputSizeStr, &width, &height)) {
+            std::cerr << "Invalid input size." << std::endl;
 
             return -1;
         }
 
-        auto pair = splitOnce(args[i], "=");
+        rawFormat = VideoFormat(fourcc, width, height);
+    }
 
-        if (pair.first.empty()) {
-            std::cerr << "Key for argumment "
-                      << i
-                      << " is emty."
-                      << std::endl;
+    FilterGraph graph;
+    auto hflip = this->containsFlag(flags, "convert", "-H");
+    auto vflip = this->containsFlag(flags, "convert", "-V");
+
+    if (hflip || vflip)
+        graph.append(std::make_shared<MirrorFilter>(hflip, vflip));
+
+    if (this->containsFlag(flags, "convert", "-r"))
+        graph.append(std::make_shared<SwapRgbFilter>());
+
+    auto adjustStr = this->flagValue(flags, "convert", "-A");
+    auto gray = this->containsFlag(flags, "convert", "-g");
+
+    if (!adjustStr.empty() || gray) {
+        int adjust[5] = {0, 0, 0, 0, 0};
+        auto values = split(adjustStr, ',');
+
+        if (values.size() > 5) {
+            std::cerr << "Too many adjust values." << std::endl;
 
             return -1;
         }
 
-        auto key = trimmed(pair.first);
-        auto value = trimmed(pair.second);
-        bool found = false;
+        for (size_t i = 0; i < values.size(); i++) {
+            char *p = nullptr;
+            adjust[i] = int(strtol(values[i].c_str(), &p, 10));
 
-        for (auto &control: this->m_ipcBridge.controls(deviceId))
-                if (control.id == key) {
-                    switch (control.type) {
-                    case ControlTypeInteger: {
-                        char *p = nullptr;
-                        auto val = strtol(value.c_str(), &p, 10);
+            if (*p) {
+                std::cerr << "Adjust values must be integers." << std::endl;
 
-                        if (*p) {
-                            std::cerr << "Value at argument "
-                                      << i
-                                      << " must be an integer."
-                                      << std::endl;
+                return -1;
+            }
+        }
 
-                            return -1;
-                        }
+        graph.append(std::make_shared<AdjustFilter>(adjust[0],
+                                                    adjust[1],
+                                                    adjust[2],
+                                                    adjust[3],
+                                                    adjust[4],
+                                                    gray));
+    }
 
-                        controls[key] = val;
+    auto scaling = ScalingFast;
+    auto scalingStr = this->flagValue(flags, "convert", "-S");
 
-                        break;
-                    }
+    if (scalingStr == "linear") {
+        scaling = ScalingLinear;
+    } else if (!scalingStr.empty() && scalingStr != "fast") {
+        std::cerr << "Invalid scaling mode." << std::endl;
 
-                    case ControlTypeBoolean: {
-                        std::locale loc;
-                        std::transform(value.begin(),
-                                       value.end(),
-                                       value.begin(),
-                                       [&loc](char c) {
-                            return std::tolower(c, loc);
-                        });
+        return -1;
+    }
 
-                        if (value == "0" || value == "false") {
-                            controls[key] = 0;
-                        } else if (value == "1" || value == "true") {
-                            controls[key] = 1;
-                        } else {
-                            std::cerr << "Value at argument "
-                                      << i
-                                      << " must be a boolean."
-                                      << std::endl;
+    auto aspectRatio = AspectRatioIgnore;
+    auto aspectRatioStr = this->flagValue(flags, "convert", "-a");
 
-                            return -1;
-                        }
+    if (aspectRatioStr == "keep") {
+        aspectRatio = AspectRatioKeep;
+    } else if (aspectRatioStr == "expanding") {
+        aspectRatio = AspectRatioExpanding;
+    } else if (!aspectRatioStr.empty() && aspectRatioStr != "ignore") {
+        std::cerr << "Invalid aspect ratio mode." << std::endl;
 
-                        break;
-                    }
+        return -1;
+    }
 
-                    case ControlTypeMenu: {
-                        char *p = nullptr;
-                        auto val = strtoul(value.c_str(), &p, 10);
+    auto sizeStr = this->flagValue(flags, "convert", "-s");
 
-                        if (*p) {
-                            auto it = std::find(control.menu.begin(),
-                                                control.menu.end(),
-                                                value);
+    if (!sizeStr.empty()) {
+        int width = 0;
+        int height = 0;
 
-                            if (it == control.menu.end()) {
-                                std::cerr << "Value at argument "
-                                          << i
-                                          << " is not valid."
-                                          << std::endl;
+        if (!this->readSize(sizeStr, &width, &height)) {
+            std::cerr << "Invalid size." << std::endl;
 
-                                return -1;
-                            }
+            return -1;
+        }
+
+        graph.append(std::make_shared<ScaleFilter>(width,
+                                                   height,
+                                                   scaling,
+                                                   aspectRatio));
+    }
+
+    auto formatStr = this->flagValue(flags, "convert", "-f");
+
+    if (!formatStr.empty()) {
+        auto fourcc = VideoFormat::fourccFromString(formatStr);
+
+        if (!fourcc) {
+            std::cerr << "Invalid pixel format." << std::endl;
+
+            return -1;
+        }
+
+        graph.append(std::make_shared<ConvertFilter>(fourcc));
+    }
+
+    uint64_t repeat = 1;
+    auto repeatStr = this->flagValue(flags, "convert", "-n");
+
+    if (!repeatStr.empty()) {
+        char *p = nullptr;
+        repeat = strtoull(repeatStr.c_str(), &p, 10);
+
+        if (*p || repeat < 1) {
+            std::cerr << "N must be a positive integer." << std::endl;
+
+            return -1;
+        }
+    }
+
+    FrameFileReader reader;
+
+    if (!reader.open(args[1], rawFormat)) {
+        std::cerr << "Can't open " << args[1] << "." << std::endl;
+
+        return -1;
+    }
+
+    FrameFileWriter writer;
+
+    if (!writer.open(args[2], reader.fps())) {
+        std::cerr << "Can't open " << args[2] << "." << std::endl;
+
+        return -1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto elapsed = [] (const Clock::time_point &startTime) {
+        auto time = Clock::now() - startTime;
+
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+    };
+
+    std::vector<StageTime> stages {{"read", 0, 0, 0, {}}};
+    StageTime writeTime {"write", 0, 0, 0, {}};
+    FilterTimings timings;
+    PerfCounters counters;
+    VideoFrame frame;
+    VideoFormat lastFormat;
+
+    for (;;) {
+        auto startCounts = counters.read();
+        auto startTime = Clock::now();
+
+        if (!reader.read(frame))
+            break;
+
+        stages[0].time += elapsed(startTime);
+        stages[0].counts += counters.read() - startCounts;
+        stages[0].bytes += frame.data().size();
+        stages[0].frames++;
+
+        if (frame.format() != lastFormat) {
+            lastFormat = frame.format();
+            auto plan = graph.plan(lastFormat);
+
+            if (plan.empty()) {
+                std::cerr << "Can't process "
+                          << VideoFormat::stringFromFourcc(lastFormat.fourcc())
+                          << " frames."
+                          << std::endl;
+
+                return -1;
+            }
+
+            if (!this->m_parseable)
+                std::cout << "Plan: " << plan << std::endl;
+        }
+
+        VideoFrame output;
+
+        for (uint64_t i = 0; i < repeat; i++) {
+            output = graph.process(frame, &timings, &counters);
+
+            for (size_t j = 0; j < timings.size(); j++) {
+                if (j + 1 >= stages.size())
+                    stages.push_back({timings[j].name, 0, 0, 0, {}});
+
+                stages[j + 1].time += timings[j].time;
+                stages[j + 1].bytes += timings[j].bytes;
+                stages[j + 1].counts += timings[j].counts;
+                stages[j + 1].frames++;
+            }
+        }
+
+        startCounts = counters.read();
+        startTime = Clock::now();
+
+        if (!writer.write(output)) {
+            std::cerr << "Can't write to " << args[2] << "." << std::endl;
+
+            return -1;
+        }
+
+        writeTime.time += elapsed(startTime);
+        writeTime.counts += counters.read() - startCounts;
+        writeTime.bytes += output.data().size();
+        writeTime.frames++;
+    }
+
+    writer.close();
+    stages.push_back(writeTime);
+    bool showCounts = counters.isAvailable();
+
+    if (this->m_parseable) {
+        for (auto &stage: stages) {
+            std::cout << stage.name
+                      << " "
+                      << stage.frames
+                      << " "
+                      << stage.time;
+
+            if (showCounts)
+                std::cout << " "
+                          << stage.bytes
+                          << " "
+                          << stage.counts.cycles
+                          << " "
+                          << stage.counts.instructions
+                          << " "
+                          << stage.counts.cacheMisses
+                          << " "
+                          << stage.counts.branchMisses;
+
+            std::cout << std::endl;
+        }
+    } else {
+        std::vector<std::string> table {
+            "Stage",
+            "Frames",
+            "Total (ms)",
+            "Per frame (ms)"
+        };
+
+        if (showCounts) {
+            table.push_back("IPC");
+            table.push_back("Bytes/cycle");
+            table.push_back("Cache misses/frame");
+            table.push_back("Branch misses/frame");
+        }
+
+        auto columns = table.size();
+
+        for (auto &stage: stages) {
+            auto frames = double(stage.frames? stage.frames: 1);
+            table.push_back(stage.name);
+            table.push_back(std::to_string(stage.frames));
+            table.push_back(std::to_string(double(stage.time) / 1e6));
+            table.push_back(std::to_string(double(stage.time) / 1e6 / frames));
+
+            if (showCounts) {
+                auto &counts = stage.counts;
+                table.push_back(std::to_string(counts.ipc()));
+                table.push_back(std::to_string(counts.cycles?
+                                                   double(stage.bytes)
+                                                   / double(counts.cycles):
+                                                   0.0));
+                table.push_back(std::to_string(double(counts.cacheMisses) / frames));
+                table.push_back(std::to_string(double(counts.branchMisses) / frames));
+            }
+        }
+
+        this->drawTable(table, columns);
+    }
+
+    return 0;
+}
+
+int AkVCam::CmdParserPrivate::loadgen(const AkVCam::StringMap &flags,
+                                      const AkVCam::StringVector &args)
+{
+    UNUSED(args);
+    auto readUInt = [this, &flags] (const std::string &flag,
+                                    uint64_t defaultValue,
+                                    uint64_t *value) {
+        auto str = this->flagValue(flags, "loadgen", flag);
+        *value = defaultValue;
+
+        if (str.empty())
+            return true;
+
+        char *p = nullptr;
+        *value = strtoull(str.c_str(), &p, 10);
+
+        return !*p && *value > 0;
+    };
+
+    uint64_t nDevices = 1;
+
+    if (!readUInt("-d", 1, &nDevices)) {
+        std::cerr << "The number of devices must be a positive integer."
+                  << std::endl;
+
+        return -1;
+    }
+
+    auto devices = this->ipcBridge().devices();
+
+    if (devices.size() < nDevices) {
+        std::cerr << "Not enough devices, "
+                  << nDevices
+                  << " requested but "
+                  << devices.size()
+                  << " available."
+                  << std::endl;
+
+        return -1;
+    }
+
+    devices.resize(size_t(nDevices));
+    auto formats =
+            this->ipcBridge().supportedPixelFormats(IpcBridge::StreamTypeOutput);
+
+    if (formats.empty()) {
+        std::cerr << "No output formats supported." << std::endl;
+
+        return -1;
+    }
+
+    auto fit = std::find(formats.begin(), formats.end(), PixelFormatRGB24);
+    FourCC fourcc = fit == formats.end()? formats.front(): *fit;
+    auto formatStr = this->flagValue(flags, "loadgen", "-f");
+
+    if (!formatStr.empty()) {
+        fourcc = VideoFormat::fourccFromString(formatStr);
+        fit = std::find(formats.begin(), formats.end(), fourcc);
+
+        if (!fourcc || fit == formats.end()) {
+            std::cerr << "Format not supported." << std::endl;
+
+            return -1;
+        }
+    }
+
+    int width = 1920;
+    int height = 1080;
+    auto sizeStr = this->flagValue(flags, "loadgen", "-s");
+
+    if (!sizeStr.empty() && !this->readSize(sizeStr, &width, &height)) {
+        std::cerr << "Invalid size." << std::endl;
+
+        return -1;
+    }
+
+    Fraction fps(30, 1);
+    auto fpsStr = this->flagValue(flags, "loadgen", "-r");
+
+    if (!fpsStr.empty())
+        fps = Fraction(fpsStr);
+
+    if (fps.num() < 1 || fps.den() < 1) {
+        std::cerr << "Invalid frame rate." << std::endl;
+
+        return -1;
+    }
+
+    uint64_t duration = 10;
+
+    if (!readUInt("-t", 10, &duration)) {
+        std::cerr << "The duration must be a positive integer." << std::endl;
+
+        return -1;
+    }
+
+    uint64_t maxMisses = 5;
+
+    if (!readUInt("-m", 5, &maxMisses)) {
+        std::cerr << "The misses must be a positive integer." << std::endl;
+
+        return -1;
+    }
+
+    auto stopOnMiss = this->containsFlag(flags, "loadgen", "-x");
+    VideoFormat format(fourcc, width, height, {fps});
+    LoadGenerator generator(&this->ipcBridge());
+
+    if (!generator.start(devices, format)) {
+        std::cerr << "Can't start the load generator." << std::endl;
+
+        return -1;
+    }
+
+    static bool exit = false;
+    auto signalHandler = [] (int) {
+        exit = true;
+    };
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    // Check the misses of each device once per second.
+    auto allowedMisses = fps.value() * double(maxMisses) / 100.0;
+    auto lastStats = generator.stats();
+    bool missed = false;
+    std::vector<bool> overBudget(lastStats.size(), false);
+
+    for (uint64_t second = 0; second < duration && !exit; second++) {
+        for (int i = 0; i < 10 && !exit; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        auto stats = generator.stats();
+
+        for (size_t i = 0; i < stats.size(); i++) {
+            auto isOverBudget = MemoryAccounting::isOverBudget(stats[i].deviceId);
+
+            if (isOverBudget && !overBudget[i])
+                std::cerr << stats[i].deviceId
+                          << ": over the memory budget at "
+                          << second + 1
+                          << " s."
+                          << std::endl;
+
+            overBudget[i] = isOverBudget;
+            auto misses = stats[i].late
+                        + stats[i].dropped
+                        - lastStats[i].late
+                        - lastStats[i].dropped;
+
+            if (double(misses) <= allowedMisses)
+                continue;
+
+            missed = true;
+            std::cerr << stats[i].deviceId
+                      << ": "
+                      << misses
+                      << " frames late or dropped at "
+                      << second + 1
+                      << " s."
+                      << std::endl;
+
+            if (stopOnMiss)
+                exit = true;
+        }
+
+        lastStats = stats;
+    }
+
+    generator.stop();
+    auto stats = generator.stats();
+
+    if (this->m_parseable) {
+        for (auto &deviceStats: stats)
+            std::cout << deviceStats.deviceId
+                      << " "
+                      << deviceStats.frames
+                      << " "
+                      << deviceStats.dropped
+                      << " "
+                      << deviceStats.late
+                      << " "
+                      << deviceStats.idle
+                      << " "
+                      << deviceStats.latencyAverage
+                      << " "
+                      << deviceStats.latencyP99
+                      << " "
+                      << deviceStats.latencyMax
+                      << " "
+                      << deviceStats.cpuTime
+                      << " "
+                      << deviceStats.elapsed
+                      << " "
+                      << deviceStats.memoryPeak
+                      << std::endl;
+    } else {
+        std::vector<std::string> table {
+            "Device",
+            "Frames",
+            "FPS",
+            "Dropped",
+            "Late",
+            "Idle",
+            "Latency avg (ms)",
+            "Latency p99 (ms)",
+            "Latency max (ms)",
+            "CPU (%)",
+            "Peak memory (MiB)"
+        };
+        auto columns = table.size();
+
+        for (auto &deviceStats: stats) {
+            auto elapsed = deviceStats.elapsed > 0? deviceStats.elapsed: 1.0;
+            table.push_back(deviceStats.deviceId);
+            table.push_back(std::to_string(deviceStats.frames));
+            table.push_back(std::to_string(double(deviceStats.frames) / elapsed));
+            table.push_back(std::to_string(deviceStats.dropped));
+            table.push_back(std::to_string(deviceStats.late));
+            table.push_back(std::to_string(deviceStats.idle));
+            table.push_back(std::to_string(double(deviceStats.latencyAverage) / 1e3));
+            table.push_back(std::to_string(double(deviceStats.latencyP99) / 1e3));
+            table.push_back(std::to_string(double(deviceStats.latencyMax) / 1e3));
+            table.push_back(std::to_string(100.0 * deviceStats.cpuTime / elapsed));
+            table.push_back(std::to_string(double(deviceStats.memoryPeak) / (1 << 20)));
+        }
+
+        this->drawTable(table, columns);
+    }
+
+    if (this->containsFlag(flags, "loadgen", "-S"))
+        this->printStats();
+
+    return missed? -1: 0;
+}
+
+int AkVCam::CmdParserPrivate::tap(const AkVCam::StringMap &flags,
+                                  const AkVCam::StringVector &args)
+{
+    if (args.size() < 3) {
+        std::cerr << "Not enough arguments." << std::endl;
+
+        return -1;
+    }
+
+    auto deviceId = args[1];
+    auto devices = this->ipcBridge().devices();
+    auto dit = std::find(devices.begin(), devices.end(), deviceId);
+
+    if (dit == devices.end()) {
+        std::cerr << "'" << deviceId << "' doesn't exists." << std::endl;
+
+        return -1;
+    }
+
+    uint64_t every = 1;
+    auto everyStr = this->flagValue(flags, "tap", "-e");
+
+    if (!everyStr.empty()) {
+        char *p = nullptr;
+        every = strtoull(everyStr.c_str(), &p, 10);
+
+        if (*p || every < 1) {
+            std::cerr << "N must be a positive integer." << std::endl;
+
+            return -1;
+        }
+    }
+
+    auto format = FrameTap::FormatY4M;
+    auto formatStr = this->flagValue(flags, "tap", "-f");
+
+    if (formatStr == "raw") {
+        format = FrameTap::FormatRaw;
+    } else if (!formatStr.empty() && formatStr != "y4m") {
+        std::cerr << "Invalid file format." << std::endl;
+
+        return -1;
+    }
+
+    size_t budget = 64;
+    auto budgetStr = this->flagValue(flags, "tap", "-b");
+
+    if (!budgetStr.empty()) {
+        char *p = nullptr;
+        budget = strtoul(budgetStr.c_str(), &p, 10);
+
+        if (*p || budget < 1) {
+            std::cerr << "Memory budget must be a positive integer."
+                      << std::endl;
+
+            return -1;
+        }
+    }
+
+    // The frames doesn't carry the frame rate, use the one of the device.
+    Fraction fps(30, 1);
+    auto formats = this->ipcBridge().formats(deviceId);
+
+    if (!formats.empty() && !formats.front().frameRates().empty())
+        fps = formats.front().frameRates().front();
+
+    FrameTap frameTap;
+
+    if (!frameTap.open(args[2], format, fps, budget << 20)) {
+        std::cerr << "Can't open " << args[2] << "." << std::endl;
+
+        return -1;
+    }
+
+    // The tap doesn't register as a listener, so it only sees the frames
+    // while some other client is capturing from the device.
+    TapContext context {deviceId, &frameTap, every, 0};
+    this->ipcBridge().connectFrameReady(&context, &CmdParserPrivate::tapFrame);
+
+    static bool exit = false;
+    auto signalHandler = [] (int) {
+        exit = true;
+    };
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    while (!exit)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    this->ipcBridge().disconnectFrameReady(&context, &CmdParserPrivate::tapFrame);
+    frameTap.close();
+    std::cout << "Frames written: " << frameTap.framesWritten() << std::endl;
+    std::cout << "Frames dropped: " << frameTap.framesDropped() << std::endl;
+    std::cout << "Bytes written: " << frameTap.bytesWritten() << std::endl;
+
+    return 0;
+}
+
+void AkVCam::CmdParserPrivate::tapFrame(void *userData,
+                                        const std::string &deviceId,
+                                        const VideoFramePtr &frame,
+                                        uint64_t sequence)
+{
+    auto context = reinterpret_cast<TapContext *>(userData);
+
+    if (deviceId != context->deviceId)
+        return;
+
+    // Skip the frames before copying them.
+    if (context->received++ % context->every)
+        return;
+
+    context->tap->push(*frame, sequence);
+}
+
+int AkVCam::CmdParserPrivate::showControls(const StringMap &flags,
+                                           const StringVector &args)
+{
+    UNUSED(flags);
+
+    if (args.size() < 2) {
+        std::cerr << "Device not provided." << std::endl;
+
+        return -1;
+    }
+
+    auto deviceId = args[1];
+    auto devices = this->ipcBridge().devices();
+    auto dit = std::find(devices.begin(), devices.end(), deviceId);
+
+    if (dit == devices.end()) {
+        std::cerr << "'" << deviceId << "' doesn't exists." << std::endl;
+
+        return -1;
+    }
+
+    if (this->m_parseable) {
+        for (auto &control: this->ipcBridge().controls(deviceId))
+            std::cout << control.id << std::endl;
+    } else {
+        auto typeStr = typeStrMap();
+
+        std::vector<std::string> table {
+            "Control",
+            "Description",
+            "Type",
+            "Minimum",
+            "Maximum",
+            "Step",
+            "Default",
+            "Value"
+        };
+        auto columns = table.size();
+
+        for (auto &control: this->ipcBridge().controls(deviceId)) {
+            table.push_back(control.id);
+            table.push_back(control.description);
+            table.push_back(typeStr[control.type]);
+            table.push_back(std::to_string(control.minimum));
+            table.push_back(std::to_string(control.maximum));
+            table.push_back(std::to_string(control.step));
+            table.push_back(std::to_string(control.defaultValue));
+            table.push_back(std::to_string(control.value));
+        }
+
+        this->drawTable(table, columns);
+    }
+
+    return 0;
+}
+
+int AkVCam::CmdParserPrivate::readControl(const StringMap &flags,
+                                          const StringVector &args)
+{
+    UNUSED(flags);
+
+    if (args.size() < 3) {
+        std::cerr << "Not enough arguments." << std::endl;
+
+        return -1;
+    }
+
+    auto deviceId = args[1];
+    auto devices = this->ipcBridge().devices();
+    auto dit = std::find(devices.begin(), devices.end(), deviceId);
+
+    if (dit == devices.end()) {
+        std::cerr << "'" << deviceId << "' doesn't exists." << std::endl;
+
+        return -1;
+    }
+
+    for (auto &control: this->ipcBridge().controls(deviceId))
+        if (control.id == args[2]) {
+            if (flags.empty()) {
+                std::cout << control.value << std::endl;
+            } else {
+                if (this->containsFlag(flags, "get-control", "-c")) {
+                    auto typeStr = typeStrMap();
+                    std::cout << control.description << std::endl;
+                }
+                if (this->containsFlag(flags, "get-control", "-t")) {
+                    auto typeStr = typeStrMap();
+                    std::cout << typeStr[control.type] << std::endl;
+                }
+
+                if (this->containsFlag(flags, "get-control", "-m")) {
+                    std::cout << control.minimum << std::endl;
+                }
+
+                if (this->containsFlag(flags, "get-control", "-M")) {
+                    std::cout << control.maximum << std::endl;
+                }
+
+                if (this->containsFlag(flags, "get-control", "-s")) {
+                    std::cout << control.step << std::endl;
+                }
+
+                if (this->containsFlag(flags, "get-control", "-d")) {
+                    std::cout << control.defaultValue << std::endl;
+                }
+
+                if (this->containsFlag(flags, "get-control", "-l")) {
+                    for (size_t i = 0; i< control.menu.size(); i++)
+                        if (this->m_parseable)
+                            std::cout << control.menu[i] << std::endl;
+                        else
+                            std::cout << i << ": " << control.menu[i] << std::endl;
+                }
+            }
+
+            return 0;
+        }
+
+    std::cerr << "'" << args[2] << "' control not available." << std::endl;
+
+    return -1;
+}
+
+int AkVCam::CmdParserPrivate::writeControls(const StringMap &flags,
+                                            const StringVector &args)
+{
+    UNUSED(flags);
+
+    if (args.size() < 3) {
+        std::cerr << "Not enough arguments." << std::endl;
+
+        return -1;
+    }
+
+    auto deviceId = args[1];
+    auto devices = this->ipcBridge().devices();
+    auto dit = std::find(devices.begin(), devices.end(), deviceId);
+
+    if (dit == devices.end()) {
+        std::cerr << "'" << deviceId << "' doesn't exists." << std::endl;
+
+        return -1;
+    }
+
+    std::map<std::string, int> controls;
+
+    for (size_t i = 2; i < args.size(); i++) {
+        if (args[i].find('=') == std::string::npos) {
+            std::cerr << "Argumment "
+                      << i
+                      << " is not in the form KEY=VALUE."
+                      << std::endl;
+
+            return -1;
+        }
+
+        auto pair = splitOnce(args[i], "=");
+
+        if (pair.first.empty()) {
+            std::cerr << "Key for argumment "
+                      << i
+                      << " is emty."
+                      << std::endl;
+
+            return -1;
+        }
+
+        auto key = trimmed(pair.first);
+        auto value = trimmed(pair.second);
+        bool found = false;
+
+        for (auto &control: this->ipcBridge().controls(deviceId))
+                if (control.id == key) {
+                    switch (control.type) {
+                    case ControlTypeInteger: {
+                        char *p = nullptr;
+                        auto val = strtol(value.c_str(), &p, 10);
+
+                        if (*p) {
+                            std::cerr << "Value at argument "
+                                      << i
+                                      << " must be an integer."
+                                      << std::endl;
+
+                            return -1;
+                        }
+
+                        controls[key] = val;
+
+                        break;
+                    }
+
+                    case ControlTypeBoolean: {
+                        std::locale loc;
+                        std::transform(value.begin(),
+                                       value.end(),
+                                       value.begin(),
+                                       [&loc](char c) {
+                            return std::tolower(c, loc);
+                        });
+
+                        if (value == "0" || value == "false") {
+                            controls[key] = 0;
+                        } else if (value == "1" || value == "true") {
+                            controls[key] = 1;
+                        } else {
+                            std::cerr << "Value at argument "
+                                      << i
+                                      << " must be a boolean."
+                                      << std::endl;
+
+                            return -1;
+                        }
+
+                        break;
+                    }
+
+                    case ControlTypeMenu: {
+                        char *p = nullptr;
+                        auto val = strtoul(value.c_str(), &p, 10);
+
+                        if (*p) {
+                            auto it = std::find(control.menu.begin(),
+                                                control.menu.end(),
+                                                value);
+
+                            if (it == control.menu.end()) {
+                                std::cerr << "Value at argument "
+                                          << i
+                                          << " is not valid."
+                                          << std::endl;
+
+                                return -1;
+                            }
 
                             controls[key] = int(it - control.menu.begin());
                         } else {
@@ -1477,7 +2531,7 @@ int AkVCam::CmdParserPrivate::writeControls(const StringMap &flags,
         }
     }
 
-    this->m_ipcBridge.setControls(deviceId, controls);
+    this->ipcBridge().setControls(deviceId, controls);
 
     return 0;
 }
@@ -1488,7 +2542,7 @@ int AkVCam::CmdParserPrivate::picture(const AkVCam::StringMap &flags,
     UNUSED(flags);
     UNUSED(args);
 
-    std::cout << this->m_ipcBridge.picture() << std::endl;
+    std::cout << this->ipcBridge().picture() << std::endl;
 
     return 0;
 }
@@ -1504,7 +2558,7 @@ int AkVCam::CmdParserPrivate::setPicture(const AkVCam::StringMap &flags,
         return -1;
     }
 
-    this->m_ipcBridge.setPicture(args[1]);
+    this->ipcBridge().setPicture(args[1]);
 
     return 0;
 }
@@ -1512,10 +2566,33 @@ int AkVCam::CmdParserPrivate::setPicture(const AkVCam::StringMap &flags,
 int AkVCam::CmdParserPrivate::logLevel(const AkVCam::StringMap &flags,
                                        const AkVCam::StringVector &args)
 {
-    UNUSED(flags);
     UNUSED(args);
 
-    auto level = this->m_ipcBridge.logLevel();
+    if (this->containsFlag(flags, "loglevel", "-m")) {
+        auto levels = LogControl::global()->levels();
+
+        if (this->m_parseable) {
+            for (auto &level: levels)
+                std::cout << level.first << " " << level.second << std::endl;
+        } else {
+            std::vector<std::string> table {
+                "Module",
+                "Level"
+            };
+            auto columns = table.size();
+
+            for (auto &level: levels) {
+                table.push_back(level.first);
+                table.push_back(AkVCam::Logger::levelToString(level.second));
+            }
+
+            this->drawTable(table, columns);
+        }
+
+        return 0;
+    }
+
+    auto level = this->ipcBridge().logLevel();
 
     if (this->m_parseable)
         std::cout << level << std::endl;
@@ -1528,8 +2605,6 @@ int AkVCam::CmdParserPrivate::logLevel(const AkVCam::StringMap &flags,
 int AkVCam::CmdParserPrivate::setLogLevel(const AkVCam::StringMap &flags,
                                           const AkVCam::StringVector &args)
 {
-    UNUSED(flags);
-
     if (args.size() < 2) {
         std::cerr << "Not enough arguments." << std::endl;
 
@@ -1543,7 +2618,24 @@ int AkVCam::CmdParserPrivate::setLogLevel(const AkVCam::StringMap &flags,
     if (*p)
         level = AkVCam::Logger::levelFromString(levelStr);
 
-    this->m_ipcBridge.setLogLevel(level);
+    auto module = this->flagValue(flags, "set-loglevel", "-m");
+
+    if (!module.empty()) {
+        if (!LogControl::global()->setLevel(module, level)) {
+            std::cerr << "Can't set the level of " << module << "." << std::endl;
+
+            return -1;
+        }
+
+        if (!LogControl::global()->isShared())
+            std::cerr << "The module levels can't be shared, "
+                      << "they won't affect other processes."
+                      << std::endl;
+
+        return 0;
+    }
+
+    this->ipcBridge().setLogLevel(level);
 
     return 0;
 }
@@ -1553,7 +2645,7 @@ int AkVCam::CmdParserPrivate::showClients(const StringMap &flags,
 {
     UNUSED(flags);
     UNUSED(args);
-    auto clients = this->m_ipcBridge.clientsPids();
+    auto clients = this->ipcBridge().clientsPids();
 
     if (clients.empty())
         return 0;
@@ -1562,7 +2654,7 @@ int AkVCam::CmdParserPrivate::showClients(const StringMap &flags,
         for (auto &pid: clients)
             std::cout << pid
                       << " "
-                      << this->m_ipcBridge.clientExe(pid)
+                      << this->ipcBridge().clientExe(pid)
                       << std::endl;
     } else {
         std::vector<std::string> table {
@@ -1573,7 +2665,7 @@ int AkVCam::CmdParserPrivate::showClients(const StringMap &flags,
 
         for (auto &pid: clients) {
             table.push_back(std::to_string(pid));
-            table.push_back(this->m_ipcBridge.clientExe(pid));
+            table.push_back(this->ipcBridge().clientExe(pid));
         }
 
         this->drawTable(table, columns);
@@ -1582,12 +2674,83 @@ int AkVCam::CmdParserPrivate::showClients(const StringMap &flags,
     return 0;
 }
 
+// Counters of this process, for the commands that stream from it.
+void AkVCam::CmdParserPrivate::printStats()
+{
+    auto counters = Stats::counters();
+
+    if (this->m_parseable) {
+        for (auto &counter: counters)
+            std::cout << counter.first << " " << counter.second << std::endl;
+
+        return;
+    }
+
+    std::cout << std::endl;
+
+    std::vector<std::string> table {
+        "Counter",
+        "Value"
+    };
+    auto columns = table.size();
+
+    // The histograms of the locks are only shown in parseable mode.
+    std::vector<std::string> sites;
+    static const std::string acquiredSuffix = "_acquired";
+
+    for (auto &counter: counters) {
+        auto &name = counter.first;
+
+        if (name.compare(0, 5, "lock_") != 0) {
+            table.push_back(name);
+            table.push_back(std::to_string(counter.second));
+        } else if (name.size() > 5 + acquiredSuffix.size()
+                   && name.compare(name.size() - acquiredSuffix.size(),
+                                   acquiredSuffix.size(),
+                                   acquiredSuffix) == 0) {
+            sites.push_back(name.substr(5,
+                                        name.size()
+                                        - 5
+                                        - acquiredSuffix.size()));
+        }
+    }
+
+    this->drawTable(table, columns);
+
+    if (!sites.empty()) {
+        std::vector<std::string> locksTable {
+            "Lock",
+            "Acquired",
+            "Contended",
+            "Wait (ns)",
+            "Hold (ns)"
+        };
+        auto locksColumns = locksTable.size();
+
+        for (auto &site: sites) {
+            locksTable.push_back(site);
+
+            for (auto &suffix: {"_acquired", "_contended", "_wait_ns", "_hold_ns"})
+                locksTable.push_back(std::to_string(counters["lock_"
+                                                             + site
+                                                             + suffix]));
+        }
+
+        std::cout << std::endl;
+        this->drawTable(locksTable, locksColumns);
+    }
+
+    std::cout << std::endl
+              << "Memory:" << std::endl
+              << MemoryAccounting::toString();
+}
+
 void AkVCam::CmdParserPrivate::loadGenerals(Settings &settings)
 {
     settings.beginGroup("General");
 
     if (settings.contains("default_frame"))
-        this->m_ipcBridge.setPicture(settings.value("default_frame"));
+        this->ipcBridge().setPicture(settings.value("default_frame"));
 
     if (settings.contains("loglevel")) {
         auto logLevel= settings.value("loglevel");
@@ -1597,9 +2760,15 @@ void AkVCam::CmdParserPrivate::loadGenerals(Settings &settings)
         if (*p)
             level = AkVCam::Logger::levelFromString(logLevel);
 
-        this->m_ipcBridge.setLogLevel(level);
+        this->ipcBridge().setLogLevel(level);
     }
 
+    if (settings.contains("idle_timeout"))
+        this->ipcBridge().setIdleTimeout(settings.valueInt32("idle_timeout"));
+
+    if (settings.contains("memory_budget"))
+        this->ipcBridge().setMemoryBudget(settings.valueInt32("memory_budget"));
+
     settings.endGroup();
 }
 
@@ -1697,10 +2866,10 @@ void AkVCam::CmdParserPrivate::matrixCombineP(const StringMatrix &matrix,
 void AkVCam::CmdParserPrivate::createDevices(Settings &settings,
                                              const VideoFormatMatrix &availableFormats)
 {
-    auto devices = this->m_ipcBridge.devices();
+    auto devices = this->ipcBridge().devices();
 
     for (auto &device: devices)
-        this->m_ipcBridge.removeDevice(device);
+        this->ipcBridge().removeDevice(device);
 
     settings.beginGroup("Cameras");
     size_t nCameras = settings.beginArray("cameras");
@@ -1712,39 +2881,62 @@ void AkVCam::CmdParserPrivate::createDevices(Settings &settings,
 
     settings.endArray();
     settings.endGroup();
-    this->m_ipcBridge.updateDevices();
+    this->ipcBridge().updateDevices();
 }
 
 void AkVCam::CmdParserPrivate::createDevice(Settings &settings,
                                             const VideoFormatMatrix &availableFormats)
 {
-    auto description = settings.value("description");
+    CameraSettings camera;
+
+    if (!this->readCamera(settings, availableFormats, camera))
+        return;
+
+    auto deviceId = this->ipcBridge().addDevice(camera.description);
+
+    for (auto &format: this->filterSupportedFormats(camera.formats))
+        this->ipcBridge().addFormat(deviceId, format, -1);
+
+    auto controls = this->readDeviceControls(deviceId, camera.controls);
+
+    if (!controls.empty())
+        this->ipcBridge().setControls(deviceId, controls);
+}
+
+bool AkVCam::CmdParserPrivate::readCamera(Settings &settings,
+                                          const VideoFormatMatrix &availableFormats,
+                                          CameraSettings &camera)
+{
+    camera.description = settings.value("description");
 
-    if (description.empty()) {
+    if (camera.description.empty()) {
         std::cerr << "Device description is empty" << std::endl;
 
-        return;
+        return false;
     }
 
-    auto formats = this->readDeviceFormats(settings, availableFormats);
+    camera.formats = this->readDeviceFormats(settings, availableFormats);
 
-    if (formats.empty()) {
+    if (camera.formats.empty()) {
         std::cerr << "Can't read device formats" << std::endl;
 
-        return;
+        return false;
     }
 
-    auto deviceId = this->m_ipcBridge.addDevice(description);
-    auto supportedFormats = this->m_ipcBridge.supportedPixelFormats(IpcBridge::StreamTypeOutput);
+    // Optional initial controls values, in the form:
+    //
+    // controls = hflip=true, scaling=1
+    camera.controls.clear();
 
-    for (auto &format: formats) {
-        auto it = std::find(supportedFormats.begin(),
-                            supportedFormats.end(),
-                            format.fourcc());
+    for (auto &control: settings.valueList("controls", ",")) {
+        auto pair = splitOnce(control, "=");
+        auto key = trimmed(pair.first);
 
-        if (it != supportedFormats.end())
-            this->m_ipcBridge.addFormat(deviceId, format, -1);
+        if (!key.empty())
+            camera.controls[key] = trimmed(pair.second);
     }
+
+    return true;
 }
 
 std::vector<AkVCam::VideoFormat> AkVCam::CmdParserPrivate::readDeviceFormats(Settings &settings,
@@ -1772,6 +2964,257 @@ std::vector<AkVCam::VideoFormat> AkVCam::CmdParserPrivate::readDeviceFormats(Set
     return formats;
 }
 
+std::vector<AkVCam::VideoFormat> AkVCam::CmdParserPrivate::filterSupportedFormats(const std::vector<VideoFormat> &formats)
+{
+    auto supportedFormats = this->ipcBridge().supportedPixelFormats(IpcBridge::StreamTypeOutput);
+    std::vector<AkVCam::VideoFormat> filtered;
+
+    for (auto &format: formats) {
+        auto it = std::find(supportedFormats.begin(),
+                            supportedFormats.end(),
+                            format.fourcc());
+
+        if (it != supportedFormats.end())
+            filtered.push_back(format);
+    }
+
+    return filtered;
+}
+
+std::map<std::string, int> AkVCam::CmdParserPrivate::readDeviceControls(const std::string &deviceId,
+                                                                        const StringMap &values)
+{
+    std::map<std::string, int> controls;
+
+    if (values.empty())
+        return controls;
+
+    for (auto &control: this->ipcBridge().controls(deviceId)) {
+        auto it = values.find(control.id);
+
+        if (it == values.end())
+            continue;
+
+        auto value = it->second;
+        std::locale loc;
+        std::transform(value.begin(),
+                       value.end(),
+                       value.begin(),
+                       [&loc](char c) {
+            return std::tolower(c, loc);
+        });
+
+        if (control.type == ControlTypeBoolean
+            && (value == "true" || value == "false")) {
+            controls[control.id] = value == "true";
+
+            continue;
+        }
+
+        char *p = nullptr;
+        auto val = strtol(value.c_str(), &p, 10);
+
+        if (!*p) {
+            controls[control.id] = int(val);
+
+            continue;
+        }
+
+        auto mit = std::find(control.menu.begin(),
+                             control.menu.end(),
+                             it->second);
+
+        if (control.type == ControlTypeMenu && mit != control.menu.end())
+            controls[control.id] = int(mit - control.menu.begin());
+        else
+            std::cerr << "Invalid value for '" << control.id << "'." << std::endl;
+    }
+
+    return controls;
+}
+
+/* Applies the settings file to the current devices, touching only what
+ * changed. The n-th camera in the file is the n-th device. Description,
+ * formats and devices count changes need the devices to be updated, while
+ * controls, picture, log level and idle timeout are applied live.
+ */
+bool AkVCam::CmdParserPrivate::applySettings(const std::string &fileName)
+{
+    Settings settings;
+
+    if (!settings.load(fileName)) {
+        std::cerr << "Settings file not valid." << std::endl;
+
+        return false;
+    }
+
+    // Read all the cameras first, so a file saved half way is ignored
+    // instead of being partially applied.
+    auto availableFormats = this->readFormats(settings);
+    std::vector<CameraSettings> cameras;
+    settings.beginGroup("Cameras");
+    size_t nCameras = settings.beginArray("cameras");
+
+    for (size_t i = 0; i < nCameras; i++) {
+        settings.setArrayIndex(i);
+        CameraSettings camera;
+
+        if (!this->readCamera(settings, availableFormats, camera)) {
+            std::cerr << "Ignoring the settings file until camera "
+                      << i + 1
+                      << " is fixed."
+                      << std::endl;
+            settings.endArray();
+            settings.endGroup();
+
+            return false;
+        }
+
+        cameras.push_back(camera);
+    }
+
+    settings.endArray();
+    settings.endGroup();
+
+    settings.beginGroup("General");
+
+    if (settings.contains("default_frame")) {
+        auto picture = settings.value("default_frame");
+
+        if (picture != this->ipcBridge().picture()) {
+            this->ipcBridge().setPicture(picture);
+            std::cout << "Picture: " << picture << std::endl;
+        }
+    }
+
+    if (settings.contains("loglevel")) {
+        auto logLevel = settings.value("loglevel");
+        char *p = nullptr;
+        auto level = strtol(logLevel.c_str(), &p, 10);
+
+        if (*p)
+            level = AkVCam::Logger::levelFromString(logLevel);
+
+        if (level != this->ipcBridge().logLevel()) {
+            this->ipcBridge().setLogLevel(level);
+            std::cout << "Log level: "
+                      << AkVCam::Logger::levelToString(level)
+                      << std::endl;
+        }
+    }
+
+    if (settings.contains("idle_timeout")) {
+        auto timeout = settings.valueInt32("idle_timeout");
+
+        if (timeout != this->ipcBridge().idleTimeout()) {
+            this->ipcBridge().setIdleTimeout(timeout);
+            std::cout << "Idle timeout: " << timeout << std::endl;
+        }
+    }
+
+    if (settings.contains("memory_budget")) {
+        auto budget = settings.valueInt32("memory_budget");
+
+        if (budget != this->ipcBridge().memoryBudget()) {
+            this->ipcBridge().setMemoryBudget(budget);
+            std::cout << "Memory budget: " << budget << " MiB" << std::endl;
+        }
+    }
+
+    settings.endGroup();
+
+    auto devices = this->ipcBridge().devices();
+    bool updateDevices = false;
+
+    for (size_t i = 0; i < cameras.size(); i++) {
+        auto &camera = cameras[i];
+        auto formats = this->filterSupportedFormats(camera.formats);
+        std::string deviceId;
+
+        if (i < devices.size()) {
+            deviceId = devices[i];
+
+            if (camera.description != this->ipcBridge().description(deviceId)) {
+                this->ipcBridge().setDescription(deviceId, camera.description);
+                std::cout << deviceId
+                          << ": description changed"
+                          << std::endl;
+                updateDevices = true;
+            }
+
+            if (formats != this->ipcBridge().formats(deviceId)) {
+                this->ipcBridge().setFormats(deviceId, formats);
+                std::cout << deviceId << ": formats changed" << std::endl;
+                updateDevices = true;
+            }
+        } else {
+            deviceId = this->ipcBridge().addDevice(camera.description);
+            this->ipcBridge().setFormats(deviceId, formats);
+            std::cout << deviceId << ": added" << std::endl;
+            updateDevices = true;
+        }
+
+        std::map<std::string, int> changedControls;
+        auto current = this->ipcBridge().controls(deviceId);
+
+        for (auto &control: this->readDeviceControls(deviceId,
+                                                     camera.controls)) {
+            auto it = std::find_if(current.begin(),
+                                   current.end(),
+                                   [&control] (const DeviceControl &c) {
+                return c.id == control.first;
+            });
+
+            if (it != current.end() && it->value != control.second)
+                changedControls[control.first] = control.second;
+        }
+
+        if (!changedControls.empty()) {
+            this->ipcBridge().setControls(deviceId, changedControls);
+
+            for (auto &control: changedControls)
+                std::cout << deviceId
+                          << ": "
+                          << control.first
+                          << " = "
+                          << control.second
+                          << std::endl;
+        }
+    }
+
+    for (size_t i = cameras.size(); i < devices.size(); i++) {
+        this->ipcBridge().removeDevice(devices[i]);
+        std::cout << devices[i] << ": removed" << std::endl;
+        updateDevices = true;
+    }
+
+    if (updateDevices)
+        this->ipcBridge().updateDevices();
+
+    return true;
+}
+
+bool AkVCam::CmdParserPrivate::readSize(const std::string &str,
+                                        int *width,
+                                        int *height)
+{
+    auto size = split(str, 'x');
+
+    if (size.size() != 2)
+        return false;
+
+    char *p = nullptr;
+    *width = int(strtol(size[0].c_str(), &p, 10));
+
+    if (*p || *width < 1)
+        return false;
+
+    p = nullptr;
+    *height = int(strtol(size[1].c_str(), &p, 10));
+
+    return !*p && *height > 0;
+}
+
 std::string AkVCam::operator *(const std::string &str, size_t n)
 {
     std::stringstream ss;
@@ -0,0 +1,507 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "frameio.h"
+#include "VCamUtils/src/image/videoformat.h"
+#include "VCamUtils/src/image/videoframe.h"
+#include "VCamUtils/src/logger.h"
+#include "VCamUtils/src/recording.h"
+#include "VCamUtils/src/utils.h"
+
+namespace AkVCam
+{
+    enum FrameFileType
+    {
+        FrameFileTypeRaw,
+        FrameFileTypeBmp,
+        FrameFileTypeY4M,
+        FrameFileTypeRecording
+    };
+
+    class FrameFileReaderPrivate
+    {
+        public:
+            FrameFileType m_type {FrameFileTypeRaw};
+            std::ifstream m_file;
+            RecordingReader m_recording;
+            VideoFrame m_picture;
+            VideoFormat m_format;
+            Fraction m_fps {30, 1};
+            size_t m_frame {0};
+            bool m_y4mPlanar {false};
+            std::vector<uint8_t> m_chroma;
+
+            bool readY4MHeader();
+            bool readY4MPlanarFrame(VideoFrame &frame);
+    };
+
+    class FrameFileWriterPrivate
+    {
+        public:
+            FrameFileType m_type {FrameFileTypeRaw};
+            std::string m_fileName;
+            std::ofstream m_file;
+            RecordingWriter m_recording;
+            VideoFormat m_format;
+            Fraction m_fps;
+            size_t m_frames {0};
+    };
+
+    static FrameFileType frameFileType(const std::string &fileName)
+    {
+        auto dot = fileName.rfind('.');
+
+        if (dot == std::string::npos)
+            return FrameFileTypeRaw;
+
+        auto extension = fileName.substr(dot + 1);
+        std::transform(extension.begin(),
+                       extension.end(),
+                       extension.begin(),
+                       ::tolower);
+
+        if (extension == "bmp")
+            return FrameFileTypeBmp;
+
+        if (extension == "y4m")
+            return FrameFileTypeY4M;
+
+        if (extension == "akvrec")
+            return FrameFileTypeRecording;
+
+        return FrameFileTypeRaw;
+    }
+}
+
+AkVCam::FrameFileReader::FrameFileReader()
+{
+    this->d = new FrameFileReaderPrivate;
+}
+
+AkVCam::FrameFileReader::~FrameFileReader()
+{
+    delete this->d;
+}
+
+bool AkVCam::FrameFileReader::open(const std::string &fileName,
+                                   const VideoFormat &rawFormat)
+{
+    this->close();
+    this->d->m_type = frameFileType(fileName);
+    this->d->m_frame = 0;
+    this->d->m_fps = {30, 1};
+    this->d->m_y4mPlanar = false;
+
+    switch (this->d->m_type) {
+    case FrameFileTypeBmp:
+        return this->d->m_picture.load(fileName);
+
+    case FrameFileTypeRecording:
+        return this->d->m_recording.open(fileName);
+
+    case FrameFileTypeY4M:
+        this->d->m_file.open(fileName, std::ios::binary);
+
+        if (!this->d->m_file.is_open())
+            return false;
+
+        if (!this->d->readY4MHeader()) {
+            this->close();
+
+            return false;
+        }
+
+        return true;
+
+    default:
+        if (rawFormat.size() < 1) {
+            AkLogError() << "The format of raw files must be known"
+                         << std::endl;
+
+            return false;
+        }
+
+        this->d->m_format = rawFormat;
+        this->d->m_file.open(fileName, std::ios::binary);
+
+        return this->d->m_file.is_open();
+    }
+}
+
+void AkVCam::FrameFileReader::close()
+{
+    if (this->d->m_file.is_open())
+        this->d->m_file.close();
+
+    this->d->m_recording.close();
+    this->d->m_picture.clear();
+    this->d->m_format.clear();
+}
+
+AkVCam::Fraction AkVCam::FrameFileReader::fps() const
+{
+    return this->d->m_fps;
+}
+
+bool AkVCam::FrameFileReader::read(VideoFrame &frame)
+{
+    switch (this->d->m_type) {
+    case FrameFileTypeBmp:
+        if (this->d->m_frame > 0 || this->d->m_picture.format().size() < 1)
+            return false;
+
+        frame = this->d->m_picture;
+        this->d->m_frame++;
+
+        return true;
+
+    case FrameFileTypeRecording:
+        if (this->d->m_frame >= this->d->m_recording.frames())
+            return false;
+
+        frame = this->d->m_recording.frame(this->d->m_frame++);
+
+        return true;
+
+    case FrameFileTypeY4M: {
+        std::string line;
+
+        if (!std::getline(this->d->m_file, line)
+            || line.compare(0, 5, "FRAME") != 0)
+            return false;
+
+        if (this->d->m_y4mPlanar) {
+            if (!this->d->readY4MPlanarFrame(frame))
+                return false;
+
+            this->d->m_frame++;
+
+            return true;
+        }
+
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    if (!this->d->m_file.is_open())
+        return false;
+
+    if (frame.format() != this->d->m_format)
+        frame = VideoFrame(this->d->m_format);
+
+    this->d->m_file.read(reinterpret_cast<char *>(frame.data().data()),
+                         std::streamsize(frame.data().size()));
+
+    if (size_t(this->d->m_file.gcount()) != frame.data().size())
+        return false;
+
+    this->d->m_frame++;
+
+    return true;
+}
+
+bool AkVCam::FrameFileReaderPrivate::readY4MHeader()
+{
+    std::string header;
+
+    if (!std::getline(this->m_file, header)
+        || header.compare(0, 9, "YUV4MPEG2") != 0)
+        return false;
+
+    int width = 0;
+    int height = 0;
+    FourCC fourcc = 0;
+    std::string colorSpace;
+    std::stringstream ss(header);
+    std::string token;
+
+    while (ss >> token) {
+        switch (token[0]) {
+        case 'W':
+            width = atoi(token.c_str() + 1);
+
+            break;
+
+        case 'H':
+            height = atoi(token.c_str() + 1);
+
+            break;
+
+        case 'F': {
+            auto fps = split(token.substr(1), ':');
+
+            if (fps.size() == 2 && atoi(fps[1].c_str()) > 0)
+                this->m_fps = {atoi(fps[0].c_str()), atoi(fps[1].c_str())};
+
+            break;
+        }
+
+        case 'C':
+            colorSpace = token.substr(1);
+
+            break;
+
+        case 'X':
+            if (token.compare(0, 15, "XAKVCAM_FORMAT=") == 0)
+                fourcc = VideoFormat::fourccFromString(token.substr(15));
+
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    /* The 8 bits 4:2:0 variants only differ in the chroma siting, the
+     * deeper ones like 420p10 are not supported.
+     */
+    static const std::vector<std::string> y4m420 {
+        "",
+        "420",
+        "420jpeg",
+        "420mpeg2",
+        "420paldv",
+    };
+
+    if (!fourcc
+        && std::find(y4m420.begin(), y4m420.end(), colorSpace) != y4m420.end()) {
+        fourcc = PixelFormatNV12;
+        this->m_y4mPlanar = true;
+    }
+
+    if (!fourcc) {
+        AkLogError() << "Unsupported Y4M colorspace: "
+                     << colorSpace
+                     << std::endl;
+
+        return false;
+    }
+
+    this->m_format = VideoFormat(fourcc, width, height, {this->m_fps});
+
+    return this->m_format.size() > 0;
+}
+
+bool AkVCam::FrameFileReaderPrivate::readY4MPlanarFrame(VideoFrame &frame)
+{
+    if (frame.format() != this->m_format)
+        frame = VideoFrame(this->m_format);
+
+    auto width = size_t(this->m_format.width());
+    auto height = size_t(this->m_format.height());
+
+    for (size_t y = 0; y < height; y++) {
+        this->m_file.read(reinterpret_cast<char *>(frame.line(0, y)),
+                          std::streamsize(width));
+
+        if (size_t(this->m_file.gcount()) != width)
+            return false;
+    }
+
+    // The U plane followed by the V plane, NV12 interleaves them.
+    auto chromaWidth = (width + 1) / 2;
+    auto chromaHeight = (height + 1) / 2;
+    auto chromaSize = chromaWidth * chromaHeight;
+    this->m_chroma.resize(2 * chromaSize);
+    this->m_file.read(reinterpret_cast<char *>(this->m_chroma.data()),
+                      std::streamsize(this->m_chroma.size()));
+
+    if (size_t(this->m_file.gcount()) != this->m_chroma.size())
+        return false;
+
+    auto lines = (std::min)(chromaHeight, height / 2);
+    auto pixels = (std::min)(chromaWidth, this->m_format.bypl(1) / 2);
+
+    for (size_t y = 0; y < lines; y++) {
+        auto u = this->m_chroma.data() + y * chromaWidth;
+        auto v = u + chromaSize;
+        auto uv = frame.line(1, y);
+
+        for (size_t x = 0; x < pixels; x++) {
+            uv[2 * x] = u[x];
+            uv[2 * x + 1] = v[x];
+        }
+    }
+
+    return true;
+}
+
+AkVCam::FrameFileWriter::FrameFileWriter()
+{
+    this->d = new FrameFileWriterPrivate;
+}
+
+AkVCam::FrameFileWriter::~FrameFileWriter()
+{
+    this->close();
+    delete this->d;
+}
+
+bool AkVCam::FrameFileWriter::open(const std::string &fileName,
+                                   const Fraction &fps)
+{
+    this->close();
+    this->d->m_type = frameFileType(fileName);
+    this->d->m_fileName = fileName;
+    this->d->m_format.clear();
+    this->d->m_fps = fps;
+    this->d->m_frames = 0;
+
+    switch (this->d->m_type) {
+    case FrameFileTypeBmp:
+        return true;
+
+    case FrameFileTypeRecording:
+        return this->d->m_recording.open(fileName);
+
+    default:
+        this->d->m_file.open(fileName, std::ios::binary | std::ios::trunc);
+
+        return this->d->m_file.is_open();
+    }
+}
+
+void AkVCam::FrameFileWriter::close()
+{
+    if (this->d->m_file.is_open())
+        this->d->m_file.close();
+
+    this->d->m_recording.close();
+}
+
+bool AkVCam::FrameFileWriter::write(const VideoFrame &frame)
+{
+    auto format = frame.format();
+
+    switch (this->d->m_type) {
+    case FrameFileTypeBmp:
+        if (this->d->m_frames++ > 0) {
+            if (this->d->m_frames == 2)
+                AkLogWarning() << "BMP files hold a single frame, "
+                               << "the other frames are discarded"
+                               << std::endl;
+
+            return true;
+        }
+
+        return frame.save(this->d->m_fileName);
+
+    case FrameFileTypeRecording:
+        return this->d->m_recording.write(frame, this->d->m_frames++);
+
+    case FrameFileTypeY4M:
+        if (this->d->m_format.size() < 1) {
+            this->d->m_format = format;
+            writeY4MHeader(this->d->m_file, format, this->d->m_fps);
+        } else if (format.fourcc() != this->d->m_format.fourcc()
+                   || format.width() != this->d->m_format.width()
+                   || format.height() != this->d->m_format.height()) {
+            return false;
+        }
+
+        writeY4MFrame(this->d->m_file, frame);
+        this->d->m_frames++;
+
+        return bool(this->d->m_file);
+
+    default:
+        break;
+    }
+
+    this->d->m_file.write(reinterpret_cast<const char *>(frame.data().data()),
+                          std::streamsize(frame.data().size()));
+    this->d->m_frames++;
+
+    return bool(this->d->m_file);
+}
+
+void AkVCam::FrameFileWriter::writeY4MHeader(std::ostream &stream,
+                                             const VideoFormat &format,
+                                             const Fraction &fps)
+{
+    stream << "YUV4MPEG2"
+           << " W" << format.width()
+           << " H" << format.height()
+           << " F" << fps.num()
+           << ":" << fps.den()
+           << " Ip A1:1";
+
+    // NV12 is stored as standard planar 4:2:0, readable by other tools.
+    if (format.fourcc() == PixelFormatNV12)
+        stream << " C420";
+    else
+        stream << " XAKVCAM_FORMAT="
+               << VideoFormat::stringFromFourcc(format.fourcc());
+
+    stream << '\n';
+}
+
+size_t AkVCam::FrameFileWriter::writeY4MFrame(std::ostream &stream,
+                                              const VideoFrame &frame)
+{
+    auto format = frame.format();
+    stream << "FRAME\n";
+
+    if (format.fourcc() != PixelFormatNV12) {
+        stream.write(reinterpret_cast<const char *>(frame.data().data()),
+                     std::streamsize(frame.data().size()));
+
+        return frame.data().size();
+    }
+
+    auto width = size_t(format.width());
+    auto height = size_t(format.height());
+
+    for (size_t y = 0; y < height; y++)
+        stream.write(reinterpret_cast<const char *>(frame.line(0, y)),
+                     std::streamsize(width));
+
+    // Split the interleaved UV plane in the U and V planes.
+    auto chromaWidth = (width + 1) / 2;
+    auto chromaHeight = (height + 1) / 2;
+    auto chromaSize = chromaWidth * chromaHeight;
+    auto lines = (std::min)(chromaHeight, height / 2);
+    auto pixels = (std::min)(chromaWidth, format.bypl(1) / 2);
+    std::vector<uint8_t> chroma(2 * chromaSize, 128);
+
+    for (size_t y = 0; y < lines; y++) {
+        auto uv = frame.line(1, y);
+        auto u = chroma.data() + y * chromaWidth;
+        auto v = u + chromaSize;
+
+        for (size_t x = 0; x < pixels; x++) {
+            u[x] = uv[2 * x];
+            v[x] = uv[2 * x + 1];
+        }
+    }
+
+    stream.write(reinterpret_cast<const char *>(chroma.data()),
+                 std::streamsize(chroma.size()));
+
+    return width * height + chroma.size();
+}
@@ -0,0 +1,87 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef FRAMEIO_H
+#define FRAMEIO_H
+
+#include <ostream>
+#include <string>
+
+#include "VCamUtils/src/fraction.h"
+
+namespace AkVCam
+{
+    class FrameFileReaderPrivate;
+    class FrameFileWriterPrivate;
+    class VideoFormat;
+    class VideoFrame;
+
+    /* Reads and writes frames from BMP, Y4M, recordings (.akvrec) and raw
+     * files, the type is taken from the file extension. Standard 4:2:0
+     * Y4M files (C420, C420jpeg, C420mpeg2, C420paldv) are read as NV12,
+     * and NV12 frames are written as C420. Other formats are written with
+     * the pixel format in the XAKVCAM_FORMAT parameter. Raw files are the
+     * frames data one after the other, so the format must be given when
+     * reading them. BMP files hold a single frame.
+     */
+    class FrameFileReader
+    {
+        public:
+            FrameFileReader();
+            FrameFileReader(const FrameFileReader &other) = delete;
+            ~FrameFileReader();
+
+            bool open(const std::string &fileName,
+                      const VideoFormat &rawFormat);
+            void close();
+            Fraction fps() const;
+
+            // Returns false at the end of the file.
+            bool read(VideoFrame &frame);
+
+        private:
+            FrameFileReaderPrivate *d;
+    };
+
+    class FrameFileWriter
+    {
+        public:
+            FrameFileWriter();
+            FrameFileWriter(const FrameFileWriter &other) = delete;
+            ~FrameFileWriter();
+
+            bool open(const std::string &fileName, const Fraction &fps);
+            void close();
+            bool write(const VideoFrame &frame);
+
+            // Also used by the tap command to write its Y4M files.
+            static void writeY4MHeader(std::ostream &stream,
+                                       const VideoFormat &format,
+                                       const Fraction &fps);
+
+            // Returns the number of bytes written.
+            static size_t writeY4MFrame(std::ostream &stream,
+                                        const VideoFrame &frame);
+
+        private:
+            FrameFileWriterPrivate *d;
+    };
+}
+
+#endif // FRAMEIO_H
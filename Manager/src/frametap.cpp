@@ -0,0 +1,276 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "frametap.h"
+#include "frameio.h"
+#include "VCamUtils/src/image/videoformat.h"
+#include "VCamUtils/src/image/videoframe.h"
+#include "VCamUtils/src/logger.h"
+#include "VCamUtils/src/stats.h"
+
+namespace AkVCam
+{
+    struct TapFrame
+    {
+        VideoFrame frame;
+        uint64_t sequence;
+        int64_t timestamp;
+    };
+
+    class FrameTapPrivate
+    {
+        public:
+            std::ofstream m_file;
+            std::ofstream m_index;
+            FrameTap::Format m_format {FrameTap::FormatY4M};
+            Fraction m_fps;
+            VideoFormat m_headerFormat;
+            size_t m_memoryBudget {0};
+            size_t m_queuedBytes {0};
+            uint64_t m_offset {0};
+            std::vector<TapFrame> m_queue;
+            std::chrono::steady_clock::time_point m_startTime;
+            bool m_started {false};
+            bool m_run {false};
+            std::atomic<uint64_t> m_framesWritten {0};
+            std::atomic<uint64_t> m_framesDropped {0};
+            std::atomic<uint64_t> m_bytesWritten {0};
+            std::thread m_thread;
+            std::mutex m_mutex;
+            std::condition_variable m_queueChanged;
+
+            void writeLoop();
+            void writeFrame(const TapFrame &frame);
+            void drop();
+    };
+}
+
+AkVCam::FrameTap::FrameTap()
+{
+    this->d = new FrameTapPrivate;
+}
+
+AkVCam::FrameTap::~FrameTap()
+{
+    this->close();
+    delete this->d;
+}
+
+bool AkVCam::FrameTap::open(const std::string &fileName,
+                            Format format,
+                            const Fraction &fps,
+                            size_t memoryBudget)
+{
+    AkLogFunction();
+    this->close();
+    this->d->m_file.open(fileName, std::ios::binary | std::ios::trunc);
+
+    if (!this->d->m_file.is_open()) {
+        AkLogError() << "Can't open " << fileName << std::endl;
+
+        return false;
+    }
+
+    if (format == FormatRaw) {
+        this->d->m_index.open(fileName + ".idx", std::ios::trunc);
+
+        if (!this->d->m_index.is_open()) {
+            AkLogError() << "Can't open " << fileName << ".idx" << std::endl;
+            this->d->m_file.close();
+
+            return false;
+        }
+    }
+
+    this->d->m_format = format;
+    this->d->m_fps = fps;
+    this->d->m_headerFormat = {};
+    this->d->m_memoryBudget = memoryBudget;
+    this->d->m_queuedBytes = 0;
+    this->d->m_offset = 0;
+    this->d->m_started = false;
+    this->d->m_framesWritten = 0;
+    this->d->m_framesDropped = 0;
+    this->d->m_bytesWritten = 0;
+    this->d->m_run = true;
+    this->d->m_thread = std::thread(&FrameTapPrivate::writeLoop, this->d);
+
+    return true;
+}
+
+void AkVCam::FrameTap::close()
+{
+    AkLogFunction();
+    this->d->m_mutex.lock();
+    this->d->m_run = false;
+    this->d->m_mutex.unlock();
+    this->d->m_queueChanged.notify_all();
+
+    // The writer thread flushes the queued frames before leaving.
+    if (this->d->m_thread.joinable())
+        this->d->m_thread.join();
+
+    if (this->d->m_file.is_open())
+        this->d->m_file.close();
+
+    if (this->d->m_index.is_open())
+        this->d->m_index.close();
+}
+
+bool AkVCam::FrameTap::push(const VideoFrame &frame, uint64_t sequence)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+
+    if (!this->d->m_run)
+        return false;
+
+    auto size = frame.data().size();
+
+    if (this->d->m_queuedBytes + size > this->d->m_memoryBudget) {
+        lock.unlock();
+        this->d->drop();
+
+        return false;
+    }
+
+    if (!this->d->m_started) {
+        this->d->m_startTime = now;
+        this->d->m_started = true;
+    }
+
+    auto timestamp =
+            std::chrono::duration_cast<std::chrono::microseconds>(now - this->d->m_startTime);
+    this->d->m_queue.push_back({frame, sequence, timestamp.count()});
+    this->d->m_queuedBytes += size;
+    lock.unlock();
+    this->d->m_queueChanged.notify_one();
+
+    return true;
+}
+
+uint64_t AkVCam::FrameTap::framesWritten() const
+{
+    return this->d->m_framesWritten;
+}
+
+uint64_t AkVCam::FrameTap::framesDropped() const
+{
+    return this->d->m_framesDropped;
+}
+
+uint64_t AkVCam::FrameTap::bytesWritten() const
+{
+    return this->d->m_bytesWritten;
+}
+
+void AkVCam::FrameTapPrivate::writeLoop()
+{
+    AkLogFunction();
+    std::vector<TapFrame> batch;
+
+    for (;;) {
+        std::unique_lock<std::mutex> lock(this->m_mutex);
+        this->m_queueChanged.wait(lock, [this] () {
+            return !this->m_run || !this->m_queue.empty();
+        });
+
+        if (this->m_queue.empty())
+            break;
+
+        std::swap(batch, this->m_queue);
+        lock.unlock();
+        size_t batchBytes = 0;
+
+        for (auto &frame: batch) {
+            this->writeFrame(frame);
+            batchBytes += frame.frame.data().size();
+        }
+
+        this->m_file.flush();
+
+        if (this->m_index.is_open())
+            this->m_index.flush();
+
+        batch.clear();
+
+        // The frames count for the budget until they are on disk.
+        lock.lock();
+        this->m_queuedBytes -= batchBytes;
+    }
+}
+
+void AkVCam::FrameTapPrivate::writeFrame(const TapFrame &frame)
+{
+    auto format = frame.frame.format();
+    auto &data = frame.frame.data();
+    size_t written = data.size();
+
+    if (this->m_format == FrameTap::FormatY4M) {
+        if (this->m_headerFormat.size() < 1) {
+            this->m_headerFormat = format;
+            FrameFileWriter::writeY4MHeader(this->m_file, format, this->m_fps);
+        } else if (format.fourcc() != this->m_headerFormat.fourcc()
+                   || format.width() != this->m_headerFormat.width()
+                   || format.height() != this->m_headerFormat.height()) {
+            // A Y4M stream can't change its format.
+            this->drop();
+
+            return;
+        }
+
+        written = FrameFileWriter::writeY4MFrame(this->m_file, frame.frame);
+    } else {
+        this->m_index << this->m_offset
+                      << ' ' << data.size()
+                      << ' ' << VideoFormat::stringFromFourcc(format.fourcc())
+                      << ' ' << format.width()
+                      << ' ' << format.height()
+                      << ' ' << frame.sequence
+                      << ' ' << frame.timestamp
+                      << '\n';
+        this->m_offset += data.size();
+        this->m_file.write(reinterpret_cast<const char *>(data.data()),
+                           std::streamsize(data.size()));
+    }
+
+    if (!this->m_file) {
+        this->drop();
+
+        return;
+    }
+
+    this->m_framesWritten++;
+    this->m_bytesWritten += written;
+}
+
+void AkVCam::FrameTapPrivate::drop()
+{
+    static auto &tapDropped = Stats::counter("tap_dropped");
+    this->m_framesDropped++;
+    tapDropped++;
+}
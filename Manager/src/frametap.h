@@ -0,0 +1,75 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef FRAMETAP_H
+#define FRAMETAP_H
+
+#include <cstdint>
+#include <string>
+
+#include "VCamUtils/src/fraction.h"
+
+namespace AkVCam
+{
+    class FrameTapPrivate;
+    class VideoFrame;
+
+    /* Writes frames to disk from a background thread.
+     *
+     * push() only queues the frame, the writer thread takes all the queued
+     * frames at once and writes them as a single batch. The queued frames
+     * never take more than the memory budget, frames that doesn't fit are
+     * dropped and counted.
+     *
+     * Y4M files are written as C420 for NV12 streams, other streams keep
+     * their pixel format, stored in the XAKVCAM_FORMAT parameter of the
+     * header. Raw files are the frames
+     * data one after the other, and a FILE.idx text file with a line per
+     * frame: offset, size, format, width, height, sequence and the
+     * microseconds since the first frame.
+     */
+    class FrameTap
+    {
+        public:
+            enum Format
+            {
+                FormatY4M,
+                FormatRaw
+            };
+
+            FrameTap();
+            FrameTap(const FrameTap &other) = delete;
+            ~FrameTap();
+
+            bool open(const std::string &fileName,
+                      Format format,
+                      const Fraction &fps,
+                      size_t memoryBudget);
+            void close();
+            bool push(const VideoFrame &frame, uint64_t sequence);
+            uint64_t framesWritten() const;
+            uint64_t framesDropped() const;
+            uint64_t bytesWritten() const;
+
+        private:
+            FrameTapPrivate *d;
+    };
+}
+
+#endif // FRAMETAP_H
@@ -0,0 +1,317 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <ctime>
+#endif
+
+#include "loadgen.h"
+#include "VCamUtils/src/ipcbridge.h"
+#include "VCamUtils/src/image/videoformat.h"
+#include "VCamUtils/src/image/videoframe.h"
+#include "VCamUtils/src/logger.h"
+#include "VCamUtils/src/memoryaccounting.h"
+
+#define LOADGEN_PATTERN_FRAMES 8
+
+namespace AkVCam
+{
+    using LoadClock = std::chrono::steady_clock;
+
+    struct LoadDevice
+    {
+        std::string deviceId;
+        std::thread thread;
+        LoadClock::time_point startTime;
+        uint64_t frames {0};
+        uint64_t dropped {0};
+        uint64_t late {0};
+        uint64_t idle {0};
+        bool started {false};
+        std::vector<uint32_t> latencies;
+        double cpuTime {0};
+        double elapsed {0};
+        std::mutex mutex;
+    };
+
+    using LoadDevicePtr = std::shared_ptr<LoadDevice>;
+
+    class LoadGeneratorPrivate
+    {
+        public:
+            IpcBridge *m_bridge;
+            std::vector<LoadDevicePtr> m_devices;
+            std::vector<VideoFrame> m_patterns;
+            std::chrono::nanoseconds m_period {0};
+            std::atomic<bool> m_run {false};
+
+            explicit LoadGeneratorPrivate(IpcBridge *bridge);
+            bool createPatterns(const VideoFormat &format);
+            void sendFrames(LoadDevice *device);
+            static double threadCpuTime();
+    };
+}
+
+AkVCam::LoadGenerator::LoadGenerator(IpcBridge *bridge)
+{
+    this->d = new LoadGeneratorPrivate(bridge);
+}
+
+AkVCam::LoadGenerator::~LoadGenerator()
+{
+    this->stop();
+    delete this->d;
+}
+
+bool AkVCam::LoadGenerator::start(const std::vector<std::string> &devices,
+                                  const VideoFormat &format)
+{
+    AkLogFunction();
+    this->stop();
+    this->d->m_devices.clear();
+    auto fps = format.minimumFrameRate();
+
+    if (fps.num() < 1 || fps.den() < 1)
+        return false;
+
+    this->d->m_period =
+            std::chrono::nanoseconds(1000000000LL * fps.den() / fps.num());
+
+    if (!this->d->createPatterns(format))
+        return false;
+
+    for (auto &deviceId: devices) {
+        auto device = std::make_shared<LoadDevice>();
+        device->deviceId = deviceId;
+        this->d->m_devices.push_back(device);
+
+        if (!this->d->m_bridge->deviceStart(deviceId, format)) {
+            AkLogError() << "Can't start " << deviceId << std::endl;
+            this->stop();
+
+            return false;
+        }
+
+        device->started = true;
+    }
+
+    this->d->m_run = true;
+
+    for (auto &device: this->d->m_devices)
+        device->thread = std::thread(&LoadGeneratorPrivate::sendFrames,
+                                     this->d,
+                                     device.get());
+
+    return true;
+}
+
+void AkVCam::LoadGenerator::stop()
+{
+    AkLogFunction();
+    this->d->m_run = false;
+
+    for (auto &device: this->d->m_devices) {
+        if (device->thread.joinable())
+            device->thread.join();
+
+        if (device->started) {
+            this->d->m_bridge->deviceStop(device->deviceId);
+            device->started = false;
+        }
+    }
+
+    this->d->m_patterns.clear();
+}
+
+std::vector<AkVCam::LoadStats> AkVCam::LoadGenerator::stats() const
+{
+    std::vector<LoadStats> stats;
+
+    for (auto &device: this->d->m_devices) {
+        std::unique_lock<std::mutex> lock(device->mutex);
+        LoadStats deviceStats {device->deviceId,
+                               device->frames,
+                               device->dropped,
+                               device->late,
+                               device->idle,
+                               0,
+                               0,
+                               0,
+                               device->cpuTime,
+                               device->elapsed,
+                               0};
+        auto latencies = device->latencies;
+        lock.unlock();
+        deviceStats.memoryPeak =
+                MemoryAccounting::deviceUsage(deviceStats.deviceId).peak;
+
+        if (!latencies.empty()) {
+            uint64_t total = 0;
+
+            for (auto &latency: latencies)
+                total += latency;
+
+            deviceStats.latencyAverage = total / latencies.size();
+            deviceStats.latencyMax =
+                    *std::max_element(latencies.begin(), latencies.end());
+            auto p99 = latencies.begin() + long(latencies.size() * 99 / 100);
+            std::nth_element(latencies.begin(), p99, latencies.end());
+            deviceStats.latencyP99 = *p99;
+        }
+
+        stats.push_back(deviceStats);
+    }
+
+    return stats;
+}
+
+AkVCam::LoadGeneratorPrivate::LoadGeneratorPrivate(IpcBridge *bridge):
+    m_bridge(bridge)
+{
+}
+
+bool AkVCam::LoadGeneratorPrivate::createPatterns(const VideoFormat &format)
+{
+    // A vertical bar moving across color stripes.
+    static const uint8_t colors[][3] = {
+        {255, 255, 255},
+        {255, 255,   0},
+        {  0, 255, 255},
+        {  0, 255,   0},
+        {255,   0, 255},
+        {255,   0,   0},
+        {  0,   0, 255},
+        {  0,   0,   0},
+    };
+    static const size_t nColors = sizeof(colors) / sizeof(colors[0]);
+    VideoFormat rgbFormat(PixelFormatRGB24, format.width(), format.height());
+    auto width = size_t(format.width());
+    auto barWidth = std::max<size_t>(width / 16, 1);
+
+    for (size_t i = 0; i < LOADGEN_PATTERN_FRAMES; i++) {
+        VideoFrame frame(rgbFormat);
+        auto barStart = i * (width - barWidth) / (LOADGEN_PATTERN_FRAMES - 1);
+
+        for (size_t y = 0; y < size_t(format.height()); y++) {
+            auto line = frame.line(0, y);
+
+            for (size_t x = 0; x < width; x++) {
+                auto color = x >= barStart && x < barStart + barWidth?
+                                 colors[nColors - 1]:
+                                 colors[x * nColors / width];
+                memcpy(line + 3 * x, color, 3);
+            }
+        }
+
+        auto pattern = frame.convert(format.fourcc());
+
+        if (pattern.format().size() < 1) {
+            AkLogError() << "Can't create "
+                         << VideoFormat::stringFromFourcc(format.fourcc())
+                         << " frames"
+                         << std::endl;
+            this->m_patterns.clear();
+
+            return false;
+        }
+
+        this->m_patterns.push_back(pattern);
+    }
+
+    return true;
+}
+
+void AkVCam::LoadGeneratorPrivate::sendFrames(LoadDevice *device)
+{
+    AkLogFunction();
+    auto startCpuTime = threadCpuTime();
+    device->startTime = LoadClock::now();
+    auto deadline = device->startTime;
+
+    for (size_t i = 0; this->m_run; i++) {
+        auto &frame = this->m_patterns[i % this->m_patterns.size()];
+        bool idle = !this->m_bridge->hasListeners(device->deviceId);
+        auto writeTime = LoadClock::now();
+        bool ok = this->m_bridge->write(device->deviceId, frame);
+        auto now = LoadClock::now();
+        auto latency =
+                std::chrono::duration_cast<std::chrono::microseconds>(now - writeTime);
+        deadline += this->m_period;
+        bool late = now > deadline;
+
+        // Don't try to catch up, start counting again from now.
+        if (late)
+            deadline = now;
+
+        device->mutex.lock();
+        device->frames++;
+        device->dropped += !ok;
+        device->late += late;
+        device->idle += idle;
+        device->latencies.push_back(uint32_t(latency.count()));
+        device->cpuTime = threadCpuTime() - startCpuTime;
+        device->elapsed =
+                std::chrono::duration<double>(now - device->startTime).count();
+        device->mutex.unlock();
+
+        if (!late)
+            std::this_thread::sleep_until(deadline);
+    }
+}
+
+double AkVCam::LoadGeneratorPrivate::threadCpuTime()
+{
+#ifdef _WIN32
+    FILETIME creationTime;
+    FILETIME exitTime;
+    FILETIME kernelTime;
+    FILETIME userTime;
+
+    if (!GetThreadTimes(GetCurrentThread(),
+                        &creationTime,
+                        &exitTime,
+                        &kernelTime,
+                        &userTime))
+        return 0;
+
+    auto seconds = [] (const FILETIME &time) {
+        return double(uint64_t(time.dwHighDateTime) << 32
+                      | time.dwLowDateTime) / 1e7;
+    };
+
+    return seconds(kernelTime) + seconds(userTime);
+#else
+    timespec time;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+        return 0;
+
+    return double(time.tv_sec) + double(time.tv_nsec) / 1e9;
+#endif
+}
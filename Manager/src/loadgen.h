@@ -0,0 +1,83 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AkVCam
+{
+    class LoadGeneratorPrivate;
+    class IpcBridge;
+    class VideoFormat;
+
+    struct LoadStats
+    {
+        std::string deviceId;
+        uint64_t frames;
+
+        // Frames that write() failed to send.
+        uint64_t dropped;
+
+        // Frames sent after their deadline.
+        uint64_t late;
+
+        // Frames discarded because no client was capturing.
+        uint64_t idle;
+
+        // write() times in microseconds.
+        uint64_t latencyAverage;
+        uint64_t latencyP99;
+        uint64_t latencyMax;
+
+        // Seconds of CPU spent by the device thread, and since it started.
+        double cpuTime;
+        double elapsed;
+
+        // Peak bytes held for the device by this process.
+        uint64_t memoryPeak;
+    };
+
+    /* Sends test patterns to several devices at the same time.
+     *
+     * Each device is fed from its own thread through IpcBridge::write(),
+     * paced to the frame rate of the format. The patterns are prepared
+     * before starting, so the measures only include the write path.
+     */
+    class LoadGenerator
+    {
+        public:
+            explicit LoadGenerator(IpcBridge *bridge);
+            LoadGenerator(const LoadGenerator &other) = delete;
+            ~LoadGenerator();
+
+            bool start(const std::vector<std::string> &devices,
+                       const VideoFormat &format);
+            void stop();
+            std::vector<LoadStats> stats() const;
+
+        private:
+            LoadGeneratorPrivate *d;
+    };
+}
+
+#endif // LOADGEN_H
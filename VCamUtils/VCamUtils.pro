@@ -39,27 +39,64 @@ TARGET = VCamUtils
 TEMPLATE = lib
 
 SOURCES += \
+    src/broker.cpp \
+    src/filewatcher.cpp \
     src/fraction.cpp \
+    src/idlemonitor.cpp \
+    src/image/filtergraph.cpp \
+    src/image/framecache.cpp \
     src/image/videoformat.cpp \
     src/image/videoframe.cpp \
+    src/listenermonitor.cpp \
+    src/logcontrol.cpp \
     src/logger.cpp \
+    src/memcopy.cpp \
+    src/memoryaccounting.cpp \
+    src/perfcounters.cpp \
+    src/profiledmutex.cpp \
+    src/queuecontroller.cpp \
+    src/recording.cpp \
     src/settings.cpp \
+    src/stats.cpp \
+    src/streamengine.cpp \
     src/timer.cpp \
     src/utils.cpp
 
 HEADERS += \
+    src/broker.h \
+    src/controlsbatch.h \
+    src/filewatcher.h \
     src/fraction.h \
+    src/idlemonitor.h \
     src/image/color.h \
+    src/image/filtergraph.h \
+    src/image/framecache.h \
     src/image/videoformat.h \
     src/image/videoframe.h \
     src/image/videoframetypes.h \
     src/image/videoformattypes.h \
     src/ipcbridge.h \
+    src/listenermonitor.h \
+    src/logcontrol.h \
     src/logger.h \
+    src/memcopy.h \
+    src/memoryaccounting.h \
+    src/perfcounters.h \
+    src/pool.h \
+    src/profiledmutex.h \
+    src/queuecontroller.h \
+    src/recording.h \
     src/settings.h \
+    src/stats.h \
+    src/streamengine.h \
     src/timer.h \
     src/utils.h
 
+unix {
+    SOURCES += src/unixbroker.cpp
+    HEADERS += src/unixbroker.h
+}
+
 isEmpty(STATIC_BUILD) | isEqual(STATIC_BUILD, 0) {
     win32-g++: QMAKE_LFLAGS = -static -static-libgcc -static-libstdc++
 }
@@ -0,0 +1,406 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "broker.h"
+#include "logger.h"
+#include "profiledmutex.h"
+#include "stats.h"
+
+namespace AkVCam
+{
+    class BrokerQueue;
+    using BrokerQueuePtr = std::shared_ptr<BrokerQueue>;
+    using BrokerMessagePtr = std::shared_ptr<const BrokerMessage>;
+
+    class BrokerQueue: public std::enable_shared_from_this<BrokerQueue>
+    {
+        public:
+            std::string m_name;
+            Broker::PeerType m_type;
+            BrokerPeerPtr m_peer;
+            std::deque<BrokerMessagePtr> m_messages;
+            std::mutex m_mutex;
+            std::condition_variable m_messageQueued;
+            std::thread m_thread;
+            bool m_run {false};
+
+            BrokerQueue(const std::string &name,
+                        Broker::PeerType type,
+                        const BrokerPeerPtr &peer);
+            ~BrokerQueue();
+            void start();
+            void stop();
+            void post(const BrokerMessagePtr &message, size_t maxFrames);
+            static void dispatchLoop(BrokerQueuePtr queue);
+    };
+
+    struct BrokerDevice
+    {
+        std::string broadcaster;
+        std::vector<std::string> listeners;
+    };
+
+    class BrokerPrivate
+    {
+        public:
+            Broker *self;
+            std::map<std::string, BrokerQueuePtr> m_peers;
+            std::map<std::string, BrokerDevice> m_devices;
+            size_t m_queueSize {4};
+            mutable ProfiledMutex m_mutex {"broker_peers"};
+
+            explicit BrokerPrivate(Broker *self);
+            void releaseDevices(const std::string &peer,
+                                std::vector<std::string> &broadcasts,
+                                std::vector<std::string> &listens);
+    };
+}
+
+AkVCam::Broker::Broker()
+{
+    this->d = new BrokerPrivate(this);
+}
+
+AkVCam::Broker::~Broker()
+{
+    this->d->m_mutex.lock();
+    auto peers = std::move(this->d->m_peers);
+    this->d->m_mutex.unlock();
+
+    for (auto &peer: peers)
+        peer.second->stop();
+
+    delete this->d;
+}
+
+size_t AkVCam::Broker::queueSize() const
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    return this->d->m_queueSize;
+}
+
+void AkVCam::Broker::setQueueSize(size_t queueSize)
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    this->d->m_queueSize = std::max<size_t>(queueSize, 1);
+}
+
+bool AkVCam::Broker::addPeer(const std::string &name,
+                             PeerType type,
+                             const BrokerPeerPtr &peer)
+{
+    AkLogFunction();
+
+    if (name.empty() || !peer)
+        return false;
+
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    if (this->d->m_peers.count(name) > 0)
+        return false;
+
+    AkLogInfo() << "Adding Peer: " << name << std::endl;
+    auto queue = std::make_shared<BrokerQueue>(name, type, peer);
+    queue->start();
+    this->d->m_peers[name] = queue;
+
+    return true;
+}
+
+bool AkVCam::Broker::removePeer(const std::string &name)
+{
+    AkLogFunction();
+    AkLogInfo() << "Port: " << name << std::endl;
+    this->d->m_mutex.lock();
+    auto it = this->d->m_peers.find(name);
+
+    if (it == this->d->m_peers.end()) {
+        this->d->m_mutex.unlock();
+
+        return false;
+    }
+
+    auto queue = it->second;
+    this->d->m_peers.erase(it);
+    std::vector<std::string> broadcasts;
+    std::vector<std::string> listens;
+    this->d->releaseDevices(name, broadcasts, listens);
+    this->d->m_mutex.unlock();
+
+    queue->stop();
+
+    for (auto &deviceId: broadcasts)
+        AKVCAM_EMIT(this, BroadcasterReleased, deviceId)
+
+    for (auto &deviceId: listens)
+        AKVCAM_EMIT(this, ListenerReleased, deviceId, name)
+
+    return true;
+}
+
+std::vector<std::string> AkVCam::Broker::peers(PeerType type) const
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    std::vector<std::string> peers;
+
+    for (auto &peer: this->d->m_peers)
+        if (peer.second->m_type == type)
+            peers.push_back(peer.first);
+
+    return peers;
+}
+
+size_t AkVCam::Broker::nPeers() const
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    return this->d->m_peers.size();
+}
+
+std::string AkVCam::Broker::broadcaster(const std::string &deviceId) const
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    auto it = this->d->m_devices.find(deviceId);
+
+    if (it == this->d->m_devices.end())
+        return {};
+
+    return it->second.broadcaster;
+}
+
+bool AkVCam::Broker::setBroadcaster(const std::string &deviceId,
+                                    const std::string &broadcaster)
+{
+    AkLogFunction();
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    auto &device = this->d->m_devices[deviceId];
+
+    if (device.broadcaster == broadcaster)
+        return false;
+
+    AkLogInfo() << "Device: " << deviceId << std::endl;
+    AkLogInfo() << "Broadcaster: " << broadcaster << std::endl;
+    device.broadcaster = broadcaster;
+
+    return true;
+}
+
+std::vector<std::string> AkVCam::Broker::listeners(const std::string &deviceId) const
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    auto it = this->d->m_devices.find(deviceId);
+
+    if (it == this->d->m_devices.end())
+        return {};
+
+    return it->second.listeners;
+}
+
+bool AkVCam::Broker::addListener(const std::string &deviceId,
+                                 const std::string &listener)
+{
+    AkLogFunction();
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    auto &listeners = this->d->m_devices[deviceId].listeners;
+    auto it = std::find(listeners.begin(), listeners.end(), listener);
+
+    if (it != listeners.end())
+        return false;
+
+    listeners.push_back(listener);
+
+    return true;
+}
+
+bool AkVCam::Broker::removeListener(const std::string &deviceId,
+                                    const std::string &listener)
+{
+    AkLogFunction();
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    auto &listeners = this->d->m_devices[deviceId].listeners;
+    auto it = std::find(listeners.begin(), listeners.end(), listener);
+
+    if (it == listeners.end())
+        return false;
+
+    listeners.erase(it);
+
+    return true;
+}
+
+void AkVCam::Broker::broadcast(const BrokerMessage &message)
+{
+    auto msg = std::make_shared<const BrokerMessage>(message);
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    for (auto &peer: this->d->m_peers)
+        if (peer.second->m_type == PeerTypeClient)
+            peer.second->post(msg, this->d->m_queueSize);
+}
+
+void AkVCam::Broker::checkPeers()
+{
+    std::vector<BrokerQueuePtr> peers;
+    this->d->m_mutex.lock();
+
+    for (auto &peer: this->d->m_peers)
+        peers.push_back(peer.second);
+
+    this->d->m_mutex.unlock();
+
+    for (auto &peer: peers)
+        if (!peer->m_peer->isAlive()) {
+            AkLogWarning() << peer->m_name
+                           << " died, removing..."
+                           << std::endl;
+            this->removePeer(peer->m_name);
+        }
+}
+
+AkVCam::BrokerQueue::BrokerQueue(const std::string &name,
+                                 Broker::PeerType type,
+                                 const BrokerPeerPtr &peer):
+    m_name(name),
+    m_type(type),
+    m_peer(peer)
+{
+}
+
+AkVCam::BrokerQueue::~BrokerQueue()
+{
+    // The last reference can be released from the dispatch thread itself.
+    if (this->m_thread.joinable())
+        this->m_thread.detach();
+}
+
+void AkVCam::BrokerQueue::start()
+{
+    this->m_run = true;
+    this->m_thread = std::thread(&BrokerQueue::dispatchLoop,
+                                 this->shared_from_this());
+}
+
+void AkVCam::BrokerQueue::stop()
+{
+    this->m_mutex.lock();
+    this->m_run = false;
+    this->m_messages.clear();
+    this->m_mutex.unlock();
+    this->m_messageQueued.notify_all();
+
+    if (this->m_thread.joinable()
+        && this->m_thread.get_id() != std::this_thread::get_id())
+        this->m_thread.join();
+}
+
+void AkVCam::BrokerQueue::post(const BrokerMessagePtr &message,
+                               size_t maxFrames)
+{
+    static auto &dropped = Stats::counter("broker_messages_dropped");
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+
+    if (!this->m_run)
+        return;
+
+    // Only frames are dropped, everything else changes the peer state.
+    if (message->id == BrokerMessageFrameReady) {
+        auto isFrame = [&message] (const BrokerMessagePtr &queued) {
+            return queued->id == BrokerMessageFrameReady
+                   && queued->deviceId == message->deviceId;
+        };
+        auto frames = size_t(std::count_if(this->m_messages.begin(),
+                                           this->m_messages.end(),
+                                           isFrame));
+
+        for (; frames >= maxFrames; frames--) {
+            auto it = std::find_if(this->m_messages.begin(),
+                                   this->m_messages.end(),
+                                   isFrame);
+            this->m_messages.erase(it);
+            dropped++;
+        }
+    }
+
+    this->m_messages.push_back(message);
+    lock.unlock();
+    this->m_messageQueued.notify_one();
+}
+
+void AkVCam::BrokerQueue::dispatchLoop(BrokerQueuePtr queue)
+{
+    static auto &sent = Stats::counter("broker_messages_sent");
+    static auto &failed = Stats::counter("broker_send_failures");
+
+    for (;;) {
+        std::unique_lock<std::mutex> lock(queue->m_mutex);
+        queue->m_messageQueued.wait(lock, [&queue] () {
+            return !queue->m_run || !queue->m_messages.empty();
+        });
+
+        if (!queue->m_run)
+            break;
+
+        auto message = queue->m_messages.front();
+        queue->m_messages.pop_front();
+        lock.unlock();
+
+        if (queue->m_peer->send(*message)) {
+            sent++;
+        } else {
+            failed++;
+            AkLogWarning() << "Failed sending message "
+                           << message->id
+                           << " to "
+                           << queue->m_name
+                           << std::endl;
+        }
+    }
+}
+
+AkVCam::BrokerPrivate::BrokerPrivate(Broker *self):
+    self(self)
+{
+}
+
+void AkVCam::BrokerPrivate::releaseDevices(const std::string &peer,
+                                           std::vector<std::string> &broadcasts,
+                                           std::vector<std::string> &listens)
+{
+    for (auto &device: this->m_devices)
+        if (device.second.broadcaster == peer) {
+            device.second.broadcaster.clear();
+            broadcasts.push_back(device.first);
+        } else {
+            auto &listeners = device.second.listeners;
+            auto it = std::find(listeners.begin(), listeners.end(), peer);
+
+            if (it != listeners.end()) {
+                listeners.erase(it);
+                listens.push_back(device.first);
+            }
+        }
+}
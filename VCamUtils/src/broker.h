@@ -0,0 +1,136 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_BROKER_H
+#define AKVCAMUTILS_BROKER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+namespace AkVCam
+{
+    class BrokerPrivate;
+
+    // Same values as the AKVCAM_ASSISTANT_MSG_* ids of the assistants.
+    enum BrokerMessageId: uint32_t
+    {
+        BrokerMessageIsAlive = 0x000,
+        BrokerMessageFrameReady = 0x001,
+        BrokerMessagePictureUpdated = 0x002,
+        BrokerMessageRequestPort = 0x100,
+        BrokerMessageAddPort = 0x101,
+        BrokerMessageRemovePort = 0x102,
+        BrokerMessageDeviceUpdate = 0x200,
+        BrokerMessageListeners = 0x300,
+        BrokerMessageListener = 0x301,
+        BrokerMessageListenerAdd = 0x302,
+        BrokerMessageListenerRemove = 0x303,
+        BrokerMessageBroadcasting = 0x400,
+        BrokerMessageSetBroadcasting = 0x401,
+        BrokerMessageControlsUpdated = 0x402
+    };
+
+    struct BrokerMessage
+    {
+        uint32_t id {0};
+        std::vector<uint8_t> data;
+
+        // Device of a frame, only older frames of it are dropped for it.
+        std::string deviceId;
+
+        // Transport specific representation of the message, if any.
+        std::shared_ptr<void> native;
+    };
+
+    // A connected peer, as seen by the broker.
+    class BrokerPeer
+    {
+        public:
+            virtual ~BrokerPeer() = default;
+
+            // Called from the dispatch thread of the peer.
+            virtual bool send(const BrokerMessage &message) = 0;
+            virtual bool isAlive() = 0;
+    };
+
+    using BrokerPeerPtr = std::shared_ptr<BrokerPeer>;
+
+    /* Transport independent part of the assistant.
+     *
+     * Keeps the connected peers and the broadcaster and listeners of each
+     * device. Messages broadcasted to the clients go through a dispatch
+     * queue and thread per peer, so a slow client does not delay the others.
+     * When a client falls behind, the oldest pending frames of each device
+     * are dropped, so the latest frame of every device is always delivered.
+     */
+    class Broker
+    {
+        public:
+            enum PeerType
+            {
+                PeerTypeClient,
+                PeerTypeServer
+            };
+
+            AKVCAM_SIGNAL(BroadcasterReleased, const std::string &deviceId)
+            AKVCAM_SIGNAL(ListenerReleased,
+                          const std::string &deviceId,
+                          const std::string &listener)
+
+        public:
+            Broker();
+            Broker(const Broker &other) = delete;
+            ~Broker();
+
+            // Maximum number of frames pending per peer.
+            size_t queueSize() const;
+            void setQueueSize(size_t queueSize);
+
+            bool addPeer(const std::string &name,
+                         PeerType type,
+                         const BrokerPeerPtr &peer);
+            bool removePeer(const std::string &name);
+            std::vector<std::string> peers(PeerType type) const;
+            size_t nPeers() const;
+            std::string broadcaster(const std::string &deviceId) const;
+            bool setBroadcaster(const std::string &deviceId,
+                                const std::string &broadcaster);
+            std::vector<std::string> listeners(const std::string &deviceId) const;
+            bool addListener(const std::string &deviceId,
+                             const std::string &listener);
+            bool removeListener(const std::string &deviceId,
+                                const std::string &listener);
+
+            // Queues the message for all the clients and returns immediately.
+            void broadcast(const BrokerMessage &message);
+
+            // Removes the peers that are not alive anymore.
+            void checkPeers();
+
+        private:
+            BrokerPrivate *d;
+            friend class BrokerPrivate;
+    };
+}
+
+#endif // AKVCAMUTILS_BROKER_H
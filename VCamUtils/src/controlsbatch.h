@@ -0,0 +1,49 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_CONTROLSBATCH_H
+#define AKVCAMUTILS_CONTROLSBATCH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace AkVCam
+{
+    /* Returns the version to send a batch of control changes with. A batch
+     * that can't hold all the changes skips a version, so the receivers
+     * see a gap and read all the controls again instead of applying the
+     * truncated batch.
+     */
+    inline uint64_t controlsBatchVersion(uint64_t version,
+                                         size_t changes,
+                                         size_t maxChanges)
+    {
+        return changes > maxChanges? version + 2: version + 1;
+    }
+
+    /* Returns true if a batch can be applied over the last version
+     * received, false if all the controls must be read again.
+     */
+    inline bool isControlsBatchDiff(uint64_t lastVersion, uint64_t version)
+    {
+        return lastVersion > 0 && version == lastVersion + 1;
+    }
+}
+
+#endif // AKVCAMUTILS_CONTROLSBATCH_H
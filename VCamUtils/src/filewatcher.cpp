@@ -0,0 +1,452 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+
+    #if defined(__linux__)
+        #include <poll.h>
+        #include <sys/inotify.h>
+    #elif defined(__APPLE__)
+        #include <sys/event.h>
+    #endif
+#endif
+
+#include "filewatcher.h"
+#include "logger.h"
+
+namespace AkVCam
+{
+    struct FileState
+    {
+        bool exists {false};
+        int64_t mtime {0};
+        int64_t size {0};
+
+        inline bool operator ==(const FileState &other) const
+        {
+            return this->exists == other.exists
+                   && this->mtime == other.mtime
+                   && this->size == other.size;
+        }
+
+        inline bool operator !=(const FileState &other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    class FileWatcherPrivate
+    {
+        public:
+            FileWatcher *self;
+            std::string m_fileName;
+            std::string m_dirName;
+            int m_debounce {AKVCAM_FILEWATCHER_DEBOUNCE_DEFAULT};
+            std::thread m_thread;
+            bool m_run {false};
+            mutable std::mutex m_mutex;
+#if defined(_WIN32)
+            HANDLE m_notification {INVALID_HANDLE_VALUE};
+#elif defined(__linux__)
+            int m_inotify {-1};
+#elif defined(__APPLE__)
+            int m_kqueue {-1};
+            int m_dirFd {-1};
+            int m_fileFd {-1};
+#endif
+            FileState m_polled;
+
+            explicit FileWatcherPrivate(FileWatcher *self);
+            bool isRunning() const;
+            FileState fileState() const;
+            bool openWatch();
+            void closeWatch();
+            void rewatch();
+
+            // Waits until something changes in the watched directory or the
+            // timeout expires.
+            bool waitEvents(int timeout);
+            void watchLoop();
+    };
+}
+
+AkVCam::FileWatcher::FileWatcher()
+{
+    this->d = new FileWatcherPrivate(this);
+}
+
+AkVCam::FileWatcher::~FileWatcher()
+{
+    this->stop();
+    delete this->d;
+}
+
+std::string AkVCam::FileWatcher::fileName() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_fileName;
+}
+
+int AkVCam::FileWatcher::debounce() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_debounce;
+}
+
+void AkVCam::FileWatcher::setDebounce(int msecs)
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    this->d->m_debounce = std::max(msecs, 0);
+}
+
+bool AkVCam::FileWatcher::start(const std::string &fileName)
+{
+    AkLogFunction();
+    this->stop();
+
+    if (fileName.empty())
+        return false;
+
+    auto sep = fileName.find_last_of("/\\");
+    std::string dirName;
+
+    if (sep == std::string::npos)
+        dirName = ".";
+    else if (sep == 0)
+        dirName = fileName.substr(0, 1);
+    else
+        dirName = fileName.substr(0, sep);
+
+    this->d->m_mutex.lock();
+    this->d->m_fileName = fileName;
+    this->d->m_dirName = dirName;
+    this->d->m_mutex.unlock();
+
+    if (!this->d->openWatch()) {
+        AkLogError() << "Can't watch " << dirName << std::endl;
+
+        return false;
+    }
+
+    this->d->m_polled = this->d->fileState();
+    this->d->m_mutex.lock();
+    this->d->m_run = true;
+    this->d->m_mutex.unlock();
+    this->d->m_thread = std::thread(&FileWatcherPrivate::watchLoop, this->d);
+
+    return true;
+}
+
+void AkVCam::FileWatcher::stop()
+{
+    AkLogFunction();
+    this->d->m_mutex.lock();
+    this->d->m_run = false;
+    this->d->m_mutex.unlock();
+
+    if (this->d->m_thread.joinable())
+        this->d->m_thread.join();
+
+    this->d->closeWatch();
+}
+
+bool AkVCam::FileWatcher::isRunning() const
+{
+    return this->d->isRunning();
+}
+
+AkVCam::FileWatcherPrivate::FileWatcherPrivate(FileWatcher *self):
+    self(self)
+{
+}
+
+bool AkVCam::FileWatcherPrivate::isRunning() const
+{
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+
+    return this->m_run;
+}
+
+AkVCam::FileState AkVCam::FileWatcherPrivate::fileState() const
+{
+    FileState state;
+
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+
+    if (!GetFileAttributesExA(this->m_fileName.c_str(),
+                              GetFileExInfoStandard,
+                              &data))
+        return state;
+
+    state.exists = true;
+    state.mtime = int64_t(data.ftLastWriteTime.dwHighDateTime) << 32
+                | data.ftLastWriteTime.dwLowDateTime;
+    state.size = int64_t(data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+#else
+    struct stat fileInfo;
+
+    if (stat(this->m_fileName.c_str(), &fileInfo) != 0)
+        return state;
+
+    state.exists = true;
+
+    #if defined(__APPLE__)
+    state.mtime = int64_t(fileInfo.st_mtimespec.tv_sec) * 1000000000
+                + fileInfo.st_mtimespec.tv_nsec;
+    #elif defined(__linux__)
+    state.mtime = int64_t(fileInfo.st_mtim.tv_sec) * 1000000000
+                + fileInfo.st_mtim.tv_nsec;
+    #else
+    state.mtime = int64_t(fileInfo.st_mtime) * 1000000000;
+    #endif
+
+    state.size = int64_t(fileInfo.st_size);
+#endif
+
+    return state;
+}
+
+bool AkVCam::FileWatcherPrivate::openWatch()
+{
+#if defined(_WIN32)
+    this->m_notification =
+            FindFirstChangeNotificationA(this->m_dirName.c_str(),
+                                         FALSE,
+                                         FILE_NOTIFY_CHANGE_FILE_NAME
+                                         | FILE_NOTIFY_CHANGE_SIZE
+                                         | FILE_NOTIFY_CHANGE_LAST_WRITE);
+
+    return this->m_notification != INVALID_HANDLE_VALUE;
+#elif defined(__linux__)
+    this->m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (this->m_inotify < 0)
+        return false;
+
+    if (inotify_add_watch(this->m_inotify,
+                          this->m_dirName.c_str(),
+                          IN_CLOSE_WRITE
+                          | IN_MODIFY
+                          | IN_ATTRIB
+                          | IN_CREATE
+                          | IN_DELETE
+                          | IN_MOVED_FROM
+                          | IN_MOVED_TO) < 0) {
+        this->closeWatch();
+
+        return false;
+    }
+
+    return true;
+#elif defined(__APPLE__)
+    this->m_kqueue = kqueue();
+
+    if (this->m_kqueue < 0)
+        return false;
+
+    this->m_dirFd = open(this->m_dirName.c_str(), O_EVTONLY);
+
+    if (this->m_dirFd < 0) {
+        this->closeWatch();
+
+        return false;
+    }
+
+    struct kevent event;
+    EV_SET(&event,
+           uintptr_t(this->m_dirFd),
+           EVFILT_VNODE,
+           EV_ADD | EV_CLEAR,
+           NOTE_WRITE | NOTE_DELETE | NOTE_RENAME,
+           0,
+           nullptr);
+
+    if (kevent(this->m_kqueue, &event, 1, nullptr, 0, nullptr) < 0) {
+        this->closeWatch();
+
+        return false;
+    }
+
+    // The directory is only notified when its entries change, in place
+    // writes are notified by the file itself.
+    this->rewatch();
+
+    return true;
+#else
+    return true;
+#endif
+}
+
+void AkVCam::FileWatcherPrivate::closeWatch()
+{
+#if defined(_WIN32)
+    if (this->m_notification != INVALID_HANDLE_VALUE) {
+        FindCloseChangeNotification(this->m_notification);
+        this->m_notification = INVALID_HANDLE_VALUE;
+    }
+#elif defined(__linux__)
+    if (this->m_inotify >= 0) {
+        close(this->m_inotify);
+        this->m_inotify = -1;
+    }
+#elif defined(__APPLE__)
+    if (this->m_fileFd >= 0) {
+        close(this->m_fileFd);
+        this->m_fileFd = -1;
+    }
+
+    if (this->m_dirFd >= 0) {
+        close(this->m_dirFd);
+        this->m_dirFd = -1;
+    }
+
+    if (this->m_kqueue >= 0) {
+        close(this->m_kqueue);
+        this->m_kqueue = -1;
+    }
+#endif
+}
+
+void AkVCam::FileWatcherPrivate::rewatch()
+{
+#ifdef __APPLE__
+    // Replacing the file creates a new vnode, so follow the current one.
+    if (this->m_fileFd >= 0) {
+        close(this->m_fileFd);
+        this->m_fileFd = -1;
+    }
+
+    this->m_fileFd = open(this->m_fileName.c_str(), O_EVTONLY);
+
+    if (this->m_fileFd < 0)
+        return;
+
+    struct kevent event;
+    EV_SET(&event,
+           uintptr_t(this->m_fileFd),
+           EVFILT_VNODE,
+           EV_ADD | EV_CLEAR,
+           NOTE_WRITE
+           | NOTE_EXTEND
+           | NOTE_ATTRIB
+           | NOTE_DELETE
+           | NOTE_RENAME,
+           0,
+           nullptr);
+    kevent(this->m_kqueue, &event, 1, nullptr, 0, nullptr);
+#endif
+}
+
+bool AkVCam::FileWatcherPrivate::waitEvents(int timeout)
+{
+#if defined(_WIN32)
+    if (WaitForSingleObject(this->m_notification,
+                            DWORD(timeout)) != WAIT_OBJECT_0)
+        return false;
+
+    FindNextChangeNotification(this->m_notification);
+
+    return true;
+#elif defined(__linux__)
+    pollfd fds;
+    fds.fd = this->m_inotify;
+    fds.events = POLLIN;
+    fds.revents = 0;
+
+    if (poll(&fds, 1, timeout) < 1)
+        return false;
+
+    // Only the fact that something changed matters, drop the events.
+    char events[4096];
+
+    while (read(this->m_inotify, events, sizeof(events)) > 0) {
+    }
+
+    return true;
+#elif defined(__APPLE__)
+    struct kevent events[4];
+    timespec timeoutSpec {timeout / 1000, 1000000L * (timeout % 1000)};
+
+    return kevent(this->m_kqueue, nullptr, 0, events, 4, &timeoutSpec) > 0;
+#else
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+    auto state = this->fileState();
+
+    if (state == this->m_polled)
+        return false;
+
+    this->m_polled = state;
+
+    return true;
+#endif
+}
+
+void AkVCam::FileWatcherPrivate::watchLoop()
+{
+    AkLogFunction();
+    static const int pollInterval = 250;
+    auto lastState = this->fileState();
+
+    while (this->isRunning()) {
+        if (!this->waitEvents(pollInterval))
+            continue;
+
+        this->m_mutex.lock();
+        auto debounce = this->m_debounce;
+        this->m_mutex.unlock();
+
+        // Wait until the editor is done with the file.
+        while (this->isRunning() && this->waitEvents(debounce)) {
+        }
+
+        if (!this->isRunning())
+            break;
+
+        this->rewatch();
+        auto state = this->fileState();
+
+        if (state == lastState)
+            continue;
+
+        lastState = state;
+
+        if (!state.exists) {
+            AkLogWarning() << this->m_fileName << " was removed" << std::endl;
+
+            continue;
+        }
+
+        AkLogInfo() << this->m_fileName << " changed" << std::endl;
+        AKVCAM_EMIT(this->self, FileChanged, this->m_fileName)
+    }
+}
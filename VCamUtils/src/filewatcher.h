@@ -0,0 +1,67 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_FILEWATCHER_H
+#define AKVCAMUTILS_FILEWATCHER_H
+
+#include <string>
+
+#include "utils.h"
+
+// Milliseconds the file must stay unmodified before notifying a change.
+#define AKVCAM_FILEWATCHER_DEBOUNCE_DEFAULT 300
+
+namespace AkVCam
+{
+    class FileWatcherPrivate;
+
+    /* Notifies the changes of a file.
+     *
+     * The directory containing the file is watched with the native API of
+     * the platform (inotify, kqueue or change notifications, with a stat
+     * polling fallback), so the file can be replaced by editors that save
+     * to a temporary file and rename it. Bursts of events are coalesced
+     * until the file stays quiet for the debounce interval, and
+     * FileChanged is only emitted when the modification time or the size
+     * of the file changed. The signal is emitted from the watcher thread.
+     */
+    class FileWatcher
+    {
+        public:
+            AKVCAM_SIGNAL(FileChanged, const std::string &fileName)
+
+        public:
+            FileWatcher();
+            FileWatcher(const FileWatcher &other) = delete;
+            ~FileWatcher();
+
+            std::string fileName() const;
+            int debounce() const;
+            void setDebounce(int msecs);
+            bool start(const std::string &fileName);
+            void stop();
+            bool isRunning() const;
+
+        private:
+            FileWatcherPrivate *d;
+            friend class FileWatcherPrivate;
+    };
+}
+
+#endif // AKVCAMUTILS_FILEWATCHER_H
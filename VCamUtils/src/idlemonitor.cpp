@@ -0,0 +1,259 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "idlemonitor.h"
+#include "logger.h"
+#include "stats.h"
+
+namespace AkVCam
+{
+    using IdleClock = std::chrono::steady_clock;
+
+    struct IdleResource
+    {
+        IdleReleaseFunc release;
+        IdleClock::time_point lastUsed;
+        bool released {false};
+    };
+
+    class IdleMonitorPrivate
+    {
+        public:
+            std::map<std::string, IdleResource> m_resources;
+            int m_timeout {AKVCAM_IDLE_TIMEOUT_DEFAULT};
+            std::string m_releasing;
+            std::thread::id m_threadId;
+            bool m_run {false};
+            bool m_stop {false};
+            mutable std::mutex m_mutex;
+            std::condition_variable m_changed;
+
+            void startMonitor();
+            bool hasPending() const;
+            void monitorLoop();
+    };
+}
+
+AkVCam::IdleMonitor::IdleMonitor()
+{
+    this->d = new IdleMonitorPrivate;
+}
+
+AkVCam::IdleMonitor::~IdleMonitor()
+{
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+    this->d->m_stop = true;
+    this->d->m_changed.notify_all();
+
+    if (std::this_thread::get_id() != this->d->m_threadId)
+        this->d->m_changed.wait(lock, [this] () {
+            return !this->d->m_run;
+        });
+
+    lock.unlock();
+    delete this->d;
+}
+
+int AkVCam::IdleMonitor::timeout() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_timeout;
+}
+
+void AkVCam::IdleMonitor::setTimeout(int timeout)
+{
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+
+    if (this->d->m_timeout == timeout)
+        return;
+
+    this->d->m_timeout = timeout;
+    this->d->startMonitor();
+    lock.unlock();
+    this->d->m_changed.notify_all();
+}
+
+void AkVCam::IdleMonitor::add(const std::string &id,
+                              const IdleReleaseFunc &release)
+{
+    if (!release)
+        return;
+
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+    auto &resource = this->d->m_resources[id];
+    resource.release = release;
+    resource.lastUsed = IdleClock::now();
+    resource.released = false;
+    this->d->startMonitor();
+    lock.unlock();
+    this->d->m_changed.notify_all();
+}
+
+void AkVCam::IdleMonitor::remove(const std::string &id)
+{
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+    this->d->m_resources.erase(id);
+
+    // Let the monitor thread finish if nothing else is left.
+    this->d->m_changed.notify_all();
+
+    // Don't let the owner go away while its resource is being released.
+    if (std::this_thread::get_id() != this->d->m_threadId)
+        this->d->m_changed.wait(lock, [this, &id] () {
+            return this->d->m_releasing != id;
+        });
+}
+
+void AkVCam::IdleMonitor::touch(const std::string &id)
+{
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+    auto it = this->d->m_resources.find(id);
+
+    if (it == this->d->m_resources.end())
+        return;
+
+    it->second.lastUsed = IdleClock::now();
+
+    if (!it->second.released)
+        return;
+
+    // The monitor thread finished with nothing to release, start it again.
+    it->second.released = false;
+    this->d->startMonitor();
+    lock.unlock();
+    this->d->m_changed.notify_all();
+}
+
+bool AkVCam::IdleMonitor::isReleased(const std::string &id) const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    auto it = this->d->m_resources.find(id);
+
+    return it != this->d->m_resources.end() && it->second.released;
+}
+
+AkVCam::IdleMonitor *AkVCam::IdleMonitor::global()
+{
+    /* Never destroy it, the static destructors of the DirectShow filter run
+     * under the loader lock, and waiting for a thread there deadlocks.
+     */
+    static auto monitor = new IdleMonitor;
+
+    return monitor;
+}
+
+// Must be called with m_mutex locked.
+void AkVCam::IdleMonitorPrivate::startMonitor()
+{
+    if (this->m_run || this->m_stop || !this->hasPending())
+        return;
+
+    /* The thread finishes by itself when there is nothing left to release,
+     * so it's never joined.
+     */
+    std::thread thread(&IdleMonitorPrivate::monitorLoop, this);
+    this->m_threadId = thread.get_id();
+    this->m_run = true;
+    thread.detach();
+}
+
+// Must be called with m_mutex locked.
+bool AkVCam::IdleMonitorPrivate::hasPending() const
+{
+    if (this->m_timeout < 1)
+        return false;
+
+    for (auto &resource: this->m_resources)
+        if (!resource.second.released)
+            return true;
+
+    return false;
+}
+
+void AkVCam::IdleMonitorPrivate::monitorLoop()
+{
+    static auto &releasedCount = Stats::counter("idle_released");
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+
+    while (!this->m_stop) {
+        bool pending = false;
+        auto deadline = IdleClock::time_point::max();
+        auto now = IdleClock::now();
+        std::vector<std::pair<std::string, IdleReleaseFunc>> idle;
+
+        if (this->m_timeout > 0) {
+            std::chrono::seconds timeout(this->m_timeout);
+
+            for (auto &resource: this->m_resources) {
+                if (resource.second.released)
+                    continue;
+
+                auto expires = resource.second.lastUsed + timeout;
+
+                if (expires <= now) {
+                    resource.second.released = true;
+                    idle.push_back({resource.first, resource.second.release});
+                } else {
+                    pending = true;
+                    deadline = std::min(deadline, expires);
+                }
+            }
+        }
+
+        if (!idle.empty()) {
+            for (auto &resource: idle) {
+                // It may have been removed while releasing the others.
+                if (!this->m_resources.count(resource.first))
+                    continue;
+
+                this->m_releasing = resource.first;
+                lock.unlock();
+                AkLogInfo() << "Releasing idle resource: "
+                            << resource.first
+                            << std::endl;
+                resource.second();
+                releasedCount++;
+                lock.lock();
+                this->m_releasing.clear();
+                this->m_changed.notify_all();
+            }
+
+            continue;
+        }
+
+        // Nothing left to release, add() and touch() will start it again.
+        if (!pending)
+            break;
+
+        // Sleep until the next resource expires, or until something changes.
+        this->m_changed.wait_until(lock, deadline);
+    }
+
+    this->m_run = false;
+    this->m_threadId = {};
+    this->m_changed.notify_all();
+}
@@ -0,0 +1,67 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_IDLEMONITOR_H
+#define AKVCAMUTILS_IDLEMONITOR_H
+
+#include <functional>
+#include <string>
+
+// Seconds a resource can stay unused before releasing it.
+#define AKVCAM_IDLE_TIMEOUT_DEFAULT 30
+
+namespace AkVCam
+{
+    class IdleMonitorPrivate;
+    using IdleReleaseFunc = std::function<void ()>;
+
+    /* Releases the resources that haven't been used for a while.
+     *
+     * Each resource is registered with a function that frees it, and
+     * touch() is called every time it's used. When a resource stays
+     * untouched for longer than the timeout, the release function is
+     * called once from the monitor thread. The owner recreates the
+     * resource the next time it needs it, so the release function must
+     * take the same locks as the code using the resource.
+     */
+    class IdleMonitor
+    {
+        public:
+            IdleMonitor();
+            IdleMonitor(const IdleMonitor &other) = delete;
+            ~IdleMonitor();
+
+            // Timeout in seconds, 0 or less disables the releasing.
+            int timeout() const;
+            void setTimeout(int timeout);
+
+            void add(const std::string &id, const IdleReleaseFunc &release);
+            void remove(const std::string &id);
+            void touch(const std::string &id);
+            bool isReleased(const std::string &id) const;
+
+            // Monitor shared by all the resources in the process.
+            static IdleMonitor *global();
+
+        private:
+            IdleMonitorPrivate *d;
+    };
+}
+
+#endif // AKVCAMUTILS_IDLEMONITOR_H
@@ -0,0 +1,680 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+
+#include "filtergraph.h"
+#include "videoformat.h"
+#include "videoframe.h"
+#include "../memoryaccounting.h"
+#include "../utils.h"
+
+namespace AkVCam
+{
+    class FilterGraphPrivate
+    {
+        public:
+            std::vector<VideoFilterPtr> m_filters;
+            std::vector<VideoFilterPtr> m_plan;
+            FourCC m_planFourcc {0};
+            int m_planWidth {0};
+            int m_planHeight {0};
+            bool m_planValid {false};
+            bool m_planDirty {true};
+            MemoryAccount m_planAccount {MemoryCategoryPlans};
+            std::mutex m_mutex;
+
+            std::vector<VideoFilterPtr> buildPlan(const VideoFormat &input,
+                                                  bool *ok) const;
+            static void removeIdentities(std::vector<VideoFilterPtr> &filters,
+                                         const VideoFormat &input);
+            static void moveDownscalers(std::vector<VideoFilterPtr> &filters,
+                                        const VideoFormat &input);
+            static void fuse(std::vector<VideoFilterPtr> &filters);
+    };
+
+    // Formats supported by the VideoFrame adjust and scale functions.
+    inline bool isAdjustable(FourCC fourcc)
+    {
+        return fourcc == PixelFormatRGB24 || fourcc == PixelFormatBGR24;
+    }
+
+    inline std::string formatString(FourCC fourcc, int width, int height)
+    {
+        std::stringstream ss;
+        ss << VideoFormat::stringFromFourcc(fourcc)
+           << ' '
+           << width
+           << 'x'
+           << height;
+
+        return ss.str();
+    }
+}
+
+int AkVCam::VideoFilter::flags() const
+{
+    return FlagNone;
+}
+
+bool AkVCam::VideoFilter::canProcess(const VideoFormat &input) const
+{
+    UNUSED(input);
+
+    return true;
+}
+
+AkVCam::VideoFormat AkVCam::VideoFilter::outputFormat(const VideoFormat &input) const
+{
+    return input;
+}
+
+bool AkVCam::VideoFilter::isIdentity(const VideoFormat &input) const
+{
+    UNUSED(input);
+
+    return false;
+}
+
+AkVCam::VideoFilterPtr AkVCam::VideoFilter::fuse(const VideoFilter &next) const
+{
+    UNUSED(next);
+
+    return {};
+}
+
+bool AkVCam::VideoFilter::processInPlace(VideoFrame &frame) const
+{
+    frame = this->process(frame);
+
+    return frame.format().size() > 0;
+}
+
+AkVCam::MirrorFilter::MirrorFilter(bool horizontalMirror, bool verticalMirror):
+    m_horizontalMirror(horizontalMirror),
+    m_verticalMirror(verticalMirror)
+{
+}
+
+std::string AkVCam::MirrorFilter::name() const
+{
+    std::stringstream ss;
+    ss << "mirror("
+       << (this->m_horizontalMirror? "h": "")
+       << (this->m_verticalMirror? "v": "")
+       << ")";
+
+    return ss.str();
+}
+
+int AkVCam::MirrorFilter::flags() const
+{
+    return FlagInPlace | FlagScaleInvariant;
+}
+
+bool AkVCam::MirrorFilter::canProcess(const VideoFormat &input) const
+{
+    return isAdjustable(input.fourcc());
+}
+
+bool AkVCam::MirrorFilter::isIdentity(const VideoFormat &input) const
+{
+    UNUSED(input);
+
+    return !this->m_horizontalMirror && !this->m_verticalMirror;
+}
+
+AkVCam::VideoFilterPtr AkVCam::MirrorFilter::fuse(const VideoFilter &next) const
+{
+    auto mirror = dynamic_cast<const MirrorFilter *>(&next);
+
+    if (!mirror)
+        return {};
+
+    return std::make_shared<MirrorFilter>(this->m_horizontalMirror != mirror->m_horizontalMirror,
+                                          this->m_verticalMirror != mirror->m_verticalMirror);
+}
+
+AkVCam::VideoFrame AkVCam::MirrorFilter::process(const VideoFrame &frame) const
+{
+    return frame.mirror(this->m_horizontalMirror, this->m_verticalMirror);
+}
+
+bool AkVCam::MirrorFilter::processInPlace(VideoFrame &frame) const
+{
+    return frame.mirrorInPlace(this->m_horizontalMirror,
+                               this->m_verticalMirror);
+}
+
+AkVCam::SwapRgbFilter::SwapRgbFilter(bool swap):
+    m_swap(swap)
+{
+}
+
+std::string AkVCam::SwapRgbFilter::name() const
+{
+    return "swap_rgb";
+}
+
+int AkVCam::SwapRgbFilter::flags() const
+{
+    return FlagInPlace | FlagScaleInvariant;
+}
+
+bool AkVCam::SwapRgbFilter::canProcess(const VideoFormat &input) const
+{
+    return isAdjustable(input.fourcc());
+}
+
+bool AkVCam::SwapRgbFilter::isIdentity(const VideoFormat &input) const
+{
+    UNUSED(input);
+
+    return !this->m_swap;
+}
+
+AkVCam::VideoFilterPtr AkVCam::SwapRgbFilter::fuse(const VideoFilter &next) const
+{
+    auto swapRgb = dynamic_cast<const SwapRgbFilter *>(&next);
+
+    if (!swapRgb)
+        return {};
+
+    return std::make_shared<SwapRgbFilter>(this->m_swap != swapRgb->m_swap);
+}
+
+AkVCam::VideoFrame AkVCam::SwapRgbFilter::process(const VideoFrame &frame) const
+{
+    return frame.swapRgb(this->m_swap);
+}
+
+bool AkVCam::SwapRgbFilter::processInPlace(VideoFrame &frame) const
+{
+    return !this->m_swap || frame.swapRgbInPlace();
+}
+
+AkVCam::AdjustFilter::AdjustFilter(int hue,
+                                   int saturation,
+                                   int luminance,
+                                   int gamma,
+                                   int contrast,
+                                   bool gray):
+    m_hue(hue),
+    m_saturation(saturation),
+    m_luminance(luminance),
+    m_gamma(gamma),
+    m_contrast(contrast),
+    m_gray(gray)
+{
+}
+
+std::string AkVCam::AdjustFilter::name() const
+{
+    std::stringstream ss;
+    ss << "adjust("
+       << this->m_hue << ", "
+       << this->m_saturation << ", "
+       << this->m_luminance << ", "
+       << this->m_gamma << ", "
+       << this->m_contrast << ", "
+       << this->m_gray << ")";
+
+    return ss.str();
+}
+
+int AkVCam::AdjustFilter::flags() const
+{
+    return FlagInPlace | FlagScaleInvariant;
+}
+
+bool AkVCam::AdjustFilter::canProcess(const VideoFormat &input) const
+{
+    return isAdjustable(input.fourcc());
+}
+
+bool AkVCam::AdjustFilter::isIdentity(const VideoFormat &input) const
+{
+    UNUSED(input);
+
+    return this->m_hue == 0
+           && this->m_saturation == 0
+           && this->m_luminance == 0
+           && this->m_gamma == 0
+           && this->m_contrast == 0
+           && !this->m_gray;
+}
+
+AkVCam::VideoFrame AkVCam::AdjustFilter::process(const VideoFrame &frame) const
+{
+    return frame.adjust(this->m_hue,
+                        this->m_saturation,
+                        this->m_luminance,
+                        this->m_gamma,
+                        this->m_contrast,
+                        this->m_gray);
+}
+
+bool AkVCam::AdjustFilter::processInPlace(VideoFrame &frame) const
+{
+    return frame.adjustInPlace(this->m_hue,
+                               this->m_saturation,
+                               this->m_luminance,
+                               this->m_gamma,
+                               this->m_contrast,
+                               this->m_gray);
+}
+
+AkVCam::ScaleFilter::ScaleFilter(int width,
+                                 int height,
+                                 Scaling scaling,
+                                 AspectRatio aspectRatio):
+    m_width(width),
+    m_height(height),
+    m_scaling(scaling),
+    m_aspectRatio(aspectRatio)
+{
+}
+
+std::string AkVCam::ScaleFilter::name() const
+{
+    std::stringstream ss;
+    ss << "scale(" << this->m_width << 'x' << this->m_height << ")";
+
+    return ss.str();
+}
+
+bool AkVCam::ScaleFilter::canProcess(const VideoFormat &input) const
+{
+    return isAdjustable(input.fourcc());
+}
+
+AkVCam::VideoFormat AkVCam::ScaleFilter::outputFormat(const VideoFormat &input) const
+{
+    return {input.fourcc(), this->m_width, this->m_height};
+}
+
+bool AkVCam::ScaleFilter::isIdentity(const VideoFormat &input) const
+{
+    return input.width() == this->m_width
+           && input.height() == this->m_height;
+}
+
+AkVCam::VideoFilterPtr AkVCam::ScaleFilter::fuse(const VideoFilter &next) const
+{
+    auto convert = dynamic_cast<const ConvertFilter *>(&next);
+
+    if (!convert)
+        return {};
+
+    return std::make_shared<ScaleConvertFilter>(this->m_width,
+                                                this->m_height,
+                                                convert->fourcc(),
+                                                this->m_scaling,
+                                                this->m_aspectRatio);
+}
+
+AkVCam::VideoFrame AkVCam::ScaleFilter::process(const VideoFrame &frame) const
+{
+    return frame.scaled(this->m_width,
+                        this->m_height,
+                        this->m_scaling,
+                        this->m_aspectRatio);
+}
+
+int AkVCam::ScaleFilter::width() const
+{
+    return this->m_width;
+}
+
+int AkVCam::ScaleFilter::height() const
+{
+    return this->m_height;
+}
+
+AkVCam::ConvertFilter::ConvertFilter(FourCC fourcc):
+    m_fourcc(fourcc)
+{
+}
+
+std::string AkVCam::ConvertFilter::name() const
+{
+    return "convert(" + VideoFormat::stringFromFourcc(this->m_fourcc) + ")";
+}
+
+bool AkVCam::ConvertFilter::canProcess(const VideoFormat &input) const
+{
+    return VideoFrame().canConvert(input.fourcc(), this->m_fourcc);
+}
+
+AkVCam::VideoFormat AkVCam::ConvertFilter::outputFormat(const VideoFormat &input) const
+{
+    return {this->m_fourcc, input.width(), input.height()};
+}
+
+bool AkVCam::ConvertFilter::isIdentity(const VideoFormat &input) const
+{
+    return input.fourcc() == this->m_fourcc;
+}
+
+AkVCam::VideoFrame AkVCam::ConvertFilter::process(const VideoFrame &frame) const
+{
+    return frame.convert(this->m_fourcc);
+}
+
+AkVCam::FourCC AkVCam::ConvertFilter::fourcc() const
+{
+    return this->m_fourcc;
+}
+
+AkVCam::ScaleConvertFilter::ScaleConvertFilter(int width,
+                                               int height,
+                                               FourCC fourcc,
+                                               Scaling scaling,
+                                               AspectRatio aspectRatio):
+    m_width(width),
+    m_height(height),
+    m_fourcc(fourcc),
+    m_scaling(scaling),
+    m_aspectRatio(aspectRatio)
+{
+}
+
+std::string AkVCam::ScaleConvertFilter::name() const
+{
+    return "scale_convert(" + formatString(this->m_fourcc,
+                                           this->m_width,
+                                           this->m_height) + ")";
+}
+
+bool AkVCam::ScaleConvertFilter::canProcess(const VideoFormat &input) const
+{
+    return isAdjustable(input.fourcc())
+           && VideoFrame().canConvert(input.fourcc(), this->m_fourcc);
+}
+
+AkVCam::VideoFormat AkVCam::ScaleConvertFilter::outputFormat(const VideoFormat &input) const
+{
+    UNUSED(input);
+
+    return {this->m_fourcc, this->m_width, this->m_height};
+}
+
+bool AkVCam::ScaleConvertFilter::isIdentity(const VideoFormat &input) const
+{
+    return input.fourcc() == this->m_fourcc
+           && input.width() == this->m_width
+           && input.height() == this->m_height;
+}
+
+AkVCam::VideoFrame AkVCam::ScaleConvertFilter::process(const VideoFrame &frame) const
+{
+    return frame.convert({this->m_fourcc, this->m_width, this->m_height},
+                         this->m_scaling,
+                         this->m_aspectRatio);
+}
+
+AkVCam::FilterGraph::FilterGraph()
+{
+    this->d = new FilterGraphPrivate;
+}
+
+AkVCam::FilterGraph::FilterGraph(const FilterGraph &other)
+{
+    this->d = new FilterGraphPrivate;
+    this->d->m_filters = other.d->m_filters;
+}
+
+AkVCam::FilterGraph::~FilterGraph()
+{
+    delete this->d;
+}
+
+AkVCam::FilterGraph &AkVCam::FilterGraph::operator =(const FilterGraph &other)
+{
+    if (this != &other) {
+        std::lock_guard<std::mutex> lock(this->d->m_mutex);
+        this->d->m_filters = other.d->m_filters;
+        this->d->m_planDirty = true;
+    }
+
+    return *this;
+}
+
+void AkVCam::FilterGraph::append(const VideoFilterPtr &filter)
+{
+    if (!filter)
+        return;
+
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    this->d->m_filters.push_back(filter);
+    this->d->m_planDirty = true;
+}
+
+void AkVCam::FilterGraph::clear()
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    this->d->m_filters.clear();
+    this->d->m_planDirty = true;
+}
+
+const std::vector<AkVCam::VideoFilterPtr> &AkVCam::FilterGraph::filters() const
+{
+    return this->d->m_filters;
+}
+
+std::string AkVCam::FilterGraph::plan(const VideoFormat &input) const
+{
+    bool ok = false;
+    this->d->m_mutex.lock();
+    auto plan = this->d->buildPlan(input, &ok);
+    this->d->m_mutex.unlock();
+
+    if (!ok)
+        return {};
+
+    std::stringstream ss;
+    ss << formatString(input.fourcc(), input.width(), input.height());
+    auto format = input;
+
+    for (auto &filter: plan) {
+        format = filter->outputFormat(format);
+        ss << " -> " << filter->name();
+    }
+
+    ss << " -> " << formatString(format.fourcc(),
+                                 format.width(),
+                                 format.height());
+
+    return ss.str();
+}
+
+AkVCam::VideoFrame AkVCam::FilterGraph::process(const VideoFrame &frame,
+                                                FilterTimings *timings,
+                                                const PerfCounters *counters) const
+{
+    auto input = frame.format();
+    std::vector<VideoFilterPtr> plan;
+
+    this->d->m_mutex.lock();
+
+    if (this->d->m_planDirty
+        || this->d->m_planFourcc != input.fourcc()
+        || this->d->m_planWidth != input.width()
+        || this->d->m_planHeight != input.height()) {
+        this->d->m_plan = this->d->buildPlan(input, &this->d->m_planValid);
+        this->d->m_planFourcc = input.fourcc();
+        this->d->m_planWidth = input.width();
+        this->d->m_planHeight = input.height();
+        this->d->m_planDirty = false;
+        this->d->m_planAccount.setSize(this->d->m_plan.capacity()
+                                       * sizeof(VideoFilterPtr));
+    }
+
+    bool valid = this->d->m_planValid;
+    plan = this->d->m_plan;
+    this->d->m_mutex.unlock();
+
+    if (!valid)
+        return {};
+
+    if (timings)
+        timings->clear();
+
+    if (plan.empty())
+        return frame;
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point startTime;
+    PerfCounts startCounts;
+    uint64_t bytes = 0;
+    auto startTiming = [&] (const VideoFrame &input) {
+        bytes = input.data().size();
+
+        if (counters)
+            startCounts = counters->read();
+
+        startTime = Clock::now();
+    };
+    auto addTiming = [&] (const VideoFilterPtr &filter) {
+        auto time = Clock::now() - startTime;
+        auto nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(time);
+        PerfCounts counts;
+
+        if (counters)
+            counts = counters->read() - startCounts;
+
+        timings->push_back({filter->name(), uint64_t(nsecs.count()), bytes, counts});
+    };
+
+    if (timings)
+        startTiming(frame);
+
+    // The input frame is borrowed, the first stage always writes to a new
+    // frame, from there on the frame is ours and can be modified in place.
+    auto output = plan.front()->process(frame);
+
+    if (timings)
+        addTiming(plan.front());
+
+    for (auto it = plan.begin() + 1; it != plan.end(); it++) {
+        if (output.format().size() < 1)
+            break;
+
+        if (timings)
+            startTiming(output);
+
+        if ((*it)->flags() & VideoFilter::FlagInPlace) {
+            if (!(*it)->processInPlace(output))
+                return {};
+        } else {
+            output = (*it)->process(output);
+        }
+
+        if (timings)
+            addTiming(*it);
+    }
+
+    return output;
+}
+
+std::vector<AkVCam::VideoFilterPtr> AkVCam::FilterGraphPrivate::buildPlan(const VideoFormat &input,
+                                                                           bool *ok) const
+{
+    auto plan = this->m_filters;
+    removeIdentities(plan, input);
+    moveDownscalers(plan, input);
+    fuse(plan);
+    removeIdentities(plan, input);
+    auto format = input;
+    *ok = true;
+
+    for (auto &filter: plan) {
+        if (!filter->canProcess(format)) {
+            *ok = false;
+
+            break;
+        }
+
+        format = filter->outputFormat(format);
+    }
+
+    return plan;
+}
+
+void AkVCam::FilterGraphPrivate::removeIdentities(std::vector<VideoFilterPtr> &filters,
+                                                  const VideoFormat &input)
+{
+    std::vector<VideoFilterPtr> result;
+    auto format = input;
+
+    for (auto &filter: filters) {
+        if (!filter->isIdentity(format))
+            result.push_back(filter);
+
+        format = filter->outputFormat(format);
+    }
+
+    filters = result;
+}
+
+void AkVCam::FilterGraphPrivate::moveDownscalers(std::vector<VideoFilterPtr> &filters,
+                                                 const VideoFormat &input)
+{
+    auto format = input;
+
+    for (size_t i = 0; i < filters.size(); i++) {
+        auto filter = filters[i];
+        auto scale = dynamic_cast<ScaleFilter *>(filter.get());
+
+        if (scale
+            && scale->width() * scale->height() < format.width() * format.height()) {
+            /* Scale invariant stages keep the format, so the scaler can be
+             * moved ahead of them without changing its input.
+             */
+            auto j = i;
+
+            while (j > 0
+                   && filters[j - 1]->flags() & VideoFilter::FlagScaleInvariant)
+                j--;
+
+            std::rotate(filters.begin() + long(j),
+                        filters.begin() + long(i),
+                        filters.begin() + long(i + 1));
+        }
+
+        format = filter->outputFormat(format);
+    }
+}
+
+void AkVCam::FilterGraphPrivate::fuse(std::vector<VideoFilterPtr> &filters)
+{
+    for (size_t i = 0; i + 1 < filters.size();) {
+        auto fused = filters[i]->fuse(*filters[i + 1]);
+
+        if (fused) {
+            filters[i] = fused;
+            filters.erase(filters.begin() + long(i + 1));
+        } else {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,242 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef FILTERGRAPH_H
+#define FILTERGRAPH_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "videoformattypes.h"
+#include "videoframetypes.h"
+#include "../perfcounters.h"
+
+namespace AkVCam
+{
+    class FilterGraphPrivate;
+    class VideoFilter;
+    class VideoFormat;
+    class VideoFrame;
+    using VideoFilterPtr = std::shared_ptr<VideoFilter>;
+
+    // Time spent by a stage of a FilterGraph, in nanoseconds, the size of
+    // its input frame and its hardware counters.
+    struct FilterTiming
+    {
+        std::string name;
+        uint64_t time;
+        uint64_t bytes;
+        PerfCounts counts;
+    };
+
+    using FilterTimings = std::vector<FilterTiming>;
+
+    // A processing stage of a FilterGraph.
+    class VideoFilter
+    {
+        public:
+            enum Flag
+            {
+                FlagNone = 0x0,
+                // processInPlace() is implemented.
+                FlagInPlace = 0x1,
+                // The result is the same if the frame is scaled before or
+                // after this stage.
+                FlagScaleInvariant = 0x2
+            };
+
+            virtual ~VideoFilter() = default;
+
+            virtual std::string name() const = 0;
+            virtual int flags() const;
+            virtual bool canProcess(const VideoFormat &input) const;
+            virtual VideoFormat outputFormat(const VideoFormat &input) const;
+            virtual bool isIdentity(const VideoFormat &input) const;
+
+            /* Returns a single stage doing the work of this stage followed by
+             * next, or nullptr if they can't be merged.
+             */
+            virtual VideoFilterPtr fuse(const VideoFilter &next) const;
+            virtual VideoFrame process(const VideoFrame &frame) const = 0;
+            virtual bool processInPlace(VideoFrame &frame) const;
+    };
+
+    class MirrorFilter: public VideoFilter
+    {
+        public:
+            MirrorFilter(bool horizontalMirror, bool verticalMirror);
+
+            std::string name() const override;
+            int flags() const override;
+            bool canProcess(const VideoFormat &input) const override;
+            bool isIdentity(const VideoFormat &input) const override;
+            VideoFilterPtr fuse(const VideoFilter &next) const override;
+            VideoFrame process(const VideoFrame &frame) const override;
+            bool processInPlace(VideoFrame &frame) const override;
+
+        private:
+            bool m_horizontalMirror;
+            bool m_verticalMirror;
+    };
+
+    class SwapRgbFilter: public VideoFilter
+    {
+        public:
+            SwapRgbFilter(bool swap=true);
+
+            std::string name() const override;
+            int flags() const override;
+            bool canProcess(const VideoFormat &input) const override;
+            bool isIdentity(const VideoFormat &input) const override;
+            VideoFilterPtr fuse(const VideoFilter &next) const override;
+            VideoFrame process(const VideoFrame &frame) const override;
+            bool processInPlace(VideoFrame &frame) const override;
+
+        private:
+            bool m_swap;
+    };
+
+    class AdjustFilter: public VideoFilter
+    {
+        public:
+            AdjustFilter(int hue,
+                         int saturation,
+                         int luminance,
+                         int gamma,
+                         int contrast,
+                         bool gray);
+
+            std::string name() const override;
+            int flags() const override;
+            bool canProcess(const VideoFormat &input) const override;
+            bool isIdentity(const VideoFormat &input) const override;
+            VideoFrame process(const VideoFrame &frame) const override;
+            bool processInPlace(VideoFrame &frame) const override;
+
+        private:
+            int m_hue;
+            int m_saturation;
+            int m_luminance;
+            int m_gamma;
+            int m_contrast;
+            bool m_gray;
+    };
+
+    class ScaleFilter: public VideoFilter
+    {
+        public:
+            ScaleFilter(int width,
+                        int height,
+                        Scaling scaling=ScalingFast,
+                        AspectRatio aspectRatio=AspectRatioIgnore);
+
+            std::string name() const override;
+            bool canProcess(const VideoFormat &input) const override;
+            VideoFormat outputFormat(const VideoFormat &input) const override;
+            bool isIdentity(const VideoFormat &input) const override;
+            VideoFilterPtr fuse(const VideoFilter &next) const override;
+            VideoFrame process(const VideoFrame &frame) const override;
+
+            int width() const;
+            int height() const;
+
+        private:
+            int m_width;
+            int m_height;
+            Scaling m_scaling;
+            AspectRatio m_aspectRatio;
+    };
+
+    class ConvertFilter: public VideoFilter
+    {
+        public:
+            ConvertFilter(FourCC fourcc);
+
+            std::string name() const override;
+            bool canProcess(const VideoFormat &input) const override;
+            VideoFormat outputFormat(const VideoFormat &input) const override;
+            bool isIdentity(const VideoFormat &input) const override;
+            VideoFrame process(const VideoFrame &frame) const override;
+
+            FourCC fourcc() const;
+
+        private:
+            FourCC m_fourcc;
+    };
+
+    // Scales and converts in a single pass.
+    class ScaleConvertFilter: public VideoFilter
+    {
+        public:
+            ScaleConvertFilter(int width,
+                               int height,
+                               FourCC fourcc,
+                               Scaling scaling=ScalingFast,
+                               AspectRatio aspectRatio=AspectRatioIgnore);
+
+            std::string name() const override;
+            bool canProcess(const VideoFormat &input) const override;
+            VideoFormat outputFormat(const VideoFormat &input) const override;
+            bool isIdentity(const VideoFormat &input) const override;
+            VideoFrame process(const VideoFrame &frame) const override;
+
+        private:
+            int m_width;
+            int m_height;
+            FourCC m_fourcc;
+            Scaling m_scaling;
+            AspectRatio m_aspectRatio;
+    };
+
+    /* A chain of filters.
+     *
+     * Before running, the chain is planned for the input format: stages
+     * that do nothing are dropped, scalers that shrink the frame are moved
+     * ahead of the scale invariant stages so those work on less pixels,
+     * adjacent stages are fused when possible, and every stage after the
+     * first one that allocates a frame runs in place when it can.
+     */
+    class FilterGraph
+    {
+        public:
+            FilterGraph();
+            FilterGraph(const FilterGraph &other);
+            ~FilterGraph();
+            FilterGraph &operator =(const FilterGraph &other);
+
+            void append(const VideoFilterPtr &filter);
+            void clear();
+            const std::vector<VideoFilterPtr> &filters() const;
+            std::string plan(const VideoFormat &input) const;
+
+            // If timings is not null, it receives the time spent by each
+            // stage of the plan, and their hardware counts if counters is
+            // also given.
+            VideoFrame process(const VideoFrame &frame,
+                               FilterTimings *timings=nullptr,
+                               const PerfCounters *counters=nullptr) const;
+
+        private:
+            FilterGraphPrivate *d;
+    };
+}
+
+#endif // FILTERGRAPH_H
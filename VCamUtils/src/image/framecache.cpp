@@ -0,0 +1,149 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <future>
+#include <map>
+#include <mutex>
+
+#include "framecache.h"
+#include "videoframe.h"
+#include "../profiledmutex.h"
+#include "../stats.h"
+#include "../utils.h"
+
+namespace AkVCam
+{
+    struct DeviceFrames
+    {
+        uint64_t sequence {0};
+        std::map<std::string, std::shared_future<VideoFramePtr>> frames;
+    };
+
+    class FrameCachePrivate
+    {
+        public:
+            std::map<std::string, DeviceFrames> m_devices;
+            ProfiledMutex m_mutex {"frame_cache"};
+    };
+
+    GLOBAL_STATIC(FrameCache, globalFrameCache)
+}
+
+AkVCam::FrameCache::FrameCache()
+{
+    this->d = new FrameCachePrivate;
+}
+
+AkVCam::FrameCache::~FrameCache()
+{
+    delete this->d;
+}
+
+AkVCam::VideoFramePtr AkVCam::FrameCache::frame(const std::string &deviceId,
+                                                uint64_t sequence,
+                                                const std::string &key,
+                                                const FrameAdaptFunc &adapt)
+{
+    return this->frame(deviceId,
+                       sequence,
+                       key,
+                       {},
+                       [&adapt] (const std::vector<std::string> &keys) {
+        UNUSED(keys);
+
+        return std::vector<VideoFramePtr> {adapt()};
+    });
+}
+
+AkVCam::VideoFramePtr AkVCam::FrameCache::frame(const std::string &deviceId,
+                                                uint64_t sequence,
+                                                const std::string &key,
+                                                const std::vector<std::string> &otherKeys,
+                                                const FrameBatchAdaptFunc &adapt)
+{
+    static auto &cacheHits = Stats::counter("frame_cache_hits");
+    static auto &cacheMisses = Stats::counter("frame_cache_misses");
+    static auto &batchedFrames = Stats::counter("frame_cache_batched");
+
+    this->d->m_mutex.lock();
+    auto &device = this->d->m_devices[deviceId];
+
+    // A new frame arrived, the previous results are of no use anymore.
+    if (device.sequence != sequence) {
+        device.sequence = sequence;
+        device.frames.clear();
+    }
+
+    auto it = device.frames.find(key);
+
+    if (it != device.frames.end()) {
+        auto future = it->second;
+        this->d->m_mutex.unlock();
+        cacheHits++;
+
+        return future.get();
+    }
+
+    // Reserve all the missing keys, the streams asking for them will wait.
+    std::vector<std::string> keys {key};
+
+    for (auto &otherKey: otherKeys)
+        if (!device.frames.count(otherKey)
+            && std::find(keys.begin(), keys.end(), otherKey) == keys.end())
+            keys.push_back(otherKey);
+
+    std::vector<std::promise<VideoFramePtr>> promises(keys.size());
+
+    for (size_t i = 0; i < keys.size(); i++)
+        device.frames[keys[i]] = promises[i].get_future().share();
+
+    this->d->m_mutex.unlock();
+    cacheMisses++;
+    batchedFrames += keys.size() - 1;
+
+    auto frames = adapt(keys);
+    frames.resize(keys.size());
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (!frames[i])
+            frames[i] = std::make_shared<const VideoFrame>();
+
+        promises[i].set_value(frames[i]);
+    }
+
+    return frames.front();
+}
+
+void AkVCam::FrameCache::remove(const std::string &deviceId)
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    this->d->m_devices.erase(deviceId);
+}
+
+void AkVCam::FrameCache::clear()
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    this->d->m_devices.clear();
+}
+
+AkVCam::FrameCache *AkVCam::FrameCache::global()
+{
+    return globalFrameCache();
+}
@@ -0,0 +1,76 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "videoframetypes.h"
+
+namespace AkVCam
+{
+    class FrameCachePrivate;
+    using FrameAdaptFunc = std::function<VideoFramePtr ()>;
+
+    // Adapts the frame for each key, the results are in the same order.
+    using FrameBatchAdaptFunc =
+        std::function<std::vector<VideoFramePtr> (const std::vector<std::string> &keys)>;
+
+    class FrameCache
+    {
+        public:
+            FrameCache();
+            FrameCache(const FrameCache &other) = delete;
+            ~FrameCache();
+
+            /* Returns the adapted version of the frame with the given
+             * sequence number. adapt is called only by the first stream
+             * asking for a given key, the others share its result. It may
+             * return the received frame itself when it needs no changes.
+             */
+            VideoFramePtr frame(const std::string &deviceId,
+                                uint64_t sequence,
+                                const std::string &key,
+                                const FrameAdaptFunc &adapt);
+
+            /* Like frame(), but the frame is also adapted for the other keys
+             * not yet asked for with this sequence, in a single call to
+             * adapt, so that several outputs can be made in one pass.
+             */
+            VideoFramePtr frame(const std::string &deviceId,
+                                uint64_t sequence,
+                                const std::string &key,
+                                const std::vector<std::string> &otherKeys,
+                                const FrameBatchAdaptFunc &adapt);
+            void remove(const std::string &deviceId);
+            void clear();
+
+            // Cache shared by all streams in the process.
+            static FrameCache *global();
+
+        private:
+            FrameCachePrivate *d;
+    };
+}
+
+#endif // FRAMECACHE_H
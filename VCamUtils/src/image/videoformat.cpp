@@ -260,6 +260,39 @@ size_t AkVCam::VideoFormat::planeSize(size_t plane) const
     return size_t(this->d->m_height) * this->bypl(plane);
 }
 
+bool AkVCam::VideoFormat::lineRange(size_t plane,
+                                    int firstLine,
+                                    int lines,
+                                    size_t *offset,
+                                    size_t *size) const
+{
+    auto bypl = this->bypl(plane);
+
+    if (plane >= this->planes()
+        || bypl < 1
+        || firstLine < 0
+        || lines < 0
+        || firstLine + lines > this->d->m_height)
+        return false;
+
+    // Subsampled planes have less lines than the frame.
+    auto planeEnd = plane + 1 < this->planes()?
+                        this->offset(plane + 1):
+                        this->size();
+    auto planeLines = (planeEnd - this->offset(plane)) / bypl;
+    auto height = size_t(this->d->m_height);
+    auto first = size_t(firstLine) * planeLines / height;
+    auto last = size_t(firstLine + lines) * planeLines / height;
+
+    if (offset)
+        *offset = this->offset(plane) + first * bypl;
+
+    if (size)
+        *size = (last - first) * bypl;
+
+    return true;
+}
+
 bool AkVCam::VideoFormat::isValid() const
 {
     if (this->size() <= 0)
@@ -409,7 +442,7 @@ size_t AkVCam::VideoFormatGlobals::offsetNV(size_t plane, size_t width, size_t h
     size_t offset[] = {
         0,
         align32(size_t(width)) * height,
-        5 * align32(size_t(width)) * height / 4
+        3 * align32(size_t(width)) * height / 2
     };
 
     return offset[plane];
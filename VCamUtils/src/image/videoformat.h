@@ -61,6 +61,13 @@ namespace AkVCam
             size_t planes() const;
             size_t offset(size_t plane) const;
             size_t planeSize(size_t plane) const;
+
+            // Byte range of the given lines of the frame inside a plane.
+            bool lineRange(size_t plane,
+                           int firstLine,
+                           int lines,
+                           size_t *offset,
+                           size_t *size) const;
             bool isValid() const;
             void clear();
             VideoFormat nearest(const std::vector<VideoFormat> &formats) const;
@@ -24,6 +24,7 @@
 
 #include "videoframe.h"
 #include "videoformat.h"
+#include "../memoryaccounting.h"
 #include "../utils.h"
 
 namespace AkVCam
@@ -131,6 +132,7 @@ namespace AkVCam
             VideoFrame *self;
             VideoFormat m_format;
             VideoData m_data;
+            size_t m_accounted {0};
             std::vector<VideoConvert> m_convert;
             std::vector<PixelFormat> m_adjustFormats;
 
@@ -181,6 +183,24 @@ namespace AkVCam
                 return (value % mod + mod) % mod;
             }
 
+            // Reports the changes in the size of the buffer.
+            inline void account();
+            bool canAdjust() const;
+            void swapRgb(VideoFrame &dst);
+            void adjustHsl(VideoFrame &dst,
+                           int hue,
+                           int saturation,
+                           int luminance);
+            void adjustGamma(VideoFrame &dst, int gamma);
+            void adjustContrast(VideoFrame &dst, int contrast);
+            void toGrayScale(VideoFrame &dst);
+            void adjust(VideoFrame &dst,
+                        int hue,
+                        int saturation,
+                        int luminance,
+                        int gamma,
+                        int contrast,
+                        bool gray);
             inline int grayval(int r, int g, int b);
 
             // YUV utility functions
@@ -229,6 +249,32 @@ namespace AkVCam
             static VideoFrame rgb24_to_nv12(const VideoFrame *src);
             static VideoFrame rgb24_to_nv21(const VideoFrame *src);
 
+            // Single pass scaling and conversion
+            inline static std::vector<int> scaleMap(int srcSize, int dstSize);
+            template<typename S, typename D>
+            inline static void convertLine(const S *src,
+                                           const int *xMap,
+                                           D *dst,
+                                           int width,
+                                           int rs, int gs, int bs);
+            template<typename S, typename D>
+            inline static void convertLineYuv(const S *src,
+                                              const int *xMap,
+                                              D *dst,
+                                              int width);
+            template<typename S, typename D>
+            inline static void convertLineNv(const S *src,
+                                             const int *xMap,
+                                             uint8_t *dstY,
+                                             D *dstUV,
+                                             int width,
+                                             bool writeUV);
+            template<typename S>
+            static bool convertLine(const S *src,
+                                    const int *xMap,
+                                    VideoFrame &dst,
+                                    int y);
+
             inline static void extrapolateUp(int dstCoord,
                                              int num, int den, int s,
                                              int *srcCoordMin, int *srcCoordMax,
@@ -267,6 +313,32 @@ namespace AkVCam
         return &contrastTable;
     }
 
+    template<typename T>
+    inline void fillX(T &pixel)
+    {
+        UNUSED(pixel);
+    }
+
+    inline void fillX(RGB32 &pixel)
+    {
+        pixel.x = 255;
+    }
+
+    inline void fillX(BGR32 &pixel)
+    {
+        pixel.x = 255;
+    }
+
+    inline void fillX(RGB15 &pixel)
+    {
+        pixel.x = 1;
+    }
+
+    inline void fillX(BGR15 &pixel)
+    {
+        pixel.x = 1;
+    }
+
     struct BmpHeader
     {
         uint32_t size;
@@ -307,8 +379,10 @@ AkVCam::VideoFrame::VideoFrame(const AkVCam::VideoFormat &format)
     this->d = new VideoFramePrivate(this);
     this->d->m_format = format;
 
-    if (format.size() > 0)
+    if (format.size() > 0) {
         this->d->m_data.resize(format.size());
+        this->d->account();
+    }
 }
 
 AkVCam::VideoFrame::VideoFrame(const AkVCam::VideoFrame &other)
@@ -316,6 +390,15 @@ AkVCam::VideoFrame::VideoFrame(const AkVCam::VideoFrame &other)
     this->d = new VideoFramePrivate(this);
     this->d->m_format = other.d->m_format;
     this->d->m_data = other.d->m_data;
+    this->d->account();
+}
+
+AkVCam::VideoFrame::VideoFrame(AkVCam::VideoFrame &&other) noexcept
+{
+    this->d = new VideoFramePrivate(this);
+    this->d->m_format = other.d->m_format;
+    std::swap(this->d->m_data, other.d->m_data);
+    std::swap(this->d->m_accounted, other.d->m_accounted);
 }
 
 AkVCam::VideoFrame &AkVCam::VideoFrame::operator =(const AkVCam::VideoFrame &other)
@@ -323,6 +406,18 @@ AkVCam::VideoFrame &AkVCam::VideoFrame::operator =(const AkVCam::VideoFrame &oth
     if (this != &other) {
         this->d->m_format = other.d->m_format;
         this->d->m_data = other.d->m_data;
+        this->d->account();
+    }
+
+    return *this;
+}
+
+AkVCam::VideoFrame &AkVCam::VideoFrame::operator =(AkVCam::VideoFrame &&other) noexcept
+{
+    if (this != &other) {
+        this->d->m_format = other.d->m_format;
+        std::swap(this->d->m_data, other.d->m_data);
+        std::swap(this->d->m_accounted, other.d->m_accounted);
     }
 
     return *this;
@@ -330,6 +425,7 @@ AkVCam::VideoFrame &AkVCam::VideoFrame::operator =(const AkVCam::VideoFrame &oth
 
 AkVCam::VideoFrame::~VideoFrame()
 {
+    MemoryAccounting::released(MemoryCategoryFrames, this->d->m_accounted);
     delete this->d;
 }
 
@@ -365,6 +461,7 @@ bool AkVCam::VideoFrame::load(const std::string &fileName)
     stream.seekg(header.offBits, std::ios_base::beg);
     this->d->m_format = format;
     this->d->m_data.resize(format.size());
+    this->d->account();
 
     VideoData data(imageHeader.sizeImage);
     stream.read(reinterpret_cast<char *>(data.data()),
@@ -423,6 +520,71 @@ bool AkVCam::VideoFrame::load(const std::string &fileName)
     return true;
 }
 
+bool AkVCam::VideoFrame::save(const std::string &fileName) const
+{
+    if (fileName.empty() || this->d->m_format.size() < 1)
+        return false;
+
+    auto frame = this;
+    VideoFrame converted;
+
+    if (this->d->m_format.fourcc() != PixelFormatRGB24) {
+        converted = this->convert(PixelFormatRGB24);
+
+        if (converted.format().size() < 1)
+            return false;
+
+        frame = &converted;
+    }
+
+    std::ofstream stream(fileName, std::ios::binary);
+
+    if (!stream.is_open())
+        return false;
+
+    auto width = frame->d->m_format.width();
+    auto height = frame->d->m_format.height();
+    VideoFormat bmpFormat(PixelFormatBGR24, width, height);
+    auto lineSize = bmpFormat.bypl(0);
+
+    BmpHeader header {};
+    header.offBits = 2 + sizeof(BmpHeader) + sizeof(BmpImageHeader);
+    header.size = uint32_t(header.offBits + lineSize * size_t(height));
+
+    BmpImageHeader imageHeader {};
+    imageHeader.size = sizeof(BmpImageHeader);
+    imageHeader.width = uint32_t(width);
+    imageHeader.height = uint32_t(height);
+    imageHeader.planes = 1;
+    imageHeader.bitCount = 24;
+    imageHeader.sizeImage = uint32_t(lineSize * size_t(height));
+
+    stream.write("BM", 2);
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(BmpHeader));
+    stream.write(reinterpret_cast<const char *>(&imageHeader),
+                 sizeof(BmpImageHeader));
+
+    // BMP lines are stored bottom up.
+    VideoData line(lineSize);
+
+    for (int y = 0; y < height; y++) {
+        auto srcLine = reinterpret_cast<const RGB24 *>
+                       (frame->line(0, size_t(height - y - 1)));
+        auto dstLine = reinterpret_cast<BGR24 *>(line.data());
+
+        for (int x = 0; x < width; x++) {
+            dstLine[x].r = srcLine[x].r;
+            dstLine[x].g = srcLine[x].g;
+            dstLine[x].b = srcLine[x].b;
+        }
+
+        stream.write(reinterpret_cast<const char *>(line.data()),
+                     std::streamsize(lineSize));
+    }
+
+    return bool(stream);
+}
+
 AkVCam::VideoFormat AkVCam::VideoFrame::format() const
 {
     return this->d->m_format;
@@ -433,7 +595,7 @@ AkVCam::VideoFormat &AkVCam::VideoFrame::format()
     return this->d->m_format;
 }
 
-AkVCam::VideoData AkVCam::VideoFrame::data() const
+const AkVCam::VideoData &AkVCam::VideoFrame::data() const
 {
     return this->d->m_data;
 }
@@ -456,17 +618,71 @@ void AkVCam::VideoFrame::clear()
     this->d->m_data.clear();
 }
 
+AkVCam::VideoFrame AkVCam::VideoFrame::band(int firstLine, int lines) const
+{
+    auto &format = this->d->m_format;
+
+    if (lines < 1 || firstLine < 0 || firstLine + lines > format.height())
+        return {};
+
+    VideoFrame band(VideoFormat(format.fourcc(), format.width(), lines));
+
+    for (size_t plane = 0; plane < format.planes(); plane++) {
+        size_t srcOffset = 0;
+        size_t srcSize = 0;
+        size_t dstOffset = 0;
+        size_t dstSize = 0;
+
+        if (!format.lineRange(plane, firstLine, lines, &srcOffset, &srcSize)
+            || !band.d->m_format.lineRange(plane, 0, lines, &dstOffset, &dstSize))
+            return {};
+
+        memcpy(band.d->m_data.data() + dstOffset,
+               this->d->m_data.data() + srcOffset,
+               std::min(srcSize, dstSize));
+    }
+
+    return band;
+}
+
+bool AkVCam::VideoFrame::setBand(int firstLine, const VideoFrame &band)
+{
+    auto &format = this->d->m_format;
+    auto &bandFormat = band.d->m_format;
+    auto lines = bandFormat.height();
+
+    if (bandFormat.fourcc() != format.fourcc()
+        || bandFormat.width() != format.width()
+        || lines < 1
+        || firstLine < 0
+        || firstLine + lines > format.height())
+        return false;
+
+    for (size_t plane = 0; plane < format.planes(); plane++) {
+        size_t srcOffset = 0;
+        size_t srcSize = 0;
+        size_t dstOffset = 0;
+        size_t dstSize = 0;
+
+        if (!bandFormat.lineRange(plane, 0, lines, &srcOffset, &srcSize)
+            || !format.lineRange(plane, firstLine, lines, &dstOffset, &dstSize))
+            return false;
+
+        memcpy(this->d->m_data.data() + dstOffset,
+               band.d->m_data.data() + srcOffset,
+               std::min(srcSize, dstSize));
+    }
+
+    return true;
+}
+
 AkVCam::VideoFrame AkVCam::VideoFrame::mirror(bool horizontalMirror,
-                                              bool verticalMirror) const
+                                              bool verticalMirror) const &
 {
     if (!horizontalMirror && !verticalMirror)
         return *this;
 
-    auto it = std::find(this->d->m_adjustFormats.begin(),
-                        this->d->m_adjustFormats.end(),
-                        this->d->m_format.fourcc());
-
-    if (it == this->d->m_adjustFormats.end())
+    if (!this->d->canAdjust())
         return {};
 
     VideoFrame dst(this->d->m_format);
@@ -500,6 +716,58 @@ AkVCam::VideoFrame AkVCam::VideoFrame::mirror(bool horizontalMirror,
     return dst;
 }
 
+AkVCam::VideoFrame AkVCam::VideoFrame::mirror(bool horizontalMirror,
+                                              bool verticalMirror) &&
+{
+    if (!this->mirrorInPlace(horizontalMirror, verticalMirror))
+        return {};
+
+    return std::move(*this);
+}
+
+bool AkVCam::VideoFrame::mirrorInPlace(bool horizontalMirror,
+                                       bool verticalMirror)
+{
+    if (!horizontalMirror && !verticalMirror)
+        return true;
+
+    if (!this->d->canAdjust())
+        return false;
+
+    int width = this->d->m_format.width();
+    int height = this->d->m_format.height();
+
+    if (horizontalMirror && verticalMirror) {
+        for (int y = 0; y < height / 2; y++) {
+            auto topLine = reinterpret_cast<RGB24 *>(this->line(0, size_t(y)));
+            auto bottomLine = reinterpret_cast<RGB24 *>(this->line(0, size_t(height - y - 1)));
+
+            for (int x = 0; x < width; x++)
+                std::swap(topLine[x], bottomLine[width - x - 1]);
+        }
+
+        if (height & 1) {
+            auto line = reinterpret_cast<RGB24 *>(this->line(0, size_t(height / 2)));
+            std::reverse(line, line + width);
+        }
+    } else if (horizontalMirror) {
+        for (int y = 0; y < height; y++) {
+            auto line = reinterpret_cast<RGB24 *>(this->line(0, size_t(y)));
+            std::reverse(line, line + width);
+        }
+    } else if (verticalMirror) {
+        auto lineSize = this->d->m_format.bypl(0);
+
+        for (int y = 0; y < height / 2; y++) {
+            auto topLine = this->line(0, size_t(y));
+            auto bottomLine = this->line(0, size_t(height - y - 1));
+            std::swap_ranges(topLine, topLine + lineSize, bottomLine);
+        }
+    }
+
+    return true;
+}
+
 AkVCam::VideoFrame AkVCam::VideoFrame::scaled(int width,
                                               int height,
                                               Scaling mode,
@@ -659,7 +927,7 @@ AkVCam::VideoFrame AkVCam::VideoFrame::scaled(size_t maxArea,
     return this->scaled(owidth, oheight, mode);
 }
 
-AkVCam::VideoFrame AkVCam::VideoFrame::swapRgb(bool swap) const
+AkVCam::VideoFrame AkVCam::VideoFrame::swapRgb(bool swap) const &
 {
     if (swap)
         return this->swapRgb();
@@ -667,29 +935,41 @@ AkVCam::VideoFrame AkVCam::VideoFrame::swapRgb(bool swap) const
     return *this;
 }
 
-AkVCam::VideoFrame AkVCam::VideoFrame::swapRgb() const
+AkVCam::VideoFrame AkVCam::VideoFrame::swapRgb(bool swap) &&
 {
-    auto it = std::find(this->d->m_adjustFormats.begin(),
-                        this->d->m_adjustFormats.end(),
-                        this->d->m_format.fourcc());
+    if (swap)
+        return std::move(*this).swapRgb();
 
-    if (it == this->d->m_adjustFormats.end())
+    return std::move(*this);
+}
+
+AkVCam::VideoFrame AkVCam::VideoFrame::swapRgb() const &
+{
+    if (!this->d->canAdjust())
         return {};
 
     VideoFrame dst(this->d->m_format);
+    this->d->swapRgb(dst);
 
-    for (int y = 0; y < this->d->m_format.height(); y++) {
-        auto srcLine = reinterpret_cast<RGB24 *>(this->line(0, size_t(y)));
-        auto destLine = reinterpret_cast<RGB24 *>(dst.line(0, size_t(y)));
+    return dst;
+}
 
-        for (int x = 0; x < this->d->m_format.width(); x++) {
-            destLine[x].r = srcLine[x].b;
-            destLine[x].g = srcLine[x].g;
-            destLine[x].b = srcLine[x].r;
-        }
-    }
+AkVCam::VideoFrame AkVCam::VideoFrame::swapRgb() &&
+{
+    if (!this->swapRgbInPlace())
+        return {};
 
-    return dst;
+    return std::move(*this);
+}
+
+bool AkVCam::VideoFrame::swapRgbInPlace()
+{
+    if (!this->d->canAdjust())
+        return false;
+
+    this->d->swapRgb(*this);
+
+    return true;
 }
 
 bool AkVCam::VideoFrame::canConvert(FourCC input, FourCC output) const
@@ -727,165 +1007,422 @@ AkVCam::VideoFrame AkVCam::VideoFrame::convert(AkVCam::FourCC fourcc) const
     return converter->convert(this);
 }
 
+AkVCam::VideoFrame AkVCam::VideoFrame::convert(const VideoFormat &format,
+                                               Scaling mode,
+                                               AspectRatio aspectRatio) const
+{
+    auto frames = this->convert(std::vector<VideoFormat> {format},
+                                mode,
+                                aspectRatio);
+
+    return frames.front();
+}
+
+std::vector<AkVCam::VideoFrame> AkVCam::VideoFrame::convert(const std::vector<VideoFormat> &formats,
+                                                            Scaling mode,
+                                                            AspectRatio aspectRatio) const
+{
+    std::vector<VideoFrame> frames;
+    auto fourcc = this->d->m_format.fourcc();
+    auto it = std::find(this->d->m_adjustFormats.begin(),
+                        this->d->m_adjustFormats.end(),
+                        fourcc);
+    bool singlePass = it != this->d->m_adjustFormats.end()
+                      && mode == ScalingFast
+                      && aspectRatio == AspectRatioIgnore;
+
+    for (auto &format: formats)
+        if (!this->canConvert(fourcc, format.fourcc()))
+            singlePass = false;
+
+    if (!singlePass) {
+        for (auto &format: formats)
+            frames.push_back(this->scaled(format.width(),
+                                          format.height(),
+                                          mode,
+                                          aspectRatio)
+                             .convert(format.fourcc()));
+
+        return frames;
+    }
+
+    std::vector<std::vector<int>> xMaps;
+    std::vector<std::vector<int>> yMaps;
+
+    for (auto &format: formats) {
+        frames.emplace_back(format);
+        xMaps.push_back(VideoFramePrivate::scaleMap(this->d->m_format.width(),
+                                                    format.width()));
+        yMaps.push_back(VideoFramePrivate::scaleMap(this->d->m_format.height(),
+                                                    format.height()));
+    }
+
+    /* Read every source line once, and write all the output lines that
+     * sample it while it's still in cache.
+     */
+    std::vector<size_t> dstY(formats.size(), 0);
+
+    for (int y = 0; y < this->d->m_format.height(); y++) {
+        auto srcLine = this->line(0, size_t(y));
+
+        for (size_t i = 0; i < frames.size(); i++) {
+            auto &yMap = yMaps[i];
+
+            for (; dstY[i] < yMap.size() && yMap[dstY[i]] == y; dstY[i]++)
+                if (fourcc == PixelFormatRGB24)
+                    VideoFramePrivate::convertLine(reinterpret_cast<const RGB24 *>(srcLine),
+                                                   xMaps[i].data(),
+                                                   frames[i],
+                                                   int(dstY[i]));
+                else
+                    VideoFramePrivate::convertLine(reinterpret_cast<const BGR24 *>(srcLine),
+                                                   xMaps[i].data(),
+                                                   frames[i],
+                                                   int(dstY[i]));
+        }
+    }
+
+    return frames;
+}
+
 AkVCam::VideoFrame AkVCam::VideoFrame::adjustHsl(int hue,
                                                  int saturation,
-                                                 int luminance)
+                                                 int luminance) const &
 {
     if (hue == 0 && saturation == 0 && luminance == 0)
         return *this;
 
-    auto it = std::find(this->d->m_adjustFormats.begin(),
-                        this->d->m_adjustFormats.end(),
-                        this->d->m_format.fourcc());
+    if (!this->d->canAdjust())
+        return {};
 
-    if (it == this->d->m_adjustFormats.end())
+    VideoFrame dst(this->d->m_format);
+    this->d->adjustHsl(dst, hue, saturation, luminance);
+
+    return dst;
+}
+
+AkVCam::VideoFrame AkVCam::VideoFrame::adjustHsl(int hue,
+                                                 int saturation,
+                                                 int luminance) &&
+{
+    if (!this->adjustHslInPlace(hue, saturation, luminance))
+        return {};
+
+    return std::move(*this);
+}
+
+bool AkVCam::VideoFrame::adjustHslInPlace(int hue,
+                                          int saturation,
+                                          int luminance)
+{
+    if (hue == 0 && saturation == 0 && luminance == 0)
+        return true;
+
+    if (!this->d->canAdjust())
+        return false;
+
+    this->d->adjustHsl(*this, hue, saturation, luminance);
+
+    return true;
+}
+
+AkVCam::VideoFrame AkVCam::VideoFrame::adjustGamma(int gamma) const &
+{
+    if (gamma == 0)
+        return *this;
+
+    if (!this->d->canAdjust())
         return {};
 
     VideoFrame dst(this->d->m_format);
+    this->d->adjustGamma(dst, gamma);
 
-    for (int y = 0; y < this->d->m_format.height(); y++) {
-        auto srcLine = reinterpret_cast<RGB24 *>(this->line(0, size_t(y)));
+    return dst;
+}
+
+AkVCam::VideoFrame AkVCam::VideoFrame::adjustGamma(int gamma) &&
+{
+    if (!this->adjustGammaInPlace(gamma))
+        return {};
+
+    return std::move(*this);
+}
+
+bool AkVCam::VideoFrame::adjustGammaInPlace(int gamma)
+{
+    if (gamma == 0)
+        return true;
+
+    if (!this->d->canAdjust())
+        return false;
+
+    this->d->adjustGamma(*this, gamma);
+
+    return true;
+}
+
+AkVCam::VideoFrame AkVCam::VideoFrame::adjustContrast(int contrast) const &
+{
+    if (contrast == 0)
+        return *this;
+
+    if (!this->d->canAdjust())
+        return {};
+
+    VideoFrame dst(this->d->m_format);
+    this->d->adjustContrast(dst, contrast);
+
+    return dst;
+}
+
+AkVCam::VideoFrame AkVCam::VideoFrame::adjustContrast(int contrast) &&
+{
+    if (!this->adjustContrastInPlace(contrast))
+        return {};
+
+    return std::move(*this);
+}
+
+bool AkVCam::VideoFrame::adjustContrastInPlace(int contrast)
+{
+    if (contrast == 0)
+        return true;
+
+    if (!this->d->canAdjust())
+        return false;
+
+    this->d->adjustContrast(*this, contrast);
+
+    return true;
+}
+
+AkVCam::VideoFrame AkVCam::VideoFrame::toGrayScale() const &
+{
+    if (!this->d->canAdjust())
+        return {};
+
+    VideoFrame dst(this->d->m_format);
+    this->d->toGrayScale(dst);
+
+    return dst;
+}
+
+AkVCam::VideoFrame AkVCam::VideoFrame::toGrayScale() &&
+{
+    if (!this->toGrayScaleInPlace())
+        return {};
+
+    return std::move(*this);
+}
+
+bool AkVCam::VideoFrame::toGrayScaleInPlace()
+{
+    if (!this->d->canAdjust())
+        return false;
+
+    this->d->toGrayScale(*this);
+
+    return true;
+}
+
+AkVCam::VideoFrame AkVCam::VideoFrame::adjust(int hue,
+                                              int saturation,
+                                              int luminance,
+                                              int gamma,
+                                              int contrast,
+                                              bool gray) const &
+{
+    if (hue == 0
+        && saturation == 0
+        && luminance == 0
+        && gamma == 0
+        && contrast == 0
+        && !gray)
+        return *this;
+
+    if (!this->d->canAdjust())
+        return {};
+
+    VideoFrame dst(this->d->m_format);
+    this->d->adjust(dst, hue, saturation, luminance, gamma, contrast, gray);
+
+    return dst;
+}
+
+AkVCam::VideoFrame AkVCam::VideoFrame::adjust(int hue,
+                                              int saturation,
+                                              int luminance,
+                                              int gamma,
+                                              int contrast,
+                                              bool gray) &&
+{
+    if (!this->adjustInPlace(hue,
+                             saturation,
+                             luminance,
+                             gamma,
+                             contrast,
+                             gray))
+        return {};
+
+    return std::move(*this);
+}
+
+bool AkVCam::VideoFrame::adjustInPlace(int hue,
+                                       int saturation,
+                                       int luminance,
+                                       int gamma,
+                                       int contrast,
+                                       bool gray)
+{
+    if (hue == 0
+        && saturation == 0
+        && luminance == 0
+        && gamma == 0
+        && contrast == 0
+        && !gray)
+        return true;
+
+    if (!this->d->canAdjust())
+        return false;
+
+    this->d->adjust(*this, hue, saturation, luminance, gamma, contrast, gray);
+
+    return true;
+}
+
+void AkVCam::VideoFramePrivate::account()
+{
+    auto size = this->m_data.capacity();
+
+    if (size > this->m_accounted)
+        MemoryAccounting::allocated(MemoryCategoryFrames,
+                                    size - this->m_accounted);
+    else if (size < this->m_accounted)
+        MemoryAccounting::released(MemoryCategoryFrames,
+                                   this->m_accounted - size);
+
+    this->m_accounted = size;
+}
+
+bool AkVCam::VideoFramePrivate::canAdjust() const
+{
+    auto it = std::find(this->m_adjustFormats.begin(),
+                        this->m_adjustFormats.end(),
+                        this->m_format.fourcc());
+
+    return it != this->m_adjustFormats.end();
+}
+
+void AkVCam::VideoFramePrivate::swapRgb(VideoFrame &dst)
+{
+    for (int y = 0; y < this->m_format.height(); y++) {
+        auto srcLine = reinterpret_cast<RGB24 *>(this->self->line(0, size_t(y)));
         auto destLine = reinterpret_cast<RGB24 *>(dst.line(0, size_t(y)));
 
-        for (int x = 0; x < this->d->m_format.width(); x++) {
+        for (int x = 0; x < this->m_format.width(); x++) {
+            // dst may be this same frame.
+            auto pixel = srcLine[x];
+            destLine[x].r = pixel.b;
+            destLine[x].g = pixel.g;
+            destLine[x].b = pixel.r;
+        }
+    }
+}
+
+void AkVCam::VideoFramePrivate::adjustHsl(VideoFrame &dst,
+                                          int hue,
+                                          int saturation,
+                                          int luminance)
+{
+    for (int y = 0; y < this->m_format.height(); y++) {
+        auto srcLine = reinterpret_cast<RGB24 *>(this->self->line(0, size_t(y)));
+        auto destLine = reinterpret_cast<RGB24 *>(dst.line(0, size_t(y)));
+
+        for (int x = 0; x < this->m_format.width(); x++) {
             int h;
             int s;
             int l;
-            this->d->rgbToHsl(srcLine[x].r, srcLine[x].g, srcLine[x].b,
-                              &h, &s, &l);
+            this->rgbToHsl(srcLine[x].r, srcLine[x].g, srcLine[x].b,
+                           &h, &s, &l);
 
-            h = this->d->mod(h + hue, 360);
+            h = this->mod(h + hue, 360);
             s = VideoFramePrivate::bound(0, s + saturation, 255);
             l = VideoFramePrivate::bound(0, l + luminance, 255);
 
             int r;
             int g;
             int b;
-            this->d->hslToRgb(h, s, l, &r, &g, &b);
+            this->hslToRgb(h, s, l, &r, &g, &b);
 
             destLine[x].r = uint8_t(r);
             destLine[x].g = uint8_t(g);
             destLine[x].b = uint8_t(b);
         }
     }
-
-    return dst;
 }
 
-AkVCam::VideoFrame AkVCam::VideoFrame::adjustGamma(int gamma)
+void AkVCam::VideoFramePrivate::adjustGamma(VideoFrame &dst, int gamma)
 {
-    if (gamma == 0)
-        return *this;
-
-    auto it = std::find(this->d->m_adjustFormats.begin(),
-                        this->d->m_adjustFormats.end(),
-                        this->d->m_format.fourcc());
-
-    if (it == this->d->m_adjustFormats.end())
-        return {};
-
-    VideoFrame dst(this->d->m_format);
     auto dataGt = gammaTable()->data();
     gamma = VideoFramePrivate::bound(-255, gamma, 255);
     size_t gammaOffset = size_t(gamma + 255) << 8;
 
-    for (int y = 0; y < this->d->m_format.height(); y++) {
-        auto srcLine = reinterpret_cast<RGB24 *>(this->line(0, size_t(y)));
+    for (int y = 0; y < this->m_format.height(); y++) {
+        auto srcLine = reinterpret_cast<RGB24 *>(this->self->line(0, size_t(y)));
         auto destLine = reinterpret_cast<RGB24 *>(dst.line(0, size_t(y)));
 
-        for (int x = 0; x < this->d->m_format.width(); x++) {
+        for (int x = 0; x < this->m_format.width(); x++) {
             destLine[x].r = dataGt[gammaOffset | srcLine[x].r];
             destLine[x].g = dataGt[gammaOffset | srcLine[x].g];
             destLine[x].b = dataGt[gammaOffset | srcLine[x].b];
         }
     }
-
-    return dst;
 }
 
-AkVCam::VideoFrame AkVCam::VideoFrame::adjustContrast(int contrast)
+void AkVCam::VideoFramePrivate::adjustContrast(VideoFrame &dst, int contrast)
 {
-    if (contrast == 0)
-        return *this;
-
-    auto it = std::find(this->d->m_adjustFormats.begin(),
-                        this->d->m_adjustFormats.end(),
-                        this->d->m_format.fourcc());
-
-    if (it == this->d->m_adjustFormats.end())
-        return {};
-
-    VideoFrame dst(this->d->m_format);
     auto dataCt = contrastTable()->data();
     contrast = VideoFramePrivate::bound(-255, contrast, 255);
     size_t contrastOffset = size_t(contrast + 255) << 8;
 
-    for (int y = 0; y < this->d->m_format.height(); y++) {
-        auto srcLine = reinterpret_cast<RGB24 *>(this->line(0, size_t(y)));
+    for (int y = 0; y < this->m_format.height(); y++) {
+        auto srcLine = reinterpret_cast<RGB24 *>(this->self->line(0, size_t(y)));
         auto destLine = reinterpret_cast<RGB24 *>(dst.line(0, size_t(y)));
 
-        for (int x = 0; x < this->d->m_format.width(); x++) {
+        for (int x = 0; x < this->m_format.width(); x++) {
             destLine[x].r = dataCt[contrastOffset | srcLine[x].r];
             destLine[x].g = dataCt[contrastOffset | srcLine[x].g];
             destLine[x].b = dataCt[contrastOffset | srcLine[x].b];
         }
     }
-
-    return dst;
 }
 
-AkVCam::VideoFrame AkVCam::VideoFrame::toGrayScale()
+void AkVCam::VideoFramePrivate::toGrayScale(VideoFrame &dst)
 {
-    auto it = std::find(this->d->m_adjustFormats.begin(),
-                        this->d->m_adjustFormats.end(),
-                        this->d->m_format.fourcc());
-
-    if (it == this->d->m_adjustFormats.end())
-        return {};
-
-    VideoFrame dst(this->d->m_format);
-
-    for (int y = 0; y < this->d->m_format.height(); y++) {
-        auto srcLine = reinterpret_cast<RGB24 *>(this->line(0, size_t(y)));
+    for (int y = 0; y < this->m_format.height(); y++) {
+        auto srcLine = reinterpret_cast<RGB24 *>(this->self->line(0, size_t(y)));
         auto destLine = reinterpret_cast<RGB24 *>(dst.line(0, size_t(y)));
 
-        for (int x = 0; x < this->d->m_format.width(); x++) {
-            int luma = this->d->grayval(srcLine[x].r,
-                                        srcLine[x].g,
-                                        srcLine[x].b);
+        for (int x = 0; x < this->m_format.width(); x++) {
+            int luma = this->grayval(srcLine[x].r,
+                                     srcLine[x].g,
+                                     srcLine[x].b);
 
             destLine[x].r = uint8_t(luma);
             destLine[x].g = uint8_t(luma);
             destLine[x].b = uint8_t(luma);
         }
     }
-
-    return dst;
 }
 
-AkVCam::VideoFrame AkVCam::VideoFrame::adjust(int hue,
-                                              int saturation,
-                                              int luminance,
-                                              int gamma,
-                                              int contrast,
-                                              bool gray)
+void AkVCam::VideoFramePrivate::adjust(VideoFrame &dst,
+                                       int hue,
+                                       int saturation,
+                                       int luminance,
+                                       int gamma,
+                                       int contrast,
+                                       bool gray)
 {
-    if (hue == 0
-        && saturation == 0
-        && luminance == 0
-        && gamma == 0
-        && contrast == 0
-        && !gray)
-        return *this;
-
-    auto it = std::find(this->d->m_adjustFormats.begin(),
-                        this->d->m_adjustFormats.end(),
-                        this->d->m_format.fourcc());
-
-    if (it == this->d->m_adjustFormats.end())
-        return {};
-
-    VideoFrame dst(this->d->m_format);
     auto dataGt = gammaTable()->data();
     auto dataCt = contrastTable()->data();
 
@@ -895,11 +1432,11 @@ AkVCam::VideoFrame AkVCam::VideoFrame::adjust(int hue,
     contrast = VideoFramePrivate::bound(-255, contrast, 255);
     size_t contrastOffset = size_t(contrast + 255) << 8;
 
-    for (int y = 0; y < this->d->m_format.height(); y++) {
-        auto srcLine = reinterpret_cast<RGB24 *>(this->line(0, size_t(y)));
+    for (int y = 0; y < this->m_format.height(); y++) {
+        auto srcLine = reinterpret_cast<RGB24 *>(this->self->line(0, size_t(y)));
         auto destLine = reinterpret_cast<RGB24 *>(dst.line(0, size_t(y)));
 
-        for (int x = 0; x < this->d->m_format.width(); x++) {
+        for (int x = 0; x < this->m_format.width(); x++) {
             int r = srcLine[x].r;
             int g = srcLine[x].g;
             int b = srcLine[x].b;
@@ -908,12 +1445,12 @@ AkVCam::VideoFrame AkVCam::VideoFrame::adjust(int hue,
                 int h;
                 int s;
                 int l;
-                this->d->rgbToHsl(r, g, b, &h, &s, &l);
+                this->rgbToHsl(r, g, b, &h, &s, &l);
 
-                h = this->d->mod(h + hue, 360);
+                h = this->mod(h + hue, 360);
                 s = VideoFramePrivate::bound(0, s + saturation, 255);
                 l = VideoFramePrivate::bound(0, l + luminance, 255);
-                this->d->hslToRgb(h, s, l, &r, &g, &b);
+                this->hslToRgb(h, s, l, &r, &g, &b);
             }
 
             if (gamma != 0) {
@@ -929,7 +1466,7 @@ AkVCam::VideoFrame AkVCam::VideoFrame::adjust(int hue,
             }
 
             if (gray) {
-                int luma = this->d->grayval(r, g, b);
+                int luma = this->grayval(r, g, b);
 
                 r = luma;
                 g = luma;
@@ -941,8 +1478,6 @@ AkVCam::VideoFrame AkVCam::VideoFrame::adjust(int hue,
             destLine[x].b = uint8_t(b);
         }
     }
-
-    return dst;
 }
 
 int AkVCam::VideoFramePrivate::grayval(int r, int g, int b)
@@ -1234,7 +1769,7 @@ AkVCam::VideoFrame AkVCam::VideoFramePrivate::bgr24_to_nv12(const VideoFrame *sr
             auto g = src_line[x].g;
             auto b = src_line[x].b;
 
-            dst_line_y[y] = rgb_y(r, g, b);
+            dst_line_y[x] = rgb_y(r, g, b);
 
             if (!(x & 0x1) && !(y & 0x1)) {
                 dst_line_vu[x / 2].v = rgb_v(r, g, b);
@@ -1264,7 +1799,7 @@ AkVCam::VideoFrame AkVCam::VideoFramePrivate::bgr24_to_nv21(const VideoFrame *sr
             auto g = src_line[x].g;
             auto b = src_line[x].b;
 
-            dst_line_y[y] = rgb_y(r, g, b);
+            dst_line_y[x] = rgb_y(r, g, b);
 
             if (!(x & 0x1) && !(y & 0x1)) {
                 dst_line_vu[x / 2].v = rgb_v(r, g, b);
@@ -1522,7 +2057,7 @@ AkVCam::VideoFrame AkVCam::VideoFramePrivate::rgb24_to_nv12(const VideoFrame *sr
             auto g = src_line[x].g;
             auto b = src_line[x].b;
 
-            dst_line_y[y] = rgb_y(r, g, b);
+            dst_line_y[x] = rgb_y(r, g, b);
 
             if (!(x & 0x1) && !(y & 0x1)) {
                 dst_line_vu[x / 2].v = rgb_v(r, g, b);
@@ -1552,7 +2087,7 @@ AkVCam::VideoFrame AkVCam::VideoFramePrivate::rgb24_to_nv21(const VideoFrame *sr
             auto g = src_line[x].g;
             auto b = src_line[x].b;
 
-            dst_line_y[y] = rgb_y(r, g, b);
+            dst_line_y[x] = rgb_y(r, g, b);
 
             if (!(x & 0x1) && !(y & 0x1)) {
                 dst_line_vu[x / 2].v = rgb_v(r, g, b);
@@ -1686,6 +2221,135 @@ void AkVCam::VideoFramePrivate::hslToRgb(int h, int s, int l, int *r, int *g, in
     *b = (2 * (*b) + m) / 2;
 }
 
+std::vector<int> AkVCam::VideoFramePrivate::scaleMap(int srcSize, int dstSize)
+{
+    std::vector<int> map(size_t(std::max(dstSize, 0)), 0);
+    int num = srcSize - 1;
+    int den = dstSize - 1;
+
+    if (den > 0)
+        for (int i = 0; i < dstSize; i++)
+            map[size_t(i)] = num * i / den;
+
+    return map;
+}
+
+template<typename S, typename D>
+void AkVCam::VideoFramePrivate::convertLine(const S *src,
+                                            const int *xMap,
+                                            D *dst,
+                                            int width,
+                                            int rs, int gs, int bs)
+{
+    for (int x = 0; x < width; x++) {
+        auto &pixel = src[xMap[x]];
+        fillX(dst[x]);
+        dst[x].r = pixel.r >> rs;
+        dst[x].g = pixel.g >> gs;
+        dst[x].b = pixel.b >> bs;
+    }
+}
+
+template<typename S, typename D>
+void AkVCam::VideoFramePrivate::convertLineYuv(const S *src,
+                                               const int *xMap,
+                                               D *dst,
+                                               int width)
+{
+    for (int x = 0; x < width; x += 2) {
+        auto &pixel0 = src[xMap[x]];
+        auto &pixel1 = src[xMap[std::min(x + 1, width - 1)]];
+        auto &yuv = dst[x / 2];
+
+        yuv.y0 = rgb_y(pixel0.r, pixel0.g, pixel0.b);
+        yuv.u0 = rgb_u(pixel0.r, pixel0.g, pixel0.b);
+        yuv.y1 = rgb_y(pixel1.r, pixel1.g, pixel1.b);
+        yuv.v0 = rgb_v(pixel0.r, pixel0.g, pixel0.b);
+    }
+}
+
+template<typename S, typename D>
+void AkVCam::VideoFramePrivate::convertLineNv(const S *src,
+                                              const int *xMap,
+                                              uint8_t *dstY,
+                                              D *dstUV,
+                                              int width,
+                                              bool writeUV)
+{
+    for (int x = 0; x < width; x++) {
+        auto &pixel = src[xMap[x]];
+        dstY[x] = rgb_y(pixel.r, pixel.g, pixel.b);
+
+        if (writeUV && !(x & 0x1)) {
+            dstUV[x / 2].u = rgb_u(pixel.r, pixel.g, pixel.b);
+            dstUV[x / 2].v = rgb_v(pixel.r, pixel.g, pixel.b);
+        }
+    }
+}
+
+template<typename S>
+bool AkVCam::VideoFramePrivate::convertLine(const S *src,
+                                            const int *xMap,
+                                            VideoFrame &dst,
+                                            int y)
+{
+    auto width = dst.format().width();
+    auto line = dst.line(0, size_t(y));
+
+    switch (dst.format().fourcc()) {
+    case PixelFormatRGB32:
+        convertLine(src, xMap, reinterpret_cast<RGB32 *>(line), width, 0, 0, 0);
+        break;
+    case PixelFormatRGB24:
+        convertLine(src, xMap, reinterpret_cast<RGB24 *>(line), width, 0, 0, 0);
+        break;
+    case PixelFormatRGB16:
+        convertLine(src, xMap, reinterpret_cast<RGB16 *>(line), width, 3, 2, 3);
+        break;
+    case PixelFormatRGB15:
+        convertLine(src, xMap, reinterpret_cast<RGB15 *>(line), width, 3, 3, 3);
+        break;
+    case PixelFormatBGR32:
+        convertLine(src, xMap, reinterpret_cast<BGR32 *>(line), width, 0, 0, 0);
+        break;
+    case PixelFormatBGR24:
+        convertLine(src, xMap, reinterpret_cast<BGR24 *>(line), width, 0, 0, 0);
+        break;
+    case PixelFormatBGR16:
+        convertLine(src, xMap, reinterpret_cast<BGR16 *>(line), width, 3, 2, 3);
+        break;
+    case PixelFormatBGR15:
+        convertLine(src, xMap, reinterpret_cast<BGR15 *>(line), width, 3, 3, 3);
+        break;
+    case PixelFormatUYVY:
+        convertLineYuv(src, xMap, reinterpret_cast<UYVY *>(line), width);
+        break;
+    case PixelFormatYUY2:
+        convertLineYuv(src, xMap, reinterpret_cast<YUY2 *>(line), width);
+        break;
+    case PixelFormatNV12:
+        convertLineNv(src,
+                      xMap,
+                      line,
+                      reinterpret_cast<VU *>(dst.line(1, size_t(y) / 2)),
+                      width,
+                      !(y & 0x1));
+        break;
+    case PixelFormatNV21:
+        convertLineNv(src,
+                      xMap,
+                      line,
+                      reinterpret_cast<UV *>(dst.line(1, size_t(y) / 2)),
+                      width,
+                      !(y & 0x1));
+        break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
 std::vector<uint8_t> AkVCam::initGammaTable()
 {
     std::vector<uint8_t> gammaTable;
@@ -1704,6 +2368,8 @@ std::vector<uint8_t> AkVCam::initGammaTable()
         }
     }
 
+    MemoryAccounting::allocated(MemoryCategoryLuts, gammaTable.capacity());
+
     return gammaTable;
 }
 
@@ -1720,5 +2386,7 @@ std::vector<uint8_t> AkVCam::initContrastTable()
         }
     }
 
+    MemoryAccounting::allocated(MemoryCategoryLuts, contrastTable.capacity());
+
     return contrastTable;
 }
@@ -40,18 +40,33 @@ namespace AkVCam
             VideoFrame(const std::string &fileName);
             VideoFrame(const VideoFormat &format);
             VideoFrame(const VideoFrame &other);
+            VideoFrame(VideoFrame &&other) noexcept;
             VideoFrame &operator =(const VideoFrame &other);
+            VideoFrame &operator =(VideoFrame &&other) noexcept;
             ~VideoFrame();
 
             bool load(const std::string &fileName);
+
+            // Saves the frame as a 24 bits BMP file.
+            bool save(const std::string &fileName) const;
             VideoFormat format() const;
             VideoFormat &format();
-            VideoData data() const;
+            const VideoData &data() const;
             VideoData &data();
             uint8_t *line(size_t plane, size_t y) const;
             void clear();
 
-            VideoFrame mirror(bool horizontalMirror, bool verticalMirror) const;
+            // Copy of the lines [firstLine, firstLine + lines) as a frame.
+            VideoFrame band(int firstLine, int lines) const;
+
+            // Replaces the lines starting at firstLine with the band.
+            bool setBand(int firstLine, const VideoFrame &band);
+
+            VideoFrame mirror(bool horizontalMirror,
+                              bool verticalMirror) const &;
+            VideoFrame mirror(bool horizontalMirror,
+                              bool verticalMirror) &&;
+            bool mirrorInPlace(bool horizontalMirror, bool verticalMirror);
             VideoFrame scaled(int width,
                               int height,
                               Scaling mode=ScalingFast,
@@ -59,20 +74,49 @@ namespace AkVCam
             VideoFrame scaled(size_t maxArea,
                               Scaling mode=ScalingFast,
                               int align=32) const;
-            VideoFrame swapRgb(bool swap) const;
-            VideoFrame swapRgb() const;
+            VideoFrame swapRgb(bool swap) const &;
+            VideoFrame swapRgb(bool swap) &&;
+            VideoFrame swapRgb() const &;
+            VideoFrame swapRgb() &&;
+            bool swapRgbInPlace();
             bool canConvert(FourCC input, FourCC output) const;
             VideoFrame convert(FourCC fourcc) const;
-            VideoFrame adjustHsl(int hue, int saturation, int luminance);
-            VideoFrame adjustGamma(int gamma);
-            VideoFrame adjustContrast(int contrast);
-            VideoFrame toGrayScale();
+            VideoFrame convert(const VideoFormat &format,
+                               Scaling mode=ScalingFast,
+                               AspectRatio aspectRatio=AspectRatioIgnore) const;
+            std::vector<VideoFrame> convert(const std::vector<VideoFormat> &formats,
+                                            Scaling mode=ScalingFast,
+                                            AspectRatio aspectRatio=AspectRatioIgnore) const;
+            VideoFrame adjustHsl(int hue, int saturation, int luminance) const &;
+            VideoFrame adjustHsl(int hue, int saturation, int luminance) &&;
+            bool adjustHslInPlace(int hue, int saturation, int luminance);
+            VideoFrame adjustGamma(int gamma) const &;
+            VideoFrame adjustGamma(int gamma) &&;
+            bool adjustGammaInPlace(int gamma);
+            VideoFrame adjustContrast(int contrast) const &;
+            VideoFrame adjustContrast(int contrast) &&;
+            bool adjustContrastInPlace(int contrast);
+            VideoFrame toGrayScale() const &;
+            VideoFrame toGrayScale() &&;
+            bool toGrayScaleInPlace();
+            VideoFrame adjust(int hue,
+                              int saturation,
+                              int luminance,
+                              int gamma,
+                              int contrast,
+                              bool gray) const &;
             VideoFrame adjust(int hue,
                               int saturation,
                               int luminance,
                               int gamma,
                               int contrast,
-                              bool gray);
+                              bool gray) &&;
+            bool adjustInPlace(int hue,
+                               int saturation,
+                               int luminance,
+                               int gamma,
+                               int contrast,
+                               bool gray);
 
         private:
             VideoFramePrivate *d;
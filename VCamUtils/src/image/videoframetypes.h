@@ -20,8 +20,13 @@
 #ifndef VIDEOFRAMETYPES_H
 #define VIDEOFRAMETYPES_H
 
+#include <memory>
+
 namespace AkVCam
 {
+    class VideoFrame;
+    using VideoFramePtr = std::shared_ptr<const VideoFrame>;
+
     enum Scaling
     {
         ScalingFast,
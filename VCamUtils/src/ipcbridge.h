@@ -70,9 +70,21 @@ namespace AkVCam
 
             AKVCAM_SIGNAL(ServerStateChanged,
                           ServerState state)
+
+            // The frame is shared by all the receivers, don't modify it.
             AKVCAM_SIGNAL(FrameReady,
                           const std::string &deviceId,
-                          const VideoFrame &frame)
+                          const VideoFramePtr &frame,
+                          uint64_t sequence)
+
+            // Lines [firstLine, firstLine + lines) of a frame sent in
+            // slices. FrameReady is still emitted once it's complete.
+            AKVCAM_SIGNAL(SliceReady,
+                          const std::string &deviceId,
+                          const VideoFrame &frame,
+                          uint64_t sequence,
+                          int firstLine,
+                          int lines)
             AKVCAM_SIGNAL(PictureChanged,
                           const std::string &picture)
             AKVCAM_SIGNAL(DevicesChanged,
@@ -101,6 +113,14 @@ namespace AkVCam
             int logLevel() const;
             void setLogLevel(int logLevel);
 
+            // Seconds before releasing the buffers of unused devices.
+            int idleTimeout() const;
+            void setIdleTimeout(int timeout);
+
+            // MiB each device may hold in a process, 0 for no limit.
+            int memoryBudget() const;
+            void setMemoryBudget(int budget);
+
             // Register the peer to the global server.
             bool registerPeer();
 
@@ -130,12 +150,25 @@ namespace AkVCam
             std::string broadcaster(const std::string &deviceId) const;
 
             std::vector<DeviceControl> controls(const std::string &deviceId);
+
+            // The changed controls are notified as a single batch, and
+            // ControlsChanged is emitted once with all the controls.
             void setControls(const std::string &deviceId,
                              const std::map<std::string, int> &controls);
 
             // Returns the clients that are capturing from a virtual camera.
             std::vector<std::string> listeners(const std::string &deviceId);
 
+            // Returns true if any client is capturing from a started device.
+            // Unlike listeners() it doesn't query the assistant, so it can be
+            // called for every frame.
+            bool hasListeners(const std::string &deviceId) const;
+
+            // Wait until a client starts capturing from a started device.
+            // The timeout is in milliseconds, negative values wait forever.
+            bool waitForListeners(const std::string &deviceId,
+                                  int timeout=-1);
+
             // Returns clients PIDs using the virtual devices.
             std::vector<uint64_t> clientsPids() const;
 
@@ -159,10 +192,22 @@ namespace AkVCam
             // Stop frame transfer to the device.
             void deviceStop(const std::string &deviceId);
 
-            // Transfer a frame to the device.
+            // Transfer a frame to the device. The frame is discarded without
+            // processing it while no client is capturing.
             bool write(const std::string &deviceId,
                        const VideoFrame &frame);
 
+            // Send the frames in the given number of horizontal slices, so
+            // the clients can start processing a frame before the rest of
+            // it arrives. 1 sends whole frames.
+            void setFrameSlices(const std::string &deviceId, int slices);
+
+            // Save all the frames written to the device to a recording, an
+            // empty file name stops recording. Started devices are recorded
+            // automatically when AKVCAM_RECORD_DIR is set.
+            bool setRecording(const std::string &deviceId,
+                              const std::string &fileName);
+
             /* Client */
 
             // Increment the count of device listeners
@@ -0,0 +1,171 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+#include "listenermonitor.h"
+
+namespace AkVCam
+{
+    class ListenerMonitorPrivate
+    {
+        public:
+            std::map<std::string, std::vector<std::string>> m_listeners;
+            uint64_t m_interrupts {0};
+            mutable std::mutex m_mutex;
+            std::condition_variable m_changed;
+
+            inline size_t count(const std::string &deviceId) const;
+    };
+}
+
+AkVCam::ListenerMonitor::ListenerMonitor()
+{
+    this->d = new ListenerMonitorPrivate;
+}
+
+AkVCam::ListenerMonitor::~ListenerMonitor()
+{
+    this->interrupt();
+    delete this->d;
+}
+
+void AkVCam::ListenerMonitor::setListeners(const std::string &deviceId,
+                                           const std::vector<std::string> &listeners)
+{
+    std::vector<std::string> deviceListeners;
+
+    for (auto &listener: listeners)
+        if (!listener.empty()
+            && std::find(deviceListeners.begin(),
+                         deviceListeners.end(),
+                         listener) == deviceListeners.end())
+            deviceListeners.push_back(listener);
+
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+    this->d->m_listeners[deviceId] = deviceListeners;
+    lock.unlock();
+    this->d->m_changed.notify_all();
+}
+
+bool AkVCam::ListenerMonitor::addListener(const std::string &deviceId,
+                                          const std::string &listener)
+{
+    if (listener.empty())
+        return false;
+
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+    auto &listeners = this->d->m_listeners[deviceId];
+    auto it = std::find(listeners.begin(), listeners.end(), listener);
+
+    if (it != listeners.end())
+        return false;
+
+    listeners.push_back(listener);
+    lock.unlock();
+    this->d->m_changed.notify_all();
+
+    return true;
+}
+
+bool AkVCam::ListenerMonitor::removeListener(const std::string &deviceId,
+                                             const std::string &listener)
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    auto dit = this->d->m_listeners.find(deviceId);
+
+    if (dit == this->d->m_listeners.end())
+        return false;
+
+    auto &listeners = dit->second;
+    auto it = std::find(listeners.begin(), listeners.end(), listener);
+
+    if (it == listeners.end())
+        return false;
+
+    listeners.erase(it);
+
+    return true;
+}
+
+void AkVCam::ListenerMonitor::removeDevice(const std::string &deviceId)
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    this->d->m_listeners.erase(deviceId);
+}
+
+void AkVCam::ListenerMonitor::clear()
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    this->d->m_listeners.clear();
+}
+
+size_t AkVCam::ListenerMonitor::count(const std::string &deviceId) const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->count(deviceId);
+}
+
+bool AkVCam::ListenerMonitor::hasListeners(const std::string &deviceId) const
+{
+    return this->count(deviceId) > 0;
+}
+
+bool AkVCam::ListenerMonitor::waitForListeners(const std::string &deviceId,
+                                               int timeout)
+{
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+    auto interrupts = this->d->m_interrupts;
+    auto ready = [this, &deviceId, interrupts] () {
+        return this->d->count(deviceId) > 0
+               || this->d->m_interrupts != interrupts;
+    };
+
+    if (timeout < 0)
+        this->d->m_changed.wait(lock, ready);
+    else
+        this->d->m_changed.wait_for(lock,
+                                    std::chrono::milliseconds(timeout),
+                                    ready);
+
+    return this->d->count(deviceId) > 0;
+}
+
+void AkVCam::ListenerMonitor::interrupt()
+{
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+    this->d->m_interrupts++;
+    lock.unlock();
+    this->d->m_changed.notify_all();
+}
+
+size_t AkVCam::ListenerMonitorPrivate::count(const std::string &deviceId) const
+{
+    auto it = this->m_listeners.find(deviceId);
+
+    if (it == this->m_listeners.end())
+        return 0;
+
+    return it->second.size();
+}
@@ -0,0 +1,67 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_LISTENERMONITOR_H
+#define AKVCAMUTILS_LISTENERMONITOR_H
+
+#include <string>
+#include <vector>
+
+namespace AkVCam
+{
+    class ListenerMonitorPrivate;
+
+    /* Local view of the clients capturing from each device.
+     *
+     * It's fed with the listener notifications sent by the assistant, so
+     * producers can ask if anyone is watching without a round trip to it,
+     * and wait until someone does instead of streaming to nowhere.
+     */
+    class ListenerMonitor
+    {
+        public:
+            ListenerMonitor();
+            ListenerMonitor(const ListenerMonitor &other) = delete;
+            ~ListenerMonitor();
+
+            void setListeners(const std::string &deviceId,
+                              const std::vector<std::string> &listeners);
+            bool addListener(const std::string &deviceId,
+                             const std::string &listener);
+            bool removeListener(const std::string &deviceId,
+                                const std::string &listener);
+            void removeDevice(const std::string &deviceId);
+            void clear();
+            size_t count(const std::string &deviceId) const;
+            bool hasListeners(const std::string &deviceId) const;
+
+            // Wait until the device has listeners, timeout is in
+            // milliseconds, a negative value waits forever.
+            bool waitForListeners(const std::string &deviceId,
+                                  int timeout=-1);
+
+            // Wake up all the waiting threads.
+            void interrupt();
+
+        private:
+            ListenerMonitorPrivate *d;
+    };
+}
+
+#endif // AKVCAMUTILS_LISTENERMONITOR_H
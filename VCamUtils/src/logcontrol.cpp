@@ -0,0 +1,310 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "logcontrol.h"
+#include "logger.h"
+
+#ifdef _WIN32
+    #define LOGCONTROL_NAME "Local\\AkVCam_LogControl"
+#else
+    #define LOGCONTROL_NAME "/AkVCam_LogControl"
+#endif
+
+#define LOGCONTROL_MAX_MODULES 32
+#define LOGCONTROL_MODULE_SIZE 64
+
+// Writers waiting longer than this assume the previous writer died.
+#define LOGCONTROL_MAX_SPINS 100000
+
+namespace AkVCam
+{
+    struct LogControlModule
+    {
+        char name[LOGCONTROL_MODULE_SIZE];
+        int32_t level;
+    };
+
+    /* The version is odd while a writer is changing the levels. Readers
+     * copy the levels and retry if the version changed meanwhile.
+     */
+    struct LogControlBlock
+    {
+        std::atomic<uint32_t> version;
+        uint32_t modules;
+        LogControlModule module[LOGCONTROL_MAX_MODULES];
+    };
+
+    class LogControlPrivate
+    {
+        public:
+            LogControlBlock *m_block {nullptr};
+            LogControlBlock m_localBlock {};
+            bool m_isShared {false};
+
+#ifdef _WIN32
+            HANDLE m_handle {nullptr};
+#endif
+
+            bool open();
+            void close();
+            uint32_t lock();
+            void unlock(uint32_t version);
+    };
+}
+
+AkVCam::LogControl::LogControl()
+{
+    this->d = new LogControlPrivate;
+    this->d->m_isShared = this->d->open();
+
+    if (!this->d->m_isShared)
+        this->d->m_block = &this->d->m_localBlock;
+}
+
+AkVCam::LogControl::~LogControl()
+{
+    this->d->close();
+    delete this->d;
+}
+
+bool AkVCam::LogControl::isShared() const
+{
+    return this->d->m_isShared;
+}
+
+uint32_t AkVCam::LogControl::version() const
+{
+    return this->d->m_block->version.load(std::memory_order_acquire);
+}
+
+std::map<std::string, int> AkVCam::LogControl::levels() const
+{
+    auto block = this->d->m_block;
+
+    for (int i = 0; i < LOGCONTROL_MAX_SPINS; i++) {
+        auto version = block->version.load(std::memory_order_acquire);
+
+        if (version & 1) {
+            std::this_thread::yield();
+
+            continue;
+        }
+
+        std::map<std::string, int> levels;
+        auto modules = (std::min<uint32_t>)(block->modules,
+                                            LOGCONTROL_MAX_MODULES);
+
+        for (uint32_t j = 0; j < modules; j++) {
+            auto &module = block->module[j];
+            std::string name(module.name,
+                             strnlen(module.name, LOGCONTROL_MODULE_SIZE));
+            levels[name] = module.level;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (block->version.load(std::memory_order_relaxed) == version)
+            return levels;
+    }
+
+    return {};
+}
+
+int AkVCam::LogControl::level(const std::string &module) const
+{
+    auto levels = this->levels();
+    auto it = levels.find(module);
+
+    if (it == levels.end())
+        return AKVCAM_LOGLEVEL_DEFAULT;
+
+    return it->second;
+}
+
+bool AkVCam::LogControl::setLevel(const std::string &module, int level)
+{
+    if (module.empty() || module.size() >= LOGCONTROL_MODULE_SIZE)
+        return false;
+
+    auto block = this->d->m_block;
+    auto version = this->d->lock();
+    auto modules = (std::min<uint32_t>)(block->modules, LOGCONTROL_MAX_MODULES);
+    uint32_t i = 0;
+
+    for (; i < modules; i++)
+        if (module == block->module[i].name)
+            break;
+
+    bool ok = true;
+
+    if (level == AKVCAM_LOGLEVEL_DEFAULT) {
+        if (i < modules) {
+            block->module[i] = block->module[modules - 1];
+            block->modules = modules - 1;
+        }
+    } else if (i < modules) {
+        block->module[i].level = level;
+    } else if (modules < LOGCONTROL_MAX_MODULES) {
+        memset(block->module[i].name, 0, LOGCONTROL_MODULE_SIZE);
+        memcpy(block->module[i].name, module.c_str(), module.size());
+        block->module[i].level = level;
+        block->modules = modules + 1;
+    } else {
+        ok = false;
+    }
+
+    this->d->unlock(version);
+
+    return ok;
+}
+
+void AkVCam::LogControl::clear()
+{
+    auto version = this->d->lock();
+    this->d->m_block->modules = 0;
+    this->d->unlock(version);
+}
+
+AkVCam::LogControl *AkVCam::LogControl::global()
+{
+    // Logging may happen from static destructors, never destroy it.
+    static auto logControl = new LogControl;
+
+    return logControl;
+}
+
+bool AkVCam::LogControlPrivate::open()
+{
+#ifdef _WIN32
+    this->m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE,
+                                        nullptr,
+                                        PAGE_READWRITE,
+                                        0,
+                                        sizeof(LogControlBlock),
+                                        LOGCONTROL_NAME);
+
+    if (!this->m_handle)
+        return false;
+
+    auto data = MapViewOfFile(this->m_handle,
+                              FILE_MAP_ALL_ACCESS,
+                              0,
+                              0,
+                              sizeof(LogControlBlock));
+
+    if (!data) {
+        CloseHandle(this->m_handle);
+        this->m_handle = nullptr;
+
+        return false;
+    }
+#else
+    // Each user has its own block, only the owner can change its levels.
+    auto name = LOGCONTROL_NAME "_" + std::to_string(geteuid());
+    auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+
+    if (fd < 0)
+        return false;
+
+    struct stat fileInfo;
+
+    if (fstat(fd, &fileInfo) != 0
+        || fileInfo.st_uid != geteuid()
+        || (size_t(fileInfo.st_size) < sizeof(LogControlBlock)
+            && ftruncate(fd, sizeof(LogControlBlock)) != 0)) {
+        ::close(fd);
+
+        return false;
+    }
+
+    auto data = mmap(nullptr,
+                     sizeof(LogControlBlock),
+                     PROT_READ | PROT_WRITE,
+                     MAP_SHARED,
+                     fd,
+                     0);
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+#endif
+
+    // A new block is zero filled, which is an empty list of levels.
+    this->m_block = reinterpret_cast<LogControlBlock *>(data);
+
+    return true;
+}
+
+void AkVCam::LogControlPrivate::close()
+{
+    if (!this->m_isShared)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(this->m_block);
+    CloseHandle(this->m_handle);
+    this->m_handle = nullptr;
+#else
+    munmap(this->m_block, sizeof(LogControlBlock));
+#endif
+
+    this->m_block = &this->m_localBlock;
+    this->m_isShared = false;
+}
+
+uint32_t AkVCam::LogControlPrivate::lock()
+{
+    auto &version = this->m_block->version;
+    auto current = version.load();
+
+    for (int i = 0;; i++) {
+        if (current & 1 && i < LOGCONTROL_MAX_SPINS) {
+            std::this_thread::yield();
+            current = version.load();
+
+            continue;
+        }
+
+        // Odd versions are taken over once the writer is given up for dead.
+        auto locked = current & 1? current + 2: current + 1;
+
+        if (version.compare_exchange_weak(current, locked))
+            return locked;
+    }
+}
+
+void AkVCam::LogControlPrivate::unlock(uint32_t version)
+{
+    this->m_block->version.store(version + 1, std::memory_order_release);
+}
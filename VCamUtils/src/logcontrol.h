@@ -0,0 +1,64 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_LOGCONTROL_H
+#define AKVCAMUTILS_LOGCONTROL_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace AkVCam
+{
+    class LogControlPrivate;
+
+    /* Log levels per module, shared by the running processes of the user.
+     *
+     * The levels are kept in a small shared memory block, so a level set
+     * from one process is seen by the others the next time they log. A
+     * module is either the base name of a source file (ipcbridge) or the
+     * project it belongs to (VCamIPC). If the block can't be shared, the
+     * levels only apply to the current process.
+     */
+    class LogControl
+    {
+        public:
+            LogControl();
+            LogControl(const LogControl &other) = delete;
+            ~LogControl();
+
+            bool isShared() const;
+
+            // Changes every time a level is set, cheap enough to poll.
+            uint32_t version() const;
+            std::map<std::string, int> levels() const;
+            int level(const std::string &module) const;
+
+            // Setting AKVCAM_LOGLEVEL_DEFAULT removes the module level.
+            bool setLevel(const std::string &module, int level);
+            void clear();
+
+            static LogControl *global();
+
+        private:
+            LogControlPrivate *d;
+    };
+}
+
+#endif // AKVCAMUTILS_LOGCONTROL_H
@@ -17,14 +17,19 @@
  * Web-Site: http://webcamoid.github.io/
  */
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <ctime>
 #include <fstream>
 #include <map>
+#include <mutex>
 #include <sstream>
 #include <thread>
+#include <vector>
 
 #include "logger.h"
+#include "logcontrol.h"
 #include "utils.h"
 
 namespace AkVCam
@@ -36,6 +41,14 @@ namespace AkVCam
             std::string fileName;
             int logLevel {AKVCAM_LOGLEVEL_DEFAULT};
             std::fstream stream;
+            std::vector<LogSite *> sites;
+            std::atomic<uint32_t> controlVersion {0};
+            std::mutex sitesMutex;
+
+            void addSite(LogSite *site);
+            void updateSites(uint32_t version);
+            static int siteLevel(const LogSite *site,
+                                 const std::map<std::string, int> &levels);
 
             static const std::map<int, std::string> &logLevelStrMap()
             {
@@ -55,11 +68,12 @@ namespace AkVCam
             }
     };
 
+    // Logging may happen from static destructors, never destroy it.
     LoggerPrivate *loggerPrivate()
     {
-        static LoggerPrivate logger;
+        static auto logger = new LoggerPrivate;
 
-        return &logger;
+        return logger;
     }
 }
 
@@ -117,6 +131,71 @@ std::string AkVCam::Logger::header(int logLevel, const std::string file, int lin
     return ss.str();
 }
 
+bool AkVCam::Logger::isEnabled(int logLevel, LogSite &site)
+{
+    auto logger = loggerPrivate();
+    auto version = LogControl::global()->version();
+
+    if (version != logger->controlVersion)
+        logger->updateSites(version);
+
+    int level = site.level;
+
+    if (level == AKVCAM_LOGLEVEL_DEFAULT)
+        level = logger->logLevel;
+
+    return logLevel <= level;
+}
+
+AkVCam::LogSite *AkVCam::Logger::sample(int logLevel,
+                                        uint64_t every,
+                                        LogSite &site)
+{
+    if (!isEnabled(logLevel, site))
+        return nullptr;
+
+    if (every > 1 && site.calls++ % every != 0) {
+        site.suppressed++;
+
+        return nullptr;
+    }
+
+    return &site;
+}
+
+AkVCam::LogSite *AkVCam::Logger::throttle(int logLevel,
+                                          int msecs,
+                                          LogSite &site)
+{
+    if (!isEnabled(logLevel, site))
+        return nullptr;
+
+    auto now =
+            std::chrono::duration_cast<std::chrono::milliseconds>
+                (std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t next = site.nextTime;
+
+    // Only the thread that moves the deadline forward logs the call.
+    if (now < next
+        || !site.nextTime.compare_exchange_strong(next, now + msecs)) {
+        site.suppressed++;
+
+        return nullptr;
+    }
+
+    return &site;
+}
+
+std::string AkVCam::Logger::suppressed(LogSite &site)
+{
+    auto suppressed = site.suppressed.exchange(0);
+
+    if (!suppressed)
+        return {};
+
+    return "(" + std::to_string(suppressed) + " suppressed) ";
+}
+
 std::ostream &AkVCam::Logger::log(int logLevel)
 {
     static std::ostream dummy(nullptr);
@@ -124,6 +203,11 @@ std::ostream &AkVCam::Logger::log(int logLevel)
     if (logLevel > loggerPrivate()->logLevel)
         return dummy;
 
+    return stream();
+}
+
+std::ostream &AkVCam::Logger::stream()
+{
     if (loggerPrivate()->fileName.empty())
         return std::cerr;
 
@@ -158,3 +242,70 @@ std::string AkVCam::Logger::levelToString(int level)
 
     return {};
 }
+
+AkVCam::LogSite::LogSite(const char *file):
+    level(AKVCAM_LOGLEVEL_DEFAULT),
+    calls(0),
+    suppressed(0),
+    nextTime(INT64_MIN)
+{
+    std::string path(file);
+    std::replace(path.begin(), path.end(), '\\', '/');
+    auto components = split(path, '/');
+    std::string name = components.empty()? std::string(): components.back();
+    std::string area;
+
+    // The project is the directory that contains the src directory.
+    for (size_t i = 1; i + 1 < components.size(); i++)
+        if (components[i] == "src")
+            area = components[i - 1];
+
+    if (area.empty() && components.size() > 1)
+        area = components[components.size() - 2];
+
+    auto dot = name.rfind('.');
+
+    if (dot != std::string::npos)
+        name = name.substr(0, dot);
+
+    memset(this->area, 0, sizeof(this->area));
+    memset(this->name, 0, sizeof(this->name));
+    area.copy(this->area, sizeof(this->area) - 1);
+    name.copy(this->name, sizeof(this->name) - 1);
+    loggerPrivate()->addSite(this);
+}
+
+void AkVCam::LoggerPrivate::addSite(LogSite *site)
+{
+    auto levels = LogControl::global()->levels();
+    std::lock_guard<std::mutex> lock(this->sitesMutex);
+    site->level = siteLevel(site, levels);
+    this->sites.push_back(site);
+}
+
+void AkVCam::LoggerPrivate::updateSites(uint32_t version)
+{
+    auto levels = LogControl::global()->levels();
+    std::lock_guard<std::mutex> lock(this->sitesMutex);
+
+    for (auto site: this->sites)
+        site->level = siteLevel(site, levels);
+
+    this->controlVersion = version;
+}
+
+int AkVCam::LoggerPrivate::siteLevel(const LogSite *site,
+                                     const std::map<std::string, int> &levels)
+{
+    auto it = levels.find(site->name);
+
+    if (it != levels.end())
+        return it->second;
+
+    it = levels.find(site->area);
+
+    if (it != levels.end())
+        return it->second;
+
+    return AKVCAM_LOGLEVEL_DEFAULT;
+}
@@ -20,6 +20,7 @@
 #ifndef AKVCAMUTILS_LOGGER_H
 #define AKVCAMUTILS_LOGGER_H
 
+#include <atomic>
 #include <iostream>
 
 #include "utils.h"
@@ -34,7 +35,21 @@
 #define AKVCAM_LOGLEVEL_INFO        6
 #define AKVCAM_LOGLEVEL_DEBUG       7
 
-#define AkLog(level)     AkVCam::Logger::log(level) << AkVCam::Logger::header(level, __FILE__, __LINE__)
+// The site of each log call, created the first time the call is reached.
+#define AKVCAM_LOG_SITE \
+    ([] () -> AkVCam::LogSite & { \
+        static AkVCam::LogSite logSite(__FILE__); \
+        \
+        return logSite; \
+    }())
+
+// Nothing after the macro is evaluated if the level is disabled.
+#define AkLog(level) \
+    !AkVCam::Logger::isEnabled((level), AKVCAM_LOG_SITE)? \
+        (void) 0: \
+        AkVCam::LogVoidify() \
+        & AkVCam::Logger::stream() \
+          << AkVCam::Logger::header((level), __FILE__, __LINE__)
 #define AkLogEmergency() AkLog(AKVCAM_LOGLEVEL_EMERGENCY)
 #define AkLogFatal()     AkLog(AKVCAM_LOGLEVEL_FATAL)
 #define AkLogCritical()  AkLog(AKVCAM_LOGLEVEL_CRITICAL)
@@ -44,16 +59,74 @@
 #define AkLogInfo()      AkLog(AKVCAM_LOGLEVEL_INFO)
 #define AkLogDebug()     AkLog(AKVCAM_LOGLEVEL_DEBUG)
 
+// Logs one of every N calls, prefixed by the count of calls skipped since.
+#define AkLogSampled(level, every) \
+    for (auto akLogSite = \
+            AkVCam::Logger::sample((level), (every), AKVCAM_LOG_SITE); \
+         akLogSite; \
+         akLogSite = nullptr) \
+        AkVCam::Logger::stream() \
+            << AkVCam::Logger::header((level), __FILE__, __LINE__) \
+            << AkVCam::Logger::suppressed(*akLogSite)
+
+// Logs at most one call every msecs milliseconds, same prefix as above.
+#define AkLogThrottled(level, msecs) \
+    for (auto akLogSite = \
+            AkVCam::Logger::throttle((level), (msecs), AKVCAM_LOG_SITE); \
+         akLogSite; \
+         akLogSite = nullptr) \
+        AkVCam::Logger::stream() \
+            << AkVCam::Logger::header((level), __FILE__, __LINE__) \
+            << AkVCam::Logger::suppressed(*akLogSite)
+
+// Interval of the log calls made once per frame.
+#define AKVCAM_LOG_FRAME_INTERVAL 1000
+
 #if defined(__GNUC__) || defined(__clang__)
-#   define AkLogFunction()  AkLogDebug() << __PRETTY_FUNCTION__ << std::endl
+#   define AKVCAM_LOG_FUNCTION __PRETTY_FUNCTION__
 #elif defined(_MSC_VER)
-#   define AkLogFunction()  AkLogDebug() << __FUNCSIG__ << std::endl
+#   define AKVCAM_LOG_FUNCTION __FUNCSIG__
 #else
-#   define AkLogFunction()  AkLogDebug() << __FUNCTION__ << "()" << std::endl
+#   define AKVCAM_LOG_FUNCTION __FUNCTION__ << "()"
 #endif
 
+#define AkLogFunction() AkLogDebug() << AKVCAM_LOG_FUNCTION << std::endl
+#define AkLogFrameFunction() \
+    AkLogThrottled(AKVCAM_LOGLEVEL_DEBUG, AKVCAM_LOG_FRAME_INTERVAL) \
+        << AKVCAM_LOG_FUNCTION << std::endl
+#define AkLogFrameInfo() \
+    AkLogThrottled(AKVCAM_LOGLEVEL_INFO, AKVCAM_LOG_FRAME_INTERVAL)
+
 namespace AkVCam
 {
+    /* Source file of a log call. The level of the site is the one of its
+     * module in the LogControl, the file base name taking precedence over
+     * the project directory.
+     */
+    struct LogSite
+    {
+        char area[32];
+        char name[64];
+
+        // Level of the module, AKVCAM_LOGLEVEL_DEFAULT to use the global one.
+        std::atomic<int> level;
+
+        // State of the sampled and throttled calls.
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> suppressed;
+        std::atomic<int64_t> nextTime;
+
+        explicit LogSite(const char *file);
+    };
+
+    // Discards the value of a log expression.
+    struct LogVoidify
+    {
+        void operator &(std::ostream &)
+        {
+        }
+    };
+
     namespace Logger
     {
         std::string logFile();
@@ -61,7 +134,18 @@ namespace AkVCam
         int logLevel();
         void setLogLevel(int logLevel);
         std::string header(int logLevel, const std::string file, int line);
+        bool isEnabled(int logLevel, LogSite &site);
+
+        // Returns the site if the call must be logged, nullptr otherwise.
+        LogSite *sample(int logLevel, uint64_t every, LogSite &site);
+        LogSite *throttle(int logLevel, int msecs, LogSite &site);
+
+        // "(N suppressed) " and resets the count, empty if none was.
+        std::string suppressed(LogSite &site);
         std::ostream &log(int logLevel);
+
+        // Log output, regardless of the level.
+        std::ostream &stream();
         int levelFromString(const std::string &level);
         std::string levelToString(int level);
     }
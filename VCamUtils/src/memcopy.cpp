@@ -0,0 +1,212 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define AKVCAM_MEMCOPY_SSE2
+    #include <emmintrin.h>
+#endif
+
+#include "memcopy.h"
+
+namespace AkVCam
+{
+    class MemCopyPrivate
+    {
+        public:
+            std::atomic<size_t> m_streamingThreshold {16 * 1024 * 1024};
+            std::atomic<size_t> m_threadingThreshold {std::numeric_limits<size_t>::max()};
+            std::atomic<int> m_maxThreads {4};
+
+            static void streamCopy(uint8_t *dst, const uint8_t *src, size_t size);
+            static void copyBlock(uint8_t *dst,
+                                  const uint8_t *src,
+                                  size_t size,
+                                  bool streaming);
+    };
+
+    MemCopyPrivate *memCopyPrivate()
+    {
+        static MemCopyPrivate memCopy;
+
+        return &memCopy;
+    }
+}
+
+void AkVCam::MemCopy::copy(void *dst, const void *src, size_t size)
+{
+    if (!dst || !src || size < 1)
+        return;
+
+    auto dstData = reinterpret_cast<uint8_t *>(dst);
+    auto srcData = reinterpret_cast<const uint8_t *>(src);
+    bool streaming = size >= memCopyPrivate()->m_streamingThreshold;
+    int nThreads = std::min<int>(memCopyPrivate()->m_maxThreads,
+                                 int(std::thread::hardware_concurrency()));
+
+    if (size < memCopyPrivate()->m_threadingThreshold || nThreads < 2) {
+        MemCopyPrivate::copyBlock(dstData, srcData, size, streaming);
+
+        return;
+    }
+
+    // Split the buffer in 64 bytes aligned blocks, one per thread.
+    size_t blockSize = (size / size_t(nThreads) + 63) & ~size_t(63);
+    std::vector<std::thread> threads;
+
+    size_t offset = blockSize;
+
+    try {
+        for (; offset < size; offset += blockSize)
+            threads.push_back(std::thread(&MemCopyPrivate::copyBlock,
+                                          dstData + offset,
+                                          srcData + offset,
+                                          std::min(blockSize, size - offset),
+                                          streaming));
+    } catch (const std::system_error &) {
+        // Copy the blocks without a thread from here.
+        if (offset < size)
+            MemCopyPrivate::copyBlock(dstData + offset,
+                                      srcData + offset,
+                                      size - offset,
+                                      streaming);
+    }
+
+    MemCopyPrivate::copyBlock(dstData,
+                              srcData,
+                              std::min(blockSize, size),
+                              streaming);
+
+    for (auto &thread: threads)
+        thread.join();
+}
+
+void AkVCam::MemCopy::copyPlane(void *dst,
+                                size_t dstStride,
+                                const void *src,
+                                size_t srcStride,
+                                size_t lineSize,
+                                size_t lines)
+{
+    if (!dst || !src || lineSize < 1 || lines < 1)
+        return;
+
+    // Contiguous planes can be copied in one go.
+    if (dstStride == srcStride && lineSize == srcStride) {
+        copy(dst, src, lineSize * lines);
+
+        return;
+    }
+
+    auto dstData = reinterpret_cast<uint8_t *>(dst);
+    auto srcData = reinterpret_cast<const uint8_t *>(src);
+    bool streaming = lineSize * lines >= memCopyPrivate()->m_streamingThreshold;
+
+    for (size_t y = 0; y < lines; y++)
+        MemCopyPrivate::copyBlock(dstData + y * dstStride,
+                                  srcData + y * srcStride,
+                                  lineSize,
+                                  streaming);
+}
+
+size_t AkVCam::MemCopy::streamingThreshold()
+{
+    return memCopyPrivate()->m_streamingThreshold;
+}
+
+void AkVCam::MemCopy::setStreamingThreshold(size_t size)
+{
+    memCopyPrivate()->m_streamingThreshold = size;
+}
+
+size_t AkVCam::MemCopy::threadingThreshold()
+{
+    return memCopyPrivate()->m_threadingThreshold;
+}
+
+void AkVCam::MemCopy::setThreadingThreshold(size_t size)
+{
+    memCopyPrivate()->m_threadingThreshold = size;
+}
+
+int AkVCam::MemCopy::maxThreads()
+{
+    return memCopyPrivate()->m_maxThreads;
+}
+
+void AkVCam::MemCopy::setMaxThreads(int threads)
+{
+    memCopyPrivate()->m_maxThreads = std::max(threads, 1);
+}
+
+void AkVCam::MemCopyPrivate::streamCopy(uint8_t *dst,
+                                        const uint8_t *src,
+                                        size_t size)
+{
+#ifdef AKVCAM_MEMCOPY_SSE2
+    // Copy the head until the destination is 16 bytes aligned.
+    auto head = size_t(-reinterpret_cast<intptr_t>(dst) & 15);
+    head = std::min(head, size);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+
+    size_t blocks = size / 64;
+
+    for (size_t i = 0; i < blocks; i++) {
+        auto srcBlock = reinterpret_cast<const __m128i *>(src);
+        auto dstBlock = reinterpret_cast<__m128i *>(dst);
+        auto a = _mm_loadu_si128(srcBlock);
+        auto b = _mm_loadu_si128(srcBlock + 1);
+        auto c = _mm_loadu_si128(srcBlock + 2);
+        auto d = _mm_loadu_si128(srcBlock + 3);
+        _mm_stream_si128(dstBlock, a);
+        _mm_stream_si128(dstBlock + 1, b);
+        _mm_stream_si128(dstBlock + 2, c);
+        _mm_stream_si128(dstBlock + 3, d);
+        src += 64;
+        dst += 64;
+    }
+
+    _mm_sfence();
+    memcpy(dst, src, size - 64 * blocks);
+#else
+    memcpy(dst, src, size);
+#endif
+}
+
+void AkVCam::MemCopyPrivate::copyBlock(uint8_t *dst,
+                                       const uint8_t *src,
+                                       size_t size,
+                                       bool streaming)
+{
+    if (streaming)
+        streamCopy(dst, src, size);
+    else
+        memcpy(dst, src, size);
+}
@@ -0,0 +1,56 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_MEMCOPY_H
+#define AKVCAMUTILS_MEMCOPY_H
+
+#include <cstddef>
+
+namespace AkVCam
+{
+    /* Copy routines for frame sized buffers.
+     *
+     * Buffers bigger than the streaming threshold, about the size of a last
+     * level cache, are written with non-temporal stores, so copying a frame
+     * doesn't evict the data the consumer is about to read. Smaller buffers
+     * are faster to read back when copied through the cache.
+     * Buffers bigger than the threading threshold are also split between
+     * several threads. Splitting is off by default, since starting the
+     * threads costs more than it saves for frame sized buffers (see the
+     * VCamUtils benchmarks).
+     */
+    namespace MemCopy
+    {
+        void copy(void *dst, const void *src, size_t size);
+        void copyPlane(void *dst,
+                       size_t dstStride,
+                       const void *src,
+                       size_t srcStride,
+                       size_t lineSize,
+                       size_t lines);
+        size_t streamingThreshold();
+        void setStreamingThreshold(size_t size);
+        size_t threadingThreshold();
+        void setThreadingThreshold(size_t size);
+        int maxThreads();
+        void setMaxThreads(int threads);
+    }
+}
+
+#endif // AKVCAMUTILS_MEMCOPY_H
@@ -0,0 +1,408 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#include "memoryaccounting.h"
+#include "logger.h"
+#include "stats.h"
+
+// Interval over which the allocation rate is measured, in milliseconds.
+#define MEMORYACCOUNTING_RATE_WINDOW 1000
+
+namespace AkVCam
+{
+    class MemoryCounters
+    {
+        public:
+            std::atomic<uint64_t> &m_current;
+            std::atomic<uint64_t> &m_peak;
+            std::atomic<uint64_t> &m_allocations;
+            std::atomic<uint64_t> &m_allocated;
+            std::atomic<uint64_t> &m_rate;
+            std::atomic<uint64_t> m_windowStart {0};
+            std::atomic<uint64_t> m_windowAllocated {0};
+
+            explicit MemoryCounters(const std::string &prefix);
+            void add(uint64_t size);
+            void remove(uint64_t size);
+            void updateRate();
+            MemoryUsage usage();
+    };
+
+    struct DeviceMemory
+    {
+        std::unique_ptr<MemoryCounters> counters;
+        std::atomic<uint64_t> *overBudgetCounter {nullptr};
+        bool overBudget {false};
+    };
+
+    class MemoryAccountingPrivate
+    {
+        public:
+            std::unique_ptr<MemoryCounters> m_categories[MemoryCategoryCount];
+            std::map<std::string, DeviceMemory> m_devices;
+            std::atomic<uint64_t> m_budget {0};
+            std::mutex m_mutex;
+
+            MemoryAccountingPrivate();
+            DeviceMemory &device(const std::string &deviceId);
+            void resizeDevice(const std::string &deviceId,
+                              uint64_t from,
+                              uint64_t to);
+            void checkBudget(const std::string &deviceId,
+                             DeviceMemory &device);
+    };
+
+    class MemoryAccountPrivate
+    {
+        public:
+            MemoryCategory m_category {MemoryCategoryCount};
+            std::string m_deviceId;
+            uint64_t m_size {0};
+    };
+
+    /* Frames and pools may be released from static destructors, so the
+     * accounting is never destroyed.
+     */
+    inline MemoryAccountingPrivate *memoryAccountingPrivate()
+    {
+        static auto accounting = new MemoryAccountingPrivate;
+
+        return accounting;
+    }
+}
+
+void AkVCam::MemoryAccounting::allocated(MemoryCategory category, size_t size)
+{
+    if (category < 0 || category >= MemoryCategoryCount || size < 1)
+        return;
+
+    memoryAccountingPrivate()->m_categories[category]->add(size);
+}
+
+void AkVCam::MemoryAccounting::released(MemoryCategory category, size_t size)
+{
+    if (category < 0 || category >= MemoryCategoryCount || size < 1)
+        return;
+
+    memoryAccountingPrivate()->m_categories[category]->remove(size);
+}
+
+AkVCam::MemoryUsage AkVCam::MemoryAccounting::usage(MemoryCategory category)
+{
+    if (category < 0 || category >= MemoryCategoryCount)
+        return {};
+
+    return memoryAccountingPrivate()->m_categories[category]->usage();
+}
+
+std::string AkVCam::MemoryAccounting::categoryName(MemoryCategory category)
+{
+    static const std::map<MemoryCategory, std::string> names {
+        {MemoryCategoryFrames      , "frames"       },
+        {MemoryCategoryPools       , "pools"        },
+        {MemoryCategoryLuts        , "luts"         },
+        {MemoryCategoryPlans       , "plans"        },
+        {MemoryCategoryPictures    , "pictures"     },
+        {MemoryCategorySharedMemory, "shared_memory"},
+    };
+
+    auto it = names.find(category);
+
+    if (it == names.end())
+        return {};
+
+    return it->second;
+}
+
+std::vector<std::string> AkVCam::MemoryAccounting::devices()
+{
+    auto accounting = memoryAccountingPrivate();
+    std::lock_guard<std::mutex> lock(accounting->m_mutex);
+    std::vector<std::string> devices;
+
+    for (auto &device: accounting->m_devices)
+        devices.push_back(device.first);
+
+    return devices;
+}
+
+AkVCam::MemoryUsage AkVCam::MemoryAccounting::deviceUsage(const std::string &deviceId)
+{
+    auto accounting = memoryAccountingPrivate();
+    std::lock_guard<std::mutex> lock(accounting->m_mutex);
+    auto it = accounting->m_devices.find(deviceId);
+
+    if (it == accounting->m_devices.end())
+        return {};
+
+    return it->second.counters->usage();
+}
+
+uint64_t AkVCam::MemoryAccounting::deviceBudget()
+{
+    return memoryAccountingPrivate()->m_budget;
+}
+
+void AkVCam::MemoryAccounting::setDeviceBudget(uint64_t budget)
+{
+    auto accounting = memoryAccountingPrivate();
+    std::lock_guard<std::mutex> lock(accounting->m_mutex);
+    accounting->m_budget = budget;
+
+    for (auto &device: accounting->m_devices)
+        accounting->checkBudget(device.first, device.second);
+}
+
+bool AkVCam::MemoryAccounting::isOverBudget(const std::string &deviceId)
+{
+    auto accounting = memoryAccountingPrivate();
+    std::lock_guard<std::mutex> lock(accounting->m_mutex);
+    auto it = accounting->m_devices.find(deviceId);
+
+    return it != accounting->m_devices.end() && it->second.overBudget;
+}
+
+std::string AkVCam::MemoryAccounting::toString()
+{
+    std::stringstream ss;
+    auto printUsage = [&ss] (const std::string &name,
+                             const MemoryUsage &usage) {
+        ss << name
+           << ": "
+           << usage.current
+           << " bytes, peak "
+           << usage.peak
+           << ", "
+           << usage.allocations
+           << " allocations, "
+           << usage.rate
+           << " bytes/s"
+           << std::endl;
+    };
+
+    for (int i = 0; i < MemoryCategoryCount; i++) {
+        auto category = MemoryCategory(i);
+        printUsage(categoryName(category), usage(category));
+    }
+
+    for (auto &deviceId: devices())
+        printUsage(deviceId, deviceUsage(deviceId));
+
+    return ss.str();
+}
+
+AkVCam::MemoryAccount::MemoryAccount(const std::string &deviceId)
+{
+    this->d = new MemoryAccountPrivate;
+    this->d->m_deviceId = deviceId;
+}
+
+AkVCam::MemoryAccount::MemoryAccount(MemoryCategory category,
+                                     const std::string &deviceId)
+{
+    this->d = new MemoryAccountPrivate;
+    this->d->m_category = category;
+    this->d->m_deviceId = deviceId;
+}
+
+AkVCam::MemoryAccount::~MemoryAccount()
+{
+    this->setSize(0);
+    delete this->d;
+}
+
+std::string AkVCam::MemoryAccount::deviceId() const
+{
+    return this->d->m_deviceId;
+}
+
+void AkVCam::MemoryAccount::setDeviceId(const std::string &deviceId)
+{
+    if (this->d->m_deviceId == deviceId)
+        return;
+
+    auto accounting = memoryAccountingPrivate();
+
+    if (!this->d->m_deviceId.empty())
+        accounting->resizeDevice(this->d->m_deviceId, this->d->m_size, 0);
+
+    if (!deviceId.empty())
+        accounting->resizeDevice(deviceId, 0, this->d->m_size);
+
+    this->d->m_deviceId = deviceId;
+}
+
+uint64_t AkVCam::MemoryAccount::size() const
+{
+    return this->d->m_size;
+}
+
+void AkVCam::MemoryAccount::setSize(uint64_t size)
+{
+    if (size == this->d->m_size)
+        return;
+
+    if (size > this->d->m_size)
+        MemoryAccounting::allocated(this->d->m_category,
+                                    size_t(size - this->d->m_size));
+    else
+        MemoryAccounting::released(this->d->m_category,
+                                   size_t(this->d->m_size - size));
+
+    if (!this->d->m_deviceId.empty())
+        memoryAccountingPrivate()->resizeDevice(this->d->m_deviceId,
+                                                this->d->m_size,
+                                                size);
+
+    this->d->m_size = size;
+}
+
+AkVCam::MemoryCounters::MemoryCounters(const std::string &prefix):
+    m_current(Stats::counter(prefix + "_bytes")),
+    m_peak(Stats::counter(prefix + "_peak")),
+    m_allocations(Stats::counter(prefix + "_allocs")),
+    m_allocated(Stats::counter(prefix + "_allocated")),
+    m_rate(Stats::counter(prefix + "_rate"))
+{
+}
+
+void AkVCam::MemoryCounters::add(uint64_t size)
+{
+    auto current = (this->m_current += size);
+    auto peak = this->m_peak.load();
+
+    while (current > peak
+           && !this->m_peak.compare_exchange_weak(peak, current)) {
+    }
+
+    this->m_allocations++;
+    this->m_allocated += size;
+    this->updateRate();
+}
+
+void AkVCam::MemoryCounters::remove(uint64_t size)
+{
+    this->m_current -= size;
+}
+
+void AkVCam::MemoryCounters::updateRate()
+{
+    auto now = uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>
+                            (std::chrono::steady_clock::now().time_since_epoch()).count());
+    auto start = this->m_windowStart.load();
+
+    if (now - start < MEMORYACCOUNTING_RATE_WINDOW)
+        return;
+
+    // Only one thread closes each window.
+    if (!this->m_windowStart.compare_exchange_strong(start, now))
+        return;
+
+    auto allocated = this->m_allocated.load();
+    auto previous = this->m_windowAllocated.exchange(allocated);
+    this->m_rate = start? 1000 * (allocated - previous) / (now - start): 0;
+}
+
+AkVCam::MemoryUsage AkVCam::MemoryCounters::usage()
+{
+    this->updateRate();
+    MemoryUsage usage;
+    usage.current = this->m_current;
+    usage.peak = this->m_peak;
+    usage.allocations = this->m_allocations;
+    usage.allocated = this->m_allocated;
+    usage.rate = this->m_rate;
+
+    return usage;
+}
+
+AkVCam::MemoryAccountingPrivate::MemoryAccountingPrivate()
+{
+    for (int i = 0; i < MemoryCategoryCount; i++) {
+        auto name = MemoryAccounting::categoryName(MemoryCategory(i));
+        this->m_categories[i] =
+                std::unique_ptr<MemoryCounters>(new MemoryCounters("mem_" + name));
+    }
+}
+
+AkVCam::DeviceMemory &AkVCam::MemoryAccountingPrivate::device(const std::string &deviceId)
+{
+    auto &device = this->m_devices[deviceId];
+
+    if (!device.counters) {
+        auto prefix = "mem_device_" + deviceId;
+        device.counters =
+                std::unique_ptr<MemoryCounters>(new MemoryCounters(prefix));
+        device.overBudgetCounter = &Stats::counter(prefix + "_over_budget");
+    }
+
+    return device;
+}
+
+void AkVCam::MemoryAccountingPrivate::resizeDevice(const std::string &deviceId,
+                                                   uint64_t from,
+                                                   uint64_t to)
+{
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    auto &device = this->device(deviceId);
+
+    if (to > from)
+        device.counters->add(to - from);
+    else
+        device.counters->remove(from - to);
+
+    this->checkBudget(deviceId, device);
+}
+
+void AkVCam::MemoryAccountingPrivate::checkBudget(const std::string &deviceId,
+                                                  DeviceMemory &device)
+{
+    uint64_t budget = this->m_budget;
+    uint64_t current = device.counters->m_current;
+    bool overBudget = budget > 0 && current > budget;
+
+    if (overBudget == device.overBudget)
+        return;
+
+    device.overBudget = overBudget;
+
+    if (overBudget) {
+        (*device.overBudgetCounter)++;
+        AkLogWarning() << "Device "
+                       << deviceId
+                       << " holds "
+                       << current
+                       << " bytes, over its budget of "
+                       << budget
+                       << " bytes"
+                       << std::endl;
+    } else {
+        AkLogInfo() << "Device "
+                    << deviceId
+                    << " is within its memory budget again"
+                    << std::endl;
+    }
+}
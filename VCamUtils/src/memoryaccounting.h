@@ -0,0 +1,103 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_MEMORYACCOUNTING_H
+#define AKVCAMUTILS_MEMORYACCOUNTING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AkVCam
+{
+    class MemoryAccountPrivate;
+
+    enum MemoryCategory
+    {
+        MemoryCategoryFrames,       // VideoFrame buffers.
+        MemoryCategoryPools,        // Buffers of the sample pools.
+        MemoryCategoryLuts,         // Lookup tables of the image adjusts.
+        MemoryCategoryPlans,        // Cached filter graph plans.
+        MemoryCategoryPictures,     // Placeholder pictures of the streams.
+        MemoryCategorySharedMemory, // Shared segments and surfaces.
+        MemoryCategoryCount
+    };
+
+    struct MemoryUsage
+    {
+        uint64_t current {0};
+        uint64_t peak {0};
+        uint64_t allocations {0};
+
+        // Total bytes allocated, and bytes allocated per second.
+        uint64_t allocated {0};
+        uint64_t rate {0};
+    };
+
+    /* Process wide accounting of the memory used by each subsystem.
+     *
+     * The usage of each category is exported as the Stats counters
+     * mem_CATEGORY_bytes, _peak, _allocs, _allocated and _rate. The
+     * categories are views of the same memory, the pictures for instance are
+     * also counted as frames.
+     * The bytes held on behalf of a device are counted by MemoryAccount
+     * objects, exported as mem_device_DEVICE_bytes, _peak and _over_budget,
+     * and checked against the device budget.
+     */
+    namespace MemoryAccounting
+    {
+        void allocated(MemoryCategory category, size_t size);
+        void released(MemoryCategory category, size_t size);
+        MemoryUsage usage(MemoryCategory category);
+        std::string categoryName(MemoryCategory category);
+        std::vector<std::string> devices();
+        MemoryUsage deviceUsage(const std::string &deviceId);
+
+        // Bytes each device is expected to hold at most, 0 for no limit.
+        uint64_t deviceBudget();
+        void setDeviceBudget(uint64_t budget);
+        bool isOverBudget(const std::string &deviceId);
+        std::string toString();
+    }
+
+    /* Memory held by an object, counted in a category, on behalf of a
+     * device, or both. The size is released on destruction. An account
+     * must not be updated from several threads at the same time.
+     */
+    class MemoryAccount
+    {
+        public:
+            explicit MemoryAccount(const std::string &deviceId={});
+            explicit MemoryAccount(MemoryCategory category,
+                                   const std::string &deviceId={});
+            MemoryAccount(const MemoryAccount &other) = delete;
+            ~MemoryAccount();
+
+            std::string deviceId() const;
+            void setDeviceId(const std::string &deviceId);
+            uint64_t size() const;
+            void setSize(uint64_t size);
+
+        private:
+            MemoryAccountPrivate *d;
+    };
+}
+
+#endif // AKVCAMUTILS_MEMORYACCOUNTING_H
@@ -0,0 +1,164 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifdef __linux__
+    #include <cerrno>
+    #include <cstring>
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#include "perfcounters.h"
+#include "logger.h"
+
+namespace AkVCam
+{
+    class PerfCountersPrivate
+    {
+        public:
+#ifdef __linux__
+            // Group leader (cycles), instructions, cache misses and branch
+            // misses. Only the cycles are required.
+            int m_fds[4] {-1, -1, -1, -1};
+
+            static int openEvent(uint64_t config, int groupFd);
+#endif
+    };
+}
+
+AkVCam::PerfCounts AkVCam::PerfCounts::operator -(const PerfCounts &other) const
+{
+    PerfCounts counts;
+    counts.cycles = this->cycles - other.cycles;
+    counts.instructions = this->instructions - other.instructions;
+    counts.cacheMisses = this->cacheMisses - other.cacheMisses;
+    counts.branchMisses = this->branchMisses - other.branchMisses;
+
+    return counts;
+}
+
+AkVCam::PerfCounts &AkVCam::PerfCounts::operator +=(const PerfCounts &other)
+{
+    this->cycles += other.cycles;
+    this->instructions += other.instructions;
+    this->cacheMisses += other.cacheMisses;
+    this->branchMisses += other.branchMisses;
+
+    return *this;
+}
+
+double AkVCam::PerfCounts::ipc() const
+{
+    return this->cycles? double(this->instructions) / double(this->cycles): 0.0;
+}
+
+AkVCam::PerfCounters::PerfCounters()
+{
+    this->d = new PerfCountersPrivate;
+
+#ifdef __linux__
+    static const uint64_t events[] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    auto &fds = this->d->m_fds;
+    fds[0] = PerfCountersPrivate::openEvent(events[0], -1);
+
+    if (fds[0] < 0) {
+        AkLogWarning() << "Performance counters not available: "
+                       << strerror(errno)
+                       << std::endl;
+
+        return;
+    }
+
+    for (int i = 1; i < 4; i++)
+        fds[i] = PerfCountersPrivate::openEvent(events[i], fds[0]);
+
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+AkVCam::PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for (auto &fd: this->d->m_fds)
+        if (fd >= 0)
+            close(fd);
+#endif
+
+    delete this->d;
+}
+
+bool AkVCam::PerfCounters::isAvailable() const
+{
+#ifdef __linux__
+    return this->d->m_fds[0] >= 0;
+#else
+    return false;
+#endif
+}
+
+AkVCam::PerfCounts AkVCam::PerfCounters::read() const
+{
+    PerfCounts counts;
+
+#ifdef __linux__
+    uint64_t *values[] = {
+        &counts.cycles,
+        &counts.instructions,
+        &counts.cacheMisses,
+        &counts.branchMisses,
+    };
+
+    for (int i = 0; i < 4; i++) {
+        if (this->d->m_fds[i] < 0)
+            continue;
+
+        uint64_t value = 0;
+
+        if (::read(this->d->m_fds[i], &value, sizeof(value)) == sizeof(value))
+            *values[i] = value;
+    }
+#endif
+
+    return counts;
+}
+
+#ifdef __linux__
+int AkVCam::PerfCountersPrivate::openEvent(uint64_t config, int groupFd)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(perf_event_attr));
+    attr.size = sizeof(perf_event_attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = groupFd < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return int(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+#endif
@@ -0,0 +1,66 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_PERFCOUNTERS_H
+#define AKVCAMUTILS_PERFCOUNTERS_H
+
+#include <cstdint>
+
+namespace AkVCam
+{
+    class PerfCountersPrivate;
+
+    // Hardware events counted while running a region of code.
+    struct PerfCounts
+    {
+        uint64_t cycles {0};
+        uint64_t instructions {0};
+        uint64_t cacheMisses {0};
+        uint64_t branchMisses {0};
+
+        PerfCounts operator -(const PerfCounts &other) const;
+        PerfCounts &operator +=(const PerfCounts &other);
+
+        // Instructions per cycle.
+        double ipc() const;
+    };
+
+    /* Hardware performance counters of the thread that creates the object.
+     *
+     * Uses perf_event_open() on Linux. Elsewhere, or if the kernel doesn't
+     * allow it (see /proc/sys/kernel/perf_event_paranoid), isAvailable()
+     * returns false and all the counts are 0. Wrap a region with two
+     * read() calls and subtract the results.
+     */
+    class PerfCounters
+    {
+        public:
+            PerfCounters();
+            PerfCounters(const PerfCounters &other) = delete;
+            ~PerfCounters();
+
+            bool isAvailable() const;
+            PerfCounts read() const;
+
+        private:
+            PerfCountersPrivate *d;
+    };
+}
+
+#endif // AKVCAMUTILS_PERFCOUNTERS_H
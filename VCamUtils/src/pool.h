@@ -0,0 +1,316 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_POOL_H
+#define AKVCAMUTILS_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "stats.h"
+
+namespace AkVCam
+{
+    /* Bounded pool of reusable items.
+     *
+     * The free items are kept in a lock-free stack, so acquire and release
+     * don't take any lock while there are free items. When the pool is
+     * empty, acquire blocks until an item is released, the timeout expires
+     * or the pool is canceled. The number of waits and the time spent
+     * waiting are published to Stats as pool_<name>_waits and
+     * pool_<name>_wait_us.
+     */
+    template <typename T>
+    class Pool
+    {
+        public:
+            explicit Pool(const std::string &name={}):
+                m_name(name)
+            {
+                if (!name.empty()) {
+                    this->m_waitsCounter =
+                            &Stats::counter("pool_" + name + "_waits");
+                    this->m_waitTimeCounter =
+                            &Stats::counter("pool_" + name + "_wait_us");
+                }
+            }
+
+            Pool(const Pool &other) = delete;
+
+            std::string name() const
+            {
+                return this->m_name;
+            }
+
+            size_t size() const
+            {
+                return this->m_items.size();
+            }
+
+            size_t available() const
+            {
+                return this->m_available;
+            }
+
+            // Items acquired and not released yet.
+            size_t used() const
+            {
+                return this->size() - this->available();
+            }
+
+            const std::vector<T> &items() const
+            {
+                return this->m_items;
+            }
+
+            /* Replaces the items of the pool, all of them start free. It
+             * fails if any item is in use, and must not be called
+             * concurrently with acquire or release.
+             */
+            bool setItems(const std::vector<T> &items)
+            {
+                if (this->used() > 0
+                    || items.size() >= std::numeric_limits<uint32_t>::max())
+                    return false;
+
+                this->m_items = items;
+                this->m_next.reset(new std::atomic<uint32_t>[items.size()]);
+                this->m_used.reset(new std::atomic<bool>[items.size()]);
+                this->m_head = 0;
+                this->m_available = 0;
+                this->m_canceled = false;
+
+                for (size_t i = items.size(); i > 0; i--) {
+                    this->m_used[i - 1] = true;
+                    this->release(i - 1);
+                }
+
+                return true;
+            }
+
+            /* Returns the index of a free item, or npos if there is none or
+             * the pool is canceled.
+             */
+            size_t tryAcquire()
+            {
+                if (this->m_canceled)
+                    return npos;
+
+                auto head = this->m_head.load();
+
+                for (;;) {
+                    auto index = uint32_t(head);
+
+                    if (!index)
+                        return npos;
+
+                    auto next = this->m_next[index - 1].load();
+                    auto newHead = this->nextTag(head) | next;
+
+                    if (this->m_head.compare_exchange_weak(head, newHead))
+                        break;
+                }
+
+                auto index = size_t(uint32_t(head) - 1);
+                this->m_used[index] = true;
+                this->m_available--;
+
+                /* Canceled while taking it, give it back. The waiters are
+                 * woken up by cancel(), and may be holding m_mutex.
+                 */
+                if (this->m_canceled) {
+                    this->push(index);
+
+                    return npos;
+                }
+
+                return index;
+            }
+
+            /* Waits up to timeout milliseconds for a free item, a negative
+             * timeout waits forever. Returns npos on failure.
+             */
+            size_t acquire(int timeout=-1)
+            {
+                auto index = this->tryAcquire();
+
+                if (index != npos
+                    || timeout == 0
+                    || this->m_items.empty()
+                    || this->m_canceled)
+                    return index;
+
+                auto start = std::chrono::steady_clock::now();
+                std::unique_lock<std::mutex> lock(this->m_mutex);
+                this->m_waiters++;
+                auto ready = [this, &index] () {
+                    index = this->tryAcquire();
+
+                    return index != npos || this->m_canceled;
+                };
+
+                if (timeout < 0)
+                    this->m_released.wait(lock, ready);
+                else
+                    this->m_released.wait_for(lock,
+                                              std::chrono::milliseconds(timeout),
+                                              ready);
+
+                this->m_waiters--;
+                lock.unlock();
+                auto waitTime =
+                        std::chrono::duration_cast<std::chrono::microseconds>
+                            (std::chrono::steady_clock::now() - start).count();
+                this->m_waits++;
+                this->m_waitTime += uint64_t(waitTime);
+
+                if (this->m_waitsCounter) {
+                    (*this->m_waitsCounter)++;
+                    (*this->m_waitTimeCounter) += uint64_t(waitTime);
+                }
+
+                return index;
+            }
+
+            bool acquire(T *item, int timeout=-1)
+            {
+                auto index = this->acquire(timeout);
+
+                if (index == npos)
+                    return false;
+
+                *item = this->m_items[index];
+
+                return true;
+            }
+
+            // Returns the item to the pool, releasing a free item is a no-op.
+            bool release(size_t index)
+            {
+                if (index >= this->m_items.size())
+                    return false;
+
+                if (!this->push(index))
+                    return false;
+
+                if (this->m_waiters > 0) {
+                    std::lock_guard<std::mutex> lock(this->m_mutex);
+                    this->m_released.notify_one();
+                }
+
+                return true;
+            }
+
+            bool release(const T &item)
+            {
+                auto it = std::find(this->m_items.begin(),
+                                    this->m_items.end(),
+                                    item);
+
+                if (it == this->m_items.end())
+                    return false;
+
+                return this->release(size_t(it - this->m_items.begin()));
+            }
+
+            // Wakes up all waiters, acquire fails until setItems or resume is
+            // called.
+            void cancel()
+            {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                this->m_canceled = true;
+                this->m_released.notify_all();
+            }
+
+            // Undoes cancel(), keeping the items.
+            void resume()
+            {
+                this->m_canceled = false;
+            }
+
+            uint64_t waits() const
+            {
+                return this->m_waits;
+            }
+
+            // Total time spent waiting for an item, in microseconds.
+            uint64_t waitTime() const
+            {
+                return this->m_waitTime;
+            }
+
+            static const size_t npos = std::numeric_limits<size_t>::max();
+
+        private:
+            std::string m_name;
+            std::vector<T> m_items;
+
+            // The low 32 bits of the head are the index of the first free
+            // item plus one, the high ones a tag that avoids ABA problems.
+            std::atomic<uint64_t> m_head {0};
+            std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+            std::unique_ptr<std::atomic<bool>[]> m_used;
+            std::atomic<size_t> m_available {0};
+            std::atomic<bool> m_canceled {false};
+            std::atomic<int> m_waiters {0};
+            std::atomic<uint64_t> m_waits {0};
+            std::atomic<uint64_t> m_waitTime {0};
+            std::atomic<uint64_t> *m_waitsCounter {nullptr};
+            std::atomic<uint64_t> *m_waitTimeCounter {nullptr};
+            std::mutex m_mutex;
+            std::condition_variable m_released;
+
+            inline static uint64_t nextTag(uint64_t head)
+            {
+                return ((head >> 32) + 1) << 32;
+            }
+
+            // Puts a used item back in the free stack.
+            bool push(size_t index)
+            {
+                if (!this->m_used[index].exchange(false))
+                    return false;
+
+                auto head = this->m_head.load();
+                uint64_t newHead;
+
+                do {
+                    this->m_next[index] = uint32_t(head);
+                    newHead = this->nextTag(head) | uint32_t(index + 1);
+                } while (!this->m_head.compare_exchange_weak(head, newHead));
+
+                this->m_available++;
+
+                return true;
+            }
+    };
+
+    template <typename T>
+    const size_t Pool<T>::npos;
+}
+
+#endif // AKVCAMUTILS_POOL_H
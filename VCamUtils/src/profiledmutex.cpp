@@ -0,0 +1,181 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "profiledmutex.h"
+#include "stats.h"
+
+// Upper bounds of the histogram buckets in microseconds.
+#define LOCKPROFILE_BUCKETS {1, 4, 16, 64, 256, 1024, 4096}
+
+namespace AkVCam
+{
+    using Counter = std::atomic<uint64_t>;
+
+    struct LockHistogram
+    {
+        std::vector<uint64_t> bounds;
+        std::vector<Counter *> buckets;
+
+        LockHistogram(const std::string &name);
+        inline void add(uint64_t time);
+    };
+
+    class LockProfilePrivate
+    {
+        public:
+            Counter &m_acquired;
+            Counter &m_contended;
+            Counter &m_waitTime;
+            Counter &m_holdTime;
+            LockHistogram m_waitHistogram;
+            LockHistogram m_holdHistogram;
+
+            explicit LockProfilePrivate(const std::string &site);
+    };
+
+    class ProfiledMutexPrivate
+    {
+        public:
+            std::mutex m_mutex;
+            LockProfile m_profile;
+            uint64_t m_lockTime {0};
+
+            explicit ProfiledMutexPrivate(const std::string &site);
+    };
+}
+
+AkVCam::LockProfile::LockProfile(const std::string &site)
+{
+    this->d = new LockProfilePrivate(site);
+}
+
+AkVCam::LockProfile::~LockProfile()
+{
+    delete this->d;
+}
+
+void AkVCam::LockProfile::acquired(bool contended, uint64_t waitTime)
+{
+    this->d->m_acquired.fetch_add(1, std::memory_order_relaxed);
+
+    if (!contended)
+        return;
+
+    this->d->m_contended.fetch_add(1, std::memory_order_relaxed);
+    this->d->m_waitTime.fetch_add(waitTime, std::memory_order_relaxed);
+    this->d->m_waitHistogram.add(waitTime);
+}
+
+void AkVCam::LockProfile::released(uint64_t holdTime)
+{
+    this->d->m_holdTime.fetch_add(holdTime, std::memory_order_relaxed);
+    this->d->m_holdHistogram.add(holdTime);
+}
+
+uint64_t AkVCam::LockProfile::now()
+{
+    auto time = std::chrono::steady_clock::now().time_since_epoch();
+
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+}
+
+AkVCam::ProfiledMutex::ProfiledMutex(const std::string &site)
+{
+    this->d = new ProfiledMutexPrivate(site);
+}
+
+AkVCam::ProfiledMutex::~ProfiledMutex()
+{
+    delete this->d;
+}
+
+void AkVCam::ProfiledMutex::lock()
+{
+    if (this->d->m_mutex.try_lock()) {
+        this->d->m_lockTime = LockProfile::now();
+        this->d->m_profile.acquired(false, 0);
+
+        return;
+    }
+
+    auto waitStart = LockProfile::now();
+    this->d->m_mutex.lock();
+    this->d->m_lockTime = LockProfile::now();
+    this->d->m_profile.acquired(true, this->d->m_lockTime - waitStart);
+}
+
+bool AkVCam::ProfiledMutex::try_lock()
+{
+    if (!this->d->m_mutex.try_lock())
+        return false;
+
+    this->d->m_lockTime = LockProfile::now();
+    this->d->m_profile.acquired(false, 0);
+
+    return true;
+}
+
+void AkVCam::ProfiledMutex::unlock()
+{
+    auto holdTime = LockProfile::now() - this->d->m_lockTime;
+    this->d->m_mutex.unlock();
+    this->d->m_profile.released(holdTime);
+}
+
+AkVCam::LockHistogram::LockHistogram(const std::string &name):
+    bounds(LOCKPROFILE_BUCKETS)
+{
+    for (auto &bound: this->bounds) {
+        auto counterName = name + "_le" + std::to_string(bound) + "us";
+        this->buckets.push_back(&Stats::counter(counterName));
+        bound *= 1000;
+    }
+
+    this->buckets.push_back(&Stats::counter(name + "_more"));
+}
+
+void AkVCam::LockHistogram::add(uint64_t time)
+{
+    size_t i = 0;
+
+    while (i < this->bounds.size() && time > this->bounds[i])
+        i++;
+
+    this->buckets[i]->fetch_add(1, std::memory_order_relaxed);
+}
+
+AkVCam::LockProfilePrivate::LockProfilePrivate(const std::string &site):
+    m_acquired(Stats::counter("lock_" + site + "_acquired")),
+    m_contended(Stats::counter("lock_" + site + "_contended")),
+    m_waitTime(Stats::counter("lock_" + site + "_wait_ns")),
+    m_holdTime(Stats::counter("lock_" + site + "_hold_ns")),
+    m_waitHistogram("lock_" + site + "_wait"),
+    m_holdHistogram("lock_" + site + "_hold")
+{
+}
+
+AkVCam::ProfiledMutexPrivate::ProfiledMutexPrivate(const std::string &site):
+    m_profile(site)
+{
+}
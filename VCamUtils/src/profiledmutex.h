@@ -0,0 +1,78 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_PROFILEDMUTEX_H
+#define AKVCAMUTILS_PROFILEDMUTEX_H
+
+#include <cstdint>
+#include <string>
+
+namespace AkVCam
+{
+    class LockProfilePrivate;
+    class ProfiledMutexPrivate;
+
+    /* Lock statistics of a named lock site, exported as Stats counters:
+     *
+     * lock_SITE_acquired, lock_SITE_contended: acquisitions and how many
+     *     of them had to wait.
+     * lock_SITE_wait_ns, lock_SITE_hold_ns: total wait and hold time.
+     * lock_SITE_wait_leNus, lock_SITE_hold_leNus: histograms, one counter
+     *     per bucket of up to N microseconds, plus a _more bucket.
+     *
+     * All the locks with the same site name share their counters.
+     */
+    class LockProfile
+    {
+        public:
+            explicit LockProfile(const std::string &site);
+            LockProfile(const LockProfile &other) = delete;
+            ~LockProfile();
+
+            void acquired(bool contended, uint64_t waitTime);
+            void released(uint64_t holdTime);
+
+            // Monotonic time in nanoseconds.
+            static uint64_t now();
+
+        private:
+            LockProfilePrivate *d;
+    };
+
+    /* Drop-in replacement for std::mutex that keeps the profile of its
+     * lock site. The uncontended path only adds a try_lock and two clock
+     * reads.
+     */
+    class ProfiledMutex
+    {
+        public:
+            explicit ProfiledMutex(const std::string &site);
+            ProfiledMutex(const ProfiledMutex &other) = delete;
+            ~ProfiledMutex();
+
+            void lock();
+            bool try_lock();
+            void unlock();
+
+        private:
+            ProfiledMutexPrivate *d;
+    };
+}
+
+#endif // AKVCAMUTILS_PROFILEDMUTEX_H
@@ -0,0 +1,330 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+
+#include "queuecontroller.h"
+#include "logger.h"
+#include "stats.h"
+
+// Weight of the last sample in the rate estimations.
+#define RATE_SMOOTHING 0.1
+
+// Time the queue must stay below the target before shrinking it.
+#define SHRINK_DELAY 2000000000
+
+// Time given to a consumer to take advantage of a deeper queue.
+#define PROBE_TIME 1000000000
+
+// Time to wait before giving more room to a slow consumer again.
+#define PROBE_BACKOFF 10000000000
+
+namespace AkVCam
+{
+    class QueueControllerPrivate
+    {
+        public:
+            size_t m_minDepth;
+            size_t m_maxDepth;
+            QueueController::Policy m_policy;
+            size_t m_target {0};
+            size_t m_lastOccupancy {0};
+            int64_t m_startTime {-1};
+            int64_t m_lastTime {-1};
+            int64_t m_belowSince {-1};
+            int64_t m_probeSince {-1};
+            int64_t m_noProbeUntil {-1};
+            double m_probeDrainRate {0.0};
+            double m_drainRate {-1.0};
+            double m_produceRate {-1.0};
+            uint64_t m_enqueued {0};
+            uint64_t m_dropped {0};
+            uint64_t m_skipped {0};
+            mutable std::mutex m_mutex;
+
+            static void smooth(double *rate, double sample);
+            void setTarget(size_t target, const char *reason);
+    };
+}
+
+AkVCam::QueueController::QueueController(size_t minDepth,
+                                         size_t maxDepth,
+                                         Policy policy)
+{
+    this->d = new QueueControllerPrivate;
+    this->d->m_policy = policy;
+    this->setDepthRange(minDepth, maxDepth);
+}
+
+AkVCam::QueueController::~QueueController()
+{
+    delete this->d;
+}
+
+size_t AkVCam::QueueController::minDepth() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_minDepth;
+}
+
+size_t AkVCam::QueueController::maxDepth() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_maxDepth;
+}
+
+void AkVCam::QueueController::setDepthRange(size_t minDepth, size_t maxDepth)
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    this->d->m_minDepth = std::max<size_t>(minDepth, 1);
+    this->d->m_maxDepth = std::max(maxDepth, this->d->m_minDepth);
+    this->d->m_target = this->d->m_minDepth;
+}
+
+AkVCam::QueueController::Policy AkVCam::QueueController::policy() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_policy;
+}
+
+void AkVCam::QueueController::setPolicy(Policy policy)
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    this->d->m_policy = policy;
+}
+
+size_t AkVCam::QueueController::targetDepth() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_target;
+}
+
+double AkVCam::QueueController::drainRate() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return std::max(this->d->m_drainRate, 0.0);
+}
+
+double AkVCam::QueueController::produceRate() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return std::max(this->d->m_produceRate, 0.0);
+}
+
+uint64_t AkVCam::QueueController::enqueued() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_enqueued;
+}
+
+uint64_t AkVCam::QueueController::dropped() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_dropped;
+}
+
+uint64_t AkVCam::QueueController::skipped() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_skipped;
+}
+
+AkVCam::QueueController::Decision AkVCam::QueueController::update(size_t occupancy,
+                                                                  int64_t now)
+{
+    static auto &enqueuedCounter = Stats::counter("queue_enqueued");
+    static auto &droppedCounter = Stats::counter("queue_dropped");
+    static auto &skippedCounter = Stats::counter("queue_skipped");
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    if (this->d->m_lastTime >= 0 && now > this->d->m_lastTime) {
+        auto elapsed = 1e-9 * double(now - this->d->m_lastTime);
+
+        // Everything that was in the queue after the last update and is not
+        // there now, was read by the consumer.
+        auto consumed = this->d->m_lastOccupancy > occupancy?
+                            this->d->m_lastOccupancy - occupancy: 0;
+        this->d->smooth(&this->d->m_drainRate, double(consumed) / elapsed);
+        this->d->smooth(&this->d->m_produceRate, 1.0 / elapsed);
+    }
+
+    if (this->d->m_startTime < 0)
+        this->d->m_startTime = now;
+
+    this->d->m_lastTime = now;
+    auto target = this->d->m_target;
+
+    auto keepsUp = this->d->m_drainRate >= 0.9 * this->d->m_produceRate;
+
+    /* A consumer reading in bursts can't drain more than what is queued,
+     * so it looks slow until it has more room. Give it one more frame, and
+     * take it back if the drain rate doesn't improve.
+     */
+    if (this->d->m_probeSince >= 0
+        && now - this->d->m_probeSince >= PROBE_TIME) {
+        if (!keepsUp
+            && this->d->m_drainRate < 1.2 * this->d->m_probeDrainRate) {
+            this->d->setTarget(target - 1, "slow consumer");
+            this->d->m_noProbeUntil = now + PROBE_BACKOFF;
+        }
+
+        this->d->m_probeSince = -1;
+        target = this->d->m_target;
+    }
+
+    if (occupancy >= target) {
+        this->d->m_belowSince = -1;
+
+        if (target < this->d->m_maxDepth && this->d->m_probeSince < 0) {
+            if (keepsUp) {
+                this->d->setTarget(target + 1, "bursty consumer");
+            } else if (now - this->d->m_startTime >= PROBE_TIME
+                       && now >= this->d->m_noProbeUntil) {
+                this->d->setTarget(target + 1, "probing consumer");
+                this->d->m_probeSince = now;
+                this->d->m_probeDrainRate = this->d->m_drainRate;
+            }
+        }
+    } else if (occupancy + 1 < target) {
+        if (this->d->m_belowSince < 0)
+            this->d->m_belowSince = now;
+        else if (now - this->d->m_belowSince >= SHRINK_DELAY) {
+            this->d->setTarget(target - 1, "queue below target");
+            this->d->m_belowSince = -1;
+        }
+    } else {
+        this->d->m_belowSince = -1;
+    }
+
+    target = this->d->m_target;
+    Decision decision {ActionEnqueue, 0};
+
+    if (occupancy >= target) {
+        if (this->d->m_policy == PolicyDropOldest) {
+            decision = {ActionDropOldest, occupancy - target + 1};
+        } else {
+            decision = {ActionSkip, 0};
+        }
+    }
+
+    switch (decision.action) {
+    case ActionEnqueue:
+        this->d->m_lastOccupancy = occupancy + 1;
+
+        break;
+
+    case ActionDropOldest:
+        this->d->m_dropped += decision.drop;
+        droppedCounter += decision.drop;
+        this->d->m_lastOccupancy = occupancy - decision.drop + 1;
+
+        break;
+
+    case ActionSkip:
+        this->d->m_skipped++;
+        skippedCounter++;
+        this->d->m_lastOccupancy = occupancy;
+
+        break;
+    }
+
+    if (decision.action != ActionSkip) {
+        this->d->m_enqueued++;
+        enqueuedCounter++;
+    }
+
+    return decision;
+}
+
+void AkVCam::QueueController::reset()
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    this->d->m_target = this->d->m_minDepth;
+    this->d->m_lastOccupancy = 0;
+    this->d->m_startTime = -1;
+    this->d->m_lastTime = -1;
+    this->d->m_belowSince = -1;
+    this->d->m_probeSince = -1;
+    this->d->m_noProbeUntil = -1;
+    this->d->m_drainRate = -1.0;
+    this->d->m_produceRate = -1.0;
+}
+
+std::string AkVCam::QueueController::toString() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    std::stringstream ss;
+    ss << "target: "
+       << this->d->m_target
+       << " ["
+       << this->d->m_minDepth
+       << ", "
+       << this->d->m_maxDepth
+       << "], drain: "
+       << std::max(this->d->m_drainRate, 0.0)
+       << " fps, produce: "
+       << std::max(this->d->m_produceRate, 0.0)
+       << " fps, enqueued: "
+       << this->d->m_enqueued
+       << ", dropped: "
+       << this->d->m_dropped
+       << ", skipped: "
+       << this->d->m_skipped;
+
+    return ss.str();
+}
+
+void AkVCam::QueueControllerPrivate::smooth(double *rate, double sample)
+{
+    if (*rate < 0.0)
+        *rate = sample;
+    else
+        *rate += RATE_SMOOTHING * (sample - *rate);
+}
+
+void AkVCam::QueueControllerPrivate::setTarget(size_t target,
+                                               const char *reason)
+{
+    // The target is never below 1, so target - 1 can't wrap around.
+    target = std::min(std::max(target, this->m_minDepth), this->m_maxDepth);
+
+    if (target == this->m_target)
+        return;
+
+    AkLogInfo() << "Queue depth "
+                << this->m_target
+                << " -> "
+                << target
+                << " ("
+                << reason
+                << ")"
+                << std::endl;
+    this->m_target = target;
+}
@@ -0,0 +1,99 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_QUEUECONTROLLER_H
+#define AKVCAMUTILS_QUEUECONTROLLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define AKVCAM_QUEUE_MIN_DEPTH 1
+#define AKVCAM_QUEUE_MAX_DEPTH 3
+
+namespace AkVCam
+{
+    class QueueControllerPrivate;
+
+    /* Keeps the number of frames waiting in a sink queue low.
+     *
+     * The producer calls update() with the queue occupancy before each
+     * enqueue. The controller estimates how fast the consumer drains the
+     * queue, and adapts the target depth between the minimum and maximum
+     * depth: it grows when a consumer that keeps up on average reads in
+     * bursts, and shrinks back when the queue stays below the target.
+     * When the target is reached, the oldest frames are dropped or the
+     * new frame is skipped, depending on the policy.
+     */
+    class QueueController
+    {
+        public:
+            enum Policy
+            {
+                PolicyDropOldest,
+                PolicySkip
+            };
+
+            enum Action
+            {
+                ActionEnqueue,
+                ActionDropOldest,
+                ActionSkip
+            };
+
+            struct Decision
+            {
+                Action action;
+
+                // Number of old frames to drop before enqueuing.
+                size_t drop;
+            };
+
+            QueueController(size_t minDepth=AKVCAM_QUEUE_MIN_DEPTH,
+                            size_t maxDepth=AKVCAM_QUEUE_MAX_DEPTH,
+                            Policy policy=PolicyDropOldest);
+            QueueController(const QueueController &other) = delete;
+            ~QueueController();
+
+            size_t minDepth() const;
+            size_t maxDepth() const;
+            void setDepthRange(size_t minDepth, size_t maxDepth);
+            Policy policy() const;
+            void setPolicy(Policy policy);
+            size_t targetDepth() const;
+
+            // Frames per second consumed and produced.
+            double drainRate() const;
+            double produceRate() const;
+
+            uint64_t enqueued() const;
+            uint64_t dropped() const;
+            uint64_t skipped() const;
+
+            // now is a monotonic time in nanoseconds.
+            Decision update(size_t occupancy, int64_t now);
+            void reset();
+            std::string toString() const;
+
+        private:
+            QueueControllerPrivate *d;
+    };
+}
+
+#endif // AKVCAMUTILS_QUEUECONTROLLER_H
@@ -0,0 +1,497 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "recording.h"
+#include "logger.h"
+#include "utils.h"
+#include "image/videoformat.h"
+#include "image/videoframe.h"
+
+namespace AkVCam
+{
+    static_assert(sizeof(RecordingHeader) == 64,
+                  "RecordingHeader must have a fixed size");
+    static_assert(sizeof(RecordingEntry) == 48,
+                  "RecordingEntry must have a fixed size");
+
+    class RecordingWriterPrivate
+    {
+        public:
+            std::ofstream m_file;
+            std::vector<RecordingEntry> m_index;
+            std::chrono::steady_clock::time_point m_startTime;
+            uint64_t m_position {0};
+            mutable std::mutex m_mutex;
+
+            void writeHeader(uint64_t indexOffset);
+    };
+
+    class RecordingReaderPrivate
+    {
+        public:
+            const uint8_t *m_data {nullptr};
+            uint64_t m_size {0};
+            std::vector<RecordingEntry> m_index;
+#ifdef _WIN32
+            HANDLE m_fileHandle {INVALID_HANDLE_VALUE};
+            HANDLE m_mapping {nullptr};
+#endif
+
+            bool map(const std::string &fileName);
+            void unmap();
+            bool readIndex();
+    };
+
+    inline uint64_t recordingAlign(uint64_t offset)
+    {
+        return (offset + AKVCAM_RECORDING_ALIGN - 1)
+               / AKVCAM_RECORDING_ALIGN
+               * AKVCAM_RECORDING_ALIGN;
+    }
+}
+
+AkVCam::RecordingWriter::RecordingWriter()
+{
+    this->d = new RecordingWriterPrivate;
+}
+
+AkVCam::RecordingWriter::~RecordingWriter()
+{
+    this->close();
+    delete this->d;
+}
+
+bool AkVCam::RecordingWriter::open(const std::string &fileName)
+{
+    AkLogFunction();
+    this->close();
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+    this->d->m_file.open(fileName, std::ios::binary | std::ios::trunc);
+
+    if (!this->d->m_file.is_open()) {
+        AkLogError() << "Can't open " << fileName << std::endl;
+
+        return false;
+    }
+
+    this->d->m_index.clear();
+    this->d->writeHeader(0);
+    this->d->m_position = sizeof(RecordingHeader);
+
+    return true;
+}
+
+void AkVCam::RecordingWriter::close()
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    if (!this->d->m_file.is_open())
+        return;
+
+    AkLogFunction();
+    auto indexOffset = this->d->m_position;
+    this->d->m_file.write(reinterpret_cast<const char *>(this->d->m_index.data()),
+                          std::streamsize(this->d->m_index.size()
+                                          * sizeof(RecordingEntry)));
+    this->d->m_file.seekp(0);
+    this->d->writeHeader(indexOffset);
+    this->d->m_file.close();
+    AkLogInfo() << "Frames recorded: " << this->d->m_index.size() << std::endl;
+}
+
+bool AkVCam::RecordingWriter::isOpen() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_file.is_open();
+}
+
+bool AkVCam::RecordingWriter::write(const VideoFrame &frame,
+                                    uint64_t sequence)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    if (!this->d->m_file.is_open())
+        return false;
+
+    if (this->d->m_index.empty())
+        this->d->m_startTime = now;
+
+    auto format = frame.format();
+    auto &data = frame.data();
+    RecordingEntry entry;
+    memset(&entry, 0, sizeof(RecordingEntry));
+    entry.offset = recordingAlign(this->d->m_position + sizeof(RecordingEntry));
+    entry.size = data.size();
+    entry.pts = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(now - this->d->m_startTime).count());
+    entry.sequence = sequence;
+    entry.fourcc = format.fourcc();
+    entry.width = uint32_t(format.width());
+    entry.height = uint32_t(format.height());
+
+    static const char padding[AKVCAM_RECORDING_ALIGN] = {0};
+    auto paddingSize = entry.offset
+                     - this->d->m_position
+                     - sizeof(RecordingEntry);
+    this->d->m_file.write(reinterpret_cast<const char *>(&entry),
+                          sizeof(RecordingEntry));
+    this->d->m_file.write(padding, std::streamsize(paddingSize));
+    this->d->m_file.write(reinterpret_cast<const char *>(data.data()),
+                          std::streamsize(data.size()));
+
+    if (!this->d->m_file) {
+        AkLogError() << "Error writing the recording" << std::endl;
+        this->d->m_file.close();
+
+        return false;
+    }
+
+    this->d->m_position = entry.offset + entry.size;
+    this->d->m_index.push_back(entry);
+
+    return true;
+}
+
+uint64_t AkVCam::RecordingWriter::frames() const
+{
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    return this->d->m_index.size();
+}
+
+void AkVCam::RecordingWriterPrivate::writeHeader(uint64_t indexOffset)
+{
+    RecordingHeader header;
+    memset(&header, 0, sizeof(RecordingHeader));
+    memcpy(header.magic, AKVCAM_RECORDING_MAGIC, sizeof(header.magic));
+    header.version = AKVCAM_RECORDING_VERSION;
+    header.headerSize = sizeof(RecordingHeader);
+    header.frameCount = indexOffset? this->m_index.size(): 0;
+    header.indexOffset = indexOffset;
+    header.entrySize = sizeof(RecordingEntry);
+    this->m_file.write(reinterpret_cast<const char *>(&header),
+                       sizeof(RecordingHeader));
+}
+
+AkVCam::RecordingReader::RecordingReader()
+{
+    this->d = new RecordingReaderPrivate;
+}
+
+AkVCam::RecordingReader::~RecordingReader()
+{
+    this->close();
+    delete this->d;
+}
+
+bool AkVCam::RecordingReader::open(const std::string &fileName)
+{
+    AkLogFunction();
+    this->close();
+
+    if (!this->d->map(fileName)) {
+        AkLogError() << "Can't map " << fileName << std::endl;
+
+        return false;
+    }
+
+    if (!this->d->readIndex()) {
+        AkLogError() << fileName << " is not a valid recording" << std::endl;
+        this->close();
+
+        return false;
+    }
+
+    return true;
+}
+
+void AkVCam::RecordingReader::close()
+{
+    this->d->m_index.clear();
+    this->d->unmap();
+}
+
+bool AkVCam::RecordingReader::isOpen() const
+{
+    return this->d->m_data != nullptr;
+}
+
+size_t AkVCam::RecordingReader::frames() const
+{
+    return this->d->m_index.size();
+}
+
+AkVCam::RecordingEntry AkVCam::RecordingReader::entry(size_t index) const
+{
+    if (index >= this->d->m_index.size()) {
+        RecordingEntry entry;
+        memset(&entry, 0, sizeof(RecordingEntry));
+
+        return entry;
+    }
+
+    return this->d->m_index[index];
+}
+
+const uint8_t *AkVCam::RecordingReader::data(size_t index) const
+{
+    if (index >= this->d->m_index.size())
+        return nullptr;
+
+    return this->d->m_data + this->d->m_index[index].offset;
+}
+
+AkVCam::VideoFrame AkVCam::RecordingReader::frame(size_t index) const
+{
+    if (index >= this->d->m_index.size())
+        return {};
+
+    auto &entry = this->d->m_index[index];
+    VideoFormat format(entry.fourcc, int(entry.width), int(entry.height));
+    VideoFrame frame(format);
+    memcpy(frame.data().data(),
+           this->d->m_data + entry.offset,
+           std::min<size_t>(frame.data().size(), entry.size));
+
+    return frame;
+}
+
+size_t AkVCam::RecordingReader::replay(const RecordingFrameFunc &func,
+                                       Speed speed,
+                                       size_t loops) const
+{
+    size_t delivered = 0;
+
+    for (size_t loop = 0; loop < loops; loop++) {
+        auto startTime = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < this->d->m_index.size(); i++) {
+            auto &entry = this->d->m_index[i];
+            auto frame = this->frame(i);
+
+            if (speed == SpeedOriginal)
+                std::this_thread::sleep_until(startTime
+                                              + std::chrono::microseconds(entry.pts));
+
+            if (!func(frame, entry))
+                return delivered;
+
+            delivered++;
+        }
+    }
+
+    return delivered;
+}
+
+std::string AkVCam::autoRecordingFile(const std::string &deviceId)
+{
+    auto dir = getenv("AKVCAM_RECORD_DIR");
+
+    if (!dir || !*dir)
+        return {};
+
+    auto name = deviceId;
+
+    for (auto &c: name)
+        if (!isalnum(c))
+            c = '_';
+
+    return std::string(dir) + "/" + name + "-" + timeStamp() + ".akvrec";
+}
+
+bool AkVCam::RecordingReaderPrivate::map(const std::string &fileName)
+{
+#ifdef _WIN32
+    this->m_fileHandle = CreateFileA(fileName.c_str(),
+                                     GENERIC_READ,
+                                     FILE_SHARE_READ,
+                                     nullptr,
+                                     OPEN_EXISTING,
+                                     FILE_ATTRIBUTE_NORMAL,
+                                     nullptr);
+
+    if (this->m_fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(this->m_fileHandle, &size) || size.QuadPart < 1) {
+        this->unmap();
+
+        return false;
+    }
+
+    this->m_mapping = CreateFileMappingA(this->m_fileHandle,
+                                         nullptr,
+                                         PAGE_READONLY,
+                                         0,
+                                         0,
+                                         nullptr);
+
+    if (!this->m_mapping) {
+        this->unmap();
+
+        return false;
+    }
+
+    this->m_data =
+            reinterpret_cast<const uint8_t *>(MapViewOfFile(this->m_mapping,
+                                                            FILE_MAP_READ,
+                                                            0,
+                                                            0,
+                                                            0));
+
+    if (!this->m_data) {
+        this->unmap();
+
+        return false;
+    }
+
+    this->m_size = uint64_t(size.QuadPart);
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    struct stat fileInfo;
+
+    if (fstat(fd, &fileInfo) != 0 || fileInfo.st_size < 1) {
+        ::close(fd);
+
+        return false;
+    }
+
+    auto data = mmap(nullptr,
+                     size_t(fileInfo.st_size),
+                     PROT_READ,
+                     MAP_PRIVATE,
+                     fd,
+                     0);
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    this->m_data = reinterpret_cast<const uint8_t *>(data);
+    this->m_size = uint64_t(fileInfo.st_size);
+#endif
+
+    return true;
+}
+
+void AkVCam::RecordingReaderPrivate::unmap()
+{
+#ifdef _WIN32
+    if (this->m_data)
+        UnmapViewOfFile(this->m_data);
+
+    if (this->m_mapping)
+        CloseHandle(this->m_mapping);
+
+    if (this->m_fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(this->m_fileHandle);
+
+    this->m_mapping = nullptr;
+    this->m_fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (this->m_data)
+        munmap(const_cast<uint8_t *>(this->m_data), size_t(this->m_size));
+#endif
+
+    this->m_data = nullptr;
+    this->m_size = 0;
+}
+
+bool AkVCam::RecordingReaderPrivate::readIndex()
+{
+    if (this->m_size < sizeof(RecordingHeader))
+        return false;
+
+    auto header = reinterpret_cast<const RecordingHeader *>(this->m_data);
+
+    if (memcmp(header->magic, AKVCAM_RECORDING_MAGIC, sizeof(header->magic))
+        || header->version != AKVCAM_RECORDING_VERSION
+        || header->headerSize < sizeof(RecordingHeader)
+        || header->entrySize != sizeof(RecordingEntry))
+        return false;
+
+    auto isValid = [this] (const RecordingEntry &entry) {
+        return entry.offset <= this->m_size
+               && entry.size <= this->m_size - entry.offset;
+    };
+
+    if (header->indexOffset > 0) {
+        auto indexSize = header->frameCount * sizeof(RecordingEntry);
+
+        if (header->indexOffset > this->m_size
+            || indexSize > this->m_size - header->indexOffset)
+            return false;
+
+        auto entries =
+                reinterpret_cast<const RecordingEntry *>(this->m_data
+                                                         + header->indexOffset);
+        this->m_index.assign(entries, entries + header->frameCount);
+
+        for (auto &entry: this->m_index)
+            if (!isValid(entry))
+                return false;
+
+        return true;
+    }
+
+    // The recording wasn't closed, rebuild the index from the entries
+    // stored before each frame.
+    AkLogWarning() << "Recording not closed, rebuilding the index" << std::endl;
+    uint64_t position = header->headerSize;
+
+    while (position + sizeof(RecordingEntry) <= this->m_size) {
+        RecordingEntry entry;
+        memcpy(&entry, this->m_data + position, sizeof(RecordingEntry));
+
+        if (entry.offset != recordingAlign(position + sizeof(RecordingEntry))
+            || !isValid(entry))
+            break;
+
+        this->m_index.push_back(entry);
+        position = entry.offset + entry.size;
+    }
+
+    return true;
+}
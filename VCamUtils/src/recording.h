@@ -0,0 +1,141 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_RECORDING_H
+#define AKVCAMUTILS_RECORDING_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#define AKVCAM_RECORDING_MAGIC "AKVCREC1"
+#define AKVCAM_RECORDING_VERSION 1
+
+// Frames data starts at a multiple of this, so it can be used in place.
+#define AKVCAM_RECORDING_ALIGN 64
+
+namespace AkVCam
+{
+    class RecordingWriterPrivate;
+    class RecordingReaderPrivate;
+    class VideoFrame;
+
+    /* A recording is a fixed size header, the frames, and the frames
+     * index. Every frame is stored as its index entry followed by the
+     * planes exactly as they were written, so the index can be rebuilt
+     * if the recording wasn't closed. All the fields are little endian.
+     */
+    struct RecordingHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t frameCount;
+
+        // 0 if the recording wasn't closed.
+        uint64_t indexOffset;
+        uint32_t entrySize;
+        uint32_t reserved[7];
+    };
+
+    struct RecordingEntry
+    {
+        // Offset of the frame data from the start of the file.
+        uint64_t offset;
+        uint64_t size;
+
+        // Microseconds since the first frame.
+        uint64_t pts;
+
+        // Sequence number the frame was sent with.
+        uint64_t sequence;
+        uint32_t fourcc;
+        uint32_t width;
+        uint32_t height;
+        uint32_t reserved;
+    };
+
+    class RecordingWriter
+    {
+        public:
+            RecordingWriter();
+            RecordingWriter(const RecordingWriter &other) = delete;
+            ~RecordingWriter();
+
+            bool open(const std::string &fileName);
+            void close();
+            bool isOpen() const;
+            bool write(const VideoFrame &frame, uint64_t sequence);
+            uint64_t frames() const;
+
+        private:
+            RecordingWriterPrivate *d;
+    };
+
+    using RecordingWriterPtr = std::shared_ptr<RecordingWriter>;
+
+    // Return false to stop replaying.
+    using RecordingFrameFunc = std::function<bool (const VideoFrame &frame,
+                                                   const RecordingEntry &entry)>;
+
+    class RecordingReader
+    {
+        public:
+            enum Speed
+            {
+                // Deliver the frames at the recorded times.
+                SpeedOriginal,
+
+                // Deliver the frames as fast as possible.
+                SpeedMaximum
+            };
+
+            RecordingReader();
+            RecordingReader(const RecordingReader &other) = delete;
+            ~RecordingReader();
+
+            // The file is mapped in memory.
+            bool open(const std::string &fileName);
+            void close();
+            bool isOpen() const;
+            size_t frames() const;
+            RecordingEntry entry(size_t index) const;
+
+            // Points to the mapped frame data, valid until closing.
+            const uint8_t *data(size_t index) const;
+            VideoFrame frame(size_t index) const;
+
+            // Returns the number of delivered frames.
+            size_t replay(const RecordingFrameFunc &func,
+                          Speed speed=SpeedOriginal,
+                          size_t loops=1) const;
+
+        private:
+            RecordingReaderPrivate *d;
+    };
+
+    /* File where the frames written to the device are recorded when the
+     * AKVCAM_RECORD_DIR environment variable points to a directory, or an
+     * empty string otherwise.
+     */
+    std::string autoRecordingFile(const std::string &deviceId);
+}
+
+#endif // AKVCAMUTILS_RECORDING_H
@@ -0,0 +1,95 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <mutex>
+#include <sstream>
+
+#include "stats.h"
+
+namespace AkVCam
+{
+    class StatsPrivate
+    {
+        public:
+            std::map<std::string, std::atomic<uint64_t>> m_counters;
+            std::mutex m_mutex;
+    };
+
+    // Counters may be updated from static destructors, never destroy them.
+    StatsPrivate *statsPrivate()
+    {
+        static auto stats = new StatsPrivate;
+
+        return stats;
+    }
+}
+
+std::atomic<uint64_t> &AkVCam::Stats::counter(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(statsPrivate()->m_mutex);
+    auto it = statsPrivate()->m_counters.find(name);
+
+    if (it != statsPrivate()->m_counters.end())
+        return it->second;
+
+    auto &counter = statsPrivate()->m_counters[name];
+    counter = 0;
+
+    return counter;
+}
+
+uint64_t AkVCam::Stats::value(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(statsPrivate()->m_mutex);
+    auto it = statsPrivate()->m_counters.find(name);
+
+    if (it == statsPrivate()->m_counters.end())
+        return 0;
+
+    return it->second;
+}
+
+std::map<std::string, uint64_t> AkVCam::Stats::counters()
+{
+    std::lock_guard<std::mutex> lock(statsPrivate()->m_mutex);
+    std::map<std::string, uint64_t> counters;
+
+    for (auto &counter: statsPrivate()->m_counters)
+        counters[counter.first] = counter.second;
+
+    return counters;
+}
+
+void AkVCam::Stats::reset()
+{
+    std::lock_guard<std::mutex> lock(statsPrivate()->m_mutex);
+
+    for (auto &counter: statsPrivate()->m_counters)
+        counter.second = 0;
+}
+
+std::string AkVCam::Stats::toString()
+{
+    std::stringstream ss;
+
+    for (auto &counter: counters())
+        ss << counter.first << ": " << counter.second << std::endl;
+
+    return ss.str();
+}
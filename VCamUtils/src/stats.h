@@ -0,0 +1,41 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_STATS_H
+#define AKVCAMUTILS_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace AkVCam
+{
+    namespace Stats
+    {
+        // Returns a process wide counter, the reference is valid forever.
+        std::atomic<uint64_t> &counter(const std::string &name);
+        uint64_t value(const std::string &name);
+        std::map<std::string, uint64_t> counters();
+        void reset();
+        std::string toString();
+    }
+}
+
+#endif // AKVCAMUTILS_STATS_H
@@ -0,0 +1,969 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "streamengine.h"
+#include "fraction.h"
+#include "idlemonitor.h"
+#include "logger.h"
+#include "memoryaccounting.h"
+#include "profiledmutex.h"
+#include "stats.h"
+#include "image/filtergraph.h"
+#include "image/framecache.h"
+#include "image/videoformat.h"
+#include "image/videoframe.h"
+
+namespace AkVCam
+{
+    using FilterGraphPtr = std::shared_ptr<const FilterGraph>;
+
+    // Output of a stream, as needed to adapt frames for it.
+    struct StreamOutput
+    {
+        std::string key;
+        VideoFormat format;
+        StreamAdjusts adjusts;
+        FilterGraphPtr graph;
+    };
+
+    using StreamOutputs = std::map<std::string, StreamOutput>;
+
+    /* Outputs of the running streams of each device in this process, so
+     * that the first stream receiving a frame can adapt it for all of them
+     * at once.
+     */
+    class StreamOutputRegistry
+    {
+        public:
+            void set(const void *stream,
+                     const std::string &deviceId,
+                     const StreamOutput &output);
+            void remove(const void *stream);
+
+            // Outputs of the device, by key.
+            StreamOutputs outputs(const std::string &deviceId) const;
+
+        private:
+            std::map<const void *, std::pair<std::string, StreamOutput>> m_outputs;
+            mutable std::mutex m_mutex;
+    };
+
+    class StreamEnginePrivate
+    {
+        public:
+            StreamEngine *self;
+            VideoFormat m_format;
+            Fraction m_frameRate {30, 1};
+            StreamAdjusts m_adjusts;
+            FilterGraphPtr m_graph;
+            FilterGraphPtr m_sliceGraph;
+            VideoFrame m_testFrame;
+            StreamPictureFunc m_pictureLoader;
+            VideoFramePtr m_testFrameAdapted;
+            VideoFramePtr m_currentFrame;
+            std::string m_broadcaster;
+            std::string m_deviceId;
+            StreamClockFunc m_clock;
+            StreamSendFunc m_send;
+            std::thread m_thread;
+            std::atomic<bool> m_running {false};
+            mutable ProfiledMutex m_mutex {"stream_engine"};
+            std::mutex m_threadMutex;
+            std::condition_variable m_threadCondition;
+            int64_t m_pts {-1};
+            int64_t m_ptsDrift {0};
+            uint64_t m_sequence {0};
+            VideoFrame m_sliceFrame;
+            uint64_t m_sliceSequence {0};
+            int m_sliceLines {-1};
+            ProfiledMutex m_sliceMutex {"stream_slices"};
+            MemoryAccount m_picturesAccount {MemoryCategoryPictures};
+            MemoryAccount m_deviceAccount;
+
+            explicit StreamEnginePrivate(StreamEngine *self);
+            inline std::string idleId() const;
+            void updateTestFrame();
+            void releaseFrames();
+            void accountFrames();
+            void updateGraphs();
+            void registerOutput();
+            static FilterGraphPtr makeGraph(const VideoFormat &format,
+                                            const StreamAdjusts &adjusts,
+                                            bool scale);
+            static std::string adjustsKey(const VideoFormat &format,
+                                          const StreamAdjusts &adjusts);
+            static bool isScaleOnly(const StreamAdjusts &adjusts);
+            static std::vector<VideoFramePtr> adaptFrames(const VideoFramePtr &frame,
+                                                          const std::vector<std::string> &keys,
+                                                          const StreamOutputs &outputs);
+            static bool isPassthrough(const VideoFormat &frameFormat,
+                                      const VideoFormat &format,
+                                      const StreamAdjusts &adjusts);
+            static VideoFrame applyAdjusts(VideoFrame frame,
+                                           const VideoFormat &format,
+                                           const StreamAdjusts &adjusts,
+                                           const FilterGraph &graph);
+            static VideoFrame randomFrame(const VideoFormat &format);
+            static int64_t steadyClock();
+            int64_t frameDuration() const;
+            void streamLoop();
+    };
+
+    // Streams may be destroyed from static destructors, never destroy it.
+    StreamOutputRegistry *streamOutputs()
+    {
+        static auto registry = new StreamOutputRegistry;
+
+        return registry;
+    }
+}
+
+bool AkVCam::StreamAdjusts::operator ==(const StreamAdjusts &other) const
+{
+    return this->horizontalMirror == other.horizontalMirror
+           && this->verticalMirror == other.verticalMirror
+           && this->scaling == other.scaling
+           && this->aspectRatio == other.aspectRatio
+           && this->swapRgb == other.swapRgb
+           && this->hue == other.hue
+           && this->saturation == other.saturation
+           && this->luminance == other.luminance
+           && this->gamma == other.gamma
+           && this->contrast == other.contrast
+           && this->gray == other.gray;
+}
+
+bool AkVCam::StreamAdjusts::operator !=(const StreamAdjusts &other) const
+{
+    return !(*this == other);
+}
+
+AkVCam::StreamEngine::StreamEngine()
+{
+    this->d = new StreamEnginePrivate(this);
+    IdleMonitor::global()->add(this->d->idleId(), [this] () {
+        this->d->releaseFrames();
+    });
+}
+
+AkVCam::StreamEngine::~StreamEngine()
+{
+    this->stop();
+    IdleMonitor::global()->remove(this->d->idleId());
+    delete this->d;
+}
+
+AkVCam::VideoFormat AkVCam::StreamEngine::format() const
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    return this->d->m_format;
+}
+
+void AkVCam::StreamEngine::setFormat(const VideoFormat &format)
+{
+    AkLogFunction();
+    this->d->m_mutex.lock();
+    auto &curFormat = this->d->m_format;
+    bool changed = curFormat.fourcc() != format.fourcc()
+                   || curFormat.width() != format.width()
+                   || curFormat.height() != format.height();
+    this->d->m_format = format;
+
+    if (changed) {
+        this->d->updateGraphs();
+        this->d->registerOutput();
+    }
+
+    if (!format.frameRates().empty())
+        this->d->m_frameRate = format.minimumFrameRate();
+
+    this->d->m_mutex.unlock();
+
+    if (changed)
+        this->d->updateTestFrame();
+}
+
+AkVCam::Fraction AkVCam::StreamEngine::frameRate() const
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    return this->d->m_frameRate;
+}
+
+void AkVCam::StreamEngine::setFrameRate(const Fraction &frameRate)
+{
+    if (frameRate.num() < 1 || frameRate.den() < 1)
+        return;
+
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    this->d->m_frameRate = frameRate;
+}
+
+AkVCam::StreamAdjusts AkVCam::StreamEngine::adjusts() const
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    return this->d->m_adjusts;
+}
+
+void AkVCam::StreamEngine::setAdjusts(const StreamAdjusts &adjusts)
+{
+    AkLogFunction();
+    this->d->m_mutex.lock();
+
+    if (this->d->m_adjusts == adjusts) {
+        this->d->m_mutex.unlock();
+
+        return;
+    }
+
+    this->d->m_adjusts = adjusts;
+    this->d->updateGraphs();
+    this->d->registerOutput();
+    this->d->m_mutex.unlock();
+    this->d->updateTestFrame();
+}
+
+void AkVCam::StreamEngine::setPicture(const VideoFrame &picture)
+{
+    AkLogFunction();
+    this->d->m_mutex.lock();
+    this->d->m_testFrame = picture;
+    this->d->m_pictureLoader = {};
+    this->d->accountFrames();
+    this->d->m_mutex.unlock();
+    this->d->updateTestFrame();
+}
+
+void AkVCam::StreamEngine::setPictureLoader(const StreamPictureFunc &loader)
+{
+    AkLogFunction();
+    this->d->m_mutex.lock();
+    this->d->m_testFrame = {};
+    this->d->m_pictureLoader = loader;
+    this->d->accountFrames();
+    this->d->m_mutex.unlock();
+    this->d->updateTestFrame();
+}
+
+std::string AkVCam::StreamEngine::broadcaster() const
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    return this->d->m_broadcaster;
+}
+
+void AkVCam::StreamEngine::setBroadcaster(const std::string &broadcaster)
+{
+    AkLogFunction();
+    AkLogInfo() << "Broadcaster: " << broadcaster << std::endl;
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    if (this->d->m_broadcaster == broadcaster)
+        return;
+
+    this->d->m_broadcaster = broadcaster;
+
+    if (broadcaster.empty()) {
+        this->d->m_currentFrame = this->d->m_testFrameAdapted;
+        this->d->accountFrames();
+    }
+}
+
+void AkVCam::StreamEngine::setClock(const StreamClockFunc &clock)
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    this->d->m_clock = clock;
+}
+
+void AkVCam::StreamEngine::setSendFunc(const StreamSendFunc &send)
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    this->d->m_send = send;
+}
+
+bool AkVCam::StreamEngine::start()
+{
+    AkLogFunction();
+
+    if (this->d->m_running)
+        return false;
+
+    // Join the thread of a stream that stopped by itself.
+    if (this->d->m_thread.joinable())
+        this->d->m_thread.join();
+
+    // Keep the frames while streaming.
+    IdleMonitor::global()->remove(this->d->idleId());
+    this->d->updateTestFrame();
+    this->d->m_mutex.lock();
+    this->d->m_currentFrame = this->d->m_testFrameAdapted;
+    this->d->accountFrames();
+    this->d->m_pts = -1;
+    this->d->m_ptsDrift = 0;
+    this->d->m_sequence = 0;
+    this->d->m_mutex.unlock();
+
+    this->d->m_running = true;
+    this->d->m_mutex.lock();
+    this->d->registerOutput();
+    this->d->m_mutex.unlock();
+    this->d->m_thread = std::thread(&StreamEnginePrivate::streamLoop, this->d);
+    AkLogInfo() << "Launching thread "
+                << this->d->m_thread.get_id()
+                << std::endl;
+
+    return true;
+}
+
+void AkVCam::StreamEngine::stop()
+{
+    AkLogFunction();
+    bool wasRunning = this->d->m_running;
+    this->d->m_threadMutex.lock();
+    this->d->m_running = false;
+    this->d->m_threadMutex.unlock();
+    this->d->m_threadCondition.notify_all();
+
+    if (this->d->m_thread.joinable()
+        && this->d->m_thread.get_id() != std::this_thread::get_id())
+        this->d->m_thread.join();
+
+    this->d->m_mutex.lock();
+
+    // registerOutput() checks m_running with this lock held, so no late
+    // frame can register the output again.
+    streamOutputs()->remove(this->d);
+    this->d->m_currentFrame = {};
+    this->d->m_testFrameAdapted = {};
+    this->d->accountFrames();
+    this->d->m_mutex.unlock();
+
+    if (wasRunning) {
+        AkLogInfo() << "Stats:" << std::endl << Stats::toString();
+        IdleMonitor::global()->add(this->d->idleId(), [this] () {
+            this->d->releaseFrames();
+        });
+    }
+}
+
+bool AkVCam::StreamEngine::isRunning() const
+{
+    return this->d->m_running;
+}
+
+void AkVCam::StreamEngine::frameReady(const std::string &deviceId,
+                                      const VideoFramePtr &frame,
+                                      uint64_t sequence)
+{
+    if (!this->d->m_running || !frame)
+        return;
+
+    this->d->m_mutex.lock();
+
+    if (this->d->m_broadcaster.empty()) {
+        this->d->m_mutex.unlock();
+
+        return;
+    }
+
+    // Other streams in this process may be streaming the same device.
+    if (this->d->m_deviceId != deviceId) {
+        this->d->m_deviceId = deviceId;
+        this->d->registerOutput();
+    }
+
+    auto format = this->d->m_format;
+    auto adjusts = this->d->m_adjusts;
+    this->d->m_mutex.unlock();
+
+    auto key = StreamEnginePrivate::adjustsKey(format, adjusts);
+    auto outputs = streamOutputs()->outputs(deviceId);
+
+    /* The outputs of the other streams that only need scaling and
+     * conversion are made in the same pass.
+     */
+    std::vector<std::string> otherKeys;
+
+    for (auto &output: outputs)
+        if (output.first != key
+            && StreamEnginePrivate::isScaleOnly(output.second.adjusts))
+            otherKeys.push_back(output.first);
+
+    auto frameAdjusted =
+            FrameCache::global()->frame(deviceId,
+                                        sequence,
+                                        key,
+                                        otherKeys,
+                                        [&frame, &outputs] (const std::vector<std::string> &keys) {
+        return StreamEnginePrivate::adaptFrames(frame, keys, outputs);
+    });
+
+    if (frameAdjusted->format().size() < 1)
+        return;
+
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    if (!this->d->m_broadcaster.empty()) {
+        this->d->m_currentFrame = frameAdjusted;
+        this->d->m_deviceAccount.setDeviceId(deviceId);
+        this->d->accountFrames();
+    }
+}
+
+void AkVCam::StreamEngine::sliceReady(const std::string &deviceId,
+                                      const VideoFrame &frame,
+                                      uint64_t sequence,
+                                      int firstLine,
+                                      int lines)
+{
+    static auto &slicedFrames = Stats::counter("frames_sliced");
+
+    if (!this->d->m_running || lines < 1)
+        return;
+
+    this->d->m_mutex.lock();
+
+    if (this->d->m_broadcaster.empty()) {
+        this->d->m_mutex.unlock();
+
+        return;
+    }
+
+    auto format = this->d->m_format;
+    auto adjusts = this->d->m_adjusts;
+    auto graph = this->d->m_sliceGraph;
+    this->d->m_mutex.unlock();
+
+    // Scaling mixes the lines of several slices.
+    if (frame.format().width() != format.width()
+        || frame.format().height() != format.height())
+        return;
+
+    std::lock_guard<ProfiledMutex> sliceLock(this->d->m_sliceMutex);
+    auto &sliceFrame = this->d->m_sliceFrame;
+
+    if (firstLine == 0) {
+        // The data of the last frame was moved to the cache.
+        if (sliceFrame.data().empty()
+            || sliceFrame.format().fourcc() != format.fourcc()
+            || sliceFrame.format().width() != format.width()
+            || sliceFrame.format().height() != format.height())
+            sliceFrame = VideoFrame(VideoFormat(format.fourcc(),
+                                                format.width(),
+                                                format.height()));
+
+        this->d->m_sliceSequence = sequence;
+        this->d->m_sliceLines = 0;
+    } else if (sequence != this->d->m_sliceSequence
+               || firstLine != this->d->m_sliceLines) {
+        // A slice was missed, frameReady() will process the whole frame.
+        this->d->m_sliceLines = -1;
+
+        return;
+    }
+
+    auto band =
+            StreamEnginePrivate::applyAdjusts(frame.band(firstLine, lines),
+                                              VideoFormat(format.fourcc(),
+                                                          format.width(),
+                                                          lines),
+                                              adjusts,
+                                              *graph);
+    auto outputLine = adjusts.verticalMirror?
+                          format.height() - firstLine - lines:
+                          firstLine;
+
+    if (!sliceFrame.setBand(outputLine, band)) {
+        this->d->m_sliceLines = -1;
+
+        return;
+    }
+
+    this->d->m_sliceLines += lines;
+
+    if (this->d->m_sliceLines < format.height())
+        return;
+
+    this->d->m_sliceLines = -1;
+    slicedFrames++;
+
+    // frameReady() will find the frame already adapted.
+    auto frameAdjusted =
+            FrameCache::global()->frame(deviceId,
+                                        sequence,
+                                        StreamEnginePrivate::adjustsKey(format,
+                                                                        adjusts),
+                                        [&sliceFrame] () {
+        return std::make_shared<const VideoFrame>(std::move(sliceFrame));
+    });
+
+    if (frameAdjusted->format().size() < 1)
+        return;
+
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+
+    if (!this->d->m_broadcaster.empty()) {
+        this->d->m_currentFrame = frameAdjusted;
+        this->d->m_deviceAccount.setDeviceId(deviceId);
+        this->d->accountFrames();
+    }
+}
+
+AkVCam::VideoFrame AkVCam::StreamEngine::process(const VideoFrame &frame) const
+{
+    this->d->m_mutex.lock();
+    auto format = this->d->m_format;
+    auto adjusts = this->d->m_adjusts;
+    auto graph = this->d->m_graph;
+    this->d->m_mutex.unlock();
+
+    return StreamEnginePrivate::applyAdjusts(frame, format, adjusts, *graph);
+}
+
+std::shared_ptr<const AkVCam::VideoFrame> AkVCam::StreamEngine::currentFrame() const
+{
+    this->d->m_mutex.lock();
+    auto frame = this->d->m_currentFrame;
+    auto format = this->d->m_format;
+    this->d->m_mutex.unlock();
+
+    if (frame && frame->format().size() > 0)
+        return frame;
+
+    return std::make_shared<const VideoFrame>(StreamEnginePrivate::randomFrame(format));
+}
+
+AkVCam::FrameTiming AkVCam::StreamEngine::nextTiming(int64_t now)
+{
+    std::lock_guard<ProfiledMutex> lock(this->d->m_mutex);
+    FrameTiming timing;
+    timing.duration = this->d->frameDuration();
+    timing.discontinuity = false;
+
+    if (this->d->m_pts < 0) {
+        this->d->m_pts = 0;
+        this->d->m_ptsDrift = this->d->m_pts - now;
+        timing.discontinuity = true;
+    } else {
+        auto diff = now - this->d->m_pts + this->d->m_ptsDrift;
+
+        if (diff <= 2 * timing.duration) {
+            this->d->m_pts = now + this->d->m_ptsDrift;
+        } else {
+            // The stream stalled, keep the timestamps continuous.
+            this->d->m_pts += timing.duration;
+            this->d->m_ptsDrift = this->d->m_pts - now;
+            timing.discontinuity = true;
+        }
+    }
+
+    timing.pts = this->d->m_pts;
+    timing.sequence = this->d->m_sequence++;
+
+    return timing;
+}
+
+AkVCam::StreamEnginePrivate::StreamEnginePrivate(StreamEngine *self):
+    self(self)
+{
+    this->updateGraphs();
+}
+
+std::string AkVCam::StreamEnginePrivate::idleId() const
+{
+    std::stringstream ss;
+    ss << "stream:" << this;
+
+    return ss.str();
+}
+
+void AkVCam::StreamEnginePrivate::updateTestFrame()
+{
+    this->m_mutex.lock();
+    auto testFrame = this->m_testFrame;
+    auto pictureLoader = this->m_pictureLoader;
+    auto format = this->m_format;
+    auto adjusts = this->m_adjusts;
+    auto graph = this->m_graph;
+    this->m_mutex.unlock();
+
+    if (format.size() < 1)
+        return;
+
+    if (testFrame.format().size() < 1 && pictureLoader) {
+        testFrame = pictureLoader();
+        std::lock_guard<ProfiledMutex> lock(this->m_mutex);
+
+        if (this->m_pictureLoader) {
+            this->m_testFrame = testFrame;
+            this->accountFrames();
+        }
+    }
+
+    auto frame = applyAdjusts(std::move(testFrame), format, adjusts, *graph);
+
+    if (frame.format().size() < 1)
+        return;
+
+    auto testFrameAdapted = std::make_shared<const VideoFrame>(std::move(frame));
+    this->m_mutex.lock();
+    this->m_testFrameAdapted = testFrameAdapted;
+
+    if (this->m_broadcaster.empty())
+        this->m_currentFrame = testFrameAdapted;
+
+    this->accountFrames();
+    this->m_mutex.unlock();
+
+    // Frames recreated while stopped must be released again.
+    IdleMonitor::global()->touch(this->idleId());
+}
+
+void AkVCam::StreamEnginePrivate::releaseFrames()
+{
+    this->m_mutex.lock();
+
+    if (this->m_running) {
+        this->m_mutex.unlock();
+
+        return;
+    }
+
+    // Only drop the picture if it can be loaded again.
+    if (this->m_pictureLoader)
+        this->m_testFrame = {};
+
+    this->m_testFrameAdapted = {};
+    this->m_currentFrame = {};
+    this->accountFrames();
+    this->m_mutex.unlock();
+
+    /* Drop the frame being received in slices too. sliceReady() locks
+     * m_mutex with m_sliceMutex held, so it's locked after releasing it.
+     */
+    std::lock_guard<ProfiledMutex> sliceLock(this->m_sliceMutex);
+
+    if (this->m_running)
+        return;
+
+    this->m_sliceFrame = {};
+    this->m_sliceLines = -1;
+}
+
+// Must be called with m_mutex locked.
+void AkVCam::StreamEnginePrivate::accountFrames()
+{
+    uint64_t pictures = this->m_testFrame.data().capacity();
+
+    if (this->m_testFrameAdapted)
+        pictures += this->m_testFrameAdapted->data().capacity();
+
+    this->m_picturesAccount.setSize(pictures);
+    auto held = pictures;
+
+    if (this->m_currentFrame
+        && this->m_currentFrame != this->m_testFrameAdapted)
+        held += this->m_currentFrame->data().capacity();
+
+    this->m_deviceAccount.setSize(held);
+}
+
+// Must be called with m_mutex locked.
+void AkVCam::StreamEnginePrivate::updateGraphs()
+{
+    this->m_graph = makeGraph(this->m_format, this->m_adjusts, true);
+
+    // Slices are never scaled, and the scaler would stretch them.
+    this->m_sliceGraph = makeGraph(this->m_format, this->m_adjusts, false);
+}
+
+/* Publishes the output of the stream, so the other streams of the device
+ * can adapt the frames for it. Must be called with m_mutex locked, stop()
+ * removes it with the same lock held.
+ */
+void AkVCam::StreamEnginePrivate::registerOutput()
+{
+    if (!this->m_running || this->m_deviceId.empty())
+        return;
+
+    streamOutputs()->set(this,
+                         this->m_deviceId,
+                         {adjustsKey(this->m_format, this->m_adjusts),
+                          this->m_format,
+                          this->m_adjusts,
+                          this->m_graph});
+}
+
+AkVCam::FilterGraphPtr AkVCam::StreamEnginePrivate::makeGraph(const VideoFormat &format,
+                                                              const StreamAdjusts &adjusts,
+                                                              bool scale)
+{
+    auto graph = std::make_shared<FilterGraph>();
+    graph->append(std::make_shared<MirrorFilter>(adjusts.horizontalMirror,
+                                                 adjusts.verticalMirror));
+    graph->append(std::make_shared<SwapRgbFilter>(adjusts.swapRgb));
+    graph->append(std::make_shared<AdjustFilter>(adjusts.hue,
+                                                 adjusts.saturation,
+                                                 adjusts.luminance,
+                                                 adjusts.gamma,
+                                                 adjusts.contrast,
+                                                 adjusts.gray));
+
+    if (scale)
+        graph->append(std::make_shared<ScaleFilter>(format.width(),
+                                                    format.height(),
+                                                    adjusts.scaling,
+                                                    adjusts.aspectRatio));
+
+    graph->append(std::make_shared<ConvertFilter>(format.fourcc()));
+
+    return graph;
+}
+
+std::string AkVCam::StreamEnginePrivate::adjustsKey(const VideoFormat &format,
+                                                    const StreamAdjusts &adjusts)
+{
+    std::stringstream ss;
+    ss << format.fourcc()
+       << ' ' << format.width()
+       << ' ' << format.height()
+       << ' ' << adjusts.horizontalMirror
+       << ' ' << adjusts.verticalMirror
+       << ' ' << adjusts.scaling
+       << ' ' << adjusts.aspectRatio
+       << ' ' << adjusts.swapRgb
+       << ' ' << adjusts.hue
+       << ' ' << adjusts.saturation
+       << ' ' << adjusts.luminance
+       << ' ' << adjusts.gamma
+       << ' ' << adjusts.contrast
+       << ' ' << adjusts.gray;
+
+    return ss.str();
+}
+
+bool AkVCam::StreamEnginePrivate::isScaleOnly(const StreamAdjusts &adjusts)
+{
+    return !adjusts.horizontalMirror
+           && !adjusts.verticalMirror
+           && !adjusts.swapRgb
+           && adjusts.hue == 0
+           && adjusts.saturation == 0
+           && adjusts.luminance == 0
+           && adjusts.gamma == 0
+           && adjusts.contrast == 0
+           && !adjusts.gray;
+}
+
+std::vector<AkVCam::VideoFramePtr> AkVCam::StreamEnginePrivate::adaptFrames(const VideoFramePtr &frame,
+                                                                            const std::vector<std::string> &keys,
+                                                                            const StreamOutputs &outputs)
+{
+    static auto &passthroughFrames = Stats::counter("frames_passthrough");
+    std::vector<VideoFramePtr> frames(keys.size());
+
+    // Outputs that only scale and convert, by scaling mode.
+    std::map<std::pair<Scaling, AspectRatio>, std::vector<size_t>> batches;
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto it = outputs.find(keys[i]);
+
+        if (it == outputs.end())
+            continue;
+
+        auto &output = it->second;
+
+        // Share the received frame, the sink copies it to its buffer. This
+        // is the second copy, the first one took it out of shared memory.
+        if (isPassthrough(frame->format(), output.format, output.adjusts)) {
+            passthroughFrames++;
+            frames[i] = frame;
+        } else if (isScaleOnly(output.adjusts)) {
+            batches[{output.adjusts.scaling,
+                     output.adjusts.aspectRatio}].push_back(i);
+        } else {
+            auto adjusted = applyAdjusts(*frame,
+                                         output.format,
+                                         output.adjusts,
+                                         *output.graph);
+            frames[i] = std::make_shared<const VideoFrame>(std::move(adjusted));
+        }
+    }
+
+    if (frame->format().size() < 1)
+        return frames;
+
+    for (auto &batch: batches) {
+        std::vector<VideoFormat> formats;
+
+        for (auto &i: batch.second) {
+            auto &format = outputs.at(keys[i]).format;
+            formats.push_back({format.fourcc(), format.width(), format.height()});
+        }
+
+        auto adapted = frame->convert(formats,
+                                      batch.first.first,
+                                      batch.first.second);
+
+        for (size_t j = 0; j < adapted.size(); j++)
+            frames[batch.second[j]] =
+                    std::make_shared<const VideoFrame>(std::move(adapted[j]));
+    }
+
+    return frames;
+}
+
+bool AkVCam::StreamEnginePrivate::isPassthrough(const VideoFormat &frameFormat,
+                                                const VideoFormat &format,
+                                                const StreamAdjusts &adjusts)
+{
+    return frameFormat.size() > 0
+           && frameFormat.fourcc() == format.fourcc()
+           && frameFormat.width() == format.width()
+           && frameFormat.height() == format.height()
+           && isScaleOnly(adjusts);
+}
+
+AkVCam::VideoFrame AkVCam::StreamEnginePrivate::applyAdjusts(VideoFrame frame,
+                                                             const VideoFormat &format,
+                                                             const StreamAdjusts &adjusts,
+                                                             const FilterGraph &graph)
+{
+    static auto &processedFrames = Stats::counter("frames_processed");
+
+    if (frame.format().size() < 1 || format.size() < 1)
+        return {};
+
+    // If the frame is already in the right shape, just forward it.
+    if (isPassthrough(frame.format(), format, adjusts))
+        return frame;
+
+    processedFrames++;
+
+    return graph.process(frame);
+}
+
+AkVCam::VideoFrame AkVCam::StreamEnginePrivate::randomFrame(const VideoFormat &format)
+{
+    VideoFrame frame(format);
+    static std::uniform_int_distribution<int> distribution(0, 255);
+    static std::default_random_engine engine;
+    std::generate(frame.data().begin(), frame.data().end(), [] () {
+        return uint8_t(distribution(engine));
+    });
+
+    return frame;
+}
+
+int64_t AkVCam::StreamEnginePrivate::steadyClock()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+int64_t AkVCam::StreamEnginePrivate::frameDuration() const
+{
+    auto fps = this->m_frameRate.value();
+
+    if (fps <= 0)
+        fps = 30;
+
+    return int64_t(1e9 / fps);
+}
+
+void AkVCam::StreamEnginePrivate::streamLoop()
+{
+    AkLogFunction();
+    auto next = std::chrono::steady_clock::now();
+
+    while (this->m_running) {
+        this->m_mutex.lock();
+        auto clock = this->m_clock;
+        auto send = this->m_send;
+        auto duration = this->frameDuration();
+        this->m_mutex.unlock();
+
+        auto now = clock? clock(): steadyClock();
+        auto frame = this->self->currentFrame();
+        auto timing = this->self->nextTiming(now);
+
+        if (send && !send(*frame, timing)) {
+            AkLogError() << "Error sending frame" << std::endl;
+            this->m_running = false;
+            this->m_mutex.lock();
+            streamOutputs()->remove(this);
+            this->m_mutex.unlock();
+
+            break;
+        }
+
+        // Don't try to catch up if sending took longer than a frame.
+        next += std::chrono::nanoseconds(duration);
+        next = std::max(next, std::chrono::steady_clock::now());
+
+        std::unique_lock<std::mutex> lock(this->m_threadMutex);
+        this->m_threadCondition.wait_until(lock, next, [this] () {
+            return !this->m_running;
+        });
+    }
+
+    AkLogInfo() << "Thread "
+                << std::this_thread::get_id()
+                << " finnished"
+                << std::endl;
+}
+
+void AkVCam::StreamOutputRegistry::set(const void *stream,
+                                       const std::string &deviceId,
+                                       const StreamOutput &output)
+{
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    this->m_outputs[stream] = {deviceId, output};
+}
+
+void AkVCam::StreamOutputRegistry::remove(const void *stream)
+{
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    this->m_outputs.erase(stream);
+}
+
+AkVCam::StreamOutputs AkVCam::StreamOutputRegistry::outputs(const std::string &deviceId) const
+{
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    StreamOutputs outputs;
+
+    for (auto &output: this->m_outputs)
+        if (output.second.first == deviceId)
+            outputs[output.second.second.key] = output.second.second;
+
+    return outputs;
+}
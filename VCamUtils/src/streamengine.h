@@ -0,0 +1,142 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_STREAMENGINE_H
+#define AKVCAMUTILS_STREAMENGINE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "image/videoframetypes.h"
+
+namespace AkVCam
+{
+    class StreamEnginePrivate;
+    class Fraction;
+    class VideoFormat;
+    class VideoFrame;
+
+    // Processing applied to the frames before sending them.
+    struct StreamAdjusts
+    {
+        bool horizontalMirror {false};
+        bool verticalMirror {false};
+        Scaling scaling {ScalingFast};
+        AspectRatio aspectRatio {AspectRatioIgnore};
+        bool swapRgb {false};
+        int hue {0};
+        int saturation {0};
+        int luminance {0};
+        int gamma {0};
+        int contrast {0};
+        bool gray {false};
+
+        bool operator ==(const StreamAdjusts &other) const;
+        bool operator !=(const StreamAdjusts &other) const;
+    };
+
+    // All times are in nanoseconds.
+    struct FrameTiming
+    {
+        int64_t pts;
+        int64_t duration;
+        uint64_t sequence;
+        bool discontinuity;
+    };
+
+    using StreamClockFunc = std::function<int64_t ()>;
+    using StreamPictureFunc = std::function<VideoFrame ()>;
+    using StreamSendFunc = std::function<bool (const VideoFrame &frame,
+                                               const FrameTiming &timing)>;
+
+    /* Platform independent part of a virtual camera stream.
+     *
+     * The engine keeps the frame to be sent, either the last frame received
+     * from the broadcaster or the test picture, adapts it to the output
+     * format, and calls the send function at the stream frame rate with the
+     * frame and its timestamps. The platform code only has to deliver the
+     * frame to the client.
+     * While stopped, the frames are released when the idle timeout expires,
+     * and recreated on start.
+     */
+    class StreamEngine
+    {
+        public:
+            StreamEngine();
+            StreamEngine(const StreamEngine &other) = delete;
+            ~StreamEngine();
+
+            VideoFormat format() const;
+            void setFormat(const VideoFormat &format);
+            Fraction frameRate() const;
+            void setFrameRate(const Fraction &frameRate);
+            StreamAdjusts adjusts() const;
+            void setAdjusts(const StreamAdjusts &adjusts);
+            void setPicture(const VideoFrame &picture);
+
+            // Like setPicture(), but the picture is loaded only when needed
+            // and dropped when idle.
+            void setPictureLoader(const StreamPictureFunc &loader);
+            std::string broadcaster() const;
+            void setBroadcaster(const std::string &broadcaster);
+
+            // Time source for the timestamps, defaults to a steady clock.
+            void setClock(const StreamClockFunc &clock);
+
+            /* Called from the streaming thread for each frame. Returning
+             * false stops the stream.
+             */
+            void setSendFunc(const StreamSendFunc &send);
+
+            bool start();
+            void stop();
+            bool isRunning() const;
+            void frameReady(const std::string &deviceId,
+                            const VideoFramePtr &frame,
+                            uint64_t sequence);
+
+            /* Like frameReady(), but only the lines [firstLine,
+             * firstLine + lines) of the frame are ready yet. Each slice is
+             * processed as it arrives, so the frame is ready shortly after
+             * its last slice. Frames that must be scaled are left to
+             * frameReady().
+             */
+            void sliceReady(const std::string &deviceId,
+                            const VideoFrame &frame,
+                            uint64_t sequence,
+                            int firstLine,
+                            int lines);
+
+            // Adapts a frame to the output format and adjusts.
+            VideoFrame process(const VideoFrame &frame) const;
+
+            // Frame to send next, a random frame if there is none.
+            std::shared_ptr<const VideoFrame> currentFrame() const;
+
+            // Timestamps for the next frame sent at the given time.
+            FrameTiming nextTiming(int64_t now);
+
+        private:
+            StreamEnginePrivate *d;
+    };
+}
+
+#endif // AKVCAMUTILS_STREAMENGINE_H
@@ -0,0 +1,676 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "unixbroker.h"
+#include "logger.h"
+
+#define UNIXBROKER_CLIENT_NAME "AkVCam_Client"
+#define UNIXBROKER_FLAG_REPLY 0x1
+#define UNIXBROKER_MAX_PAYLOAD (64 << 20)
+#define UNIXBROKER_POLL_INTERVAL 100
+
+#ifdef MSG_NOSIGNAL
+    #define UNIXBROKER_SEND_FLAGS MSG_NOSIGNAL
+#else
+    #define UNIXBROKER_SEND_FLAGS 0
+#endif
+
+namespace AkVCam
+{
+    struct UnixBrokerHeader
+    {
+        uint32_t id;
+        uint32_t flags;
+        uint32_t size;
+    };
+
+    class UnixBrokerConnection: public BrokerPeer
+    {
+        public:
+            int m_socket;
+            std::string m_port;
+            std::atomic<bool> m_open {true};
+            std::mutex m_writeMutex;
+            std::thread m_thread;
+
+            explicit UnixBrokerConnection(int socket);
+            ~UnixBrokerConnection() override;
+            bool send(const BrokerMessage &message) override;
+            bool isAlive() override;
+            bool write(uint32_t id,
+                       uint32_t flags,
+                       const std::vector<uint8_t> &data);
+            bool read(UnixBrokerHeader *header, std::vector<uint8_t> *data);
+    };
+
+    using UnixBrokerConnectionPtr = std::shared_ptr<UnixBrokerConnection>;
+
+    class UnixBrokerServerPrivate
+    {
+        public:
+            Broker m_broker;
+            std::string m_path;
+            int m_socket {-1};
+            std::thread m_thread;
+            std::atomic<bool> m_run {false};
+            std::vector<UnixBrokerConnectionPtr> m_connections;
+            std::mutex m_mutex;
+            uint64_t m_id {0};
+
+            UnixBrokerServerPrivate();
+            void acceptLoop();
+            void readLoop(UnixBrokerConnectionPtr connection);
+            void handle(const UnixBrokerConnectionPtr &connection,
+                        BrokerMessage &message);
+            void reapConnections();
+            static void broadcasterReleased(void *userData,
+                                            const std::string &deviceId);
+    };
+
+    class UnixBrokerClientPrivate
+    {
+        public:
+            UnixBrokerClient *self;
+            UnixBrokerConnectionPtr m_connection;
+            std::mutex m_callMutex;
+            std::mutex m_replyMutex;
+            std::condition_variable m_replyReady;
+            uint32_t m_pendingId {0};
+            bool m_waiting {false};
+            bool m_replied {false};
+            BrokerMessage m_reply;
+
+            explicit UnixBrokerClientPrivate(UnixBrokerClient *self);
+            void readLoop(UnixBrokerConnectionPtr connection);
+    };
+
+    int unixBrokerSocket(const std::string &path, sockaddr_un *address);
+}
+
+std::vector<uint8_t> AkVCam::UnixBroker::pack(const std::vector<std::string> &strings)
+{
+    std::vector<uint8_t> data;
+
+    for (auto &str: strings) {
+        data.insert(data.end(), str.begin(), str.end());
+        data.push_back(0);
+    }
+
+    return data;
+}
+
+std::vector<std::string> AkVCam::UnixBroker::unpack(const std::vector<uint8_t> &data)
+{
+    std::vector<std::string> strings;
+    auto it = data.begin();
+
+    while (it != data.end()) {
+        auto end = std::find(it, data.end(), 0);
+        strings.emplace_back(it, end);
+
+        if (end == data.end())
+            break;
+
+        it = end + 1;
+    }
+
+    return strings;
+}
+
+AkVCam::UnixBrokerServer::UnixBrokerServer()
+{
+    this->d = new UnixBrokerServerPrivate;
+}
+
+AkVCam::UnixBrokerServer::~UnixBrokerServer()
+{
+    this->stop();
+    delete this->d;
+}
+
+AkVCam::Broker &AkVCam::UnixBrokerServer::broker()
+{
+    return this->d->m_broker;
+}
+
+std::string AkVCam::UnixBrokerServer::path() const
+{
+    return this->d->m_path;
+}
+
+bool AkVCam::UnixBrokerServer::start(const std::string &path)
+{
+    AkLogFunction();
+    this->stop();
+    sockaddr_un address;
+    auto fd = unixBrokerSocket(path, &address);
+
+    if (fd < 0)
+        return false;
+
+    unlink(path.c_str());
+
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0
+        || listen(fd, SOMAXCONN) < 0) {
+        AkLogError() << "Can't listen on "
+                     << path
+                     << ": "
+                     << strerror(errno)
+                     << std::endl;
+        close(fd);
+
+        return false;
+    }
+
+    this->d->m_path = path;
+    this->d->m_socket = fd;
+    this->d->m_run = true;
+    this->d->m_thread = std::thread(&UnixBrokerServerPrivate::acceptLoop,
+                                    this->d);
+
+    return true;
+}
+
+void AkVCam::UnixBrokerServer::stop()
+{
+    AkLogFunction();
+
+    if (!this->d->m_run)
+        return;
+
+    this->d->m_run = false;
+    this->d->m_thread.join();
+    close(this->d->m_socket);
+    this->d->m_socket = -1;
+    unlink(this->d->m_path.c_str());
+
+    this->d->m_mutex.lock();
+    auto connections = std::move(this->d->m_connections);
+    this->d->m_mutex.unlock();
+
+    for (auto &connection: connections) {
+        shutdown(connection->m_socket, SHUT_RDWR);
+        connection->m_thread.join();
+    }
+}
+
+bool AkVCam::UnixBrokerServer::isRunning() const
+{
+    return this->d->m_run;
+}
+
+AkVCam::UnixBrokerClient::UnixBrokerClient()
+{
+    this->d = new UnixBrokerClientPrivate(this);
+}
+
+AkVCam::UnixBrokerClient::~UnixBrokerClient()
+{
+    this->disconnect();
+    delete this->d;
+}
+
+bool AkVCam::UnixBrokerClient::connect(const std::string &path)
+{
+    AkLogFunction();
+    this->disconnect();
+    sockaddr_un address;
+    auto fd = unixBrokerSocket(path, &address);
+
+    if (fd < 0)
+        return false;
+
+    if (::connect(fd,
+                  reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)) < 0) {
+        AkLogError() << "Can't connect to "
+                     << path
+                     << ": "
+                     << strerror(errno)
+                     << std::endl;
+        close(fd);
+
+        return false;
+    }
+
+    auto connection = std::make_shared<UnixBrokerConnection>(fd);
+    this->d->m_connection = connection;
+    connection->m_thread = std::thread(&UnixBrokerClientPrivate::readLoop,
+                                       this->d,
+                                       connection);
+
+    return true;
+}
+
+void AkVCam::UnixBrokerClient::disconnect()
+{
+    if (!this->d->m_connection)
+        return;
+
+    shutdown(this->d->m_connection->m_socket, SHUT_RDWR);
+    this->d->m_connection->m_thread.join();
+    this->d->m_connection.reset();
+}
+
+bool AkVCam::UnixBrokerClient::isConnected() const
+{
+    return this->d->m_connection && this->d->m_connection->m_open;
+}
+
+bool AkVCam::UnixBrokerClient::send(const BrokerMessage &message)
+{
+    if (!this->d->m_connection)
+        return false;
+
+    return this->d->m_connection->send(message);
+}
+
+bool AkVCam::UnixBrokerClient::call(const BrokerMessage &request,
+                                    BrokerMessage *reply,
+                                    int timeout)
+{
+    if (!this->d->m_connection)
+        return false;
+
+    std::lock_guard<std::mutex> callLock(this->d->m_callMutex);
+    std::unique_lock<std::mutex> lock(this->d->m_replyMutex);
+    this->d->m_pendingId = request.id;
+    this->d->m_waiting = true;
+    this->d->m_replied = false;
+    lock.unlock();
+
+    bool ok = this->d->m_connection->send(request);
+    lock.lock();
+
+    if (ok)
+        ok = this->d->m_replyReady.wait_for(lock,
+                                            std::chrono::milliseconds(timeout),
+                                            [this] () {
+            return this->d->m_replied || !this->d->m_connection->m_open;
+        }) && this->d->m_replied;
+
+    this->d->m_waiting = false;
+
+    if (ok && reply)
+        *reply = std::move(this->d->m_reply);
+
+    this->d->m_reply = {};
+
+    return ok;
+}
+
+AkVCam::UnixBrokerConnection::UnixBrokerConnection(int socket):
+    m_socket(socket)
+{
+}
+
+AkVCam::UnixBrokerConnection::~UnixBrokerConnection()
+{
+    close(this->m_socket);
+}
+
+bool AkVCam::UnixBrokerConnection::send(const BrokerMessage &message)
+{
+    return this->write(message.id, 0, message.data);
+}
+
+bool AkVCam::UnixBrokerConnection::isAlive()
+{
+    return this->m_open;
+}
+
+bool AkVCam::UnixBrokerConnection::write(uint32_t id,
+                                         uint32_t flags,
+                                         const std::vector<uint8_t> &data)
+{
+    if (!this->m_open || data.size() > UNIXBROKER_MAX_PAYLOAD)
+        return false;
+
+    UnixBrokerHeader header {id, flags, uint32_t(data.size())};
+    struct Chunk
+    {
+        const uint8_t *data;
+        size_t size;
+    };
+    Chunk chunks[] {
+        {reinterpret_cast<const uint8_t *>(&header), sizeof(header)},
+        {data.data(), data.size()}
+    };
+    std::lock_guard<std::mutex> lock(this->m_writeMutex);
+
+    for (auto &chunk: chunks)
+        for (size_t written = 0; written < chunk.size;) {
+            auto result = ::send(this->m_socket,
+                                 chunk.data + written,
+                                 chunk.size - written,
+                                 UNIXBROKER_SEND_FLAGS);
+
+            if (result < 0 && errno == EINTR)
+                continue;
+
+            if (result <= 0)
+                return false;
+
+            written += size_t(result);
+        }
+
+    return true;
+}
+
+bool AkVCam::UnixBrokerConnection::read(UnixBrokerHeader *header,
+                                        std::vector<uint8_t> *data)
+{
+    auto readAll = [this] (void *buffer, size_t size) {
+        auto bytes = reinterpret_cast<uint8_t *>(buffer);
+
+        for (size_t nread = 0; nread < size;) {
+            auto result = recv(this->m_socket,
+                               bytes + nread,
+                               size - nread,
+                               0);
+
+            if (result < 0 && errno == EINTR)
+                continue;
+
+            if (result <= 0)
+                return false;
+
+            nread += size_t(result);
+        }
+
+        return true;
+    };
+
+    if (!readAll(header, sizeof(UnixBrokerHeader))
+        || header->size > UNIXBROKER_MAX_PAYLOAD)
+        return false;
+
+    data->resize(header->size);
+
+    return readAll(data->data(), data->size());
+}
+
+AkVCam::UnixBrokerServerPrivate::UnixBrokerServerPrivate()
+{
+    this->m_broker.connectBroadcasterReleased(this, &broadcasterReleased);
+}
+
+void AkVCam::UnixBrokerServerPrivate::acceptLoop()
+{
+    while (this->m_run) {
+        pollfd pfd {this->m_socket, POLLIN, 0};
+
+        if (poll(&pfd, 1, UNIXBROKER_POLL_INTERVAL) <= 0)
+            continue;
+
+        auto fd = accept(this->m_socket, nullptr, nullptr);
+
+        if (fd < 0)
+            continue;
+
+#ifdef SO_NOSIGPIPE
+        int noSigPipe = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(int));
+#endif
+
+        this->reapConnections();
+        auto connection = std::make_shared<UnixBrokerConnection>(fd);
+        connection->m_thread =
+                std::thread(&UnixBrokerServerPrivate::readLoop,
+                            this,
+                            connection);
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_connections.push_back(connection);
+    }
+}
+
+void AkVCam::UnixBrokerServerPrivate::readLoop(UnixBrokerConnectionPtr connection)
+{
+    UnixBrokerHeader header;
+    BrokerMessage message;
+
+    while (connection->read(&header, &message.data)) {
+        message.id = header.id;
+        this->handle(connection, message);
+    }
+
+    connection->m_open = false;
+
+    if (!connection->m_port.empty())
+        this->m_broker.removePeer(connection->m_port);
+}
+
+void AkVCam::UnixBrokerServerPrivate::handle(const UnixBrokerConnectionPtr &connection,
+                                             BrokerMessage &message)
+{
+    auto args = UnixBroker::unpack(message.data);
+    args.resize(std::max<size_t>(args.size(), 2));
+    auto &deviceId = args[0];
+    message.deviceId = deviceId;
+    std::vector<std::string> reply;
+
+    switch (message.id) {
+    case BrokerMessageIsAlive:
+        reply = {"1"};
+
+        break;
+
+    case BrokerMessageFrameReady:
+    case BrokerMessagePictureUpdated:
+    case BrokerMessageDeviceUpdate:
+    case BrokerMessageControlsUpdated:
+        this->m_broker.broadcast(message);
+
+        return;
+
+    case BrokerMessageRequestPort: {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        reply = {UNIXBROKER_CLIENT_NAME + std::to_string(this->m_id++)};
+
+        break;
+    }
+
+    case BrokerMessageAddPort: {
+        auto &port = args[0];
+        auto type = port.find(UNIXBROKER_CLIENT_NAME) == 0?
+                        Broker::PeerTypeClient:
+                        Broker::PeerTypeServer;
+        bool ok = connection->m_port.empty()
+                  && this->m_broker.addPeer(port,
+                                            type,
+                                            connection);
+
+        if (ok)
+            connection->m_port = port;
+
+        reply = {ok? "1": "0"};
+
+        break;
+    }
+
+    case BrokerMessageRemovePort:
+        if (args[0] == connection->m_port)
+            connection->m_port.clear();
+
+        this->m_broker.removePeer(args[0]);
+
+        return;
+
+    case BrokerMessageListeners:
+        reply = this->m_broker.listeners(deviceId);
+
+        break;
+
+    case BrokerMessageListener: {
+        auto listeners = this->m_broker.listeners(deviceId);
+        auto index = size_t(strtoul(args[1].c_str(), nullptr, 10));
+        reply = {"0", ""};
+
+        if (index < listeners.size())
+            reply = {"1", listeners[index]};
+
+        break;
+    }
+
+    case BrokerMessageListenerAdd:
+    case BrokerMessageListenerRemove: {
+        bool ok = message.id == BrokerMessageListenerAdd?
+                      this->m_broker.addListener(deviceId, args[1]):
+                      this->m_broker.removeListener(deviceId, args[1]);
+
+        if (ok)
+            this->m_broker.broadcast(message);
+
+        reply = {ok? "1": "0"};
+
+        break;
+    }
+
+    case BrokerMessageBroadcasting:
+        reply = {this->m_broker.broadcaster(deviceId)};
+
+        break;
+
+    case BrokerMessageSetBroadcasting: {
+        bool ok = this->m_broker.setBroadcaster(deviceId, args[1]);
+
+        if (ok)
+            this->m_broker.broadcast(message);
+
+        reply = {ok? "1": "0"};
+
+        break;
+    }
+
+    default:
+        AkLogWarning() << "Unknown message: " << message.id << std::endl;
+
+        return;
+    }
+
+    connection->write(message.id,
+                      UNIXBROKER_FLAG_REPLY,
+                      UnixBroker::pack(reply));
+}
+
+void AkVCam::UnixBrokerServerPrivate::reapConnections()
+{
+    std::vector<UnixBrokerConnectionPtr> closed;
+    this->m_mutex.lock();
+
+    for (auto it = this->m_connections.begin();
+         it != this->m_connections.end();)
+        if ((*it)->m_open) {
+            it++;
+        } else {
+            closed.push_back(*it);
+            it = this->m_connections.erase(it);
+        }
+
+    this->m_mutex.unlock();
+
+    for (auto &connection: closed)
+        connection->m_thread.join();
+}
+
+void AkVCam::UnixBrokerServerPrivate::broadcasterReleased(void *userData,
+                                                          const std::string &deviceId)
+{
+    auto self = reinterpret_cast<UnixBrokerServerPrivate *>(userData);
+    BrokerMessage message;
+    message.id = BrokerMessageSetBroadcasting;
+    message.data = UnixBroker::pack({deviceId, ""});
+    self->m_broker.broadcast(message);
+}
+
+AkVCam::UnixBrokerClientPrivate::UnixBrokerClientPrivate(UnixBrokerClient *self):
+    self(self)
+{
+}
+
+void AkVCam::UnixBrokerClientPrivate::readLoop(UnixBrokerConnectionPtr connection)
+{
+    UnixBrokerHeader header;
+    BrokerMessage message;
+
+    while (connection->read(&header, &message.data)) {
+        message.id = header.id;
+
+        if (header.flags & UNIXBROKER_FLAG_REPLY) {
+            std::lock_guard<std::mutex> lock(this->m_replyMutex);
+
+            if (this->m_waiting && header.id == this->m_pendingId) {
+                this->m_reply = message;
+                this->m_replied = true;
+                this->m_replyReady.notify_all();
+            }
+        } else if (header.id == BrokerMessageIsAlive) {
+            connection->write(header.id,
+                              UNIXBROKER_FLAG_REPLY,
+                              UnixBroker::pack({"1"}));
+        } else {
+            AKVCAM_EMIT(this->self, MessageReceived, message)
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(this->m_replyMutex);
+    connection->m_open = false;
+    this->m_replyReady.notify_all();
+}
+
+int AkVCam::unixBrokerSocket(const std::string &path, sockaddr_un *address)
+{
+    memset(address, 0, sizeof(sockaddr_un));
+
+    if (path.empty() || path.size() >= sizeof(address->sun_path)) {
+        AkLogError() << "Invalid socket path: " << path << std::endl;
+
+        return -1;
+    }
+
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path, path.c_str(), path.size());
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0) {
+        AkLogError() << "Can't create socket: " << strerror(errno) << std::endl;
+
+        return -1;
+    }
+
+#ifdef SO_NOSIGPIPE
+    int noSigPipe = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(int));
+#endif
+
+    return fd;
+}
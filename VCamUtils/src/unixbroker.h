@@ -0,0 +1,90 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_UNIXBROKER_H
+#define AKVCAMUTILS_UNIXBROKER_H
+
+#include <string>
+#include <vector>
+
+#include "broker.h"
+
+namespace AkVCam
+{
+    class UnixBrokerServerPrivate;
+    class UnixBrokerClientPrivate;
+
+    /* Broker transport over a Unix domain socket.
+     *
+     * Each message is a header with the message id, flags and payload size,
+     * followed by the payload. Requests send their arguments as NUL
+     * terminated strings, and are answered with a message with the same id
+     * and the reply flag set. Peers whose port name starts with
+     * AkVCam_Client receive the broadcasted messages.
+     */
+    namespace UnixBroker
+    {
+        std::vector<uint8_t> pack(const std::vector<std::string> &strings);
+        std::vector<std::string> unpack(const std::vector<uint8_t> &data);
+    }
+
+    class UnixBrokerServer
+    {
+        public:
+            UnixBrokerServer();
+            UnixBrokerServer(const UnixBrokerServer &other) = delete;
+            ~UnixBrokerServer();
+
+            Broker &broker();
+            std::string path() const;
+            bool start(const std::string &path);
+            void stop();
+            bool isRunning() const;
+
+        private:
+            UnixBrokerServerPrivate *d;
+    };
+
+    class UnixBrokerClient
+    {
+        public:
+            AKVCAM_SIGNAL(MessageReceived, const BrokerMessage &message)
+
+        public:
+            UnixBrokerClient();
+            UnixBrokerClient(const UnixBrokerClient &other) = delete;
+            ~UnixBrokerClient();
+
+            bool connect(const std::string &path);
+            void disconnect();
+            bool isConnected() const;
+            bool send(const BrokerMessage &message);
+
+            // Sends a request and waits for the reply.
+            bool call(const BrokerMessage &request,
+                      BrokerMessage *reply,
+                      int timeout=5000);
+
+        private:
+            UnixBrokerClientPrivate *d;
+            friend class UnixBrokerClientPrivate;
+    };
+}
+
+#endif // AKVCAMUTILS_UNIXBROKER_H
@@ -0,0 +1,108 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "test.h"
+#include "controlsbatch.h"
+
+// Controls a batch can hold, same as in the Windows messages.
+#define BATCH_CONTROLS 16
+
+namespace
+{
+    using ControlValues = std::map<std::string, int>;
+
+    struct ControlsReceiver
+    {
+        uint64_t version {0};
+        ControlValues values;
+        int fullReads {0};
+    };
+
+    // Sends the changes the way IpcBridge::setControls does.
+    void sendControls(uint64_t *version,
+                      ControlValues *stored,
+                      const ControlValues &changes,
+                      ControlsReceiver *receiver)
+    {
+        std::vector<std::pair<std::string, int>> batch;
+
+        for (auto &change: changes) {
+            (*stored)[change.first] = change.second;
+
+            if (batch.size() < BATCH_CONTROLS)
+                batch.push_back(change);
+        }
+
+        *version = AkVCam::controlsBatchVersion(*version,
+                                                changes.size(),
+                                                BATCH_CONTROLS);
+
+        if (AkVCam::isControlsBatchDiff(receiver->version, *version)) {
+            for (auto &change: batch)
+                receiver->values[change.first] = change.second;
+        } else {
+            receiver->values = *stored;
+            receiver->fullReads++;
+        }
+
+        receiver->version = *version;
+    }
+
+    ControlValues changedControls(size_t count, int value)
+    {
+        ControlValues changes;
+
+        for (size_t i = 0; i < count; i++)
+            changes["control" + std::to_string(i)] = value;
+
+        return changes;
+    }
+}
+
+// A truncated batch must make the receivers read all the controls again.
+AKVCAM_TEST(controlsBatchOverflow)
+{
+    uint64_t version = 0;
+    ControlValues stored;
+    ControlsReceiver receiver;
+
+    // The first batch is always a full read.
+    sendControls(&version, &stored, changedControls(24, 1), &receiver);
+    AKVCAM_VERIFY(receiver.fullReads == 1);
+
+    // A batch that fits is applied as a diff.
+    sendControls(&version,
+                 &stored,
+                 changedControls(BATCH_CONTROLS, 2),
+                 &receiver);
+    AKVCAM_VERIFY(receiver.fullReads == 1);
+    AKVCAM_VERIFY(receiver.values == stored);
+
+    // More changes than the batch holds.
+    auto lastVersion = version;
+    sendControls(&version, &stored, changedControls(24, 3), &receiver);
+    AKVCAM_VERIFY(version == lastVersion + 2);
+    AKVCAM_VERIFY(receiver.fullReads == 2);
+    AKVCAM_VERIFY(receiver.values == stored);
+    AKVCAM_VERIFY(receiver.values.at("control23") == 3);
+}
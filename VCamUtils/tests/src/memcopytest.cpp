@@ -0,0 +1,211 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+#include "memcopy.h"
+
+namespace
+{
+    // Restores the MemCopy settings changed by a test.
+    struct MemCopySettings
+    {
+        size_t streamingThreshold {AkVCam::MemCopy::streamingThreshold()};
+        size_t threadingThreshold {AkVCam::MemCopy::threadingThreshold()};
+        int maxThreads {AkVCam::MemCopy::maxThreads()};
+
+        ~MemCopySettings()
+        {
+            AkVCam::MemCopy::setStreamingThreshold(this->streamingThreshold);
+            AkVCam::MemCopy::setThreadingThreshold(this->threadingThreshold);
+            AkVCam::MemCopy::setMaxThreads(this->maxThreads);
+        }
+    };
+
+    std::vector<uint8_t> pattern(size_t size)
+    {
+        std::vector<uint8_t> data(size);
+
+        for (size_t i = 0; i < size; i++)
+            data[i] = uint8_t(i * 31 + i / 251);
+
+        return data;
+    }
+
+    // Throughput of the copy function in GB/s.
+    double throughput(size_t size,
+                      const std::function<void (uint8_t *, const uint8_t *)> &copy,
+                      bool readBack)
+    {
+        auto src = pattern(size);
+        std::vector<uint8_t> dst(size);
+        volatile uint64_t sum = 0;
+        size_t iterations = std::max<size_t>(8, (1 << 30) / size);
+
+        // Warm up.
+        copy(dst.data(), src.data());
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < iterations; i++) {
+            copy(dst.data(), src.data());
+
+            // What the consumer does right after the copy.
+            if (readBack)
+                for (size_t j = 0; j < size; j += 64)
+                    sum = sum + dst[j];
+        }
+
+        auto elapsed =
+                std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                              - start).count();
+
+        return double(size) * double(iterations) / elapsed / 1e9;
+    }
+}
+
+AKVCAM_TEST(memCopyMatchesMemcpy)
+{
+    MemCopySettings settings;
+    auto src = pattern(4 << 20);
+
+    for (int mode = 0; mode < 3; mode++) {
+        AkVCam::MemCopy::setStreamingThreshold(mode == 0?
+                                                   std::numeric_limits<size_t>::max():
+                                                   0);
+        AkVCam::MemCopy::setThreadingThreshold(mode == 2?
+                                                   0:
+                                                   std::numeric_limits<size_t>::max());
+        AkVCam::MemCopy::setMaxThreads(4);
+
+        // Odd sizes and misaligned buffers exercise the head and tail copies.
+        for (size_t size: {size_t(1), size_t(63), size_t(4097), src.size() - 3})
+            for (size_t offset: {size_t(0), size_t(1), size_t(3)}) {
+                std::vector<uint8_t> dst(size + 8, 0);
+                AkVCam::MemCopy::copy(dst.data() + offset,
+                                      src.data() + 1,
+                                      size);
+                AKVCAM_VERIFY(memcmp(dst.data() + offset,
+                                     src.data() + 1,
+                                     size) == 0);
+                AKVCAM_VERIFY(dst[offset + size] == 0);
+            }
+    }
+}
+
+AKVCAM_TEST(memCopyPlaneStrides)
+{
+    size_t lineSize = 1922;
+    size_t lines = 64;
+    size_t srcStride = 2048;
+    size_t dstStride = 1984;
+    auto src = pattern(srcStride * lines);
+    std::vector<uint8_t> dst(dstStride * lines, 0);
+    AkVCam::MemCopy::copyPlane(dst.data(),
+                               dstStride,
+                               src.data(),
+                               srcStride,
+                               lineSize,
+                               lines);
+
+    for (size_t y = 0; y < lines; y++) {
+        AKVCAM_VERIFY(memcmp(dst.data() + y * dstStride,
+                             src.data() + y * srcStride,
+                             lineSize) == 0);
+
+        for (size_t x = lineSize; x < dstStride; x++)
+            AKVCAM_VERIFY(dst[y * dstStride + x] == 0);
+    }
+}
+
+AKVCAM_BENCHMARK(memCopyThroughput)
+{
+    MemCopySettings settings;
+    struct Size
+    {
+        const char *name;
+        size_t size;
+    };
+    static const Size sizes[] {
+        {"640x480 RGB24"  ,  640 *  480 * 3},
+        {"1920x1080 NV12" , 1920 * 1080 * 3 / 2},
+        {"1920x1080 RGB24", 1920 * 1080 * 3},
+        {"3840x2160 RGB24", 3840 * 2160 * 3},
+        {"3840x2160 RGB32", 3840 * 2160 * 4},
+    };
+    static const size_t noLimit = std::numeric_limits<size_t>::max();
+    struct Method
+    {
+        const char *name;
+        size_t streamingThreshold;
+        size_t threadingThreshold;
+        int threads;
+    };
+    static const Method methods[] {
+        {"MemCopy cached"    , noLimit, noLimit, 1},
+        {"MemCopy streaming" , 0      , noLimit, 1},
+        {"MemCopy 2 threads" , 0      , 0      , 2},
+        {"MemCopy 4 threads" , 0      , 0      , 4},
+    };
+
+    // MemCopy never splits a copy in more threads than cores.
+    auto cores = int(std::thread::hardware_concurrency());
+    std::cout << "    Cores: " << cores << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+
+    for (auto readBack: {false, true}) {
+        std::cout << "    GB/s, "
+                  << (readBack? "copy and read back": "copy only")
+                  << std::endl;
+
+        for (auto &size: sizes) {
+            std::cout << "    " << std::setw(16) << std::left << size.name
+                      << " memcpy: "
+                      << throughput(size.size,
+                                    [&size] (uint8_t *dst, const uint8_t *src) {
+                                        memcpy(dst, src, size.size);
+                                    },
+                                    readBack);
+
+            for (auto &method: methods) {
+                if (method.threads > std::max(cores, 1))
+                    continue;
+
+                AkVCam::MemCopy::setStreamingThreshold(method.streamingThreshold);
+                AkVCam::MemCopy::setThreadingThreshold(method.threadingThreshold);
+                AkVCam::MemCopy::setMaxThreads(method.threads);
+                std::cout << ", " << method.name << ": "
+                          << throughput(size.size,
+                                        [&size] (uint8_t *dst, const uint8_t *src) {
+                                            AkVCam::MemCopy::copy(dst, src, size.size);
+                                        },
+                                        readBack);
+            }
+
+            std::cout << std::endl;
+        }
+    }
+}
@@ -0,0 +1,215 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+#include "pool.h"
+
+#define POOL_ITEMS      4
+#define POOL_THREADS    8
+#define POOL_ITERATIONS 20000
+
+namespace
+{
+    // Acquire and release operations per second with the given threads.
+    double poolThroughput(AkVCam::Pool<int> &pool, int threads)
+    {
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < threads; i++)
+            workers.emplace_back([&pool] () {
+                for (int j = 0; j < POOL_ITERATIONS; j++) {
+                    auto index = pool.acquire();
+
+                    if (index != AkVCam::Pool<int>::npos)
+                        pool.release(index);
+                }
+            });
+
+        for (auto &worker: workers)
+            worker.join();
+
+        auto elapsed =
+                std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                              - start).count();
+
+        return double(threads) * POOL_ITERATIONS / elapsed;
+    }
+}
+
+// More threads than items, an item must never be held by two of them.
+AKVCAM_TEST(poolContention)
+{
+    AkVCam::Pool<int> pool;
+    AKVCAM_VERIFY(pool.setItems({0, 1, 2, 3}));
+    std::atomic<int> holders[POOL_ITEMS];
+    std::atomic<int> shared {0};
+    std::atomic<int> failed {0};
+
+    for (auto &holder: holders)
+        holder = 0;
+
+    std::vector<std::thread> workers;
+
+    for (int i = 0; i < POOL_THREADS; i++)
+        workers.emplace_back([&] () {
+            for (int j = 0; j < POOL_ITERATIONS; j++) {
+                int item = -1;
+
+                if (!pool.acquire(&item, 1000)) {
+                    failed++;
+
+                    continue;
+                }
+
+                if (holders[item]++ > 0)
+                    shared++;
+
+                if (j % 64 == 0)
+                    std::this_thread::yield();
+
+                holders[item]--;
+                pool.release(item);
+            }
+        });
+
+    for (auto &worker: workers)
+        worker.join();
+
+    AKVCAM_VERIFY(failed == 0);
+    AKVCAM_VERIFY(shared == 0);
+    AKVCAM_VERIFY(pool.available() == POOL_ITEMS);
+    AKVCAM_VERIFY(pool.used() == 0);
+}
+
+AKVCAM_TEST(poolTimeoutAndCancel)
+{
+    AkVCam::Pool<int> pool;
+    AKVCAM_VERIFY(pool.setItems({0, 1}));
+    auto first = pool.acquire(0);
+    auto second = pool.acquire(0);
+    AKVCAM_VERIFY(first != AkVCam::Pool<int>::npos);
+    AKVCAM_VERIFY(second != AkVCam::Pool<int>::npos);
+    AKVCAM_VERIFY(pool.acquire(0) == AkVCam::Pool<int>::npos);
+
+    auto start = std::chrono::steady_clock::now();
+    AKVCAM_VERIFY(pool.acquire(50) == AkVCam::Pool<int>::npos);
+    AKVCAM_VERIFY(std::chrono::steady_clock::now() - start
+                  >= std::chrono::milliseconds(50));
+
+    // Items can't be replaced while in use.
+    AKVCAM_VERIFY(!pool.setItems({0, 1, 2}));
+
+    // A waiter blocked forever is woken up by cancel().
+    std::atomic<size_t> waited {0};
+    std::thread waiter([&pool, &waited] () {
+        waited = pool.acquire(-1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    pool.cancel();
+    waiter.join();
+    AKVCAM_VERIFY(waited == AkVCam::Pool<int>::npos);
+
+    // Released items are handed out again after resume().
+    pool.release(first);
+    pool.resume();
+    AKVCAM_VERIFY(pool.acquire(0) == first);
+
+    // Releasing a free item is a no-op.
+    pool.release(second);
+    AKVCAM_VERIFY(!pool.release(second));
+    AKVCAM_VERIFY(pool.available() == 1);
+}
+
+// Free items must not be handed out once the pool is canceled.
+AKVCAM_TEST(poolAcquireAfterCancel)
+{
+    AkVCam::Pool<int> pool;
+    AKVCAM_VERIFY(pool.setItems({0, 1, 2}));
+    pool.cancel();
+    AKVCAM_VERIFY(pool.available() == 3);
+    AKVCAM_VERIFY(pool.tryAcquire() == AkVCam::Pool<int>::npos);
+    AKVCAM_VERIFY(pool.acquire(0) == AkVCam::Pool<int>::npos);
+    AKVCAM_VERIFY(pool.acquire(10) == AkVCam::Pool<int>::npos);
+    AKVCAM_VERIFY(pool.acquire(-1) == AkVCam::Pool<int>::npos);
+    int item = -1;
+    AKVCAM_VERIFY(!pool.acquire(&item, 0));
+    AKVCAM_VERIFY(pool.available() == 3);
+
+    pool.resume();
+    AKVCAM_VERIFY(pool.acquire(&item, 0));
+}
+
+// The same workload on the lock-free pool and on a mutex protected list.
+AKVCAM_BENCHMARK(poolAcquireRelease)
+{
+    auto cores = int(std::thread::hardware_concurrency());
+    std::cout << "    Cores: " << cores << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+
+    for (int threads: {1, 2, 4, 8}) {
+        AkVCam::Pool<int> pool;
+        pool.setItems({0, 1, 2, 3});
+        std::mutex mutex;
+        std::vector<int> items {0, 1, 2, 3};
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < threads; i++)
+            workers.emplace_back([&mutex, &items] () {
+                for (int j = 0; j < POOL_ITERATIONS; j++) {
+                    int item = -1;
+
+                    while (item < 0) {
+                        std::lock_guard<std::mutex> lock(mutex);
+
+                        if (!items.empty()) {
+                            item = items.back();
+                            items.pop_back();
+                        }
+                    }
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    items.push_back(item);
+                }
+            });
+
+        for (auto &worker: workers)
+            worker.join();
+
+        auto elapsed =
+                std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                              - start).count();
+        std::cout << "    " << threads << " threads, Mops/s, Pool: "
+                  << poolThroughput(pool, threads) / 1e6
+                  << ", mutex: "
+                  << double(threads) * POOL_ITERATIONS / elapsed / 1e6
+                  << ", waits: "
+                  << pool.waits()
+                  << std::endl;
+    }
+}
@@ -0,0 +1,94 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <cstdint>
+
+#include "test.h"
+#include "queuecontroller.h"
+
+#define QUEUE_FRAME_TIME 33333333
+
+namespace
+{
+    /* Feeds the controller for the given time, the consumer reads
+     * drainFrames frames every drainPeriod updates. Returns false if the
+     * target ever leaves the depth range.
+     */
+    bool runQueue(AkVCam::QueueController &controller,
+                  int64_t duration,
+                  int drainPeriod,
+                  size_t drainFrames)
+    {
+        size_t occupancy = 0;
+
+        for (int64_t now = 0, i = 0; now < duration; now += QUEUE_FRAME_TIME, i++) {
+            if (drainPeriod > 0 && i % drainPeriod == 0)
+                occupancy -= std::min(occupancy, drainFrames);
+
+            auto decision = controller.update(occupancy, now);
+
+            switch (decision.action) {
+            case AkVCam::QueueController::ActionDropOldest:
+                occupancy -= decision.drop;
+                occupancy++;
+
+                break;
+
+            case AkVCam::QueueController::ActionEnqueue:
+                occupancy++;
+
+                break;
+
+            default:
+                break;
+            }
+
+            auto target = controller.targetDepth();
+
+            if (target < controller.minDepth()
+                || target > controller.maxDepth())
+                return false;
+        }
+
+        return true;
+    }
+}
+
+// A consumer that empties the queue must not shrink it below the minimum.
+AKVCAM_TEST(queueFastConsumer)
+{
+    AkVCam::QueueController controller(2, 4);
+    AKVCAM_VERIFY(runQueue(controller, 20000000000, 1, 1));
+    AKVCAM_VERIFY(controller.targetDepth() == 2);
+}
+
+// A consumer that never reads gives back every probed frame.
+AKVCAM_TEST(queueStalledConsumer)
+{
+    AkVCam::QueueController controller(2, 4);
+    AKVCAM_VERIFY(runQueue(controller, 60000000000, 0, 0));
+    AKVCAM_VERIFY(controller.dropped() > 0);
+}
+
+AKVCAM_TEST(queueBurstyConsumer)
+{
+    AkVCam::QueueController controller(1, 6, AkVCam::QueueController::PolicySkip);
+    AKVCAM_VERIFY(runQueue(controller, 60000000000, 4, 4));
+}
@@ -0,0 +1,202 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+#include "fraction.h"
+#include "streamengine.h"
+#include "image/videoformat.h"
+#include "image/videoframe.h"
+
+namespace
+{
+    const int64_t frameDuration = 10000000;
+
+    AkVCam::VideoFrame patternFrame(AkVCam::FourCC fourcc,
+                                    int width,
+                                    int height)
+    {
+        AkVCam::VideoFrame frame(AkVCam::VideoFormat(fourcc, width, height));
+
+        for (size_t i = 0; i < frame.data().size(); i++)
+            frame.data()[i] = uint8_t(i * 7 + i / 1000);
+
+        return frame;
+    }
+}
+
+AKVCAM_TEST(streamTimestamps)
+{
+    AkVCam::StreamEngine engine;
+    engine.setFrameRate({100, 1});
+    int64_t now = 5 * frameDuration;
+
+    // The first frame starts the timeline.
+    auto timing = engine.nextTiming(now);
+    AKVCAM_VERIFY(timing.pts == 0);
+    AKVCAM_VERIFY(timing.duration == frameDuration);
+    AKVCAM_VERIFY(timing.sequence == 0);
+    AKVCAM_VERIFY(timing.discontinuity);
+
+    // The timestamps follow the clock, jitter included.
+    now += frameDuration + frameDuration / 4;
+    timing = engine.nextTiming(now);
+    AKVCAM_VERIFY(timing.pts == frameDuration + frameDuration / 4);
+    AKVCAM_VERIFY(timing.sequence == 1);
+    AKVCAM_VERIFY(!timing.discontinuity);
+    auto lastPts = timing.pts;
+
+    // A stall advances a single frame and flags the discontinuity.
+    now += 20 * frameDuration;
+    timing = engine.nextTiming(now);
+    AKVCAM_VERIFY(timing.pts == lastPts + frameDuration);
+    AKVCAM_VERIFY(timing.sequence == 2);
+    AKVCAM_VERIFY(timing.discontinuity);
+    lastPts = timing.pts;
+
+    // From there on the clock is followed again.
+    now += frameDuration;
+    timing = engine.nextTiming(now);
+    AKVCAM_VERIFY(timing.pts == lastPts + frameDuration);
+    AKVCAM_VERIFY(timing.sequence == 3);
+    AKVCAM_VERIFY(!timing.discontinuity);
+}
+
+AKVCAM_TEST(streamPacing)
+{
+    AkVCam::StreamEngine engine;
+    engine.setFormat({AkVCam::PixelFormatRGB24, 64, 48, {{100, 1}}});
+    std::mutex mutex;
+    std::condition_variable sent;
+    std::vector<AkVCam::FrameTiming> timings;
+    std::vector<std::chrono::steady_clock::time_point> times;
+    bool emptyFrame = false;
+
+    engine.setSendFunc([&] (const AkVCam::VideoFrame &frame,
+                            const AkVCam::FrameTiming &timing) {
+        std::lock_guard<std::mutex> lock(mutex);
+        timings.push_back(timing);
+        times.push_back(std::chrono::steady_clock::now());
+
+        if (frame.format().size() < 1)
+            emptyFrame = true;
+
+        sent.notify_all();
+
+        // Stops the stream.
+        return timings.size() < 30;
+    });
+    AKVCAM_VERIFY(engine.start());
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        sent.wait_for(lock, std::chrono::seconds(10), [&timings] () {
+            return timings.size() >= 30;
+        });
+    }
+
+    // Returning false from the send function stops the stream.
+    for (int i = 0; i < 100 && engine.isRunning(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    AKVCAM_VERIFY(!engine.isRunning());
+    engine.stop();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    AKVCAM_VERIFY(timings.size() == 30);
+    AKVCAM_VERIFY(!emptyFrame);
+
+    for (size_t i = 1; i < timings.size(); i++) {
+        AKVCAM_VERIFY(timings[i].sequence == timings[i - 1].sequence + 1);
+        AKVCAM_VERIFY(timings[i].pts > timings[i - 1].pts);
+    }
+
+    // 29 frame intervals at 100 fps, with room for a loaded machine.
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>
+                       (times.back() - times.front()).count();
+    AKVCAM_VERIFY(elapsed >= 250);
+    AKVCAM_VERIFY(elapsed < 2000);
+}
+
+// Frames already in the output format are shared, not copied.
+AKVCAM_TEST(streamPassthrough)
+{
+    AkVCam::StreamEngine engine;
+    AkVCam::VideoFormat format(AkVCam::PixelFormatRGB24, 64, 48, {{30, 1}});
+    engine.setFormat(format);
+    AKVCAM_VERIFY(engine.start());
+    engine.setBroadcaster("AkVCamTestBroadcaster");
+
+    auto frame =
+            std::make_shared<const AkVCam::VideoFrame>(patternFrame(AkVCam::PixelFormatRGB24,
+                                                                    64,
+                                                                    48));
+    engine.frameReady("AkVCamTestDevice", frame, 1);
+    AKVCAM_VERIFY(engine.currentFrame() == frame);
+
+    // Adjusted frames are new, and match process().
+    AkVCam::StreamAdjusts adjusts;
+    adjusts.horizontalMirror = true;
+    engine.setAdjusts(adjusts);
+    engine.frameReady("AkVCamTestDevice", frame, 2);
+    auto adjusted = engine.currentFrame();
+    AKVCAM_VERIFY(adjusted != frame);
+    AKVCAM_VERIFY(adjusted->data() == engine.process(*frame).data());
+    AKVCAM_VERIFY(adjusted->line(0, 0)[0] == frame->line(0, 0)[3 * 63]);
+    engine.stop();
+}
+
+// A frame built from slices must match the frame processed at once.
+AKVCAM_TEST(streamSlices)
+{
+    auto source = patternFrame(AkVCam::PixelFormatRGB24, 64, 48);
+    uint64_t sequence = 1;
+
+    for (auto fourcc: {AkVCam::PixelFormatRGB24,
+                       AkVCam::PixelFormatNV12,
+                       AkVCam::PixelFormatYUY2})
+        for (auto verticalMirror: {false, true}) {
+            AkVCam::StreamEngine engine;
+            engine.setFormat({fourcc, 64, 48, {{30, 1}}});
+            AkVCam::StreamAdjusts adjusts;
+            adjusts.verticalMirror = verticalMirror;
+            adjusts.hue = 10;
+            engine.setAdjusts(adjusts);
+            AKVCAM_VERIFY(engine.start());
+            engine.setBroadcaster("AkVCamTestBroadcaster");
+
+            for (int line = 0; line < 48; line += 16)
+                engine.sliceReady("AkVCamTestDevice",
+                                  source,
+                                  sequence,
+                                  line,
+                                  16);
+
+            sequence++;
+            AKVCAM_VERIFY(engine.currentFrame()->data()
+                          == engine.process(source).data());
+            engine.stop();
+        }
+}
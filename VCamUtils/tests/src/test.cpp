@@ -0,0 +1,120 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "test.h"
+
+namespace AkVCam
+{
+    namespace Test
+    {
+        struct TestInfo
+        {
+            std::string name;
+            TestFunction function;
+            bool benchmark;
+        };
+
+        std::vector<TestInfo> &tests()
+        {
+            static std::vector<TestInfo> tests;
+
+            return tests;
+        }
+
+        std::atomic<uint64_t> &failures()
+        {
+            static std::atomic<uint64_t> failures {0};
+
+            return failures;
+        }
+    }
+}
+
+bool AkVCam::Test::registerTest(const std::string &name,
+                                const TestFunction &function,
+                                bool benchmark)
+{
+    tests().push_back({name, function, benchmark});
+
+    return true;
+}
+
+void AkVCam::Test::fail(const std::string &file,
+                        int line,
+                        const std::string &condition)
+{
+    failures()++;
+    std::cerr << "    FAIL: "
+              << condition
+              << " ("
+              << file
+              << ":"
+              << line
+              << ")"
+              << std::endl;
+}
+
+int AkVCam::Test::run(int argc, char **argv)
+{
+    bool benchmarks = false;
+    std::vector<std::string> names;
+
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--benchmarks") == 0)
+            benchmarks = true;
+        else
+            names.push_back(argv[i]);
+
+    int failed = 0;
+    int ran = 0;
+
+    for (auto &test: tests()) {
+        if (test.benchmark != benchmarks)
+            continue;
+
+        if (!names.empty()
+            && std::find(names.begin(), names.end(), test.name) == names.end())
+            continue;
+
+        std::cout << test.name << std::endl;
+        auto failuresBefore = uint64_t(failures());
+        auto start = std::chrono::steady_clock::now();
+        test.function();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>
+                           (std::chrono::steady_clock::now() - start).count();
+        bool ok = failures() == failuresBefore;
+        std::cout << "    " << (ok? "PASS": "FAIL")
+                  << " (" << elapsed << " ms)" << std::endl;
+        ran++;
+
+        if (!ok)
+            failed++;
+    }
+
+    std::cout << ran - failed << " passed, " << failed << " failed" << std::endl;
+
+    return failed? 1: 0;
+}
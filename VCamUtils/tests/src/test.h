@@ -0,0 +1,68 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#ifndef AKVCAMUTILS_TEST_H
+#define AKVCAMUTILS_TEST_H
+
+#include <functional>
+#include <string>
+
+// Defines a test, run by default.
+#define AKVCAM_TEST(name) \
+    static void name(); \
+    static const bool name##Registered = \
+        AkVCam::Test::registerTest(#name, name, false); \
+    static void name()
+
+// Defines a benchmark, only run when asked for.
+#define AKVCAM_BENCHMARK(name) \
+    static void name(); \
+    static const bool name##Registered = \
+        AkVCam::Test::registerTest(#name, name, true); \
+    static void name()
+
+// Marks the running test as failed and returns from the current function.
+#define AKVCAM_VERIFY(condition) \
+    do { \
+        if (!(condition)) { \
+            AkVCam::Test::fail(__FILE__, __LINE__, #condition); \
+            \
+            return; \
+        } \
+    } while (false)
+
+namespace AkVCam
+{
+    namespace Test
+    {
+        using TestFunction = std::function<void ()>;
+
+        bool registerTest(const std::string &name,
+                          const TestFunction &function,
+                          bool benchmark);
+        void fail(const std::string &file,
+                  int line,
+                  const std::string &condition);
+
+        // Runs the tests, or the benchmarks, matching the given names.
+        int run(int argc, char **argv);
+    }
+}
+
+#endif // AKVCAMUTILS_TEST_H
@@ -0,0 +1,400 @@
+/* akvirtualcamera, virtual camera for Mac and Windows.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * akvirtualcamera is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * akvirtualcamera is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Web-Site: http://webcamoid.github.io/
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+#include "test.h"
+#include "unixbroker.h"
+
+#define TRANSPORT_DEVICES   8
+#define TRANSPORT_LISTENERS 4
+#define TRANSPORT_FRAMES    500
+#define TRANSPORT_PAYLOAD   (16 << 10)
+
+namespace
+{
+    struct ReceivedFrames
+    {
+        std::mutex mutex;
+        std::condition_variable received;
+        std::map<std::string, int64_t> lastSequence;
+        uint64_t frames {0};
+        uint64_t corrupted {0};
+        uint64_t unordered {0};
+    };
+
+    std::string socketPath()
+    {
+        return "/tmp/akvcam_test_" + std::to_string(getpid()) + ".sock";
+    }
+
+    char payloadByte(int device, int64_t sequence, size_t i)
+    {
+        return char('a' + (size_t(device) + size_t(sequence) + i) % 26);
+    }
+
+    std::string payload(int device, int64_t sequence)
+    {
+        std::string data(TRANSPORT_PAYLOAD, 0);
+
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = payloadByte(device, sequence, i);
+
+        return data;
+    }
+
+    bool callOk(AkVCam::UnixBrokerClient &client,
+                uint32_t id,
+                const std::vector<std::string> &args,
+                std::string *result=nullptr)
+    {
+        AkVCam::BrokerMessage request;
+        request.id = id;
+        request.data = AkVCam::UnixBroker::pack(args);
+        AkVCam::BrokerMessage reply;
+
+        if (!client.call(request, &reply))
+            return false;
+
+        auto values = AkVCam::UnixBroker::unpack(reply.data);
+
+        if (values.empty())
+            return false;
+
+        if (result)
+            *result = values[0];
+
+        return !values[0].empty() && values[0] != "0";
+    }
+
+    void frameReceived(void *userData, const AkVCam::BrokerMessage &message)
+    {
+        if (message.id != AkVCam::BrokerMessageFrameReady)
+            return;
+
+        auto received = reinterpret_cast<ReceivedFrames *>(userData);
+        auto args = AkVCam::UnixBroker::unpack(message.data);
+        std::lock_guard<std::mutex> lock(received->mutex);
+        received->frames++;
+
+        if (args.size() < 4) {
+            received->corrupted++;
+
+            return;
+        }
+
+        auto device = std::stoi(args[1]);
+        auto sequence = std::stoll(args[2]);
+
+        if (args[3] != payload(device, sequence)) {
+            received->corrupted++;
+
+            return;
+        }
+
+        auto it = received->lastSequence.find(args[0]);
+
+        if (it != received->lastSequence.end() && sequence <= it->second)
+            received->unordered++;
+
+        received->lastSequence[args[0]] = sequence;
+        received->received.notify_all();
+    }
+
+    struct FanOutListener
+    {
+        ReceivedFrames received;
+        AkVCam::UnixBrokerClient client;
+    };
+
+    struct Latencies
+    {
+        std::mutex mutex;
+        std::condition_variable received;
+        std::vector<int64_t> latencies;
+    };
+
+    int64_t steadyTime()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+
+        return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+    }
+
+    void latencyReceived(void *userData, const AkVCam::BrokerMessage &message)
+    {
+        if (message.id != AkVCam::BrokerMessageFrameReady)
+            return;
+
+        auto latencies = reinterpret_cast<Latencies *>(userData);
+        auto args = AkVCam::UnixBroker::unpack(message.data);
+
+        if (args.size() < 2)
+            return;
+
+        std::lock_guard<std::mutex> lock(latencies->mutex);
+        latencies->latencies.push_back(steadyTime() - std::stoll(args[1]));
+        latencies->received.notify_all();
+    }
+
+    bool addListener(AkVCam::UnixBrokerClient &client,
+                     const std::string &path,
+                     void *userData,
+                     AkVCam::UnixBrokerClient::MessageReceivedCallbackT callback)
+    {
+        client.connectMessageReceived(userData, callback);
+        std::string port;
+
+        return client.connect(path)
+               && callOk(client, AkVCam::BrokerMessageRequestPort, {}, &port)
+               && callOk(client, AkVCam::BrokerMessageAddPort, {port});
+    }
+}
+
+// Several producers write to their own device at the same time, the
+// listener must get every device's frames intact and in order.
+AKVCAM_TEST(concurrentDeviceWrites)
+{
+    AkVCam::UnixBrokerServer server;
+    AKVCAM_VERIFY(server.start(socketPath()));
+
+    ReceivedFrames received;
+    AkVCam::UnixBrokerClient listener;
+    listener.connectMessageReceived(&received, frameReceived);
+    AKVCAM_VERIFY(listener.connect(server.path()));
+    std::string listenerPort;
+    AKVCAM_VERIFY(callOk(listener,
+                         AkVCam::BrokerMessageRequestPort,
+                         {},
+                         &listenerPort));
+    AKVCAM_VERIFY(callOk(listener,
+                         AkVCam::BrokerMessageAddPort,
+                         {listenerPort}));
+
+    std::atomic<int> started {0};
+    std::vector<std::thread> producers;
+
+    for (int device = 0; device < TRANSPORT_DEVICES; device++)
+        producers.emplace_back([&server, &started, device] () {
+            auto deviceId = "AkVCamTestDevice" + std::to_string(device);
+            auto port = "AkVCamTestProducer" + std::to_string(device);
+            AkVCam::UnixBrokerClient producer;
+            AKVCAM_VERIFY(producer.connect(server.path()));
+            AKVCAM_VERIFY(callOk(producer,
+                                 AkVCam::BrokerMessageAddPort,
+                                 {port}));
+            AKVCAM_VERIFY(callOk(producer,
+                                 AkVCam::BrokerMessageSetBroadcasting,
+                                 {deviceId, port}));
+            started++;
+
+            for (int64_t sequence = 0; sequence < TRANSPORT_FRAMES; sequence++) {
+                AkVCam::BrokerMessage message;
+                message.id = AkVCam::BrokerMessageFrameReady;
+                message.data =
+                        AkVCam::UnixBroker::pack({deviceId,
+                                                  std::to_string(device),
+                                                  std::to_string(sequence),
+                                                  payload(device, sequence)});
+                AKVCAM_VERIFY(producer.send(message));
+            }
+
+            // Keep the producer registered until the last frame arrives.
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        });
+
+    {
+        std::unique_lock<std::mutex> lock(received.mutex);
+        received.received.wait_for(lock,
+                                   std::chrono::seconds(30),
+                                   [&received] () {
+            if (received.lastSequence.size() < TRANSPORT_DEVICES)
+                return false;
+
+            for (auto &device: received.lastSequence)
+                if (device.second < TRANSPORT_FRAMES - 1)
+                    return false;
+
+            return true;
+        });
+    }
+
+    for (auto &producer: producers)
+        producer.join();
+
+    listener.disconnect();
+    server.stop();
+
+    std::lock_guard<std::mutex> lock(received.mutex);
+    AKVCAM_VERIFY(started == TRANSPORT_DEVICES);
+    AKVCAM_VERIFY(received.corrupted == 0);
+    AKVCAM_VERIFY(received.unordered == 0);
+    AKVCAM_VERIFY(received.lastSequence.size() == TRANSPORT_DEVICES);
+
+    // Frames may be dropped when the listener falls behind, the last never.
+    for (auto &device: received.lastSequence)
+        AKVCAM_VERIFY(device.second == TRANSPORT_FRAMES - 1);
+}
+
+// A single producer, every listener must get all its frames intact.
+AKVCAM_TEST(fanOut)
+{
+    AkVCam::UnixBrokerServer server;
+    AKVCAM_VERIFY(server.start(socketPath()));
+    std::vector<std::unique_ptr<FanOutListener>> listeners;
+
+    for (int i = 0; i < TRANSPORT_LISTENERS; i++) {
+        listeners.emplace_back(new FanOutListener);
+        auto listener = listeners.back().get();
+        AKVCAM_VERIFY(addListener(listener->client,
+                                  server.path(),
+                                  &listener->received,
+                                  frameReceived));
+    }
+
+    std::string deviceId = "AkVCamTestDevice";
+    std::string port = "AkVCamTestProducer";
+    AkVCam::UnixBrokerClient producer;
+    AKVCAM_VERIFY(producer.connect(server.path()));
+    AKVCAM_VERIFY(callOk(producer, AkVCam::BrokerMessageAddPort, {port}));
+    AKVCAM_VERIFY(callOk(producer,
+                         AkVCam::BrokerMessageSetBroadcasting,
+                         {deviceId, port}));
+
+    for (int64_t sequence = 0; sequence < TRANSPORT_FRAMES; sequence++) {
+        AkVCam::BrokerMessage message;
+        message.id = AkVCam::BrokerMessageFrameReady;
+        message.data = AkVCam::UnixBroker::pack({deviceId,
+                                                 "0",
+                                                 std::to_string(sequence),
+                                                 payload(0, sequence)});
+        AKVCAM_VERIFY(producer.send(message));
+    }
+
+    for (auto &listener: listeners) {
+        auto &received = listener->received;
+        std::unique_lock<std::mutex> lock(received.mutex);
+        received.received.wait_for(lock,
+                                   std::chrono::seconds(30),
+                                   [&received, &deviceId] () {
+            auto it = received.lastSequence.find(deviceId);
+
+            return it != received.lastSequence.end()
+                   && it->second == TRANSPORT_FRAMES - 1;
+        });
+    }
+
+    producer.disconnect();
+
+    for (auto &listener: listeners)
+        listener->client.disconnect();
+
+    server.stop();
+
+    for (auto &listener: listeners) {
+        auto &received = listener->received;
+        std::lock_guard<std::mutex> lock(received.mutex);
+        AKVCAM_VERIFY(received.frames > 0);
+        AKVCAM_VERIFY(received.corrupted == 0);
+        AKVCAM_VERIFY(received.unordered == 0);
+        AKVCAM_VERIFY(received.lastSequence[deviceId] == TRANSPORT_FRAMES - 1);
+    }
+}
+
+// Time from send() until each listener gets a frame, at 30 fps.
+AKVCAM_BENCHMARK(fanOutLatency)
+{
+    for (int nListeners: {1, 2, 4, 8}) {
+        AkVCam::UnixBrokerServer server;
+        AKVCAM_VERIFY(server.start(socketPath()));
+        Latencies latencies;
+        std::vector<std::unique_ptr<AkVCam::UnixBrokerClient>> listeners;
+
+        for (int i = 0; i < nListeners; i++) {
+            listeners.emplace_back(new AkVCam::UnixBrokerClient);
+            AKVCAM_VERIFY(addListener(*listeners.back(),
+                                      server.path(),
+                                      &latencies,
+                                      latencyReceived));
+        }
+
+        std::string deviceId = "AkVCamTestDevice";
+        std::string port = "AkVCamTestProducer";
+        AkVCam::UnixBrokerClient producer;
+        AKVCAM_VERIFY(producer.connect(server.path()));
+        AKVCAM_VERIFY(callOk(producer, AkVCam::BrokerMessageAddPort, {port}));
+        AKVCAM_VERIFY(callOk(producer,
+                             AkVCam::BrokerMessageSetBroadcasting,
+                             {deviceId, port}));
+
+        // A 640x480 RGB24 frame.
+        std::string frame(640 * 480 * 3, 'x');
+        int frames = 60;
+
+        for (int i = 0; i < frames; i++) {
+            AkVCam::BrokerMessage message;
+            message.id = AkVCam::BrokerMessageFrameReady;
+            message.data = AkVCam::UnixBroker::pack({deviceId,
+                                                     std::to_string(steadyTime()),
+                                                     frame});
+            AKVCAM_VERIFY(producer.send(message));
+            std::this_thread::sleep_for(std::chrono::milliseconds(33));
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(latencies.mutex);
+            latencies.received.wait_for(lock,
+                                        std::chrono::seconds(5),
+                                        [&] () {
+                return latencies.latencies.size()
+                       >= size_t(frames * nListeners);
+            });
+        }
+
+        producer.disconnect();
+
+        for (auto &listener: listeners)
+            listener->disconnect();
+
+        server.stop();
+
+        std::lock_guard<std::mutex> lock(latencies.mutex);
+        auto &values = latencies.latencies;
+        AKVCAM_VERIFY(!values.empty());
+        std::sort(values.begin(), values.end());
+        std::cout << "    " << nListeners << " listeners, "
+                  << values.size() << "/" << frames * nListeners
+                  << " frames, latency us, median: "
+                  << values[values.size() / 2]
+                  << ", p99: "
+                  << values[values.size() * 99 / 100]
+                  << ", max: "
+                  << values.back()
+                  << std::endl;
+    }
+}
@@ -0,0 +1,62 @@
+# akvirtualcamera, virtual camera for Mac and Windows.
+# Copyright (C) 2020  Gonzalo Exequiel Pedone
+#
+# akvirtualcamera is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# akvirtualcamera is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with akvirtualcamera. If not, see <http://www.gnu.org/licenses/>.
+#
+# Web-Site: http://webcamoid.github.io/
+
+exists(commons.pri) {
+    include(commons.pri)
+} else {
+    exists(../../commons.pri) {
+        include(../../commons.pri)
+    } else {
+        error("commons.pri file not found.")
+    }
+}
+
+TEMPLATE = app
+CONFIG += console link_prl testcase
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = VCamUtilsTests
+
+HEADERS = \
+    src/test.h
+
+SOURCES = \
+    src/main.cpp \
+    src/controlsbatchtest.cpp \
+    src/memcopytest.cpp \
+    src/pooltest.cpp \
+    src/queuecontrollertest.cpp \
+    src/streamenginetest.cpp \
+    src/test.cpp
+
+unix: SOURCES += \
+    src/transporttest.cpp
+
+INCLUDEPATH += \
+    ../.. \
+    ../src
+
+LIBS += \
+    -L$${OUT_PWD}/../$${BIN_DIR} -lVCamUtils
+
+isEmpty(STATIC_BUILD) | isEqual(STATIC_BUILD, 0) {
+    win32-g++: QMAKE_LFLAGS = -static -static-libgcc -static-libstdc++
+}
+
+DESTDIR = $${OUT_PWD}/$${BIN_DIR}
@@ -23,3 +23,4 @@ SUBDIRS = VCamUtils
 macx: SUBDIRS += cmio
 win32: SUBDIRS += dshow
 SUBDIRS += Manager
+SUBDIRS += VCamUtils/tests
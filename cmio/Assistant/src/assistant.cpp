@@ -28,6 +28,7 @@
 #include "assistantglobals.h"
 #include "PlatformUtils/src/preferences.h"
 #include "PlatformUtils/src/utils.h"
+#include "VCamUtils/src/broker.h"
 #include "VCamUtils/src/image/videoformat.h"
 #include "VCamUtils/src/image/videoframe.h"
 #include "VCamUtils/src/ipcbridge.h"
@@ -40,20 +41,21 @@
 
 namespace AkVCam
 {
-    struct AssistantDevice
+    class AssistantPeer: public BrokerPeer
     {
-        std::string broadcaster;
-        std::vector<std::string> listeners;
-    };
+        public:
+            xpc_connection_t m_connection;
 
-    using AssistantPeers = std::map<std::string, xpc_connection_t>;
-    using DeviceConfigs = std::map<std::string, AssistantDevice>;
+            explicit AssistantPeer(xpc_connection_t connection);
+            ~AssistantPeer() override;
+            bool send(const BrokerMessage &message) override;
+            bool isAlive() override;
+    };
 
     class AssistantPrivate
     {
         public:
-            AssistantPeers m_clients;
-            DeviceConfigs m_deviceConfigs;
+            Broker m_broker;
             std::map<int64_t, XpcMessage> m_messageHandlers;
             CFRunLoopTimerRef m_timer {nullptr};
             double m_timeout {0.0};
@@ -63,7 +65,12 @@ namespace AkVCam
             bool startTimer();
             void stopTimer();
             static void timerTimeout(CFRunLoopTimerRef timer, void *info);
-            void releaseDevicesFromPeer(const std::string &portName);
+            static void broadcasterReleased(void *userData,
+                                            const std::string &deviceId);
+            static void listenerReleased(void *userData,
+                                         const std::string &deviceId,
+                                         const std::string &listener);
+            static BrokerMessage brokerMessage(xpc_object_t event);
             void peerDied();
             void requestPort(xpc_connection_t client, xpc_object_t event);
             void addPort(xpc_connection_t client, xpc_object_t event);
@@ -137,6 +144,10 @@ AkVCam::AssistantPrivate::AssistantPrivate()
         {AKVCAM_ASSISTANT_MSG_DEVICE_CONTROLS_UPDATED, AKVCAM_BIND_FUNC(AssistantPrivate::controlsUpdated)},
     };
 
+    this->m_broker.connectBroadcasterReleased(this,
+                                              &AssistantPrivate::broadcasterReleased);
+    this->m_broker.connectListenerReleased(this,
+                                           &AssistantPrivate::listenerReleased);
     this->startTimer();
 }
 
@@ -199,58 +210,49 @@ void AkVCam::AssistantPrivate::timerTimeout(CFRunLoopTimerRef timer, void *info)
     CFRunLoopStop(CFRunLoopGetMain());
 }
 
-void AkVCam::AssistantPrivate::releaseDevicesFromPeer(const std::string &portName)
+void AkVCam::AssistantPrivate::broadcasterReleased(void *userData,
+                                                   const std::string &deviceId)
 {
     AkLogFunction();
+    auto self = reinterpret_cast<AssistantPrivate *>(userData);
+    auto dictionary = xpc_dictionary_create(nullptr, nullptr, 0);
+    xpc_dictionary_set_int64(dictionary, "message", AKVCAM_ASSISTANT_MSG_DEVICE_SETBROADCASTING);
+    xpc_dictionary_set_string(dictionary, "device", deviceId.c_str());
+    xpc_dictionary_set_string(dictionary, "broadcaster", "");
+    self->m_broker.broadcast(brokerMessage(dictionary));
+    xpc_release(dictionary);
+}
 
-    for (auto &config: this->m_deviceConfigs)
-        if (config.second.broadcaster == portName) {
-            config.second.broadcaster.clear();
-
-            auto dictionary = xpc_dictionary_create(nullptr, nullptr, 0);
-            xpc_dictionary_set_int64(dictionary, "message", AKVCAM_ASSISTANT_MSG_DEVICE_SETBROADCASTING);
-            xpc_dictionary_set_string(dictionary, "device", config.first.c_str());
-            xpc_dictionary_set_string(dictionary, "broadcaster", "");
-
-            for (auto &client: this->m_clients) {
-                auto reply =
-                        xpc_connection_send_message_with_reply_sync(client.second,
-                                                                    dictionary);
-                xpc_release(reply);
-            }
+void AkVCam::AssistantPrivate::listenerReleased(void *userData,
+                                                const std::string &deviceId,
+                                                const std::string &listener)
+{
+    AkLogFunction();
+    auto self = reinterpret_cast<AssistantPrivate *>(userData);
+    auto dictionary = xpc_dictionary_create(nullptr, nullptr, 0);
+    xpc_dictionary_set_int64(dictionary, "message", AKVCAM_ASSISTANT_MSG_DEVICE_LISTENER_REMOVE);
+    xpc_dictionary_set_string(dictionary, "device", deviceId.c_str());
+    xpc_dictionary_set_string(dictionary, "listener", listener.c_str());
+    self->m_broker.broadcast(brokerMessage(dictionary));
+    xpc_release(dictionary);
+}
 
-            xpc_release(dictionary);
-        } else {
-            auto it = std::find(config.second.listeners.begin(),
-                                config.second.listeners.end(),
-                                portName);
+AkVCam::BrokerMessage AkVCam::AssistantPrivate::brokerMessage(xpc_object_t event)
+{
+    BrokerMessage message;
+    message.id = uint32_t(xpc_dictionary_get_int64(event, "message"));
+    message.native = std::shared_ptr<void>(xpc_copy(event), xpc_release);
 
-            if (it != config.second.listeners.end())
-                config.second.listeners.erase(it);
-        }
+    return message;
 }
 
 void AkVCam::AssistantPrivate::peerDied()
 {
     AkLogFunction();
+    this->m_broker.checkPeers();
 
-    for (auto &client: this->m_clients) {
-        auto dictionary = xpc_dictionary_create(nullptr, nullptr, 0);
-        xpc_dictionary_set_int64(dictionary, "message", AKVCAM_ASSISTANT_MSG_ISALIVE);
-        auto reply = xpc_connection_send_message_with_reply_sync(client.second,
-                                                                 dictionary);
-        xpc_release(dictionary);
-        auto replyType = xpc_get_type(reply);
-        bool alive = false;
-
-        if (replyType == XPC_TYPE_DICTIONARY)
-            alive = xpc_dictionary_get_bool(reply, "alive");
-
-        xpc_release(reply);
-
-        if (!alive)
-            this->removePortByName(client.first);
-    }
+    if (this->m_broker.nPeers() < 1)
+        this->startTimer();
 }
 
 void AkVCam::AssistantPrivate::requestPort(xpc_connection_t client,
@@ -278,20 +280,12 @@ void AkVCam::AssistantPrivate::addPort(xpc_connection_t client,
     auto connection = xpc_connection_create_from_endpoint(reinterpret_cast<xpc_endpoint_t>(endpoint));
     xpc_connection_set_event_handler(connection, ^(xpc_object_t) {});
     xpc_connection_resume(connection);
-    bool ok = true;
-
-    for (auto &client: this->m_clients)
-        if (client.first == portName) {
-            ok = false;
+    bool ok = this->m_broker.addPeer(portName,
+                                     Broker::PeerTypeClient,
+                                     std::make_shared<AssistantPeer>(connection));
 
-            break;
-        }
-
-    if (ok) {
-        AkLogInfo() << "Adding Peer: " << portName << std::endl;
-        this->m_clients[portName] = connection;
+    if (ok)
         this->stopTimer();
-    }
 
     auto reply = xpc_dictionary_create_reply(event);
     xpc_dictionary_set_bool(reply, "status", ok);
@@ -302,20 +296,10 @@ void AkVCam::AssistantPrivate::addPort(xpc_connection_t client,
 void AkVCam::AssistantPrivate::removePortByName(const std::string &portName)
 {
     AkLogFunction();
-    AkLogInfo() << "Port: " << portName << std::endl;
-
-    for (auto &peer: this->m_clients)
-        if (peer.first == portName) {
-            xpc_release(peer.second);
-            this->m_clients.erase(portName);
-
-            break;
-        }
+    this->m_broker.removePeer(portName);
 
-    if (this->m_clients.empty())
+    if (this->m_broker.nPeers() < 1)
         this->startTimer();
-
-    this->releaseDevicesFromPeer(portName);
 }
 
 void AkVCam::AssistantPrivate::removePort(xpc_connection_t client,
@@ -332,12 +316,7 @@ void AkVCam::AssistantPrivate::devicesUpdate(xpc_connection_t client,
 {
     UNUSED(client);
     AkLogFunction();
-    auto notification = xpc_copy(event);
-
-    for (auto &client: this->m_clients)
-        xpc_connection_send_message(client.second, notification);
-
-    xpc_release(notification);
+    this->m_broker.broadcast(brokerMessage(event));
 }
 
 void AkVCam::AssistantPrivate::setBroadcasting(xpc_connection_t client,
@@ -346,21 +325,10 @@ void AkVCam::AssistantPrivate::setBroadcasting(xpc_connection_t client,
     AkLogFunction();
     std::string deviceId = xpc_dictionary_get_string(event, "device");
     std::string broadcaster = xpc_dictionary_get_string(event, "broadcaster");
-    bool ok = false;
-
-    if (this->m_deviceConfigs.count(deviceId) > 0)
-        if (this->m_deviceConfigs[deviceId].broadcaster != broadcaster) {
-            AkLogInfo() << "Device: " << deviceId << std::endl;
-            AkLogInfo() << "Broadcaster: " << broadcaster << std::endl;
-            this->m_deviceConfigs[deviceId].broadcaster = broadcaster;
-            auto notification = xpc_copy(event);
-
-            for (auto &client: this->m_clients)
-                xpc_connection_send_message(client.second, notification);
+    bool ok = this->m_broker.setBroadcaster(deviceId, broadcaster);
 
-            xpc_release(notification);
-            ok = true;
-        }
+    if (ok)
+        this->m_broker.broadcast(brokerMessage(event));
 
     auto reply = xpc_dictionary_create_reply(event);
     xpc_dictionary_set_bool(reply, "status", ok);
@@ -371,26 +339,13 @@ void AkVCam::AssistantPrivate::setBroadcasting(xpc_connection_t client,
 void AkVCam::AssistantPrivate::frameReady(xpc_connection_t client,
                                           xpc_object_t event)
 {
-    UNUSED(client);
-    AkLogFunction();
+    AkLogFrameFunction();
+    auto frame = brokerMessage(event);
+    frame.deviceId = xpc_dictionary_get_string(event, "device");
+    this->m_broker.broadcast(frame);
 
     auto reply = xpc_dictionary_create_reply(event);
-    bool ok = true;
-
-    for (auto &client: this->m_clients) {
-        auto reply = xpc_connection_send_message_with_reply_sync(client.second,
-                                                                 event);
-        auto replyType = xpc_get_type(reply);
-        bool isOk = false;
-
-        if (replyType == XPC_TYPE_DICTIONARY)
-            isOk = xpc_dictionary_get_bool(reply, "status");
-
-        ok &= isOk;
-        xpc_release(reply);
-    }
-
-    xpc_dictionary_set_bool(reply, "status", ok);
+    xpc_dictionary_set_bool(reply, "status", true);
     xpc_connection_send_message(client, reply);
     xpc_release(reply);
 }
@@ -398,25 +353,11 @@ void AkVCam::AssistantPrivate::frameReady(xpc_connection_t client,
 void AkVCam::AssistantPrivate::pictureUpdated(xpc_connection_t client,
                                               xpc_object_t event)
 {
-    UNUSED(client);
     AkLogFunction();
-    auto reply = xpc_dictionary_create_reply(event);
-    bool ok = true;
-
-    for (auto &client: this->m_clients) {
-        auto reply = xpc_connection_send_message_with_reply_sync(client.second,
-                                                                 event);
-        auto replyType = xpc_get_type(reply);
-        bool isOk = false;
+    this->m_broker.broadcast(brokerMessage(event));
 
-        if (replyType == XPC_TYPE_DICTIONARY)
-            isOk = xpc_dictionary_get_bool(reply, "status");
-
-        ok &= isOk;
-        xpc_release(reply);
-    }
-
-    xpc_dictionary_set_bool(reply, "status", ok);
+    auto reply = xpc_dictionary_create_reply(event);
+    xpc_dictionary_set_bool(reply, "status", true);
     xpc_connection_send_message(client, reply);
     xpc_release(reply);
 }
@@ -428,11 +369,10 @@ void AkVCam::AssistantPrivate::listeners(xpc_connection_t client,
     std::string deviceId = xpc_dictionary_get_string(event, "device");
     auto listeners = xpc_array_create(nullptr, 0);
 
-    if (this->m_deviceConfigs.count(deviceId) > 0)
-        for (auto &listener: this->m_deviceConfigs[deviceId].listeners) {
-            auto listenerObj = xpc_string_create(listener.c_str());
-            xpc_array_append_value(listeners, listenerObj);
-        }
+    for (auto &listener: this->m_broker.listeners(deviceId)) {
+        auto listenerObj = xpc_string_create(listener.c_str());
+        xpc_array_append_value(listeners, listenerObj);
+    }
 
     AkLogInfo() << "Device: " << deviceId << std::endl;
     AkLogInfo() << "Listeners: " << xpc_array_get_count(listeners) << std::endl;
@@ -448,14 +388,14 @@ void AkVCam::AssistantPrivate::listener(xpc_connection_t client,
     AkLogFunction();
     std::string deviceId = xpc_dictionary_get_string(event, "device");
     auto index = xpc_dictionary_get_uint64(event, "index");
+    auto listeners = this->m_broker.listeners(deviceId);
     std::string listener;
     bool ok = false;
 
-    if (this->m_deviceConfigs.count(deviceId) > 0)
-        if (index < this->m_deviceConfigs[deviceId].listeners.size()) {
-            listener = this->m_deviceConfigs[deviceId].listeners[index];
-            ok = true;
-        }
+    if (index < listeners.size()) {
+        listener = listeners[index];
+        ok = true;
+    }
 
     AkLogInfo() << "Device: " << deviceId << std::endl;
     AkLogInfo() << "Listener: " << listener << std::endl;
@@ -471,10 +411,7 @@ void AkVCam::AssistantPrivate::broadcasting(xpc_connection_t client,
 {
     AkLogFunction();
     std::string deviceId = xpc_dictionary_get_string(event, "device");
-    std::string broadcaster;
-
-    if (this->m_deviceConfigs.count(deviceId) > 0)
-        broadcaster = this->m_deviceConfigs[deviceId].broadcaster;
+    auto broadcaster = this->m_broker.broadcaster(deviceId);
 
     AkLogInfo() << "Device: " << deviceId << std::endl;
     AkLogInfo() << "Broadcaster: " << broadcaster << std::endl;
@@ -488,16 +425,7 @@ void AkVCam::AssistantPrivate::controlsUpdated(xpc_connection_t client, xpc_obje
 {
     UNUSED(client);
     AkLogFunction();
-    std::string deviceId = xpc_dictionary_get_string(event, "device");
-
-    if (this->m_deviceConfigs.count(deviceId) > 0) {
-        auto notification = xpc_copy(event);
-
-        for (auto &client: this->m_clients)
-            xpc_connection_send_message(client.second, notification);
-
-        xpc_release(notification);
-    }
+    this->m_broker.broadcast(brokerMessage(event));
 }
 
 void AkVCam::AssistantPrivate::listenerAdd(xpc_connection_t client,
@@ -506,23 +434,10 @@ void AkVCam::AssistantPrivate::listenerAdd(xpc_connection_t client,
     AkLogFunction();
     std::string deviceId = xpc_dictionary_get_string(event, "device");
     std::string listener = xpc_dictionary_get_string(event, "listener");
-    bool ok = false;
-
-    if (this->m_deviceConfigs.count(deviceId) > 0) {
-        auto &listeners = this->m_deviceConfigs[deviceId].listeners;
-        auto it = std::find(listeners.begin(), listeners.end(), listener);
+    bool ok = this->m_broker.addListener(deviceId, listener);
 
-        if (it == listeners.end()) {
-            listeners.push_back(listener);
-            auto notification = xpc_copy(event);
-
-            for (auto &client: this->m_clients)
-                xpc_connection_send_message(client.second, notification);
-
-            xpc_release(notification);
-            ok = true;
-        }
-    }
+    if (ok)
+        this->m_broker.broadcast(brokerMessage(event));
 
     auto reply = xpc_dictionary_create_reply(event);
     xpc_dictionary_set_bool(reply, "status", ok);
@@ -536,26 +451,70 @@ void AkVCam::AssistantPrivate::listenerRemove(xpc_connection_t client,
     AkLogFunction();
     std::string deviceId = xpc_dictionary_get_string(event, "device");
     std::string listener = xpc_dictionary_get_string(event, "listener");
-    bool ok = false;
+    bool ok = this->m_broker.removeListener(deviceId, listener);
 
-    if (this->m_deviceConfigs.count(deviceId) > 0) {
-        auto &listeners = this->m_deviceConfigs[deviceId].listeners;
-        auto it = std::find(listeners.begin(), listeners.end(), listener);
+    if (ok)
+        this->m_broker.broadcast(brokerMessage(event));
 
-        if (it != listeners.end()) {
-            listeners.erase(it);
-            auto notification = xpc_copy(event);
+    auto reply = xpc_dictionary_create_reply(event);
+    xpc_dictionary_set_bool(reply, "status", ok);
+    xpc_connection_send_message(client, reply);
+    xpc_release(reply);
+}
 
-            for (auto &client: this->m_clients)
-                xpc_connection_send_message(client.second, notification);
+AkVCam::AssistantPeer::AssistantPeer(xpc_connection_t connection):
+    m_connection(connection)
+{
+}
 
-            xpc_release(notification);
-            ok = true;
-        }
+AkVCam::AssistantPeer::~AssistantPeer()
+{
+    xpc_release(this->m_connection);
+}
+
+bool AkVCam::AssistantPeer::send(const BrokerMessage &message)
+{
+    auto event = reinterpret_cast<xpc_object_t>(message.native.get());
+
+    if (!event)
+        return false;
+
+    // Frames and pictures are acknowledged, so a slow client only blocks
+    // its own queue.
+    if (message.id != AKVCAM_ASSISTANT_MSG_FRAME_READY
+        && message.id != AKVCAM_ASSISTANT_MSG_PICTURE_UPDATED) {
+        xpc_connection_send_message(this->m_connection, event);
+
+        return true;
     }
 
-    auto reply = xpc_dictionary_create_reply(event);
-    xpc_dictionary_set_bool(reply, "status", ok);
-    xpc_connection_send_message(client, reply);
+    auto reply = xpc_connection_send_message_with_reply_sync(this->m_connection,
+                                                             event);
+    auto replyType = xpc_get_type(reply);
+    bool ok = false;
+
+    if (replyType == XPC_TYPE_DICTIONARY)
+        ok = xpc_dictionary_get_bool(reply, "status");
+
     xpc_release(reply);
+
+    return ok;
+}
+
+bool AkVCam::AssistantPeer::isAlive()
+{
+    auto dictionary = xpc_dictionary_create(nullptr, nullptr, 0);
+    xpc_dictionary_set_int64(dictionary, "message", AKVCAM_ASSISTANT_MSG_ISALIVE);
+    auto reply = xpc_connection_send_message_with_reply_sync(this->m_connection,
+                                                             dictionary);
+    xpc_release(dictionary);
+    auto replyType = xpc_get_type(reply);
+    bool alive = false;
+
+    if (replyType == XPC_TYPE_DICTIONARY)
+        alive = xpc_dictionary_get_bool(reply, "alive");
+
+    xpc_release(reply);
+
+    return alive;
 }
@@ -22,6 +22,7 @@
 #include "preferences.h"
 #include "utils.h"
 #include "VCamUtils/src/image/videoformat.h"
+#include "VCamUtils/src/idlemonitor.h"
 #include "VCamUtils/src/logger.h"
 
 #define PREFERENCES_ID CFSTR(CMIO_ASSISTANT_NAME)
@@ -575,6 +576,18 @@ void AkVCam::Preferences::cameraSetControlValue(size_t cameraIndex,
     sync();
 }
 
+int AkVCam::Preferences::cameraControlsVersion(size_t cameraIndex)
+{
+    return readInt("cameras." + std::to_string(cameraIndex) + ".controlsversion");
+}
+
+void AkVCam::Preferences::cameraSetControlsVersion(size_t cameraIndex,
+                                                   int version)
+{
+    write("cameras." + std::to_string(cameraIndex) + ".controlsversion", version);
+    sync();
+}
+
 std::string AkVCam::Preferences::picture()
 {
     return readString("picture");
@@ -596,3 +609,25 @@ void AkVCam::Preferences::setLogLevel(int logLevel)
     write("loglevel", logLevel);
     sync();
 }
+
+int AkVCam::Preferences::idleTimeout()
+{
+    return readInt("idletimeout", AKVCAM_IDLE_TIMEOUT_DEFAULT);
+}
+
+void AkVCam::Preferences::setIdleTimeout(int timeout)
+{
+    write("idletimeout", timeout);
+    sync();
+}
+
+int AkVCam::Preferences::memoryBudget()
+{
+    return readInt("memorybudget", 0);
+}
+
+void AkVCam::Preferences::setMemoryBudget(int budget)
+{
+    write("memorybudget", budget);
+    sync();
+}
@@ -80,10 +80,16 @@ namespace AkVCam
         void cameraSetControlValue(size_t cameraIndex,
                                    const std::string &key,
                                    int value);
+        int cameraControlsVersion(size_t cameraIndex);
+        void cameraSetControlsVersion(size_t cameraIndex, int version);
         std::string picture();
         void setPicture(const std::string &picture);
         int logLevel();
         void setLogLevel(int logLevel);
+        int idleTimeout();
+        void setIdleTimeout(int timeout);
+        int memoryBudget();
+        void setMemoryBudget(int budget);
     }
 }
 
@@ -18,10 +18,12 @@
  */
 
 #include <algorithm>
+#include <chrono>
 #include <codecvt>
 #include <fstream>
 #include <locale>
 #include <map>
+#include <mutex>
 #include <sstream>
 #include <sys/stat.h>
 #include <dirent.h>
@@ -38,8 +40,14 @@
 #include "PlatformUtils/src/utils.h"
 #include "VCamUtils/src/image/videoformat.h"
 #include "VCamUtils/src/image/videoframe.h"
+#include "VCamUtils/src/idlemonitor.h"
 #include "VCamUtils/src/ipcbridge.h"
+#include "VCamUtils/src/listenermonitor.h"
 #include "VCamUtils/src/logger.h"
+#include "VCamUtils/src/memcopy.h"
+#include "VCamUtils/src/memoryaccounting.h"
+#include "VCamUtils/src/profiledmutex.h"
+#include "VCamUtils/src/recording.h"
 #include "VCamUtils/src/utils.h"
 
 #define AKVCAM_BIND_FUNC(member) \
@@ -47,6 +55,21 @@
 
 namespace AkVCam
 {
+    // Last version of the controls received for each device.
+    struct DeviceControlsState
+    {
+        uint64_t version {0};
+        std::map<std::string, int> values;
+    };
+
+    // Frame being received in slices.
+    struct DeviceSlices
+    {
+        std::shared_ptr<VideoFrame> frame;
+        uint64_t sequence {0};
+        int lines {0};
+    };
+
     class IpcBridgePrivate
     {
         public:
@@ -56,6 +79,14 @@ namespace AkVCam
             xpc_connection_t m_serverMessagePort;
             std::map<int64_t, XpcMessage> m_messageHandlers;
             std::vector<std::string> m_broadcasting;
+            std::map<std::string, uint64_t> m_sequences;
+            std::map<std::string, int> m_frameSlices;
+            std::map<std::string, DeviceSlices> m_slices;
+            std::map<std::string, RecordingWriterPtr> m_recordings;
+            std::mutex m_recordingsMutex;
+            ListenerMonitor m_listeners;
+            std::map<std::string, DeviceControlsState> m_deviceControls;
+            ProfiledMutex m_controlsMutex {"ipc_controls"};
 
             IpcBridgePrivate(IpcBridge *self=nullptr);
             ~IpcBridgePrivate();
@@ -64,11 +95,16 @@ namespace AkVCam
             void remove(IpcBridge *bridge);
             inline std::vector<IpcBridge *> &bridges();
             inline const std::vector<DeviceControl> &controls() const;
+            RecordingWriterPtr recording(const std::string &deviceId);
 
             // Message handling methods
             void isAlive(xpc_connection_t client, xpc_object_t event);
             void deviceUpdate(xpc_connection_t client, xpc_object_t event);
             void frameReady(xpc_connection_t client, xpc_object_t event);
+            void sliceReady(const std::string &deviceId,
+                            IOSurfaceRef surface,
+                            uint64_t sequence,
+                            int lines);
             void pictureUpdated(xpc_connection_t client, xpc_object_t event);
             void setBroadcasting(xpc_connection_t client, xpc_object_t event);
             void controlsUpdated(xpc_connection_t client, xpc_object_t event);
@@ -99,6 +135,9 @@ AkVCam::IpcBridge::IpcBridge()
     this->d = new IpcBridgePrivate(this);
     auto loglevel = AkVCam::Preferences::logLevel();
     AkVCam::Logger::setLogLevel(loglevel);
+    IdleMonitor::global()->setTimeout(Preferences::idleTimeout());
+    auto memoryBudget = (std::max)(Preferences::memoryBudget(), 0);
+    MemoryAccounting::setDeviceBudget(uint64_t(memoryBudget) << 20);
     ipcBridgePrivate().add(this);
     this->registerPeer();
 }
@@ -141,6 +180,28 @@ void AkVCam::IpcBridge::setLogLevel(int logLevel)
     Logger::setLogLevel(logLevel);
 }
 
+int AkVCam::IpcBridge::idleTimeout() const
+{
+    return Preferences::idleTimeout();
+}
+
+void AkVCam::IpcBridge::setIdleTimeout(int timeout)
+{
+    Preferences::setIdleTimeout(timeout);
+    IdleMonitor::global()->setTimeout(timeout);
+}
+
+int AkVCam::IpcBridge::memoryBudget() const
+{
+    return Preferences::memoryBudget();
+}
+
+void AkVCam::IpcBridge::setMemoryBudget(int budget)
+{
+    Preferences::setMemoryBudget(budget);
+    MemoryAccounting::setDeviceBudget(uint64_t((std::max)(budget, 0)) << 20);
+}
+
 bool AkVCam::IpcBridge::registerPeer()
 {
     AkLogFunction();
@@ -405,6 +466,7 @@ void AkVCam::IpcBridge::setControls(const std::string &deviceId,
     if (cameraIndex < 0)
         return;
 
+    auto changes = xpc_dictionary_create(nullptr, nullptr, 0);
     bool updated = false;
 
     for (auto &control: this->d->controls()) {
@@ -419,19 +481,36 @@ void AkVCam::IpcBridge::setControls(const std::string &deviceId,
                 Preferences::cameraSetControlValue(size_t(cameraIndex),
                                                    control.id,
                                                    newValue);
+                xpc_dictionary_set_int64(changes, control.id.c_str(), newValue);
                 updated = true;
             }
         }
     }
 
-    if (!this->d->m_serverMessagePort || !updated)
+    if (!updated) {
+        xpc_release(changes);
+
+        return;
+    }
+
+    // Send all the changes as a single batch.
+    auto version = Preferences::cameraControlsVersion(size_t(cameraIndex)) + 1;
+    Preferences::cameraSetControlsVersion(size_t(cameraIndex), version);
+
+    if (!this->d->m_serverMessagePort) {
+        xpc_release(changes);
+
         return;
+    }
 
     auto dictionary = xpc_dictionary_create(nullptr, nullptr, 0);
     xpc_dictionary_set_int64(dictionary, "message", AKVCAM_ASSISTANT_MSG_DEVICE_CONTROLS_UPDATED);
     xpc_dictionary_set_string(dictionary, "device", deviceId.c_str());
+    xpc_dictionary_set_int64(dictionary, "version", version);
+    xpc_dictionary_set_value(dictionary, "controls", changes);
     xpc_connection_send_message(this->d->m_serverMessagePort, dictionary);
     xpc_release(dictionary);
+    xpc_release(changes);
 }
 
 std::vector<std::string> AkVCam::IpcBridge::listeners(const std::string &deviceId)
@@ -469,6 +548,26 @@ std::vector<std::string> AkVCam::IpcBridge::listeners(const std::string &deviceI
     return listeners;
 }
 
+bool AkVCam::IpcBridge::hasListeners(const std::string &deviceId) const
+{
+    return ipcBridgePrivate().m_listeners.hasListeners(deviceId);
+}
+
+bool AkVCam::IpcBridge::waitForListeners(const std::string &deviceId,
+                                         int timeout)
+{
+    AkLogFunction();
+
+    auto it = std::find(this->d->m_broadcasting.begin(),
+                        this->d->m_broadcasting.end(),
+                        deviceId);
+
+    if (it == this->d->m_broadcasting.end())
+        return false;
+
+    return ipcBridgePrivate().m_listeners.waitForListeners(deviceId, timeout);
+}
+
 std::vector<uint64_t> AkVCam::IpcBridge::clientsPids() const
 {
     AkLogFunction();
@@ -610,6 +709,20 @@ bool AkVCam::IpcBridge::deviceStart(const std::string &deviceId,
     xpc_release(reply);
     this->d->m_broadcasting.push_back(deviceId);
 
+    // From now on the listener notifications keep the list updated.
+    ipcBridgePrivate().m_listeners.setListeners(deviceId,
+                                                this->listeners(deviceId));
+
+    // Start from a different sequence each time so that receivers can
+    // tell apart the frames of a restarted stream.
+    this->d->m_sequences[deviceId] =
+            uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+
+    auto recordingFile = autoRecordingFile(deviceId);
+
+    if (!recordingFile.empty())
+        this->setRecording(deviceId, recordingFile);
+
     return status;
 }
 
@@ -636,12 +749,16 @@ void AkVCam::IpcBridge::deviceStop(const std::string &deviceId)
     xpc_release(dictionary);
     xpc_release(reply);
     this->d->m_broadcasting.erase(it);
+    this->d->m_sequences.erase(deviceId);
+    this->setRecording(deviceId, {});
+    ipcBridgePrivate().m_listeners.removeDevice(deviceId);
+    ipcBridgePrivate().m_listeners.interrupt();
 }
 
 bool AkVCam::IpcBridge::write(const std::string &deviceId,
                               const VideoFrame &frame)
 {
-    AkLogFunction();
+    AkLogFrameFunction();
 
     if (!this->d->m_serverMessagePort)
         return false;
@@ -653,6 +770,18 @@ bool AkVCam::IpcBridge::write(const std::string &deviceId,
     if (it == this->d->m_broadcasting.end())
         return false;
 
+    /* Record even the frames that nobody is capturing, with the sequence
+     * they are sent with, so they can be matched with the received ones.
+     */
+    auto sequence = this->d->m_sequences[deviceId]++;
+    auto recording = this->d->recording(deviceId);
+
+    if (recording)
+        recording->write(frame, sequence);
+
+    if (!ipcBridgePrivate().m_listeners.hasListeners(deviceId))
+        return true;
+
     std::vector<CFStringRef> keys {
         kIOSurfacePixelFormat,
         kIOSurfaceWidth,
@@ -689,27 +818,87 @@ bool AkVCam::IpcBridge::write(const std::string &deviceId,
     if (!surface)
         return false;
 
-    uint32_t surfaceSeed = 0;
-    IOSurfaceLock(surface, 0, &surfaceSeed);
-    auto data = IOSurfaceGetBaseAddress(surface);
-    memcpy(data, frame.data().data(), frame.data().size());
-    IOSurfaceUnlock(surface, 0, &surfaceSeed);
+    MemoryAccount surfaceAccount(MemoryCategorySharedMemory, deviceId);
+    surfaceAccount.setSize(uint64_t(dataSize));
+    auto sit = this->d->m_frameSlices.find(deviceId);
+    int slices = sit == this->d->m_frameSlices.end()? 1: sit->second;
+    slices = std::max(1, std::min(slices, height));
+
+    // Keep the slices even so they don't split subsampled lines.
+    auto sliceLines = ((height + slices - 1) / slices + 1) & ~1;
     auto surfaceObj = IOSurfaceCreateXPCObject(surface);
 
-    auto dictionary = xpc_dictionary_create(nullptr, nullptr, 0);
-    xpc_dictionary_set_int64(dictionary, "message", AKVCAM_ASSISTANT_MSG_FRAME_READY);
-    xpc_dictionary_set_string(dictionary, "device", deviceId.c_str());
-    xpc_dictionary_set_value(dictionary, "frame", surfaceObj);
-    auto reply = xpc_connection_send_message_with_reply_sync(this->d->m_serverMessagePort,
-                                                             dictionary);
-    xpc_release(dictionary);
-    xpc_release(reply);
+    for (int line = 0; line < height; line += sliceLines) {
+        auto lines = std::min(sliceLines, height - line);
+        uint32_t surfaceSeed = 0;
+        IOSurfaceLock(surface, 0, &surfaceSeed);
+        auto data = reinterpret_cast<uint8_t *>(IOSurfaceGetBaseAddress(surface));
+
+        if (lines == height) {
+            MemCopy::copy(data, frame.data().data(), frame.data().size());
+        } else {
+            for (size_t plane = 0; plane < frame.format().planes(); plane++) {
+                size_t offset = 0;
+                size_t size = 0;
+                frame.format().lineRange(plane, line, lines, &offset, &size);
+                MemCopy::copy(data + offset, frame.data().data() + offset, size);
+            }
+        }
+
+        IOSurfaceUnlock(surface, 0, &surfaceSeed);
+
+        auto dictionary = xpc_dictionary_create(nullptr, nullptr, 0);
+        xpc_dictionary_set_int64(dictionary, "message", AKVCAM_ASSISTANT_MSG_FRAME_READY);
+        xpc_dictionary_set_string(dictionary, "device", deviceId.c_str());
+        xpc_dictionary_set_value(dictionary, "frame", surfaceObj);
+        xpc_dictionary_set_uint64(dictionary, "sequence", sequence);
+        xpc_dictionary_set_int64(dictionary, "lines", line + lines);
+        xpc_dictionary_set_int64(dictionary, "slices", slices);
+        auto reply = xpc_connection_send_message_with_reply_sync(this->d->m_serverMessagePort,
+                                                                 dictionary);
+        xpc_release(dictionary);
+        xpc_release(reply);
+    }
+
     xpc_release(surfaceObj);
     CFRelease(surface);
 
     return true;
 }
 
+void AkVCam::IpcBridge::setFrameSlices(const std::string &deviceId,
+                                       int slices)
+{
+    AkLogFunction();
+    this->d->m_frameSlices[deviceId] = std::max(1, slices);
+}
+
+bool AkVCam::IpcBridge::setRecording(const std::string &deviceId,
+                                     const std::string &fileName)
+{
+    AkLogFunction();
+    RecordingWriterPtr recording;
+
+    if (!fileName.empty()) {
+        recording = std::make_shared<RecordingWriter>();
+
+        if (!recording->open(fileName))
+            return false;
+
+        AkLogInfo() << "Recording " << deviceId << " to " << fileName << std::endl;
+    }
+
+    // The previous recording is closed when the last write using it ends.
+    std::lock_guard<std::mutex> lock(this->d->m_recordingsMutex);
+
+    if (recording)
+        this->d->m_recordings[deviceId] = recording;
+    else
+        this->d->m_recordings.erase(deviceId);
+
+    return true;
+}
+
 bool AkVCam::IpcBridge::addListener(const std::string &deviceId)
 {
     AkLogFunction();
@@ -833,6 +1022,17 @@ const std::vector<AkVCam::DeviceControl> &AkVCam::IpcBridgePrivate::controls() c
     return controls;
 }
 
+AkVCam::RecordingWriterPtr AkVCam::IpcBridgePrivate::recording(const std::string &deviceId)
+{
+    std::lock_guard<std::mutex> lock(this->m_recordingsMutex);
+    auto it = this->m_recordings.find(deviceId);
+
+    if (it == this->m_recordings.end())
+        return {};
+
+    return it->second;
+}
+
 void AkVCam::IpcBridgePrivate::isAlive(xpc_connection_t client,
                                        xpc_object_t event)
 {
@@ -863,14 +1063,22 @@ void AkVCam::IpcBridgePrivate::frameReady(xpc_connection_t client,
                                           xpc_object_t event)
 {
     UNUSED(client);
-    AkLogFunction();
+    AkLogFrameFunction();
 
     std::string deviceId =
             xpc_dictionary_get_string(event, "device");
     auto frame = xpc_dictionary_get_value(event, "frame");
+    auto sequence = xpc_dictionary_get_uint64(event, "sequence");
+    auto slices = xpc_dictionary_get_int64(event, "slices");
     auto surface = IOSurfaceLookupFromXPCObject(frame);
 
-    if (surface) {
+    if (surface && slices > 1) {
+        this->sliceReady(deviceId,
+                         surface,
+                         sequence,
+                         int(xpc_dictionary_get_int64(event, "lines")));
+        CFRelease(surface);
+    } else if (surface) {
         uint32_t surfaceSeed = 0;
         IOSurfaceLock(surface, kIOSurfaceLockReadOnly, &surfaceSeed);
         FourCC fourcc = IOSurfaceGetPixelFormat(surface);
@@ -879,13 +1087,18 @@ void AkVCam::IpcBridgePrivate::frameReady(xpc_connection_t client,
         size_t size = IOSurfaceGetAllocSize(surface);
         auto data = reinterpret_cast<uint8_t *>(IOSurfaceGetBaseAddress(surface));
         VideoFormat videoFormat(fourcc, width, height);
-        VideoFrame videoFrame(videoFormat);
-        memcpy(videoFrame.data().data(), data, size);
+        /* The surface is reused for the next frame, so it must be copied
+         * out. Passthrough streams copy it once more, into their buffer.
+         */
+        auto videoFrame = std::make_shared<VideoFrame>(videoFormat);
+        MemCopy::copy(videoFrame->data().data(),
+                      data,
+                      std::min(size, videoFrame->data().size()));
         IOSurfaceUnlock(surface, kIOSurfaceLockReadOnly, &surfaceSeed);
         CFRelease(surface);
 
         for (auto bridge: this->m_bridges)
-            AKVCAM_EMIT(bridge, FrameReady, deviceId, videoFrame)
+            AKVCAM_EMIT(bridge, FrameReady, deviceId, videoFrame, sequence)
     }
 
     auto reply = xpc_dictionary_create_reply(event);
@@ -894,6 +1107,73 @@ void AkVCam::IpcBridgePrivate::frameReady(xpc_connection_t client,
     xpc_release(reply);
 }
 
+void AkVCam::IpcBridgePrivate::sliceReady(const std::string &deviceId,
+                                          IOSurfaceRef surface,
+                                          uint64_t sequence,
+                                          int lines)
+{
+    uint32_t surfaceSeed = 0;
+    IOSurfaceLock(surface, kIOSurfaceLockReadOnly, &surfaceSeed);
+    FourCC fourcc = IOSurfaceGetPixelFormat(surface);
+    int width = int(IOSurfaceGetWidth(surface));
+    int height = int(IOSurfaceGetHeight(surface));
+    size_t size = IOSurfaceGetAllocSize(surface);
+    auto data = reinterpret_cast<uint8_t *>(IOSurfaceGetBaseAddress(surface));
+    VideoFormat videoFormat(fourcc, width, height);
+    auto &slices = this->m_slices[deviceId];
+
+    // Start a new frame, reusing the last one if nobody kept it.
+    if (!slices.frame || sequence != slices.sequence) {
+        if (!slices.frame
+            || slices.frame.use_count() > 1
+            || slices.frame->format() != videoFormat)
+            slices.frame = std::make_shared<VideoFrame>(videoFormat);
+
+        slices.sequence = sequence;
+        slices.lines = 0;
+    }
+
+    // Copy all the slices written since the last message.
+    auto firstLine = slices.lines;
+    lines = std::min(lines, height) - firstLine;
+
+    if (lines > 0) {
+        for (size_t plane = 0; plane < videoFormat.planes(); plane++) {
+            size_t offset = 0;
+            size_t planeSize = 0;
+            videoFormat.lineRange(plane, firstLine, lines, &offset, &planeSize);
+
+            if (offset + planeSize <= size)
+                MemCopy::copy(slices.frame->data().data() + offset,
+                              data + offset,
+                              planeSize);
+        }
+
+        slices.lines += lines;
+    }
+
+    IOSurfaceUnlock(surface, kIOSurfaceLockReadOnly, &surfaceSeed);
+
+    if (lines < 1)
+        return;
+
+    auto videoFrame = slices.frame;
+    bool completed = slices.lines >= height;
+
+    for (auto bridge: this->m_bridges)
+        AKVCAM_EMIT(bridge,
+                    SliceReady,
+                    deviceId,
+                    *videoFrame,
+                    sequence,
+                    firstLine,
+                    lines)
+
+    if (completed)
+        for (auto bridge: this->m_bridges)
+            AKVCAM_EMIT(bridge, FrameReady, deviceId, videoFrame, sequence)
+}
+
 void AkVCam::IpcBridgePrivate::pictureUpdated(xpc_connection_t client,
                                               xpc_object_t event)
 {
@@ -929,16 +1209,55 @@ void AkVCam::IpcBridgePrivate::controlsUpdated(xpc_connection_t client,
 
     std::string deviceId =
             xpc_dictionary_get_string(event, "device");
-    auto cameraIndex = Preferences::cameraFromPath(deviceId);
+    auto version = uint64_t(xpc_dictionary_get_int64(event, "version"));
+    auto changes = xpc_dictionary_get_value(event, "controls");
+    std::unique_lock<ProfiledMutex> lock(this->m_controlsMutex);
+    auto &state = this->m_deviceControls[deviceId];
+    bool isBatch = changes && xpc_get_type(changes) == XPC_TYPE_DICTIONARY;
+    auto values = &state.values;
+
+    // Each registered bridge receives the batch, apply it just once.
+    if (state.version > 0 && version == state.version && isBatch) {
+        __block bool applied = true;
+        xpc_dictionary_apply(changes, ^bool (const char *key, xpc_object_t value) {
+            auto it = values->find(key);
+            applied = it != values->end()
+                      && it->second == int(xpc_int64_get_value(value));
+
+            return applied;
+        });
 
-    if (cameraIndex < 0)
-        return;
+        if (applied)
+            return;
+    }
 
-    std::map<std::string, int> controls;
+    if (state.version > 0 && version == state.version + 1 && isBatch) {
+        xpc_dictionary_apply(changes, ^bool (const char *key, xpc_object_t value) {
+            (*values)[key] = int(xpc_int64_get_value(value));
 
-    for (auto &control: this->controls())
-        controls[control.id] =
-                Preferences::cameraControlValue(size_t(cameraIndex), control.id);
+            return true;
+        });
+    } else {
+        // First or missed batch, read all the controls again.
+        auto cameraIndex = Preferences::cameraFromPath(deviceId);
+
+        if (cameraIndex < 0) {
+            this->m_deviceControls.erase(deviceId);
+
+            return;
+        }
+
+        state.values.clear();
+
+        for (auto &control: this->controls())
+            state.values[control.id] =
+                    Preferences::cameraControlValue(size_t(cameraIndex),
+                                                    control.id);
+    }
+
+    state.version = version;
+    auto controls = state.values;
+    lock.unlock();
 
     for (auto bridge: this->m_bridges)
         AKVCAM_EMIT(bridge,
@@ -955,6 +1274,7 @@ void AkVCam::IpcBridgePrivate::listenerAdd(xpc_connection_t client,
 
     std::string deviceId = xpc_dictionary_get_string(event, "device");
     std::string listener = xpc_dictionary_get_string(event, "listener");
+    this->m_listeners.addListener(deviceId, listener);
 
     for (auto bridge: this->m_bridges)
         AKVCAM_EMIT(bridge, ListenerAdded, deviceId, listener)
@@ -968,6 +1288,7 @@ void AkVCam::IpcBridgePrivate::listenerRemove(xpc_connection_t client,
 
     std::string deviceId = xpc_dictionary_get_string(event, "device");
     std::string listener = xpc_dictionary_get_string(event, "listener");
+    this->m_listeners.removeListener(deviceId, listener);
 
     for (auto bridge: this->m_bridges)
         AKVCAM_EMIT(bridge, ListenerRemoved, deviceId, listener)
@@ -992,6 +1313,9 @@ void AkVCam::IpcBridgePrivate::messageReceived(xpc_connection_t client,
 
 void AkVCam::IpcBridgePrivate::connectionInterrupted()
 {
+    this->m_listeners.clear();
+    this->m_listeners.interrupt();
+
     for (auto bridge: this->m_bridges) {
         AKVCAM_EMIT(bridge, ServerStateChanged, IpcBridge::ServerStateGone)
         bridge->unregisterPeer();
@@ -188,52 +188,42 @@ void AkVCam::Device::serverStateChanged(IpcBridge::ServerState state)
         stream.second->serverStateChanged(state);
 }
 
-void AkVCam::Device::frameReady(const AkVCam::VideoFrame &frame)
+void AkVCam::Device::frameReady(const AkVCam::VideoFramePtr &frame,
+                                uint64_t sequence)
 {
     for (auto &stream: this->m_streams)
-        stream.second->frameReady(frame);
+        stream.second->frameReady(this->m_deviceId, frame, sequence);
 }
 
-void AkVCam::Device::setPicture(const std::string &picture)
-{
-    for (auto &stream: this->m_streams)
-        stream.second->setPicture(picture);
-}
-
-void AkVCam::Device::setBroadcasting(const std::string &broadcaster)
-{
-    for (auto &stream: this->m_streams)
-        stream.second->setBroadcasting(broadcaster);
-}
-
-void AkVCam::Device::setHorizontalMirror(bool horizontalMirror)
-{
-    for (auto &stream: this->m_streams)
-        stream.second->setHorizontalMirror(horizontalMirror);
-}
-
-void AkVCam::Device::setVerticalMirror(bool verticalMirror)
+void AkVCam::Device::sliceReady(const AkVCam::VideoFrame &frame,
+                                uint64_t sequence,
+                                int firstLine,
+                                int lines)
 {
     for (auto &stream: this->m_streams)
-        stream.second->setVerticalMirror(verticalMirror);
+        stream.second->sliceReady(this->m_deviceId,
+                                  frame,
+                                  sequence,
+                                  firstLine,
+                                  lines);
 }
 
-void AkVCam::Device::setScaling(Scaling scaling)
+void AkVCam::Device::setPicture(const std::string &picture)
 {
     for (auto &stream: this->m_streams)
-        stream.second->setScaling(scaling);
+        stream.second->setPicture(picture);
 }
 
-void AkVCam::Device::setAspectRatio(AspectRatio aspectRatio)
+void AkVCam::Device::setBroadcasting(const std::string &broadcaster)
 {
     for (auto &stream: this->m_streams)
-        stream.second->setAspectRatio(aspectRatio);
+        stream.second->setBroadcasting(broadcaster);
 }
 
-void AkVCam::Device::setSwapRgb(bool swap)
+void AkVCam::Device::setControls(const std::map<std::string, int> &controls)
 {
     for (auto &stream: this->m_streams)
-        stream.second->setSwapRgb(swap);
+        stream.second->setControls(controls);
 }
 
 OSStatus AkVCam::Device::suspend()
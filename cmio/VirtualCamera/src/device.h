@@ -51,14 +51,14 @@ namespace AkVCam
             void stopStreams();
 
             void serverStateChanged(IpcBridge::ServerState state);
-            void frameReady(const VideoFrame &frame);
+            void frameReady(const VideoFramePtr &frame, uint64_t sequence);
+            void sliceReady(const VideoFrame &frame,
+                            uint64_t sequence,
+                            int firstLine,
+                            int lines);
             void setPicture(const std::string &picture);
             void setBroadcasting(const std::string &broadcaster);
-            void setHorizontalMirror(bool horizontalMirror);
-            void setVerticalMirror(bool verticalMirror);
-            void setScaling(Scaling scaling);
-            void setAspectRatio(AspectRatio aspectRatio);
-            void setSwapRgb(bool swap);
+            void setControls(const std::map<std::string, int> &controls);
 
             // Device Interface
             OSStatus suspend();
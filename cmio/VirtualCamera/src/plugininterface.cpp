@@ -160,6 +160,7 @@ AkVCam::PluginInterface::PluginInterface():
     this->d->m_ipcBridge.connectServerStateChanged(this, &PluginInterface::serverStateChanged);
     this->d->m_ipcBridge.connectDevicesChanged(this, &PluginInterface::devicesChanged);
     this->d->m_ipcBridge.connectFrameReady(this, &PluginInterface::frameReady);
+    this->d->m_ipcBridge.connectSliceReady(this, &PluginInterface::sliceReady);
     this->d->m_ipcBridge.connectPictureChanged(this, &PluginInterface::pictureChanged);
     this->d->m_ipcBridge.connectBroadcastingChanged(this, &PluginInterface::setBroadcasting);
     this->d->m_ipcBridge.connectControlsChanged(this, &PluginInterface::controlsChanged);
@@ -295,14 +296,30 @@ void AkVCam::PluginInterface::devicesChanged(void *userData,
 
 void AkVCam::PluginInterface::frameReady(void *userData,
                                          const std::string &deviceId,
-                                         const VideoFrame &frame)
+                                         const VideoFramePtr &frame,
+                                         uint64_t sequence)
 {
-    AkLogFunction();
+    AkLogFrameFunction();
     auto self = reinterpret_cast<PluginInterface *>(userData);
 
     for (auto device: self->m_devices)
         if (device->deviceId() == deviceId)
-            device->frameReady(frame);
+            device->frameReady(frame, sequence);
+}
+
+void AkVCam::PluginInterface::sliceReady(void *userData,
+                                         const std::string &deviceId,
+                                         const VideoFrame &frame,
+                                         uint64_t sequence,
+                                         int firstLine,
+                                         int lines)
+{
+    AkLogFrameFunction();
+    auto self = reinterpret_cast<PluginInterface *>(userData);
+
+    for (auto device: self->m_devices)
+        if (device->deviceId() == deviceId)
+            device->sliceReady(frame, sequence, firstLine, lines);
 }
 
 void AkVCam::PluginInterface::pictureChanged(void *userData,
@@ -338,22 +355,8 @@ void AkVCam::PluginInterface::controlsChanged(void *userData,
     auto self = reinterpret_cast<PluginInterface *>(userData);
 
     for (auto device: self->m_devices)
-        if (device->deviceId() == deviceId) {
-            if (controls.count("hflip"))
-                device->setHorizontalMirror(controls.at("hflip"));
-
-            if (controls.count("vflip"))
-                device->setVerticalMirror(controls.at("vflip"));
-
-            if (controls.count("scaling"))
-                device->setScaling(Scaling(controls.at("scaling")));
-
-            if (controls.count("aspect_ratio"))
-                device->setAspectRatio(AspectRatio(controls.at("aspect_ratio")));
-
-            if (controls.count("swap_rgb"))
-                device->setSwapRgb(controls.at("swap_rgb"));
-        }
+        if (device->deviceId() == deviceId)
+            device->setControls(controls);
 }
 
 void AkVCam::PluginInterface::addListener(void *userData,
@@ -451,11 +454,13 @@ bool AkVCam::PluginInterface::createDevice(const std::string &deviceId,
     }
 
     device->setBroadcasting(this->d->m_ipcBridge.broadcaster(deviceId));
-    device->setHorizontalMirror(hflip);
-    device->setVerticalMirror(vflip);
-    device->setScaling(Scaling(scaling));
-    device->setAspectRatio(AspectRatio(aspectRatio));
-    device->setSwapRgb(swapRgb);
+    device->setControls({
+        {"hflip"       , hflip      },
+        {"vflip"       , vflip      },
+        {"scaling"     , scaling    },
+        {"aspect_ratio", aspectRatio},
+        {"swap_rgb"    , swapRgb    },
+    });
 
     return true;
 
@@ -497,11 +502,13 @@ void AkVCam::PluginInterfacePrivate::updateDevices()
         auto scaling = Preferences::cameraControlValue(cameraIndex, "scaling");
         auto aspectRatio = Preferences::cameraControlValue(cameraIndex, "aspect_ratio");
         auto swapRgb = Preferences::cameraControlValue(cameraIndex, "swap_rgb");
-        device->setHorizontalMirror(hflip);
-        device->setVerticalMirror(vflip);
-        device->setScaling(Scaling(scaling));
-        device->setAspectRatio(AspectRatio(aspectRatio));
-        device->setSwapRgb(swapRgb);
+        device->setControls({
+            {"hflip"       , hflip      },
+            {"vflip"       , vflip      },
+            {"scaling"     , scaling    },
+            {"aspect_ratio", aspectRatio},
+            {"swap_rgb"    , swapRgb    },
+        });
     }
 }
 
@@ -54,7 +54,14 @@ namespace AkVCam
                                        const std::vector<std::string> &devices);
             static void frameReady(void *userData,
                                    const std::string &deviceId,
-                                   const VideoFrame &frame);
+                                   const VideoFramePtr &frame,
+                                   uint64_t sequence);
+            static void sliceReady(void *userData,
+                                   const std::string &deviceId,
+                                   const VideoFrame &frame,
+                                   uint64_t sequence,
+                                   int firstLine,
+                                   int lines);
             static void pictureChanged(void *userData,
                                        const std::string &picture);
             static void setBroadcasting(void *userData,
@@ -20,9 +20,7 @@
 #include <algorithm>
 #include <codecvt>
 #include <locale>
-#include <mutex>
-#include <random>
-#include <thread>
+#include <sstream>
 #include <CoreMediaIO/CMIOSampleBuffer.h>
 
 #include "stream.h"
@@ -32,6 +30,9 @@
 #include "VCamUtils/src/image/videoformat.h"
 #include "VCamUtils/src/image/videoframe.h"
 #include "VCamUtils/src/logger.h"
+#include "VCamUtils/src/memcopy.h"
+#include "VCamUtils/src/queuecontroller.h"
+#include "VCamUtils/src/streamengine.h"
 
 namespace AkVCam
 {
@@ -41,32 +42,18 @@ namespace AkVCam
             Stream *self;
             IpcBridge *m_bridge {nullptr};
             ClockPtr m_clock;
-            UInt64 m_sequence;
-            CMTime m_pts;
             SampleBufferQueuePtr m_queue;
             CMIODeviceStreamQueueAlteredProc m_queueAltered {nullptr};
-            VideoFrame m_currentFrame;
-            VideoFrame m_testFrame;
-            VideoFrame m_testFrameAdapted;
             void *m_queueAlteredRefCon {nullptr};
-            CFRunLoopTimerRef m_timer {nullptr};
-            std::string m_broadcaster;
-            std::mutex m_mutex;
-            Scaling m_scaling {ScalingFast};
-            AspectRatio m_aspectRatio {AspectRatioIgnore};
-            bool m_running {false};
-            bool m_horizontalMirror {false};
-            bool m_verticalMirror {false};
-            bool m_swapRgb {false};
+
+            // The client dequeues the buffers, so frames can only be skipped.
+            QueueController m_queueController {AKVCAM_QUEUE_MIN_DEPTH,
+                                               AKVCAM_QUEUE_MAX_DEPTH,
+                                               QueueController::PolicySkip};
+            StreamEngine m_engine;
 
             explicit StreamPrivate(Stream *self);
-            bool startTimer();
-            void stopTimer();
-            static void streamLoop(CFRunLoopTimerRef timer, void *info);
-            void sendFrame(const VideoFrame &frame);
-            void updateTestFrame();
-            VideoFrame applyAdjusts(const VideoFrame &frame);
-            VideoFrame randomFrame();
+            bool sendFrame(const VideoFrame &frame, const FrameTiming &timing);
     };
 }
 
@@ -80,14 +67,25 @@ AkVCam::Stream::Stream(bool registerObject,
     auto picture = Preferences::picture();
 
     if (!picture.empty())
-        this->d->m_testFrame = loadPicture(picture);
+        this->d->m_engine.setPictureLoader([picture] () {
+            return loadPicture(picture);
+        });
+
+    this->d->m_engine.setClock([] () {
+        return int64_t(1e9 * CFAbsoluteTimeGetCurrent());
+    });
+    this->d->m_engine.setSendFunc([this] (const VideoFrame &frame,
+                                          const FrameTiming &timing) {
+        return this->d->sendFrame(frame, timing);
+    });
 
     this->d->m_clock =
             std::make_shared<Clock>("CMIO::VirtualCamera::Stream",
                                     CMTimeMake(1, 10),
                                     100,
                                     10);
-    this->d->m_queue = std::make_shared<SampleBufferQueue>(30);
+    this->d->m_queue =
+            std::make_shared<SampleBufferQueue>(AKVCAM_QUEUE_MAX_DEPTH);
 
     if (registerObject) {
         this->createObject();
@@ -99,6 +97,7 @@ AkVCam::Stream::Stream(bool registerObject,
 
 AkVCam::Stream::~Stream()
 {
+    this->d->m_engine.stop();
     this->registerObject(false);
     delete this->d;
 }
@@ -163,14 +162,13 @@ void AkVCam::Stream::setPicture(const std::string &picture)
 {
     AkLogFunction();
     AkLogDebug() << "Picture: " << picture;
-    this->d->m_testFrame = loadPicture(picture);
-    this->d->updateTestFrame();
-    this->d->m_mutex.lock();
 
-    if (this->d->m_broadcaster.empty())
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
-
-    this->d->m_mutex.unlock();
+    if (picture.empty())
+        this->d->m_engine.setPicture({});
+    else
+        this->d->m_engine.setPictureLoader([picture] () {
+            return loadPicture(picture);
+        });
 }
 
 void AkVCam::Stream::setBridge(IpcBridge *bridge)
@@ -224,6 +222,7 @@ void AkVCam::Stream::setFormat(const VideoFormat &format)
                                    format.frameRateRanges());
     this->m_properties.setProperty(kCMIOStreamPropertyMinimumFrameRate,
                                    format.minimumFrameRate().value());
+    this->d->m_engine.setFormat(format);
 
     if (!format.frameRates().empty())
         this->setFrameRate(format.frameRates().front());
@@ -233,41 +232,29 @@ void AkVCam::Stream::setFrameRate(const Fraction &frameRate)
 {
     this->m_properties.setProperty(kCMIOStreamPropertyFrameRate,
                                    frameRate.value());
+    this->d->m_engine.setFrameRate(frameRate);
 }
 
 bool AkVCam::Stream::start()
 {
     AkLogFunction();
+    this->d->m_queueController.reset();
+    auto running = this->d->m_engine.start();
+    AkLogInfo() << "Running: " << running << std::endl;
 
-    if (this->d->m_running)
-        return false;
-
-    this->d->updateTestFrame();
-    this->d->m_currentFrame = this->d->m_testFrameAdapted;
-    this->d->m_sequence = 0;
-    memset(&this->d->m_pts, 0, sizeof(CMTime));
-    this->d->m_running = this->d->startTimer();
-    AkLogInfo() << "Running: " << this->d->m_running << std::endl;
-
-    return this->d->m_running;
+    return running;
 }
 
 void AkVCam::Stream::stop()
 {
     AkLogFunction();
-
-    if (!this->d->m_running)
-        return;
-
-    this->d->m_running = false;
-    this->d->stopTimer();
-    this->d->m_currentFrame.clear();
-    this->d->m_testFrameAdapted.clear();
+    this->d->m_engine.stop();
+    AkLogInfo() << "Queue: " << this->d->m_queueController.toString() << std::endl;
 }
 
 bool AkVCam::Stream::running()
 {
-    return this->d->m_running;
+    return this->d->m_engine.isRunning();
 }
 
 void AkVCam::Stream::serverStateChanged(IpcBridge::ServerState state)
@@ -275,136 +262,59 @@ void AkVCam::Stream::serverStateChanged(IpcBridge::ServerState state)
     AkLogFunction();
 
     if (state == IpcBridge::ServerStateGone) {
-        this->d->m_broadcaster.clear();
-        this->d->m_horizontalMirror = false;
-        this->d->m_verticalMirror = false;
-        this->d->m_scaling = ScalingFast;
-        this->d->m_aspectRatio = AspectRatioIgnore;
-        this->d->m_swapRgb = false;
-        this->d->updateTestFrame();
-
-        this->d->m_mutex.lock();
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
-        this->d->m_mutex.unlock();
+        this->d->m_engine.setBroadcaster({});
+        this->d->m_engine.setAdjusts({});
     }
 }
 
-void AkVCam::Stream::frameReady(const AkVCam::VideoFrame &frame)
+void AkVCam::Stream::frameReady(const std::string &deviceId,
+                                const AkVCam::VideoFramePtr &frame,
+                                uint64_t sequence)
 {
-    AkLogFunction();
-    AkLogInfo() << "Running: " << this->d->m_running << std::endl;
-    AkLogInfo() << "Broadcaster: " << this->d->m_broadcaster << std::endl;
-
-    if (!this->d->m_running)
-        return;
-
-    this->d->m_mutex.lock();
-
-    if (!this->d->m_broadcaster.empty())
-        this->d->m_currentFrame = this->d->applyAdjusts(frame);
-
-    this->d->m_mutex.unlock();
+    AkLogFrameFunction();
+    AkLogFrameInfo() << "Running: " << this->d->m_engine.isRunning() << std::endl;
+    AkLogFrameInfo() << "Broadcaster: " << this->d->m_engine.broadcaster() << std::endl;
+    this->d->m_engine.frameReady(deviceId, frame, sequence);
 }
 
-void AkVCam::Stream::setBroadcasting(const std::string &broadcaster)
+void AkVCam::Stream::sliceReady(const std::string &deviceId,
+                                const AkVCam::VideoFrame &frame,
+                                uint64_t sequence,
+                                int firstLine,
+                                int lines)
 {
-    AkLogFunction();
-
-    if (this->d->m_broadcaster == broadcaster)
-        return;
-
-    this->d->m_mutex.lock();
-    this->d->m_broadcaster = broadcaster;
-
-    if (broadcaster.empty())
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
-
-    this->d->m_mutex.unlock();
+    AkLogFrameFunction();
+    this->d->m_engine.sliceReady(deviceId, frame, sequence, firstLine, lines);
 }
 
-void AkVCam::Stream::setHorizontalMirror(bool horizontalMirror)
-{
-    AkLogFunction();
-
-    if (this->d->m_horizontalMirror == horizontalMirror)
-        return;
-
-    this->d->m_horizontalMirror = horizontalMirror;
-    this->d->updateTestFrame();
-    this->d->m_mutex.lock();
-
-    if (this->d->m_broadcaster.empty())
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
-
-    this->d->m_mutex.unlock();
-}
-
-void AkVCam::Stream::setVerticalMirror(bool verticalMirror)
-{
-    AkLogFunction();
-
-    if (this->d->m_verticalMirror == verticalMirror)
-        return;
-
-    this->d->m_verticalMirror = verticalMirror;
-    this->d->updateTestFrame();
-    this->d->m_mutex.lock();
-
-    if (this->d->m_broadcaster.empty())
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
-
-    this->d->m_mutex.unlock();
-}
-
-void AkVCam::Stream::setScaling(Scaling scaling)
+void AkVCam::Stream::setBroadcasting(const std::string &broadcaster)
 {
     AkLogFunction();
-
-    if (this->d->m_scaling == scaling)
-        return;
-
-    this->d->m_scaling = scaling;
-    this->d->updateTestFrame();
-    this->d->m_mutex.lock();
-
-    if (this->d->m_broadcaster.empty())
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
-
-    this->d->m_mutex.unlock();
+    this->d->m_engine.setBroadcaster(broadcaster);
 }
 
-void AkVCam::Stream::setAspectRatio(AspectRatio aspectRatio)
+void AkVCam::Stream::setControls(const std::map<std::string, int> &controls)
 {
     AkLogFunction();
+    auto adjusts = this->d->m_engine.adjusts();
 
-    if (this->d->m_aspectRatio == aspectRatio)
-        return;
+    if (controls.count("hflip"))
+        adjusts.horizontalMirror = controls.at("hflip");
 
-    this->d->m_aspectRatio = aspectRatio;
-    this->d->updateTestFrame();
-    this->d->m_mutex.lock();
-
-    if (this->d->m_broadcaster.empty())
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
-
-    this->d->m_mutex.unlock();
-}
-
-void AkVCam::Stream::setSwapRgb(bool swap)
-{
-    AkLogFunction();
+    if (controls.count("vflip"))
+        adjusts.verticalMirror = controls.at("vflip");
 
-    if (this->d->m_swapRgb == swap)
-        return;
+    if (controls.count("scaling"))
+        adjusts.scaling = Scaling(controls.at("scaling"));
 
-    this->d->m_swapRgb = swap;
-    this->d->updateTestFrame();
-    this->d->m_mutex.lock();
+    if (controls.count("aspect_ratio"))
+        adjusts.aspectRatio = AspectRatio(controls.at("aspect_ratio"));
 
-    if (this->d->m_broadcaster.empty())
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
+    if (controls.count("swap_rgb"))
+        adjusts.swapRgb = controls.at("swap_rgb");
 
-    this->d->m_mutex.unlock();
+    // Rebuild the frames once for all the controls.
+    this->d->m_engine.setAdjusts(adjusts);
 }
 
 OSStatus AkVCam::Stream::copyBufferQueue(CMIODeviceStreamQueueAlteredProc queueAlteredProc,
@@ -463,113 +373,39 @@ AkVCam::StreamPrivate::StreamPrivate(AkVCam::Stream *self):
 {
 }
 
-bool AkVCam::StreamPrivate::startTimer()
-{
-    AkLogFunction();
-
-    if (this->m_timer)
-        return false;
-
-    Float64 fps = 0;
-    this->self->m_properties.getProperty(kCMIOStreamPropertyFrameRate, &fps);
-
-    CFTimeInterval interval = 1.0 / fps;
-    CFRunLoopTimerContext context {0, this, nullptr, nullptr, nullptr};
-    this->m_timer =
-            CFRunLoopTimerCreate(kCFAllocatorDefault,
-                                 0.0,
-                                 interval,
-                                 0,
-                                 0,
-                                 StreamPrivate::streamLoop,
-                                 &context);
-
-    if (!this->m_timer)
-        return false;
-
-    CFRunLoopAddTimer(CFRunLoopGetMain(),
-                      this->m_timer,
-                      kCFRunLoopCommonModes);
-
-    return true;
-}
-
-void AkVCam::StreamPrivate::stopTimer()
-{
-    AkLogFunction();
-
-    if (!this->m_timer)
-        return;
-
-    CFRunLoopTimerInvalidate(this->m_timer);
-    CFRunLoopRemoveTimer(CFRunLoopGetMain(),
-                         this->m_timer,
-                         kCFRunLoopCommonModes);
-    CFRelease(this->m_timer);
-    this->m_timer = nullptr;
-}
-
-void AkVCam::StreamPrivate::streamLoop(CFRunLoopTimerRef timer, void *info)
+bool AkVCam::StreamPrivate::sendFrame(const VideoFrame &frame,
+                                      const FrameTiming &timing)
 {
-    UNUSED(timer);
-    AkLogFunction();
-
-    auto self = reinterpret_cast<StreamPrivate *>(info);
-    AkLogInfo() << "Running: " << self->m_running << std::endl;
+    AkLogFrameFunction();
 
-    if (!self->m_running)
-        return;
-
-    self->m_mutex.lock();
+    if (frame.format().size() < 1)
+        return true;
 
-    if (self->m_currentFrame.format().size() < 1)
-        self->sendFrame(self->randomFrame());
-    else
-        self->sendFrame(self->m_currentFrame);
+    auto decision =
+            this->m_queueController.update(size_t(this->m_queue->count()),
+                                           timing.pts);
 
-    self->m_mutex.unlock();
-}
-
-void AkVCam::StreamPrivate::sendFrame(const VideoFrame &frame)
-{
-    AkLogFunction();
-
-    if (this->m_queue->fullness() >= 1.0f)
-        return;
+    if (decision.action == QueueController::ActionSkip
+        || this->m_queue->fullness() >= 1.0f)
+        return true;
 
     FourCC fourcc = frame.format().fourcc();
     int width = frame.format().width();
     int height = frame.format().height();
 
-    AkLogInfo() << "Sending Frame: "
-                << enumToString(fourcc)
-                << " "
-                << width
-                << "x"
-                << height
-                << std::endl;
+    AkLogFrameInfo() << "Sending Frame: "
+                     << enumToString(fourcc)
+                     << " "
+                     << width
+                     << "x"
+                     << height
+                     << std::endl;
 
-    bool resync = false;
     auto hostTime = CFAbsoluteTimeGetCurrent();
-    auto pts = CMTimeMake(int64_t(hostTime), 1e9);
-    auto ptsDiff = CMTimeGetSeconds(CMTimeSubtract(this->m_pts, pts));
-
-    if (CMTimeCompare(pts, this->m_pts) == 0)
-        return;
-
-    Float64 fps = 0;
-    this->self->m_properties.getProperty(kCMIOStreamPropertyFrameRate, &fps);
-
-    if (CMTIME_IS_INVALID(this->m_pts)
-        || ptsDiff < 0
-        || ptsDiff > 2. / fps) {
-        this->m_pts = pts;
-        resync = true;
-    }
-
-    CMIOStreamClockPostTimingEvent(this->m_pts,
+    auto pts = CMTimeMake(timing.pts, 1e9);
+    CMIOStreamClockPostTimingEvent(pts,
                                    UInt64(hostTime),
-                                   resync,
+                                   timing.discontinuity,
                                    this->m_clock->ref());
 
     CVImageBufferRef imageBuffer = nullptr;
@@ -581,11 +417,41 @@ void AkVCam::StreamPrivate::sendFrame(const VideoFrame &frame)
                         &imageBuffer);
 
     if (!imageBuffer)
-        return;
+        return true;
 
     CVPixelBufferLockBaseAddress(imageBuffer, 0);
-    auto data = CVPixelBufferGetBaseAddress(imageBuffer);
-    memcpy(data, frame.data().data(), frame.data().size());
+
+    // Pixel buffers may pad the lines, so copy line by line honoring the
+    // stride of each plane.
+    if (CVPixelBufferIsPlanar(imageBuffer)) {
+        auto planes = std::min(CVPixelBufferGetPlaneCount(imageBuffer),
+                               frame.format().planes());
+
+        for (size_t plane = 0; plane < planes; plane++) {
+            auto srcStride = frame.format().bypl(plane);
+            auto dstStride =
+                    CVPixelBufferGetBytesPerRowOfPlane(imageBuffer, plane);
+            auto lines =
+                    CVPixelBufferGetHeightOfPlane(imageBuffer, plane);
+            MemCopy::copyPlane(CVPixelBufferGetBaseAddressOfPlane(imageBuffer,
+                                                                  plane),
+                               dstStride,
+                               frame.line(plane, 0),
+                               srcStride,
+                               std::min(srcStride, dstStride),
+                               lines);
+        }
+    } else {
+        auto srcStride = frame.format().bypl(0);
+        auto dstStride = CVPixelBufferGetBytesPerRow(imageBuffer);
+        MemCopy::copyPlane(CVPixelBufferGetBaseAddress(imageBuffer),
+                           dstStride,
+                           frame.data().data(),
+                           srcStride,
+                           std::min(srcStride, dstStride),
+                           size_t(height));
+    }
+
     CVPixelBufferUnlockBaseAddress(imageBuffer, 0);
 
     CMVideoFormatDescriptionRef format = nullptr;
@@ -593,11 +459,10 @@ void AkVCam::StreamPrivate::sendFrame(const VideoFrame &frame)
                                                  imageBuffer,
                                                  &format);
 
-    auto duration = CMTimeMake(1e3, int32_t(1e3 * fps));
     CMSampleTimingInfo timingInfo {
-        duration,
-        this->m_pts,
-        this->m_pts
+        CMTimeMake(timing.duration, 1e9),
+        pts,
+        pts
     };
 
     CMSampleBufferRef buffer = nullptr;
@@ -605,8 +470,8 @@ void AkVCam::StreamPrivate::sendFrame(const VideoFrame &frame)
                                          imageBuffer,
                                          format,
                                          &timingInfo,
-                                         this->m_sequence,
-                                         resync?
+                                         timing.sequence,
+                                         timing.discontinuity?
                                              kCMIOSampleBufferDiscontinuityFlag_UnknownDiscontinuity:
                                              kCMIOSampleBufferNoDiscontinuities,
                                          &buffer);
@@ -614,65 +479,11 @@ void AkVCam::StreamPrivate::sendFrame(const VideoFrame &frame)
     CFRelease(imageBuffer);
 
     this->m_queue->enqueue(buffer);
-    this->m_pts = CMTimeAdd(this->m_pts, duration);
-    this->m_sequence++;
 
     if (this->m_queueAltered)
         this->m_queueAltered(this->self->m_objectID,
                              buffer,
                              this->m_queueAlteredRefCon);
-}
 
-void AkVCam::StreamPrivate::updateTestFrame()
-{
-    this->m_testFrameAdapted = this->applyAdjusts(this->m_testFrame);
-}
-
-AkVCam::VideoFrame AkVCam::StreamPrivate::applyAdjusts(const VideoFrame &frame)
-{
-    VideoFormat format;
-    this->self->m_properties.getProperty(kCMIOStreamPropertyFormatDescription,
-                                         &format);
-
-    FourCC fourcc = format.fourcc();
-    int width = format.width();
-    int height = format.height();
-
-    if (width * height > frame.format().width() * frame.format().height()) {
-        return frame.mirror(this->m_horizontalMirror,
-                            this->m_verticalMirror)
-                    .swapRgb(this->m_swapRgb)
-                    .scaled(width, height,
-                            this->m_scaling,
-                            this->m_aspectRatio)
-                    .convert(fourcc);
-    }
-
-    return frame.scaled(width, height,
-                        this->m_scaling,
-                        this->m_aspectRatio)
-                .mirror(this->m_horizontalMirror,
-                        this->m_verticalMirror)
-                .swapRgb(this->m_swapRgb)
-            .convert(fourcc);
-}
-
-AkVCam::VideoFrame AkVCam::StreamPrivate::randomFrame()
-{
-    VideoFormat format;
-    this->self->m_properties.getProperty(kCMIOStreamPropertyFormatDescription,
-                                         &format);
-    VideoData data(format.size());
-    static std::uniform_int_distribution<uint8_t> distribution(std::numeric_limits<uint8_t>::min(),
-                                                               std::numeric_limits<uint8_t>::max());
-    static std::default_random_engine engine;
-    std::generate(data.begin(), data.end(), [] () {
-        return distribution(engine);
-    });
-
-    VideoFrame frame;
-    frame.format() = format;
-    frame.data() = data;
-
-    return frame;
+    return true;
 }
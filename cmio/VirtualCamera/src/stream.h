@@ -53,14 +53,17 @@ namespace AkVCam
             bool running();
 
             void serverStateChanged(IpcBridge::ServerState state);
-            void frameReady(const VideoFrame &frame);
+            void frameReady(const std::string &deviceId,
+                            const VideoFramePtr &frame,
+                            uint64_t sequence);
+            void sliceReady(const std::string &deviceId,
+                            const VideoFrame &frame,
+                            uint64_t sequence,
+                            int firstLine,
+                            int lines);
             void setPicture(const std::string &picture);
             void setBroadcasting(const std::string &broadcaster);
-            void setHorizontalMirror(bool horizontalMirror);
-            void setVerticalMirror(bool verticalMirror);
-            void setScaling(Scaling scaling);
-            void setAspectRatio(AspectRatio aspectRatio);
-            void setSwapRgb(bool swap);
+            void setControls(const std::map<std::string, int> &controls);
 
             // Stream Interface
             OSStatus copyBufferQueue(CMIODeviceStreamQueueAlteredProc queueAlteredProc,
@@ -21,7 +21,6 @@
 #include <iostream>
 #include <map>
 #include <memory>
-#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -31,6 +30,7 @@
 
 #include "service.h"
 #include "PlatformUtils/src/messageserver.h"
+#include "VCamUtils/src/broker.h"
 #include "VCamUtils/src/image/videoformat.h"
 #include "VCamUtils/src/image/videoframe.h"
 #include "VCamUtils/src/timer.h"
@@ -38,14 +38,15 @@
 
 namespace AkVCam
 {
-    struct AssistantDevice
+    class ServicePeer: public BrokerPeer
     {
-        std::string broadcaster;
-        std::vector<std::string> listeners;
-    };
+        public:
+            std::string m_pipeName;
 
-    typedef std::map<std::string, std::string> AssistantPeers;
-    typedef std::map<std::string, AssistantDevice> DeviceConfigs;
+            explicit ServicePeer(const std::string &pipeName);
+            bool send(const BrokerMessage &message) override;
+            bool isAlive() override;
+    };
 
     class ServicePrivate
     {
@@ -53,20 +54,22 @@ namespace AkVCam
             SERVICE_STATUS m_status;
             SERVICE_STATUS_HANDLE m_statusHandler;
             MessageServer m_messageServer;
-            AssistantPeers m_servers;
-            AssistantPeers m_clients;
-            DeviceConfigs m_deviceConfigs;
+            Broker m_broker;
             Timer m_timer;
-            std::mutex m_peerMutex;
 
             ServicePrivate();
             static void stateChanged(void *userData,
                                      MessageServer::State state);
             static void checkPeers(void *userData);
+            static void broadcasterReleased(void *userData,
+                                            const std::string &deviceId);
+            static void listenerReleased(void *userData,
+                                         const std::string &deviceId,
+                                         const std::string &listener);
             void sendStatus(DWORD currentState, DWORD exitCode, DWORD wait);
             inline static uint64_t id();
+            inline static BrokerMessage brokerMessage(const Message *message);
             void removePortByName(const std::string &portName);
-            void releaseDevicesFromPeer(const std::string &portName);
             void requestPort(Message *message);
             void addPort(Message *message);
             void removePort(Message *message);
@@ -280,6 +283,10 @@ AkVCam::ServicePrivate::ServicePrivate()
         {AKVCAM_ASSISTANT_MSG_DEVICE_SETBROADCASTING , AKVCAM_BIND_FUNC(ServicePrivate::setBroadCasting)},
         {AKVCAM_ASSISTANT_MSG_DEVICE_CONTROLS_UPDATED, AKVCAM_BIND_FUNC(ServicePrivate::controlsUpdated)},
     });
+    this->m_broker.connectBroadcasterReleased(this,
+                                              &ServicePrivate::broadcasterReleased);
+    this->m_broker.connectListenerReleased(this,
+                                           &ServicePrivate::listenerReleased);
     this->m_timer.setInterval(60000);
     this->m_timer.connectTimeout(this, &ServicePrivate::checkPeers);
 }
@@ -311,32 +318,41 @@ void AkVCam::ServicePrivate::stateChanged(void *userData,
 void AkVCam::ServicePrivate::checkPeers(void *userData)
 {
     auto self = reinterpret_cast<ServicePrivate *>(userData);
-    std::vector<std::string> removePorts;
-
-    self->m_peerMutex.lock();
-    std::vector<AssistantPeers *> allPeers {
-        &self->m_clients,
-        &self->m_servers
-    };
-
-    for (auto peers: allPeers)
-            for (auto &peer: *peers) {
-                Message message;
-                message.messageId = AKVCAM_ASSISTANT_MSG_ISALIVE;
-                message.dataSize = sizeof(MsgIsAlive);
-                MessageServer::sendMessage(peer.second, &message);
-                auto requestData = messageData<MsgIsAlive>(&message);
-
-                if (!requestData->alive)
-                    removePorts.push_back(peer.first);
-            }
+    self->m_broker.checkPeers();
+}
 
-    self->m_peerMutex.unlock();
+void AkVCam::ServicePrivate::broadcasterReleased(void *userData,
+                                                 const std::string &deviceId)
+{
+    auto self = reinterpret_cast<ServicePrivate *>(userData);
+    Message message;
+    message.messageId = AKVCAM_ASSISTANT_MSG_DEVICE_SETBROADCASTING;
+    message.dataSize = sizeof(MsgBroadcasting);
+    auto data = messageData<MsgBroadcasting>(&message);
+    memcpy(data->device,
+           deviceId.c_str(),
+           (std::min<size_t>)(deviceId.size(), MAX_STRING));
+    self->m_broker.broadcast(brokerMessage(&message));
+}
 
-    for (auto &port: removePorts) {
-        AkLogWarning() << port << " died, removing..." << std::endl;
-        self->removePortByName(port);
-    }
+void AkVCam::ServicePrivate::listenerReleased(void *userData,
+                                              const std::string &deviceId,
+                                              const std::string &listener)
+{
+    auto self = reinterpret_cast<ServicePrivate *>(userData);
+    Message message;
+    message.messageId = AKVCAM_ASSISTANT_MSG_DEVICE_LISTENER_REMOVE;
+    message.dataSize = sizeof(MsgListeners);
+    auto data = messageData<MsgListeners>(&message);
+    memcpy(data->device,
+           deviceId.c_str(),
+           (std::min<size_t>)(deviceId.size(), MAX_STRING));
+    memcpy(data->listener,
+           listener.c_str(),
+           (std::min<size_t>)(listener.size(), MAX_STRING));
+    data->nlistener = self->m_broker.listeners(deviceId).size();
+    data->status = true;
+    self->m_broker.broadcast(brokerMessage(&message));
 }
 
 void AkVCam::ServicePrivate::sendStatus(DWORD currentState,
@@ -365,69 +381,22 @@ uint64_t AkVCam::ServicePrivate::id()
     return id++;
 }
 
-void AkVCam::ServicePrivate::removePortByName(const std::string &portName)
+AkVCam::BrokerMessage AkVCam::ServicePrivate::brokerMessage(const Message *message)
 {
-    AkLogFunction();
-    AkLogInfo() << "Port: " << portName << std::endl;
-
-    this->m_peerMutex.lock();
+    BrokerMessage brokerMessage;
+    brokerMessage.id = message->messageId;
+    auto dataSize = (std::min<size_t>)(message->dataSize, MSG_BUFFER_SIZE);
+    brokerMessage.data = {message->data, message->data + dataSize};
 
-    std::vector<AssistantPeers *> allPeers {
-        &this->m_clients,
-        &this->m_servers
-    };
-
-    bool breakLoop = false;
-
-    for (auto peers: allPeers) {
-        for (auto &peer: *peers)
-            if (peer.first == portName) {
-                peers->erase(portName);
-                breakLoop = true;
-
-                break;
-            }
-
-        if (breakLoop)
-            break;
-    }
-
-    bool peersEmpty = this->m_servers.empty() && this->m_clients.empty();
-    this->m_peerMutex.unlock();
-
-    if (peersEmpty)
-        this->m_timer.stop();
-
-    this->releaseDevicesFromPeer(portName);
+    return brokerMessage;
 }
 
-void AkVCam::ServicePrivate::releaseDevicesFromPeer(const std::string &portName)
+void AkVCam::ServicePrivate::removePortByName(const std::string &portName)
 {
-    for (auto &config: this->m_deviceConfigs)
-        if (config.second.broadcaster == portName) {
-            config.second.broadcaster.clear();
-
-            Message message;
-            message.messageId = AKVCAM_ASSISTANT_MSG_DEVICE_SETBROADCASTING;
-            message.dataSize = sizeof(MsgBroadcasting);
-            auto data = messageData<MsgBroadcasting>(&message);
-            memcpy(data->device,
-                   config.first.c_str(),
-                   (std::min<size_t>)(config.first.size(), MAX_STRING));
-            this->m_peerMutex.lock();
-
-            for (auto &client: this->m_clients)
-                MessageServer::sendMessage(client.second, &message);
-
-            this->m_peerMutex.unlock();
-        } else {
-            auto it = std::find(config.second.listeners.begin(),
-                                config.second.listeners.end(),
-                                portName);
+    AkLogFunction();
 
-            if (it != config.second.listeners.end())
-                config.second.listeners.erase(it);
-        }
+    if (this->m_broker.removePeer(portName) && this->m_broker.nPeers() < 1)
+        this->m_timer.stop();
 }
 
 void AkVCam::ServicePrivate::requestPort(AkVCam::Message *message)
@@ -450,33 +419,14 @@ void AkVCam::ServicePrivate::addPort(AkVCam::Message *message)
     auto data = messageData<MsgAddPort>(message);
     std::string portName(data->port);
     std::string pipeName(data->pipeName);
-    bool ok = true;
-
-    this->m_peerMutex.lock();
-    AssistantPeers *peers;
-
-    if (portName.find(AKVCAM_ASSISTANT_CLIENT_NAME) != std::string::npos)
-        peers = &this->m_clients;
-    else
-        peers = &this->m_servers;
-
-    for (auto &peer: *peers)
-        if (peer.first == portName) {
-            ok = false;
-
-            break;
-        }
-
-    if (ok) {
-        AkLogInfo() << "Adding Peer: " << portName << std::endl;
-        (*peers)[portName] = pipeName;
-    }
-
-    size_t nPeers = this->m_servers.size() + this->m_clients.size();
-
-    this->m_peerMutex.unlock();
-
-    if (ok && nPeers == 1)
+    auto type = portName.find(AKVCAM_ASSISTANT_CLIENT_NAME) != std::string::npos?
+                    Broker::PeerTypeClient:
+                    Broker::PeerTypeServer;
+    bool ok = this->m_broker.addPeer(portName,
+                                     type,
+                                     std::make_shared<ServicePeer>(pipeName));
+
+    if (ok && this->m_broker.nPeers() == 1)
         this->m_timer.start();
 
     data->status = ok;
@@ -496,78 +446,44 @@ void AkVCam::ServicePrivate::setBroadCasting(AkVCam::Message *message)
     auto data = messageData<MsgBroadcasting>(message);
     std::string deviceId(data->device);
     std::string broadcaster(data->broadcaster);
-    data->status = false;
+    data->status = this->m_broker.setBroadcaster(deviceId, broadcaster);
 
-    if (this->m_deviceConfigs.count(deviceId) < 1)
-        this->m_deviceConfigs[deviceId] = {};
-
-    if (this->m_deviceConfigs[deviceId].broadcaster == broadcaster)
-        return;
-
-    AkLogInfo() << "Device: " << deviceId << std::endl;
-    AkLogInfo() << "Broadcaster: " << broadcaster << std::endl;
-    this->m_deviceConfigs[deviceId].broadcaster = broadcaster;
-    data->status = true;
-
-    this->m_peerMutex.lock();
-
-    for (auto &client: this->m_clients) {
-        Message msg(message);
-        MessageServer::sendMessage(client.second, &msg);
-    }
-
-    this->m_peerMutex.unlock();
+    if (data->status)
+        this->m_broker.broadcast(brokerMessage(message));
 }
 
 void AkVCam::ServicePrivate::frameReady(AkVCam::Message *message)
 {
-    AkLogFunction();
-    this->m_peerMutex.lock();
-
-    for (auto &client: this->m_clients)
-        MessageServer::sendMessage(client.second, message);
-
-    this->m_peerMutex.unlock();
+    AkLogFrameFunction();
+    auto data = messageData<MsgFrameReady>(message);
+    auto frame = brokerMessage(message);
+    frame.deviceId = data->device;
+    this->m_broker.broadcast(frame);
 }
 
 void AkVCam::ServicePrivate::pictureUpdated(AkVCam::Message *message)
 {
     AkLogFunction();
-    this->m_peerMutex.lock();
-
-    for (auto &client: this->m_clients)
-        MessageServer::sendMessage(client.second, message);
-
-    this->m_peerMutex.unlock();
+    this->m_broker.broadcast(brokerMessage(message));
 }
 
 void AkVCam::ServicePrivate::deviceUpdate(AkVCam::Message *message)
 {
     AkLogFunction();
-    this->m_peerMutex.lock();
-
-    for (auto &client: this->m_clients)
-        MessageServer::sendMessage(client.second, message);
-
-    this->m_peerMutex.unlock();
+    this->m_broker.broadcast(brokerMessage(message));
 }
 
 void AkVCam::ServicePrivate::listeners(AkVCam::Message *message)
 {
     AkLogFunction();
     auto data = messageData<MsgListeners>(message);
-    std::string deviceId(data->device);
-
-    if (this->m_deviceConfigs.count(deviceId) < 1)
-        this->m_deviceConfigs[deviceId] = {};
-
-    data->nlistener = this->m_deviceConfigs[deviceId].listeners.size();
+    auto listeners = this->m_broker.listeners(data->device);
+    data->nlistener = listeners.size();
 
     if (data->nlistener > 0) {
         memcpy(data->listener,
-               this->m_deviceConfigs[deviceId].listeners[0].c_str(),
-               std::min<size_t>(this->m_deviceConfigs[deviceId].listeners[0].size(),
-                                MAX_STRING));
+               listeners[0].c_str(),
+               std::min<size_t>(listeners[0].size(), MAX_STRING));
     }
 
     data->status = true;
@@ -577,23 +493,17 @@ void AkVCam::ServicePrivate::listener(AkVCam::Message *message)
 {
     AkLogFunction();
     auto data = messageData<MsgListeners>(message);
-    std::string deviceId(data->device);
+    auto listeners = this->m_broker.listeners(data->device);
 
-    if (this->m_deviceConfigs.count(deviceId) < 1)
-        this->m_deviceConfigs[deviceId] = {};
-
-    auto nlistener = this->m_deviceConfigs[deviceId].listeners.size();
-
-    if (data->nlistener >= nlistener) {
+    if (data->nlistener >= listeners.size()) {
         data->status = false;
 
         return;
     }
 
     memcpy(data->listener,
-           this->m_deviceConfigs[deviceId].listeners[data->nlistener].c_str(),
-           std::min<size_t>(this->m_deviceConfigs[deviceId].listeners[data->nlistener].size(),
-                            MAX_STRING));
+           listeners[data->nlistener].c_str(),
+           std::min<size_t>(listeners[data->nlistener].size(), MAX_STRING));
 
     data->status = true;
 }
@@ -602,15 +512,10 @@ void AkVCam::ServicePrivate::broadcasting(AkVCam::Message *message)
 {
     AkLogFunction();
     auto data = messageData<MsgBroadcasting>(message);
-    std::string deviceId(data->device);
-
-    if (this->m_deviceConfigs.count(deviceId) < 1)
-        this->m_deviceConfigs[deviceId] = {};
-
+    auto broadcaster = this->m_broker.broadcaster(data->device);
     memcpy(data->broadcaster,
-           this->m_deviceConfigs[deviceId].broadcaster.c_str(),
-           std::min<size_t>(this->m_deviceConfigs[deviceId].broadcaster.size(),
-                            MAX_STRING));
+           broadcaster.c_str(),
+           std::min<size_t>(broadcaster.size(), MAX_STRING));
     data->status = true;
 }
 
@@ -619,31 +524,11 @@ void AkVCam::ServicePrivate::listenerAdd(AkVCam::Message *message)
     AkLogFunction();
     auto data = messageData<MsgListeners>(message);
     std::string deviceId(data->device);
+    data->status = this->m_broker.addListener(deviceId, data->listener);
+    data->nlistener = this->m_broker.listeners(deviceId).size();
 
-    if (this->m_deviceConfigs.count(deviceId) < 1)
-        this->m_deviceConfigs[deviceId] = {};
-
-    auto &listeners = this->m_deviceConfigs[deviceId].listeners;
-    std::string listener(data->listener);
-    auto it = std::find(listeners.begin(), listeners.end(), listener);
-
-    if (it == listeners.end()) {
-        listeners.push_back(listener);
-        data->nlistener = listeners.size();
-        data->status = true;
-
-        this->m_peerMutex.lock();
-
-        for (auto &client: this->m_clients) {
-            Message msg(message);
-            MessageServer::sendMessage(client.second, &msg);
-        }
-
-        this->m_peerMutex.unlock();
-    } else {
-        data->nlistener = listeners.size();
-        data->status = false;
-    }
+    if (data->status)
+        this->m_broker.broadcast(brokerMessage(message));
 }
 
 void AkVCam::ServicePrivate::listenerRemove(AkVCam::Message *message)
@@ -651,42 +536,43 @@ void AkVCam::ServicePrivate::listenerRemove(AkVCam::Message *message)
     AkLogFunction();
     auto data = messageData<MsgListeners>(message);
     std::string deviceId(data->device);
+    data->status = this->m_broker.removeListener(deviceId, data->listener);
+    data->nlistener = this->m_broker.listeners(deviceId).size();
 
-    if (this->m_deviceConfigs.count(deviceId) < 1)
-        this->m_deviceConfigs[deviceId] = {};
-
-    auto &listeners = this->m_deviceConfigs[deviceId].listeners;
-    std::string listener(data->listener);
-    auto it = std::find(listeners.begin(), listeners.end(), listener);
+    if (data->status)
+        this->m_broker.broadcast(brokerMessage(message));
+}
 
-    if (it != listeners.end()) {
-        listeners.erase(it);
-        data->nlistener = listeners.size();
-        data->status = true;
+void AkVCam::ServicePrivate::controlsUpdated(AkVCam::Message *message)
+{
+    AkLogFunction();
+    this->m_broker.broadcast(brokerMessage(message));
+}
 
-        this->m_peerMutex.lock();
+AkVCam::ServicePeer::ServicePeer(const std::string &pipeName):
+    m_pipeName(pipeName)
+{
+}
 
-        for (auto &client: this->m_clients) {
-            Message msg(message);
-            MessageServer::sendMessage(client.second, &msg);
-        }
+bool AkVCam::ServicePeer::send(const BrokerMessage &message)
+{
+    Message msg;
+    msg.messageId = message.id;
+    msg.dataSize =
+            uint32_t((std::min<size_t>)(message.data.size(), MSG_BUFFER_SIZE));
+    memcpy(msg.data, message.data.data(), msg.dataSize);
 
-        this->m_peerMutex.unlock();
-    } else {
-        data->nlistener = listeners.size();
-        data->status = false;
-    }
+    return MessageServer::sendMessage(this->m_pipeName, &msg);
 }
 
-void AkVCam::ServicePrivate::controlsUpdated(AkVCam::Message *message)
+bool AkVCam::ServicePeer::isAlive()
 {
-    AkLogFunction();
-    this->m_peerMutex.lock();
-
-    for (auto &client: this->m_clients)
-        MessageServer::sendMessage(client.second, message);
+    Message message;
+    message.messageId = AKVCAM_ASSISTANT_MSG_ISALIVE;
+    message.dataSize = sizeof(MsgIsAlive);
+    MessageServer::sendMessage(this->m_pipeName, &message);
 
-    this->m_peerMutex.unlock();
+    return messageData<MsgIsAlive>(&message)->alive;
 }
 
 DWORD WINAPI controlHandler(DWORD control,
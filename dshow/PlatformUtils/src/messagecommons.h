@@ -55,6 +55,8 @@
 
 #define MSG_BUFFER_SIZE 4096
 #define MAX_STRING 1024
+#define MAX_CONTROLS 16
+#define MAX_CONTROL_ID 32
 
 #define AKVCAM_BIND_FUNC(member) \
     std::bind(&member, this, std::placeholders::_1)
@@ -67,6 +69,11 @@ namespace AkVCam
         int32_t width;
         int32_t height;
         uint32_t size;
+        uint64_t sequence;
+
+        // Lines of the frame written so far and number of slices.
+        int32_t lines;
+        uint32_t slices;
         uint8_t data[4];
     };
 
@@ -182,9 +189,21 @@ namespace AkVCam
         char picture[MAX_STRING];
     };
 
+    struct MsgControl
+    {
+        char id[MAX_CONTROL_ID];
+        int32_t value;
+    };
+
+    /* Only the controls that changed since the previous version are sent.
+     * A batch with more than MAX_CONTROLS changes skips a version.
+     */
     struct MsgControlsUpdated
     {
         char device[MAX_STRING];
+        uint64_t version;
+        uint32_t ncontrols;
+        MsgControl controls[MAX_CONTROLS];
     };
 }
 
@@ -28,6 +28,7 @@
 #include "preferences.h"
 #include "utils.h"
 #include "VCamUtils/src/image/videoformat.h"
+#include "VCamUtils/src/idlemonitor.h"
 #include "VCamUtils/src/logger.h"
 
 #define REG_PREFIX "SOFTWARE\\Webcamoid\\VirtualCamera\\"
@@ -524,6 +525,22 @@ void AkVCam::Preferences::cameraSetControlValue(size_t cameraIndex,
           value);
 }
 
+int AkVCam::Preferences::cameraControlsVersion(size_t cameraIndex)
+{
+    return readInt("Cameras\\"
+                   + std::to_string(cameraIndex + 1)
+                   + "\\ControlsVersion");
+}
+
+void AkVCam::Preferences::cameraSetControlsVersion(size_t cameraIndex,
+                                                   int version)
+{
+    write("Cameras\\"
+          + std::to_string(cameraIndex + 1)
+          + "\\ControlsVersion",
+          version);
+}
+
 std::string AkVCam::Preferences::picture()
 {
     return readString("picture");
@@ -544,6 +561,26 @@ void AkVCam::Preferences::setLogLevel(int logLevel)
     write("loglevel", logLevel);
 }
 
+int AkVCam::Preferences::idleTimeout()
+{
+    return readInt("idletimeout", AKVCAM_IDLE_TIMEOUT_DEFAULT);
+}
+
+void AkVCam::Preferences::setIdleTimeout(int timeout)
+{
+    write("idletimeout", timeout);
+}
+
+int AkVCam::Preferences::memoryBudget()
+{
+    return readInt("memorybudget", 0);
+}
+
+void AkVCam::Preferences::setMemoryBudget(int budget)
+{
+    write("memorybudget", budget);
+}
+
 void AkVCam::Preferences::splitSubKey(const std::string &key,
                                       std::string &subKey,
                                       std::string &value)
@@ -23,6 +23,11 @@
 #include "mutex.h"
 #include "utils.h"
 #include "VCamUtils/src/logger.h"
+#include "VCamUtils/src/memoryaccounting.h"
+#include "VCamUtils/src/profiledmutex.h"
+
+// Waits for the kernel mutex shorter than this are not counted as contended.
+#define SHAREDMEMORY_CONTENDED_WAIT 2000
 
 namespace AkVCam
 {
@@ -35,6 +40,10 @@ namespace AkVCam
             size_t m_pageSize;
             SharedMemory::OpenMode m_mode;
             bool m_isOpen;
+            uint64_t m_lockTime {0};
+            MemoryAccount m_account {MemoryCategorySharedMemory};
+
+            inline static LockProfile &profile();
     };
 }
 
@@ -57,6 +66,7 @@ AkVCam::SharedMemory::SharedMemory(const SharedMemory &other)
     this->d->m_pageSize = 0;
     this->d->m_mode = OpenModeRead;
     this->d->m_isOpen = false;
+    this->d->m_account.setDeviceId(other.d->m_account.deviceId());
 
     if (other.d->m_isOpen)
         this->open(other.d->m_pageSize, other.d->m_mode);
@@ -77,6 +87,7 @@ AkVCam::SharedMemory &AkVCam::SharedMemory::operator =(const SharedMemory &other
         this->d->m_pageSize = 0;
         this->d->m_mode = OpenModeRead;
         this->d->m_isOpen = false;
+        this->d->m_account.setDeviceId(other.d->m_account.deviceId());
 
         if (other.d->m_isOpen)
             this->open(other.d->m_pageSize, other.d->m_mode);
@@ -100,6 +111,16 @@ void AkVCam::SharedMemory::setName(const std::string &name)
     this->d->m_name = name;
 }
 
+std::string AkVCam::SharedMemory::deviceId() const
+{
+    return this->d->m_account.deviceId();
+}
+
+void AkVCam::SharedMemory::setDeviceId(const std::string &deviceId)
+{
+    this->d->m_account.setDeviceId(deviceId);
+}
+
 bool AkVCam::SharedMemory::open(size_t pageSize, OpenMode mode)
 {
     if (this->d->m_isOpen)
@@ -153,6 +174,7 @@ bool AkVCam::SharedMemory::open(size_t pageSize, OpenMode mode)
     this->d->m_pageSize = pageSize;
     this->d->m_mode = mode;
     this->d->m_isOpen = true;
+    this->d->m_account.setSize(pageSize);
 
     return true;
 }
@@ -174,16 +196,28 @@ AkVCam::SharedMemory::OpenMode AkVCam::SharedMemory::mode() const
 
 void *AkVCam::SharedMemory::lock(AkVCam::Mutex *mutex, int timeout)
 {
-    if (mutex && !mutex->tryLock(timeout))
-        return nullptr;
+    if (mutex) {
+        auto waitStart = LockProfile::now();
+
+        if (!mutex->tryLock(timeout))
+            return nullptr;
+
+        this->d->m_lockTime = LockProfile::now();
+        auto waitTime = this->d->m_lockTime - waitStart;
+        SharedMemoryPrivate::profile().acquired(waitTime > SHAREDMEMORY_CONTENDED_WAIT,
+                                                waitTime);
+    }
 
     return this->d->m_buffer;
 }
 
 void AkVCam::SharedMemory::unlock(AkVCam::Mutex *mutex)
 {
-    if (mutex)
+    if (mutex) {
+        auto holdTime = LockProfile::now() - this->d->m_lockTime;
         mutex->unlock();
+        SharedMemoryPrivate::profile().released(holdTime);
+    }
 }
 
 void AkVCam::SharedMemory::close()
@@ -201,4 +235,12 @@ void AkVCam::SharedMemory::close()
     this->d->m_pageSize = 0;
     this->d->m_mode = OpenModeRead;
     this->d->m_isOpen = false;
+    this->d->m_account.setSize(0);
+}
+
+AkVCam::LockProfile &AkVCam::SharedMemoryPrivate::profile()
+{
+    static LockProfile profile("shared_memory");
+
+    return profile;
 }
@@ -44,6 +44,10 @@ namespace AkVCam
             std::string name() const;
             std::string &name();
             void setName(const std::string &name);
+
+            // Device the mapped memory is accounted to.
+            std::string deviceId() const;
+            void setDeviceId(const std::string &deviceId);
             bool open(size_t pageSize=0, OpenMode mode=OpenModeRead);
             bool isOpen() const;
             size_t pageSize() const;
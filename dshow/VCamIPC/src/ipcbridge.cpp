@@ -18,12 +18,15 @@
  */
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <codecvt>
 #include <fstream>
 #include <locale>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <sstream>
 #include <thread>
 #include <windows.h>
@@ -34,10 +37,18 @@
 #include "PlatformUtils/src/preferences.h"
 #include "PlatformUtils/src/sharedmemory.h"
 #include "PlatformUtils/src/utils.h"
+#include "VCamUtils/src/controlsbatch.h"
+#include "VCamUtils/src/image/framecache.h"
 #include "VCamUtils/src/image/videoformat.h"
 #include "VCamUtils/src/image/videoframe.h"
+#include "VCamUtils/src/idlemonitor.h"
 #include "VCamUtils/src/ipcbridge.h"
+#include "VCamUtils/src/listenermonitor.h"
 #include "VCamUtils/src/logger.h"
+#include "VCamUtils/src/memcopy.h"
+#include "VCamUtils/src/memoryaccounting.h"
+#include "VCamUtils/src/profiledmutex.h"
+#include "VCamUtils/src/recording.h"
 
 namespace AkVCam
 {
@@ -47,6 +58,34 @@ namespace AkVCam
     {
         SharedMemory sharedMemory;
         Mutex mutex;
+
+        // Frame being received in slices.
+        std::shared_ptr<VideoFrame> sliceFrame;
+        uint64_t sliceSequence {0};
+        int sliceLines {0};
+    };
+
+    // Transport channel used by the broadcaster for each device.
+    struct DeviceChannel
+    {
+        SharedMemory sharedMemory;
+        Mutex mutex;
+        ProfiledMutex writeMutex {"ipc_channel_write"};
+        std::atomic<uint64_t> sequence {0};
+        std::atomic<int> slices {1};
+        std::atomic<uint64_t> framesWritten {0};
+        std::atomic<uint64_t> framesDropped {0};
+        std::atomic<uint64_t> framesIdle {0};
+        bool released {false};
+    };
+
+    using DeviceChannelPtr = std::shared_ptr<DeviceChannel>;
+
+    // Last version of the controls received for each device.
+    struct DeviceControlsState
+    {
+        uint64_t version {0};
+        std::map<std::string, int> values;
     };
 
     class IpcBridgePrivate
@@ -55,17 +94,37 @@ namespace AkVCam
             IpcBridge *self;
             std::string m_portName;
             std::map<std::string, DeviceSharedProperties> m_devices;
+            ProfiledMutex m_devicesMutex {"ipc_devices"};
             std::map<uint32_t, MessageHandler> m_messageHandlers;
-            std::vector<std::string> m_broadcasting;
+            std::map<std::string, DeviceChannelPtr> m_channels;
+            std::map<std::string, DeviceControlsState> m_deviceControls;
+            std::map<std::string, int> m_frameSlices;
+            ProfiledMutex m_channelsMutex {"ipc_channels"};
+            std::map<std::string, RecordingWriterPtr> m_recordings;
+            std::mutex m_recordingsMutex;
+            ListenerMonitor m_listeners;
+
+            // Devices captured through this bridge, announced again when the
+            // server comes back.
+            std::set<std::string> m_listening;
+            std::mutex m_listeningMutex;
             MessageServer m_messageServer;
             MessageServer m_mainServer;
-            SharedMemory m_sharedMemory;
-            Mutex m_globalMutex;
 
             explicit IpcBridgePrivate(IpcBridge *self);
             ~IpcBridgePrivate();
 
             inline const std::vector<DeviceControl> &controls() const;
+            inline static std::string channelName(const std::string &owner,
+                                                  const std::string &deviceId);
+            DeviceChannelPtr channel(const std::string &deviceId);
+            RecordingWriterPtr recording(const std::string &deviceId);
+            inline std::string idleId(const std::string &kind,
+                                      const std::string &deviceId) const;
+            void releaseChannel(const std::string &deviceId);
+            void cancelChannel(const std::string &deviceId);
+            void releaseDevice(const std::string &deviceId);
+            bool sendFrameReady(const std::string &deviceId);
             void updateDeviceSharedProperties();
             void updateDeviceSharedProperties(const std::string &deviceId,
                                               const std::string &owner);
@@ -75,6 +134,10 @@ namespace AkVCam
             // Message handling methods
             void isAlive(Message *message);
             void frameReady(Message *message);
+            void sliceReady(const std::string &deviceId,
+                            DeviceSharedProperties &device,
+                            const Frame *frame,
+                            std::unique_lock<ProfiledMutex> &devicesLock);
             void pictureUpdated(Message *message);
             void deviceUpdate(Message *message);
             void listenerAdd(Message *message);
@@ -95,6 +158,9 @@ AkVCam::IpcBridge::IpcBridge()
     this->d = new IpcBridgePrivate(this);
     auto loglevel = AkVCam::Preferences::logLevel();
     AkVCam::Logger::setLogLevel(loglevel);
+    IdleMonitor::global()->setTimeout(Preferences::idleTimeout());
+    auto memoryBudget = (std::max)(Preferences::memoryBudget(), 0);
+    MemoryAccounting::setDeviceBudget(uint64_t(memoryBudget) << 20);
     this->d->m_mainServer.start();
     this->registerPeer();
 }
@@ -135,6 +201,28 @@ void AkVCam::IpcBridge::setLogLevel(int logLevel)
     Logger::setLogLevel(logLevel);
 }
 
+int AkVCam::IpcBridge::idleTimeout() const
+{
+    return Preferences::idleTimeout();
+}
+
+void AkVCam::IpcBridge::setIdleTimeout(int timeout)
+{
+    Preferences::setIdleTimeout(timeout);
+    IdleMonitor::global()->setTimeout(timeout);
+}
+
+int AkVCam::IpcBridge::memoryBudget() const
+{
+    return Preferences::memoryBudget();
+}
+
+void AkVCam::IpcBridge::setMemoryBudget(int budget)
+{
+    Preferences::setMemoryBudget(budget);
+    MemoryAccounting::setDeviceBudget(uint64_t((std::max)(budget, 0)) << 20);
+}
+
 bool AkVCam::IpcBridge::registerPeer()
 {
     AkLogFunction();
@@ -186,8 +274,6 @@ bool AkVCam::IpcBridge::registerPeer()
         return false;
     }
 
-    this->d->m_sharedMemory.setName("Local\\" + portName + ".data");
-    this->d->m_globalMutex = Mutex(portName + ".mutex");
     this->d->m_portName = portName;
     AkLogInfo() << "Peer registered as " << portName << std::endl;
 
@@ -201,7 +287,20 @@ void AkVCam::IpcBridge::unregisterPeer()
     if (this->d->m_portName.empty())
         return;
 
-    this->d->m_sharedMemory.setName({});
+    this->d->m_channelsMutex.lock();
+
+    for (auto &channel: this->d->m_channels) {
+        if (!channel.second)
+            continue;
+
+        channel.second->writeMutex.lock();
+        channel.second->sharedMemory.close();
+        channel.second->writeMutex.unlock();
+    }
+
+    this->d->m_channels.clear();
+    this->d->m_channelsMutex.unlock();
+
     Message message;
     message.messageId = AKVCAM_ASSISTANT_MSG_REMOVE_PORT;
     message.dataSize = sizeof(MsgRemovePort);
@@ -348,7 +447,11 @@ void AkVCam::IpcBridge::setControls(const std::string &deviceId,
     if (cameraIndex < 0)
         return;
 
-    bool updated = false;
+    Message message;
+    message.messageId = AKVCAM_ASSISTANT_MSG_DEVICE_CONTROLS_UPDATED;
+    message.dataSize = sizeof(MsgControlsUpdated);
+    auto data = messageData<MsgControlsUpdated>(&message);
+    size_t changes = 0;
 
     for (auto &control: this->d->controls()) {
         auto oldValue =
@@ -362,21 +465,34 @@ void AkVCam::IpcBridge::setControls(const std::string &deviceId,
                 Preferences::cameraSetControlValue(size_t(cameraIndex),
                                                    control.id,
                                                    newValue);
-                updated = true;
+                changes++;
+
+                if (data->ncontrols < MAX_CONTROLS) {
+                    auto &msgControl = data->controls[data->ncontrols];
+                    memcpy(msgControl.id,
+                           control.id.c_str(),
+                           (std::min<size_t>)(control.id.size(),
+                                              MAX_CONTROL_ID - 1));
+                    msgControl.value = newValue;
+                    data->ncontrols++;
+                }
             }
         }
     }
 
-    if (!updated)
+    if (data->ncontrols < 1)
         return;
 
-    Message message;
-    message.messageId = AKVCAM_ASSISTANT_MSG_DEVICE_CONTROLS_UPDATED;
-    message.dataSize = sizeof(MsgControlsUpdated);
-    auto data = messageData<MsgControlsUpdated>(&message);
+    // Send all the changes as a single batch.
+    auto lastVersion = Preferences::cameraControlsVersion(size_t(cameraIndex));
+    auto version = int(controlsBatchVersion(uint64_t(lastVersion),
+                                            changes,
+                                            MAX_CONTROLS));
+    Preferences::cameraSetControlsVersion(size_t(cameraIndex), version);
     memcpy(data->device,
            deviceId.c_str(),
            (std::min<size_t>)(deviceId.size(), MAX_STRING));
+    data->version = uint64_t(version);
     this->d->m_mainServer.sendMessage(&message);
 }
 
@@ -416,6 +532,22 @@ std::vector<std::string> AkVCam::IpcBridge::listeners(const std::string &deviceI
     return listeners;
 }
 
+bool AkVCam::IpcBridge::hasListeners(const std::string &deviceId) const
+{
+    return this->d->m_listeners.hasListeners(deviceId);
+}
+
+bool AkVCam::IpcBridge::waitForListeners(const std::string &deviceId,
+                                         int timeout)
+{
+    AkLogFunction();
+
+    if (!this->d->channel(deviceId))
+        return false;
+
+    return this->d->m_listeners.waitForListeners(deviceId, timeout);
+}
+
 std::vector<uint64_t> AkVCam::IpcBridge::clientsPids() const
 {
     AkLogFunction();
@@ -588,22 +720,38 @@ bool AkVCam::IpcBridge::deviceStart(const std::string &deviceId,
 {
     UNUSED(format);
     AkLogFunction();
-    auto it = std::find(this->d->m_broadcasting.begin(),
-                        this->d->m_broadcasting.end(),
-                        deviceId);
+    auto name = IpcBridgePrivate::channelName(this->d->m_portName, deviceId);
+    auto channel = std::make_shared<DeviceChannel>();
 
-    if (it != this->d->m_broadcasting.end()) {
+    // Start from a different sequence each time so that receivers can
+    // tell apart the frames of a restarted stream.
+    channel->sequence =
+            uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+    this->d->m_channelsMutex.lock();
+
+    if (this->d->m_channels.count(deviceId)) {
+        this->d->m_channelsMutex.unlock();
         AkLogError() << '\'' << deviceId << "' is busy." << std::endl;
 
         return false;
     }
 
-    this->d->m_sharedMemory.setName("Local\\" + this->d->m_portName + ".data");
-    this->d->m_globalMutex = Mutex(this->d->m_portName + ".mutex");
+    // Reserve the device, the channel is published once it's ready.
+    this->d->m_channels[deviceId] = {};
+    auto sit = this->d->m_frameSlices.find(deviceId);
+
+    if (sit != this->d->m_frameSlices.end())
+        channel->slices = sit->second;
+
+    this->d->m_channelsMutex.unlock();
+    channel->sharedMemory.setName("Local\\" + name + ".data");
+    channel->sharedMemory.setDeviceId(deviceId);
+    channel->mutex = Mutex(name + ".mutex");
 
-    if (!this->d->m_sharedMemory.open(maxBufferSize,
-                                      SharedMemory::OpenModeWrite)) {
+    if (!channel->sharedMemory.open(maxBufferSize,
+                                    SharedMemory::OpenModeWrite)) {
         AkLogError() << "Can't open shared memory for writing." << std::endl;
+        this->d->cancelChannel(deviceId);
 
         return false;
     }
@@ -621,15 +769,44 @@ bool AkVCam::IpcBridge::deviceStart(const std::string &deviceId,
 
     if (!this->d->m_mainServer.sendMessage(&message)) {
         AkLogError() << "Error sending message." << std::endl;
-        this->d->m_sharedMemory.close();
+        channel->sharedMemory.close();
+        this->d->cancelChannel(deviceId);
 
         return false;
     }
 
-    if (!data->status)
+    if (!data->status) {
+        channel->sharedMemory.close();
+        this->d->cancelChannel(deviceId);
+
         return false;
+    }
+
+    this->d->m_channelsMutex.lock();
+    auto it = this->d->m_channels.find(deviceId);
 
-    this->d->m_broadcasting.push_back(deviceId);
+    // The peer was unregistered while starting.
+    if (it == this->d->m_channels.end() || it->second) {
+        this->d->m_channelsMutex.unlock();
+        channel->sharedMemory.close();
+
+        return false;
+    }
+
+    it->second = channel;
+    this->d->m_channelsMutex.unlock();
+
+    // From now on the listener notifications keep the list updated.
+    this->d->m_listeners.setListeners(deviceId, this->listeners(deviceId));
+    IdleMonitor::global()->add(this->d->idleId("channel", deviceId),
+                               [this, deviceId] () {
+        this->d->releaseChannel(deviceId);
+    });
+
+    auto recordingFile = autoRecordingFile(deviceId);
+
+    if (!recordingFile.empty())
+        this->setRecording(deviceId, recordingFile);
 
     return true;
 }
@@ -637,12 +814,23 @@ bool AkVCam::IpcBridge::deviceStart(const std::string &deviceId,
 void AkVCam::IpcBridge::deviceStop(const std::string &deviceId)
 {
     AkLogFunction();
-    auto it = std::find(this->d->m_broadcasting.begin(),
-                        this->d->m_broadcasting.end(),
-                        deviceId);
+    this->d->m_channelsMutex.lock();
+    auto it = this->d->m_channels.find(deviceId);
+
+    // Not started, or still starting.
+    if (it == this->d->m_channels.end() || !it->second) {
+        this->d->m_channelsMutex.unlock();
 
-    if (it == this->d->m_broadcasting.end())
         return;
+    }
+
+    auto channel = it->second;
+    this->d->m_channels.erase(it);
+    this->d->m_channelsMutex.unlock();
+    this->d->m_listeners.removeDevice(deviceId);
+    this->d->m_listeners.interrupt();
+    IdleMonitor::global()->remove(this->d->idleId("channel", deviceId));
+    this->setRecording(deviceId, {});
 
     Message message;
     message.messageId = AKVCAM_ASSISTANT_MSG_DEVICE_SETBROADCASTING;
@@ -653,62 +841,173 @@ void AkVCam::IpcBridge::deviceStop(const std::string &deviceId)
            (std::min<size_t>)(deviceId.size(), MAX_STRING));
 
     this->d->m_mainServer.sendMessage(&message);
-    this->d->m_sharedMemory.close();
-    this->d->m_broadcasting.erase(it);
+
+    // Wait for any write in progress before releasing the segment.
+    channel->writeMutex.lock();
+    channel->sharedMemory.close();
+    channel->released = false;
+    channel->writeMutex.unlock();
+
+    AkLogInfo() << "Device: " << deviceId << std::endl;
+    AkLogInfo() << "Frames written: " << channel->framesWritten << std::endl;
+    AkLogInfo() << "Frames dropped: " << channel->framesDropped << std::endl;
+    AkLogInfo() << "Frames without listeners: " << channel->framesIdle << std::endl;
 }
 
 bool AkVCam::IpcBridge::write(const std::string &deviceId,
                               const VideoFrame &frame)
 {
-    AkLogFunction();
+    AkLogFrameFunction();
 
     if (frame.format().size() < 1)
         return false;
 
-    auto buffer =
-            reinterpret_cast<Frame *>(this->d->m_sharedMemory.lock(&this->d->m_globalMutex));
+    auto channel = this->d->channel(deviceId);
+
+    if (!channel)
+        return false;
+
+    /* Record even the frames that nobody is capturing, with the sequence
+     * they are sent with, so they can be matched with the received ones.
+     */
+    auto sequence = channel->sequence++;
+    auto recording = this->d->recording(deviceId);
 
-    if (!buffer)
+    if (recording)
+        recording->write(frame, sequence);
+
+    if (!this->d->m_listeners.hasListeners(deviceId)) {
+        channel->framesIdle++;
+
+        return true;
+    }
+
+    IdleMonitor::global()->touch(this->d->idleId("channel", deviceId));
+    std::lock_guard<ProfiledMutex> writeLock(channel->writeMutex);
+
+    // Recreate the segment released while idle.
+    if (channel->released) {
+        if (!channel->sharedMemory.open(maxBufferSize,
+                                        SharedMemory::OpenModeWrite)) {
+            channel->framesDropped++;
+
+            return false;
+        }
+
+        channel->released = false;
+    }
+
+    if (!channel->sharedMemory.isOpen())
         return false;
 
+    VideoFrame scaledFrame;
+    auto sendFrame = &frame;
+
     if (size_t(frame.format().width() * frame.format().height()) > maxFrameSize) {
-        auto scaledFrame = frame.scaled(maxFrameSize);
-        buffer->format = scaledFrame.format().fourcc();
-        buffer->width = scaledFrame.format().width();
-        buffer->height = scaledFrame.format().height();
-        buffer->size = uint32_t(frame.data().size());
-        memcpy(buffer->data,
-               scaledFrame.data().data(),
-               scaledFrame.data().size());
-    } else {
-        buffer->format = frame.format().fourcc();
-        buffer->width = frame.format().width();
-        buffer->height = frame.format().height();
-        buffer->size = uint32_t(frame.data().size());
-        memcpy(buffer->data,
-               frame.data().data(),
-               frame.data().size());
+        scaledFrame = frame.scaled(maxFrameSize);
+        sendFrame = &scaledFrame;
     }
 
-    this->d->m_sharedMemory.unlock(&this->d->m_globalMutex);
+    auto format = sendFrame->format();
+    auto height = format.height();
+    int slices = (std::max)(1, (std::min)(int(channel->slices), height));
 
-    Message message;
-    message.messageId = AKVCAM_ASSISTANT_MSG_FRAME_READY;
-    message.dataSize = sizeof(MsgFrameReady);
-    auto data = messageData<MsgFrameReady>(&message);
-    memcpy(data->device,
-           deviceId.c_str(),
-           (std::min<size_t>)(deviceId.size(), MAX_STRING));
-    memcpy(data->port,
-           this->d->m_portName.c_str(),
-           (std::min<size_t>)(this->d->m_portName.size(), MAX_STRING));
+    // Keep the slices even so they don't split subsampled lines.
+    auto sliceLines = ((height + slices - 1) / slices + 1) & ~1;
+
+    for (int line = 0; line < height; line += sliceLines) {
+        auto lines = (std::min)(sliceLines, height - line);
+        auto buffer =
+                reinterpret_cast<Frame *>(channel->sharedMemory.lock(&channel->mutex));
+
+        if (!buffer) {
+            channel->framesDropped++;
+
+            return false;
+        }
+
+        if (line == 0) {
+            buffer->format = format.fourcc();
+            buffer->width = format.width();
+            buffer->height = height;
+            buffer->size = uint32_t(sendFrame->data().size());
+            buffer->sequence = sequence;
+            buffer->slices = uint32_t(slices);
+        }
+
+        if (lines == height) {
+            MemCopy::copy(buffer->data,
+                          sendFrame->data().data(),
+                          sendFrame->data().size());
+        } else {
+            for (size_t plane = 0; plane < format.planes(); plane++) {
+                size_t offset = 0;
+                size_t size = 0;
+                format.lineRange(plane, line, lines, &offset, &size);
+                MemCopy::copy(buffer->data + offset,
+                              sendFrame->data().data() + offset,
+                              size);
+            }
+        }
+
+        buffer->lines = line + lines;
+        channel->sharedMemory.unlock(&channel->mutex);
+
+        if (!this->d->sendFrameReady(deviceId))
+            return false;
+    }
+
+    channel->framesWritten++;
+
+    return true;
+}
+
+void AkVCam::IpcBridge::setFrameSlices(const std::string &deviceId,
+                                       int slices)
+{
+    AkLogFunction();
+    slices = (std::max)(1, slices);
+    std::lock_guard<ProfiledMutex> lock(this->d->m_channelsMutex);
+    this->d->m_frameSlices[deviceId] = slices;
+    auto it = this->d->m_channels.find(deviceId);
 
-    return this->d->m_mainServer.sendMessage(&message) == TRUE;
+    if (it != this->d->m_channels.end() && it->second)
+        it->second->slices = slices;
+}
+
+bool AkVCam::IpcBridge::setRecording(const std::string &deviceId,
+                                     const std::string &fileName)
+{
+    AkLogFunction();
+    RecordingWriterPtr recording;
+
+    if (!fileName.empty()) {
+        recording = std::make_shared<RecordingWriter>();
+
+        if (!recording->open(fileName))
+            return false;
+
+        AkLogInfo() << "Recording " << deviceId << " to " << fileName << std::endl;
+    }
+
+    // The previous recording is closed when the last write using it ends.
+    std::lock_guard<std::mutex> lock(this->d->m_recordingsMutex);
+
+    if (recording)
+        this->d->m_recordings[deviceId] = recording;
+    else
+        this->d->m_recordings.erase(deviceId);
+
+    return true;
 }
 
 bool AkVCam::IpcBridge::addListener(const std::string &deviceId)
 {
     AkLogFunction();
+    this->d->m_listeningMutex.lock();
+    this->d->m_listening.insert(deviceId);
+    this->d->m_listeningMutex.unlock();
+
     Message message;
     message.messageId = AKVCAM_ASSISTANT_MSG_DEVICE_LISTENER_ADD;
     message.dataSize = sizeof(MsgListeners);
@@ -729,6 +1028,10 @@ bool AkVCam::IpcBridge::addListener(const std::string &deviceId)
 bool AkVCam::IpcBridge::removeListener(const std::string &deviceId)
 {
     AkLogFunction();
+    this->d->m_listeningMutex.lock();
+    this->d->m_listening.erase(deviceId);
+    this->d->m_listeningMutex.unlock();
+
     Message message;
     message.messageId = AKVCAM_ASSISTANT_MSG_DEVICE_LISTENER_REMOVE;
     message.dataSize = sizeof(MsgListeners);
@@ -770,6 +1073,23 @@ AkVCam::IpcBridgePrivate::IpcBridgePrivate(IpcBridge *self):
 AkVCam::IpcBridgePrivate::~IpcBridgePrivate()
 {
     this->m_mainServer.stop(true);
+    std::vector<std::string> devices;
+    this->m_devicesMutex.lock();
+
+    for (auto &device: this->m_devices)
+        devices.push_back(device.first);
+
+    this->m_devicesMutex.unlock();
+
+    for (auto &deviceId: devices)
+        IdleMonitor::global()->remove(this->idleId("device", deviceId));
+
+    this->m_channelsMutex.lock();
+    auto channels = this->m_channels;
+    this->m_channelsMutex.unlock();
+
+    for (auto &channel: channels)
+        IdleMonitor::global()->remove(this->idleId("channel", channel.first));
 }
 
 const std::vector<AkVCam::DeviceControl> &AkVCam::IpcBridgePrivate::controls() const
@@ -797,6 +1117,97 @@ const std::vector<AkVCam::DeviceControl> &AkVCam::IpcBridgePrivate::controls() c
     return controls;
 }
 
+std::string AkVCam::IpcBridgePrivate::channelName(const std::string &owner,
+                                                  const std::string &deviceId)
+{
+    return owner + "." + deviceId;
+}
+
+AkVCam::DeviceChannelPtr AkVCam::IpcBridgePrivate::channel(const std::string &deviceId)
+{
+    std::lock_guard<ProfiledMutex> lock(this->m_channelsMutex);
+    auto it = this->m_channels.find(deviceId);
+
+    if (it == this->m_channels.end())
+        return {};
+
+    return it->second;
+}
+
+bool AkVCam::IpcBridgePrivate::sendFrameReady(const std::string &deviceId)
+{
+    Message message;
+    message.messageId = AKVCAM_ASSISTANT_MSG_FRAME_READY;
+    message.dataSize = sizeof(MsgFrameReady);
+    auto data = messageData<MsgFrameReady>(&message);
+    memcpy(data->device,
+           deviceId.c_str(),
+           (std::min<size_t>)(deviceId.size(), MAX_STRING));
+    memcpy(data->port,
+           this->m_portName.c_str(),
+           (std::min<size_t>)(this->m_portName.size(), MAX_STRING));
+
+    return this->m_mainServer.sendMessage(&message) == TRUE;
+}
+
+AkVCam::RecordingWriterPtr AkVCam::IpcBridgePrivate::recording(const std::string &deviceId)
+{
+    std::lock_guard<std::mutex> lock(this->m_recordingsMutex);
+    auto it = this->m_recordings.find(deviceId);
+
+    if (it == this->m_recordings.end())
+        return {};
+
+    return it->second;
+}
+
+std::string AkVCam::IpcBridgePrivate::idleId(const std::string &kind,
+                                             const std::string &deviceId) const
+{
+    std::stringstream ss;
+    ss << kind << '(' << this << "):" << deviceId;
+
+    return ss.str();
+}
+
+void AkVCam::IpcBridgePrivate::releaseChannel(const std::string &deviceId)
+{
+    auto channel = this->channel(deviceId);
+
+    if (!channel)
+        return;
+
+    std::lock_guard<ProfiledMutex> writeLock(channel->writeMutex);
+
+    if (!channel->sharedMemory.isOpen())
+        return;
+
+    channel->sharedMemory.close();
+    channel->released = true;
+}
+
+void AkVCam::IpcBridgePrivate::cancelChannel(const std::string &deviceId)
+{
+    std::lock_guard<ProfiledMutex> lock(this->m_channelsMutex);
+    auto it = this->m_channels.find(deviceId);
+
+    // Only drop the reservation made by deviceStart.
+    if (it != this->m_channels.end() && !it->second)
+        this->m_channels.erase(it);
+}
+
+void AkVCam::IpcBridgePrivate::releaseDevice(const std::string &deviceId)
+{
+    this->m_devicesMutex.lock();
+    auto it = this->m_devices.find(deviceId);
+
+    if (it != this->m_devices.end())
+        it->second.sharedMemory.close();
+
+    this->m_devicesMutex.unlock();
+    FrameCache::global()->remove(deviceId);
+}
+
 void AkVCam::IpcBridgePrivate::updateDeviceSharedProperties()
 {
     for (size_t i = 0; i < Preferences::camerasCount(); i++) {
@@ -818,15 +1229,28 @@ void AkVCam::IpcBridgePrivate::updateDeviceSharedProperties(const std::string &d
                                                             const std::string &owner)
 {
     if (owner.empty()) {
+        this->m_devicesMutex.lock();
         this->m_devices[deviceId] = {SharedMemory(), Mutex()};
+        this->m_devicesMutex.unlock();
     } else {
-        Mutex mutex(owner + ".mutex");
+        auto name = channelName(owner, deviceId);
+        Mutex mutex(name + ".mutex");
         SharedMemory sharedMemory;
-        sharedMemory.setName("Local\\" + owner + ".data");
+        sharedMemory.setName("Local\\" + name + ".data");
+        sharedMemory.setDeviceId(deviceId);
+
+        if (!sharedMemory.open())
+            return;
 
-        if (sharedMemory.open())
-            this->m_devices[deviceId] = {sharedMemory, mutex};
+        this->m_devicesMutex.lock();
+        this->m_devices[deviceId] = {sharedMemory, mutex};
+        this->m_devicesMutex.unlock();
     }
+
+    IdleMonitor::global()->add(this->idleId("device", deviceId),
+                               [this, deviceId] () {
+        this->releaseDevice(deviceId);
+    });
 }
 
 void AkVCam::IpcBridgePrivate::pipeStateChanged(void *userData,
@@ -840,6 +1264,30 @@ void AkVCam::IpcBridgePrivate::pipeStateChanged(void *userData,
         AkLogInfo() << "Server Available" << std::endl;
 
         if (self->self->registerPeer()) {
+            /* The listeners were lost with the server, announce them again,
+             * the producers receive them as listener notifications.
+             */
+            self->m_listeningMutex.lock();
+            auto listening = self->m_listening;
+            self->m_listeningMutex.unlock();
+
+            for (auto &deviceId: listening)
+                self->self->addListener(deviceId);
+
+            // And ask for the listeners of the devices still streaming.
+            std::vector<std::string> channels;
+            self->m_channelsMutex.lock();
+
+            for (auto &channel: self->m_channels)
+                if (channel.second)
+                    channels.push_back(channel.first);
+
+            self->m_channelsMutex.unlock();
+
+            for (auto &deviceId: channels)
+                self->m_listeners.setListeners(deviceId,
+                                               self->self->listeners(deviceId));
+
             AKVCAM_EMIT(self->self,
                         ServerStateChanged,
                         IpcBridge::ServerStateAvailable)
@@ -849,6 +1297,8 @@ void AkVCam::IpcBridgePrivate::pipeStateChanged(void *userData,
 
     case MessageServer::PipeStateGone:
         AkLogWarning() << "Server Gone" << std::endl;
+        self->m_listeners.clear();
+        self->m_listeners.interrupt();
         AKVCAM_EMIT(self->self,
                     ServerStateChanged,
                     IpcBridge::ServerStateGone)
@@ -867,29 +1317,110 @@ void AkVCam::IpcBridgePrivate::isAlive(Message *message)
 
 void AkVCam::IpcBridgePrivate::frameReady(Message *message)
 {
-    AkLogFunction();
+    AkLogFrameFunction();
     auto data = messageData<MsgFrameReady>(message);
     std::string deviceId(data->device);
+    std::unique_lock<ProfiledMutex> devicesLock(this->m_devicesMutex);
+    auto it = this->m_devices.find(deviceId);
 
-    if (this->m_devices.count(deviceId) < 1) {
+    if (it == this->m_devices.end()) {
+        devicesLock.unlock();
         this->updateDeviceSharedProperties(deviceId, std::string(data->port));
 
         return;
     }
 
+    auto &device = it->second;
+    IdleMonitor::global()->touch(this->idleId("device", deviceId));
+
+    // Map again the segment released while idle.
+    if (!device.sharedMemory.isOpen() && !device.sharedMemory.name().empty())
+        device.sharedMemory.open();
+
     auto frame =
-            reinterpret_cast<Frame *>(this->m_devices[deviceId]
-                                      .sharedMemory
-                                      .lock(&this->m_devices[deviceId].mutex));
+            reinterpret_cast<Frame *>(device.sharedMemory.lock(&device.mutex));
 
     if (!frame)
         return;
 
     VideoFormat videoFormat(frame->format, frame->width, frame->height);
-    VideoFrame videoFrame(videoFormat);
-    memcpy(videoFrame.data().data(), frame->data, frame->size);
-    this->m_devices[deviceId].sharedMemory.unlock(&this->m_devices[deviceId].mutex);
-    AKVCAM_EMIT(this->self, FrameReady, deviceId, videoFrame)
+
+    if (frame->slices > 1) {
+        this->sliceReady(deviceId, device, frame, devicesLock);
+
+        return;
+    }
+
+    /* The producer writes the next frame to the same segment, and the
+     * streams read this one at their own pace, so it must be copied out.
+     * Passthrough streams copy it once more, into their sample.
+     */
+    auto videoFrame = std::make_shared<VideoFrame>(videoFormat);
+    MemCopy::copy(videoFrame->data().data(),
+                  frame->data,
+                  (std::min)(size_t(frame->size), videoFrame->data().size()));
+    auto sequence = frame->sequence;
+    device.sharedMemory.unlock(&device.mutex);
+    devicesLock.unlock();
+    AKVCAM_EMIT(this->self, FrameReady, deviceId, videoFrame, sequence)
+}
+
+void AkVCam::IpcBridgePrivate::sliceReady(const std::string &deviceId,
+                                          DeviceSharedProperties &device,
+                                          const Frame *frame,
+                                          std::unique_lock<ProfiledMutex> &devicesLock)
+{
+    VideoFormat videoFormat(frame->format, frame->width, frame->height);
+    auto &sliceFrame = device.sliceFrame;
+
+    // Start a new frame, reusing the last one if nobody kept it.
+    if (!sliceFrame || frame->sequence != device.sliceSequence) {
+        if (!sliceFrame
+            || sliceFrame.use_count() > 1
+            || sliceFrame->format() != videoFormat)
+            sliceFrame = std::make_shared<VideoFrame>(videoFormat);
+
+        device.sliceSequence = frame->sequence;
+        device.sliceLines = 0;
+    }
+
+    // Copy all the slices written since the last message.
+    auto firstLine = device.sliceLines;
+    auto lines = (std::min)(int(frame->lines), frame->height) - firstLine;
+
+    if (lines < 1) {
+        device.sharedMemory.unlock(&device.mutex);
+
+        return;
+    }
+
+    for (size_t plane = 0; plane < videoFormat.planes(); plane++) {
+        size_t offset = 0;
+        size_t size = 0;
+        videoFormat.lineRange(plane, firstLine, lines, &offset, &size);
+
+        if (offset + size <= frame->size)
+            MemCopy::copy(sliceFrame->data().data() + offset,
+                          frame->data + offset,
+                          size);
+    }
+
+    device.sliceLines += lines;
+    auto sequence = frame->sequence;
+    auto videoFrame = sliceFrame;
+    bool completed = device.sliceLines >= frame->height;
+    device.sharedMemory.unlock(&device.mutex);
+    devicesLock.unlock();
+    AKVCAM_EMIT(this->self,
+                SliceReady,
+                deviceId,
+                *videoFrame,
+                sequence,
+                firstLine,
+                lines)
+
+    if (completed)
+        AKVCAM_EMIT(this->self, FrameReady, deviceId, videoFrame, sequence)
 }
 
 void AkVCam::IpcBridgePrivate::pictureUpdated(Message *message)
@@ -916,6 +1447,7 @@ void AkVCam::IpcBridgePrivate::listenerAdd(Message *message)
 {
     AkLogFunction();
     auto data = messageData<MsgListeners>(message);
+    this->m_listeners.addListener(data->device, data->listener);
     AKVCAM_EMIT(this->self,
                 ListenerAdded,
                 std::string(data->device),
@@ -926,6 +1458,7 @@ void AkVCam::IpcBridgePrivate::listenerRemove(Message *message)
 {
     AkLogFunction();
     auto data = messageData<MsgListeners>(message);
+    this->m_listeners.removeListener(data->device, data->listener);
     AKVCAM_EMIT(this->self,
                 ListenerRemoved,
                 std::string(data->device),
@@ -947,16 +1480,35 @@ void AkVCam::IpcBridgePrivate::controlsUpdated(Message *message)
     AkLogFunction();
     auto data = messageData<MsgControlsUpdated>(message);
     std::string deviceId(data->device);
-    auto cameraIndex = Preferences::cameraFromPath(deviceId);
+    auto &state = this->m_deviceControls[deviceId];
 
-    if (cameraIndex < 0)
-        return;
+    if (isControlsBatchDiff(state.version, data->version)) {
+        auto ncontrols = (std::min<uint32_t>)(data->ncontrols, MAX_CONTROLS);
+
+        for (uint32_t i = 0; i < ncontrols; i++) {
+            auto &control = data->controls[i];
+            std::string id(control.id,
+                           strnlen(control.id, MAX_CONTROL_ID));
+            state.values[id] = control.value;
+        }
+    } else {
+        // First or missed batch, read all the controls again.
+        auto cameraIndex = Preferences::cameraFromPath(deviceId);
 
-    std::map<std::string, int> controls;
+        if (cameraIndex < 0) {
+            this->m_deviceControls.erase(deviceId);
 
-    for (auto &control: this->controls())
-        controls[control.id] =
-                Preferences::cameraControlValue(size_t(cameraIndex), control.id);
+            return;
+        }
+
+        state.values.clear();
+
+        for (auto &control: this->controls())
+            state.values[control.id] =
+                    Preferences::cameraControlValue(size_t(cameraIndex),
+                                                    control.id);
+    }
 
-    AKVCAM_EMIT(this->self, ControlsChanged, deviceId, controls)
+    state.version = data->version;
+    AKVCAM_EMIT(this->self, ControlsChanged, deviceId, state.values)
 }
@@ -75,7 +75,14 @@ namespace AkVCam
                                            IpcBridge::ServerState state);
             static void frameReady(void *userData,
                                    const std::string &deviceId,
-                                   const VideoFrame &frame);
+                                   const VideoFramePtr &frame,
+                                   uint64_t sequence);
+            static void sliceReady(void *userData,
+                                   const std::string &deviceId,
+                                   const VideoFrame &frame,
+                                   uint64_t sequence,
+                                   int firstLine,
+                                   int lines);
             static void pictureChanged(void *userData,
                                        const std::string &picture);
             static void devicesChanged(void *userData,
@@ -367,6 +374,8 @@ AkVCam::BaseFilterPrivate::BaseFilterPrivate(AkVCam::BaseFilter *self,
                                             &BaseFilterPrivate::devicesChanged);
     this->m_ipcBridge.connectFrameReady(this,
                                         &BaseFilterPrivate::frameReady);
+    this->m_ipcBridge.connectSliceReady(this,
+                                        &BaseFilterPrivate::sliceReady);
     this->m_ipcBridge.connectPictureChanged(this,
                                             &BaseFilterPrivate::pictureChanged);
     this->m_ipcBridge.connectBroadcastingChanged(this,
@@ -448,11 +457,31 @@ void AkVCam::BaseFilterPrivate::serverStateChanged(void *userData,
 
 void AkVCam::BaseFilterPrivate::frameReady(void *userData,
                                            const std::string &deviceId,
-                                           const VideoFrame &frame)
+                                           const VideoFramePtr &frame,
+                                           uint64_t sequence)
 {
-    AkLogFunction();
+    AkLogFrameFunction();
+    auto self = reinterpret_cast<BaseFilterPrivate *>(userData);
+    AkVCamDevicePinCall(deviceId, self, frameReady, deviceId, frame, sequence)
+}
+
+void AkVCam::BaseFilterPrivate::sliceReady(void *userData,
+                                           const std::string &deviceId,
+                                           const VideoFrame &frame,
+                                           uint64_t sequence,
+                                           int firstLine,
+                                           int lines)
+{
+    AkLogFrameFunction();
     auto self = reinterpret_cast<BaseFilterPrivate *>(userData);
-    AkVCamDevicePinCall(deviceId, self, frameReady, frame)
+    AkVCamDevicePinCall(deviceId,
+                        self,
+                        sliceReady,
+                        deviceId,
+                        frame,
+                        sequence,
+                        firstLine,
+                        lines)
 }
 
 void AkVCam::BaseFilterPrivate::pictureChanged(void *userData,
@@ -21,6 +21,7 @@
 
 #include "mediasample.h"
 #include "PlatformUtils/src/utils.h"
+#include "VCamUtils/src/memoryaccounting.h"
 #include "VCamUtils/src/utils.h"
 
 namespace AkVCam
@@ -30,6 +31,7 @@ namespace AkVCam
         public:
             IMemAllocator *m_memAllocator {nullptr};
             BYTE *m_buffer {nullptr};
+            size_t m_realSize {0};
             LONG m_bufferSize {0};
             LONG m_dataLength {0};
             LONG m_prefix {0};
@@ -58,12 +60,15 @@ AkVCam::MediaSample::MediaSample(IMemAllocator *memAllocator,
     this->d->m_prefix = prefix;
     auto realSize = size_t(bufferSize + prefix + align - 1) & ~size_t(align - 1);
     this->d->m_buffer = new BYTE[realSize];
+    this->d->m_realSize = realSize;
     memset(this->d->m_buffer, 0, realSize * sizeof(BYTE));
+    MemoryAccounting::allocated(MemoryCategoryPools, realSize);
 }
 
 AkVCam::MediaSample::~MediaSample()
 {
     delete [] this->d->m_buffer;
+    MemoryAccounting::released(MemoryCategoryPools, this->d->m_realSize);
     deleteMediaType(&this->d->m_mediaType);
     delete this->d;
 }
@@ -71,7 +76,10 @@ AkVCam::MediaSample::~MediaSample()
 ULONG AkVCam::MediaSample::Release()
 {
     auto result = CUnknown::Release();
-    this->d->m_memAllocator->ReleaseBuffer(this);
+
+    // Only the allocator holds the sample, give it back.
+    if (result == 1)
+        this->d->m_memAllocator->ReleaseBuffer(this);
 
     if (!result)
         delete this;
@@ -17,7 +17,7 @@
  * Web-Site: http://webcamoid.github.io/
  */
 
-#include <condition_variable>
+#include <atomic>
 #include <mutex>
 #include <vector>
 #include <dshow.h>
@@ -26,6 +26,7 @@
 #include "mediasample.h"
 #include "PlatformUtils/src/utils.h"
 #include "VCamUtils/src/image/videoformat.h"
+#include "VCamUtils/src/pool.h"
 #include "VCamUtils/src/utils.h"
 
 namespace AkVCam
@@ -33,12 +34,16 @@ namespace AkVCam
     class MemAllocatorPrivate
     {
         public:
-            std::vector<MediaSample *> m_samples;
+            Pool<MediaSample *> m_samples {"mediasample"};
             ALLOCATOR_PROPERTIES m_properties;
             std::mutex m_mutex;
-            std::condition_variable_any m_bufferReleased;
-            bool m_commited {false};
-            bool m_decommiting {false};
+            std::atomic<bool> m_commited {false};
+            std::atomic<bool> m_decommiting {false};
+
+            // Threads inside GetBuffer, the samples are kept until they leave.
+            int m_acquiring {0};
+
+            void finishDecommit();
     };
 }
 
@@ -51,7 +56,7 @@ AkVCam::MemAllocator::MemAllocator():
 
 AkVCam::MemAllocator::~MemAllocator()
 {
-    for (auto &sample: this->d->m_samples)
+    for (auto &sample: this->d->m_samples.items())
         sample->Release();
 
     delete this->d;
@@ -71,9 +76,8 @@ HRESULT AkVCam::MemAllocator::SetProperties(ALLOCATOR_PROPERTIES *pRequest,
     if (pRequest->cbAlign < 1)
         return VFW_E_BADALIGN;
 
-    for (auto &sample:this->d->m_samples)
-        if (sample->ref() > 1)
-            return VFW_E_BUFFERS_OUTSTANDING;
+    if (this->d->m_samples.used() > 0)
+        return VFW_E_BUFFERS_OUTSTANDING;
 
     memcpy(&this->d->m_properties, pRequest, sizeof(ALLOCATOR_PROPERTIES));
     memcpy(pActual, &this->d->m_properties, sizeof(ALLOCATOR_PROPERTIES));
@@ -97,9 +101,17 @@ HRESULT AkVCam::MemAllocator::GetProperties(ALLOCATOR_PROPERTIES *pProps)
 HRESULT AkVCam::MemAllocator::Commit()
 {
     AkLogFunction();
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
+
+    if (this->d->m_commited) {
+        // Samples are still outstanding, keep using them.
+        if (this->d->m_decommiting) {
+            this->d->m_samples.resume();
+            this->d->m_decommiting = false;
+        }
 
-    if (this->d->m_commited)
         return S_OK;
+    }
 
     if (this->d->m_properties.cBuffers < 1
         || this->d->m_properties.cbBuffer < 1) {
@@ -108,7 +120,7 @@ HRESULT AkVCam::MemAllocator::Commit()
         return VFW_E_SIZENOTSET;
     }
 
-    this->d->m_samples.clear();
+    std::vector<MediaSample *> samples;
 
     for (LONG i = 0; i < this->d->m_properties.cBuffers; i++) {
         auto sample =
@@ -117,7 +129,16 @@ HRESULT AkVCam::MemAllocator::Commit()
                                 this->d->m_properties.cbAlign,
                                 this->d->m_properties.cbPrefix);
         sample->AddRef();
-        this->d->m_samples.push_back(sample);
+        samples.push_back(sample);
+    }
+
+    if (!this->d->m_samples.setItems(samples)) {
+        AkLogError() << "Samples of the last commit still in use" << std::endl;
+
+        for (auto &sample: samples)
+            sample->Release();
+
+        return VFW_E_BUFFERS_OUTSTANDING;
     }
 
     this->d->m_commited = true;
@@ -128,37 +149,23 @@ HRESULT AkVCam::MemAllocator::Commit()
 HRESULT AkVCam::MemAllocator::Decommit()
 {
     AkLogFunction();
+    std::lock_guard<std::mutex> lock(this->d->m_mutex);
 
     if (!this->d->m_commited)
         return S_OK;
 
+    // Wake up the threads waiting in GetBuffer.
     this->d->m_decommiting = true;
-    auto totalSamples = this->d->m_samples.size();
-    size_t freeSamples = 0;
-
-    for (size_t i = 0; i < totalSamples; i++)
-        if (this->d->m_samples[i]) {
-            if (this->d->m_samples[i]->ref() < 2) {
-                this->d->m_samples[i]->Release();
-                this->d->m_samples[i] = nullptr;
-                freeSamples++;
-            }
-        } else {
-            freeSamples++;
-        }
+    this->d->m_samples.cancel();
 
     AkLogInfo() << "Free samples: "
-                << freeSamples
+                << this->d->m_samples.available()
                 << "/"
-                << totalSamples
+                << this->d->m_samples.size()
                 << std::endl;
 
-    if (freeSamples >= totalSamples) {
-        AkLogInfo() << "Decommiting" << std::endl;
-        this->d->m_samples.clear();
-        this->d->m_commited = false;
-        this->d->m_decommiting = false;
-    }
+    // Otherwise, the last sample returned will finish it.
+    this->d->finishDecommit();
 
     return S_OK;
 }
@@ -168,7 +175,7 @@ HRESULT AkVCam::MemAllocator::GetBuffer(IMediaSample **ppBuffer,
                                         REFERENCE_TIME *pEndTime,
                                         DWORD dwFlags)
 {
-    AkLogFunction();
+    AkLogFrameFunction();
 
     if (!ppBuffer)
         return E_POINTER;
@@ -181,49 +188,71 @@ HRESULT AkVCam::MemAllocator::GetBuffer(IMediaSample **ppBuffer,
     if (pEndTime)
         *pEndTime = 0;
 
+    std::unique_lock<std::mutex> lock(this->d->m_mutex);
+
     if (!this->d->m_commited || this->d->m_decommiting) {
         AkLogError() << "Allocator not commited." << std::endl;
 
         return VFW_E_NOT_COMMITTED;
     }
 
-    HRESULT result = S_FALSE;
+    // Decommit() can't free the samples until this call leaves.
+    this->d->m_acquiring++;
+    lock.unlock();
 
-    do {
-        for (auto &sample: this->d->m_samples) {
-            if (sample->ref() < 2) {
-                *ppBuffer = sample;
-                (*ppBuffer)->AddRef();
-                (*ppBuffer)->GetTime(pStartTime, pEndTime);
-                result = S_OK;
+    MediaSample *sample = nullptr;
+    auto acquired =
+            this->d->m_samples.acquire(&sample,
+                                       dwFlags & AM_GBF_NOWAIT? 0: -1);
 
-                break;
-            }
-        }
+    lock.lock();
+    this->d->m_acquiring--;
 
-        this->d->m_mutex.lock();
+    if (!acquired) {
+        auto decommited = !this->d->m_commited || this->d->m_decommiting;
+        this->d->finishDecommit();
 
-        if (result == S_FALSE) {
-            if (dwFlags & AM_GBF_NOWAIT)
-                result = VFW_E_TIMEOUT;
-            else
-                this->d->m_bufferReleased.wait(this->d->m_mutex);
-        }
+        return decommited? VFW_E_NOT_COMMITTED: VFW_E_TIMEOUT;
+    }
 
-        this->d->m_mutex.unlock();
-    } while (result == S_FALSE);
+    sample->AddRef();
+    sample->GetTime(pStartTime, pEndTime);
+    *ppBuffer = sample;
 
-    return result;
+    return S_OK;
 }
 
 HRESULT AkVCam::MemAllocator::ReleaseBuffer(IMediaSample *pBuffer)
 {
-    UNUSED(pBuffer);
-    AkLogFunction();
+    AkLogFrameFunction();
+
+    if (!pBuffer)
+        return E_POINTER;
+
+    this->d->m_samples.release(static_cast<MediaSample *>(pBuffer));
 
-    this->d->m_mutex.lock();
-    this->d->m_bufferReleased.notify_one();
-    this->d->m_mutex.unlock();
+    if (this->d->m_decommiting) {
+        std::lock_guard<std::mutex> lock(this->d->m_mutex);
+        this->d->finishDecommit();
+    }
 
     return S_OK;
 }
+
+// Must be called with m_mutex locked.
+void AkVCam::MemAllocatorPrivate::finishDecommit()
+{
+    if (!this->m_decommiting
+        || this->m_acquiring > 0
+        || this->m_samples.available() < this->m_samples.size())
+        return;
+
+    AkLogInfo() << "Decommiting" << std::endl;
+
+    for (auto &sample: this->m_samples.items())
+        sample->Release();
+
+    this->m_samples.setItems({});
+    this->m_commited = false;
+    this->m_decommiting = false;
+}
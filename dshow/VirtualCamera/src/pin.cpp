@@ -18,13 +18,10 @@
  */
 
 #include <algorithm>
-#include <atomic>
 #include <functional>
 #include <limits>
 #include <mutex>
-#include <random>
 #include <sstream>
-#include <thread>
 #include <dshow.h>
 
 #include "pin.h"
@@ -40,6 +37,10 @@
 #include "PlatformUtils/src/utils.h"
 #include "VCamUtils/src/image/videoformat.h"
 #include "VCamUtils/src/image/videoframe.h"
+#include "VCamUtils/src/memcopy.h"
+#include "VCamUtils/src/profiledmutex.h"
+#include "VCamUtils/src/queuecontroller.h"
+#include "VCamUtils/src/streamengine.h"
 #include "VCamUtils/src/utils.h"
 
 namespace AkVCam
@@ -56,22 +57,12 @@ namespace AkVCam
             IPin *m_connectedTo {nullptr};
             IMemInputPin *m_memInputPin {nullptr};
             IMemAllocator *m_memAllocator {nullptr};
-            REFERENCE_TIME m_pts {-1};
-            REFERENCE_TIME m_ptsDrift {0};
             REFERENCE_TIME m_start {0};
             REFERENCE_TIME m_stop {MAXLONGLONG};
             double m_rate {1.0};
             FILTER_STATE m_prevState = State_Stopped;
-            DWORD_PTR m_adviseCookie {0};
-            HANDLE m_sendFrameEvent {nullptr};
-            std::thread m_sendFrameThread;
-            std::atomic<bool> m_running {false};
-            std::mutex m_mutex;
-            std::mutex m_controlsMutex;
-            VideoFrame m_currentFrame;
-            VideoFrame m_testFrame;
-            VideoFrame m_testFrameAdapted;
-            std::string m_broadcaster;
+            StreamEngine m_engine;
+            ProfiledMutex m_controlsMutex {"pin_controls"};
             bool m_horizontalFlip {false};   // Controlled by client
             bool m_verticalFlip {false};
             std::map<std::string, int> m_controls;
@@ -82,16 +73,14 @@ namespace AkVCam
             LONG m_hue {0};
             LONG m_colorenable {0};
 
-            void sendFrameOneShot();
-            void sendFrameLoop();
-            HRESULT sendFrame();
-            void updateTestFrame();
-            VideoFrame applyAdjusts(const VideoFrame &frame);
+            int64_t clock();
+            HRESULT sendFrame(const VideoFrame &frame,
+                              const FrameTiming &timing);
+            void updateAdjusts();
             static void propertyChanged(void *userData,
                                         LONG Property,
                                         LONG lValue,
                                         LONG Flags);
-            VideoFrame randomFrame();
     };
 }
 
@@ -114,7 +103,17 @@ AkVCam::Pin::Pin(BaseFilter *baseFilter,
     auto picture = Preferences::picture();
 
     if (!picture.empty())
-        this->d->m_testFrame = loadPicture(picture);
+        this->d->m_engine.setPictureLoader([picture] () {
+            return loadPicture(picture);
+        });
+
+    this->d->m_engine.setClock([this] () {
+        return this->d->clock();
+    });
+    this->d->m_engine.setSendFunc([this] (const VideoFrame &frame,
+                                          const FrameTiming &timing) {
+        return SUCCEEDED(this->d->sendFrame(frame, timing));
+    });
 
     baseFilter->QueryInterface(IID_IAMVideoProcAmp,
                                reinterpret_cast<void **>(&this->d->m_videoProcAmp));
@@ -144,6 +143,7 @@ AkVCam::Pin::Pin(BaseFilter *baseFilter,
 
 AkVCam::Pin::~Pin()
 {
+    this->d->m_engine.stop();
     this->d->m_mediaTypes->Release();
 
     if (this->d->m_connectedTo)
@@ -188,47 +188,11 @@ HRESULT AkVCam::Pin::stateChanged(void *userData, FILTER_STATE state)
         if (FAILED(self->d->m_memAllocator->Commit()))
             return VFW_E_NOT_COMMITTED;
 
-        self->d->updateTestFrame();
-        self->d->m_currentFrame = self->d->m_testFrameAdapted;
-        self->d->m_pts = -1;
-        self->d->m_ptsDrift = 0;
-
-        self->d->m_sendFrameEvent =
-                CreateSemaphore(nullptr, 1, 1, L"SendFrame");
-
-        self->d->m_running = true;
-        self->d->m_sendFrameThread =
-                std::thread(&PinPrivate::sendFrameLoop, self->d);
-        AkLogInfo() << "Launching thread "
-                    << self->d->m_sendFrameThread.get_id()
-                    << std::endl;
-
-        auto clock = self->d->m_baseFilter->referenceClock();
-        REFERENCE_TIME now = 0;
-        clock->GetTime(&now);
-
-        AM_MEDIA_TYPE *mediaType = nullptr;
-        self->GetFormat(&mediaType);
-        auto videoFormat = formatFromMediaType(mediaType);
-        deleteMediaType(&mediaType);
-        auto fps = videoFormat.minimumFrameRate();
-        auto period = REFERENCE_TIME(TIME_BASE / fps.value());
-
-        clock->AdvisePeriodic(now,
-                              period,
-                              HSEMAPHORE(self->d->m_sendFrameEvent),
-                              &self->d->m_adviseCookie);
+        self->d->updateAdjusts();
+        self->d->m_engine.start();
     } else if (state == State_Stopped) {
-        self->d->m_running = false;
-        self->d->m_sendFrameThread.join();
-        auto clock = self->d->m_baseFilter->referenceClock();
-        clock->Unadvise(self->d->m_adviseCookie);
-        self->d->m_adviseCookie = 0;
-        CloseHandle(self->d->m_sendFrameEvent);
-        self->d->m_sendFrameEvent = nullptr;
+        self->d->m_engine.stop();
         self->d->m_memAllocator->Decommit();
-        self->d->m_currentFrame.clear();
-        self->d->m_testFrameAdapted.clear();
     }
 
     self->d->m_prevState = state;
@@ -241,68 +205,51 @@ void AkVCam::Pin::serverStateChanged(IpcBridge::ServerState state)
     AkLogFunction();
 
     if (state == IpcBridge::ServerStateGone) {
-        this->d->m_broadcaster.clear();
+        this->d->m_engine.setBroadcaster({});
         this->d->m_controlsMutex.lock();
         this->d->m_controls = {};
         this->d->m_controlsMutex.unlock();
-        this->d->updateTestFrame();
-
-        this->d->m_mutex.lock();
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
-        this->d->m_mutex.unlock();
+        this->d->updateAdjusts();
     }
 }
 
-void AkVCam::Pin::frameReady(const VideoFrame &frame)
+void AkVCam::Pin::frameReady(const std::string &deviceId,
+                             const VideoFramePtr &frame,
+                             uint64_t sequence)
 {
-    AkLogFunction();
-    AkLogInfo() << "Running: " << this->d->m_running << std::endl;
-    AkLogInfo() << "Broadcaster: " << this->d->m_broadcaster << std::endl;
-
-    if (!this->d->m_running)
-        return;
-
-    this->d->m_mutex.lock();
-
-    if (!this->d->m_broadcaster.empty()) {
-        auto frameAdjusted = this->d->applyAdjusts(frame);
-
-        if (frameAdjusted.format().size() > 0)
-            this->d->m_currentFrame = frameAdjusted;
-    }
+    AkLogFrameFunction();
+    AkLogFrameInfo() << "Running: " << this->d->m_engine.isRunning() << std::endl;
+    AkLogFrameInfo() << "Broadcaster: " << this->d->m_engine.broadcaster() << std::endl;
+    this->d->m_engine.frameReady(deviceId, frame, sequence);
+}
 
-    this->d->m_mutex.unlock();
+void AkVCam::Pin::sliceReady(const std::string &deviceId,
+                             const VideoFrame &frame,
+                             uint64_t sequence,
+                             int firstLine,
+                             int lines)
+{
+    AkLogFrameFunction();
+    this->d->m_engine.sliceReady(deviceId, frame, sequence, firstLine, lines);
 }
 
 void AkVCam::Pin::setPicture(const std::string &picture)
 {
     AkLogFunction();
     AkLogDebug() << "Picture: " << picture;
-    this->d->m_testFrame = loadPicture(picture);
-    this->d->updateTestFrame();
-    this->d->m_mutex.lock();
 
-    if (this->d->m_broadcaster.empty())
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
-
-    this->d->m_mutex.unlock();
+    if (picture.empty())
+        this->d->m_engine.setPicture({});
+    else
+        this->d->m_engine.setPictureLoader([picture] () {
+            return loadPicture(picture);
+        });
 }
 
 void AkVCam::Pin::setBroadcasting(const std::string &broadcaster)
 {
     AkLogFunction();
-    AkLogInfo() << "Broadcaster: " << broadcaster << std::endl;
-
-    if (this->d->m_broadcaster == broadcaster)
-        return;
-
-    this->d->m_mutex.lock();
-    this->d->m_broadcaster = broadcaster;
-
-    if (broadcaster.empty())
-        this->d->m_currentFrame = this->d->m_testFrameAdapted;
-
-    this->d->m_mutex.unlock();
+    this->d->m_engine.setBroadcaster(broadcaster);
 }
 
 void AkVCam::Pin::setControls(const std::map<std::string, int> &controls)
@@ -318,7 +265,7 @@ void AkVCam::Pin::setControls(const std::map<std::string, int> &controls)
 
     this->d->m_controls = controls;
     this->d->m_controlsMutex.unlock();
-    this->d->updateTestFrame();
+    this->d->updateAdjusts();
 }
 
 bool AkVCam::Pin::horizontalFlip() const
@@ -329,6 +276,7 @@ bool AkVCam::Pin::horizontalFlip() const
 void AkVCam::Pin::setHorizontalFlip(bool flip)
 {
     this->d->m_horizontalFlip = flip;
+    this->d->updateAdjusts();
 }
 
 bool AkVCam::Pin::verticalFlip() const
@@ -339,6 +287,7 @@ bool AkVCam::Pin::verticalFlip() const
 void AkVCam::Pin::setVerticalFlip(bool flip)
 {
     this->d->m_verticalFlip = flip;
+    this->d->updateAdjusts();
 }
 
 HRESULT AkVCam::Pin::QueryInterface(const IID &riid, void **ppvObject)
@@ -516,8 +465,9 @@ HRESULT AkVCam::Pin::Connect(IPin *pReceivePin, const AM_MEDIA_TYPE *pmt)
     memInputPin->GetAllocatorRequirements(&allocatorRequirements);
     auto videoFormat = formatFromMediaType(mediaType);
 
+    // Enough samples for a consumer reading in bursts, not more.
     if (allocatorRequirements.cBuffers < 1)
-        allocatorRequirements.cBuffers = 1;
+        allocatorRequirements.cBuffers = AKVCAM_QUEUE_MAX_DEPTH;
 
     allocatorRequirements.cbBuffer = LONG(videoFormat.size());
 
@@ -785,48 +735,19 @@ HRESULT AkVCam::Pin::NewSegment(REFERENCE_TIME tStart,
     return S_OK;
 }
 
-void AkVCam::PinPrivate::sendFrameOneShot()
+int64_t AkVCam::PinPrivate::clock()
 {
-    AkLogFunction();
-
-    WaitForSingleObject(this->m_sendFrameEvent, INFINITE);
-    this->sendFrame();
-    AkLogInfo() << "Thread "
-                << std::this_thread::get_id()
-                << " finnished"
-                << std::endl;
-    this->m_running = false;
-}
-
-void AkVCam::PinPrivate::sendFrameLoop()
-{
-    AkLogFunction();
-
-    while (this->m_running) {
-        WaitForSingleObject(this->m_sendFrameEvent, INFINITE);
-        auto result = this->sendFrame();
-
-        if (FAILED(result)) {
-            AkLogError() << "Error sending frame: "
-                         << result
-                         << ": "
-                         << stringFromResult(result)
-                         << std::endl;
-            this->m_running = false;
-
-            break;
-        }
-    }
+    REFERENCE_TIME clock = 0;
+    this->m_baseFilter->referenceClock()->GetTime(&clock);
 
-    AkLogInfo() << "Thread "
-                << std::this_thread::get_id()
-                << " finnished"
-                << std::endl;
+    // Reference times are in 100 ns units.
+    return 100 * int64_t(clock);
 }
 
-HRESULT AkVCam::PinPrivate::sendFrame()
+HRESULT AkVCam::PinPrivate::sendFrame(const VideoFrame &frame,
+                                      const FrameTiming &timing)
 {
-    AkLogFunction();
+    AkLogFrameFunction();
     IMediaSample *sample = nullptr;
 
     if (FAILED(this->m_memAllocator->GetBuffer(&sample,
@@ -845,93 +766,49 @@ HRESULT AkVCam::PinPrivate::sendFrame()
         return E_FAIL;
     }
 
-    this->m_mutex.lock();
+    auto copyBytes = (std::min)(size_t(size), frame.data().size());
 
-    if (this->m_currentFrame.format().size() > 0) {
-        auto copyBytes = (std::min)(size_t(size),
-                                    this->m_currentFrame.data().size());
+    if (copyBytes > 0)
+        MemCopy::copy(buffer, frame.data().data(), copyBytes);
 
-        if (copyBytes > 0)
-            memcpy(buffer, this->m_currentFrame.data().data(), copyBytes);
-    } else {
-        auto frame = this->randomFrame();
-        auto copyBytes = (std::min)(size_t(size),
-                                    frame.data().size());
-
-        if (copyBytes > 0)
-            memcpy(buffer, frame.data().data(), copyBytes);
-    }
-
-    this->m_mutex.unlock();
-
-    REFERENCE_TIME clock = 0;
-    this->m_baseFilter->referenceClock()->GetTime(&clock);
-
-    AM_MEDIA_TYPE *mediaType = nullptr;
-    self->GetFormat(&mediaType);
-    auto format = formatFromMediaType(mediaType);
-    deleteMediaType(&mediaType);
-    auto fps = format.minimumFrameRate();
-    auto duration = REFERENCE_TIME(TIME_BASE / fps.value());
-
-    if (this->m_pts < 0) {
-        this->m_pts = 0;
-        this->m_ptsDrift = this->m_pts - clock;
-    } else {
-        auto diff = clock - this->m_pts + this->m_ptsDrift;
-
-        if (diff <= 2 * duration) {
-            this->m_pts = clock + this->m_ptsDrift;
-        } else {
-            this->m_pts += duration;
-            this->m_ptsDrift = this->m_pts - clock;
-        }
-    }
-
-    auto startTime = this->m_pts;
-    auto endTime = startTime + duration;
+    auto startTime = REFERENCE_TIME(timing.pts / 100);
+    auto endTime = startTime + REFERENCE_TIME(timing.duration / 100);
 
     sample->SetTime(&startTime, &endTime);
     sample->SetMediaTime(&startTime, &endTime);
     sample->SetActualDataLength(size);
-    sample->SetDiscontinuity(false);
+    sample->SetDiscontinuity(timing.discontinuity);
     sample->SetSyncPoint(true);
     sample->SetPreroll(false);
-    AkLogInfo() << "Sending " << stringFromMediaSample(sample) << std::endl;
+    AkLogFrameInfo() << "Sending " << stringFromMediaSample(sample) << std::endl;
     auto result = this->m_memInputPin->Receive(sample);
-    AkLogInfo() << "Frame sent" << std::endl;
+    AkLogFrameInfo() << "Frame sent" << std::endl;
     sample->Release();
 
-    return result;
-}
+    if (FAILED(result))
+        AkLogError() << "Error sending frame: "
+                     << result
+                     << ": "
+                     << stringFromResult(result)
+                     << std::endl;
 
-void AkVCam::PinPrivate::updateTestFrame()
-{
-    auto frame = this->applyAdjusts(this->m_testFrame);
-
-    if (frame.format().size() < 1)
-        return;
-
-    this->m_testFrameAdapted = frame;
+    return result;
 }
 
-AkVCam::VideoFrame AkVCam::PinPrivate::applyAdjusts(const VideoFrame &frame)
+void AkVCam::PinPrivate::updateAdjusts()
 {
     AM_MEDIA_TYPE *mediaType = nullptr;
 
     if (FAILED(this->self->GetFormat(&mediaType)))
-        return {};
+        return;
 
     auto format = formatFromMediaType(mediaType);
     deleteMediaType(&mediaType);
-    FourCC fourcc = format.fourcc();
-    int width = format.width();
-    int height = format.height();
 
     /* In Windows red and blue channels are swapped, so hack it with the
      * opposite format. Endianness problem maybe?
      */
-    std::map<FourCC, FourCC> fixFormat {
+    static const std::map<FourCC, FourCC> fixFormat {
         {PixelFormatRGB32, PixelFormatBGR32},
         {PixelFormatRGB24, PixelFormatBGR24},
         {PixelFormatRGB16, PixelFormatBGR16},
@@ -940,9 +817,7 @@ AkVCam::VideoFrame AkVCam::PinPrivate::applyAdjusts(const VideoFrame &frame)
 
     bool horizontalMirror = false;
     bool verticalMirror = false;
-    Scaling scaling = ScalingFast;
-    AspectRatio aspectRatio = AspectRatioIgnore;
-    bool swapRgb = false;
+    StreamAdjusts adjusts;
     this->m_controlsMutex.lock();
 
     if (this->m_controls.count("hflip") > 0)
@@ -952,60 +827,33 @@ AkVCam::VideoFrame AkVCam::PinPrivate::applyAdjusts(const VideoFrame &frame)
         verticalMirror = this->m_controls["vflip"];
 
     if (this->m_controls.count("scaling") > 0)
-        scaling = Scaling(this->m_controls["scaling"]);
+        adjusts.scaling = Scaling(this->m_controls["scaling"]);
 
     if (this->m_controls.count("aspect_ratio") > 0)
-        aspectRatio = AspectRatio(this->m_controls["aspect_ratio"]);
+        adjusts.aspectRatio = AspectRatio(this->m_controls["aspect_ratio"]);
 
     if (this->m_controls.count("swap_rgb") > 0)
-        swapRgb = this->m_controls["swap_rgb"];
+        adjusts.swapRgb = this->m_controls["swap_rgb"];
 
     this->m_controlsMutex.unlock();
-    bool vmirror;
-
-    if (fixFormat.count(fourcc) > 0) {
-        fourcc = fixFormat[fourcc];
-        vmirror = verticalMirror == this->m_verticalFlip;
-    } else {
-        vmirror = verticalMirror != this->m_verticalFlip;
-    }
+    adjusts.horizontalMirror = horizontalMirror != this->m_horizontalFlip;
+    auto it = fixFormat.find(format.fourcc());
 
-    VideoFrame newFrame;
-
-    if (width * height > frame.format().width() * frame.format().height()) {
-        newFrame =
-                frame
-                .mirror(horizontalMirror != this->m_horizontalFlip,
-                        vmirror)
-                .swapRgb(swapRgb)
-                .adjust(this->m_hue,
-                        this->m_saturation,
-                        this->m_brightness,
-                        this->m_gamma,
-                        this->m_contrast,
-                        !this->m_colorenable)
-                .scaled(width, height, scaling, aspectRatio)
-                .convert(fourcc);
+    if (it != fixFormat.end()) {
+        format.fourcc() = it->second;
+        adjusts.verticalMirror = verticalMirror == this->m_verticalFlip;
     } else {
-        newFrame =
-                frame
-                .scaled(width, height, scaling, aspectRatio)
-                .mirror(horizontalMirror != this->m_horizontalFlip,
-                        vmirror)
-                .swapRgb(swapRgb)
-                .adjust(this->m_hue,
-                        this->m_saturation,
-                        this->m_brightness,
-                        this->m_gamma,
-                        this->m_contrast,
-                        !this->m_colorenable)
-                .convert(fourcc);
-
+        adjusts.verticalMirror = verticalMirror != this->m_verticalFlip;
     }
 
-    newFrame.format().fourcc() = format.fourcc();
-
-    return newFrame;
+    adjusts.hue = this->m_hue;
+    adjusts.saturation = this->m_saturation;
+    adjusts.luminance = this->m_brightness;
+    adjusts.gamma = this->m_gamma;
+    adjusts.contrast = this->m_contrast;
+    adjusts.gray = !this->m_colorenable;
+    this->m_engine.setFormat(format);
+    this->m_engine.setAdjusts(adjusts);
 }
 
 void AkVCam::PinPrivate::propertyChanged(void *userData,
@@ -1051,39 +899,5 @@ void AkVCam::PinPrivate::propertyChanged(void *userData,
         break;
     }
 
-    self->updateTestFrame();
-    self->m_mutex.lock();
-    self->m_currentFrame = self->m_testFrameAdapted;
-    self->m_mutex.unlock();
-}
-
-AkVCam::VideoFrame AkVCam::PinPrivate::randomFrame()
-{
-    AM_MEDIA_TYPE *mediaType = nullptr;
-
-    if (FAILED(this->self->GetFormat(&mediaType)))
-        return {};
-
-    auto format = formatFromMediaType(mediaType);
-    deleteMediaType(&mediaType);
-
-    VideoFormat rgbFormat(PixelFormatRGB24, format.width(), format.height());
-    VideoData data(rgbFormat.size());
-    static std::uniform_int_distribution<int> distribution(0, 255);
-    static std::default_random_engine engine;
-    std::generate(data.begin(), data.end(), [] () {
-        return uint8_t(distribution(engine));
-    });
-
-    VideoFrame rgbFrame;
-    rgbFrame.format() = rgbFormat;
-    rgbFrame.data() = data;
-
-    return rgbFrame.adjust(this->m_hue,
-                           this->m_saturation,
-                           this->m_brightness,
-                           this->m_gamma,
-                           this->m_contrast,
-                           !this->m_colorenable)
-                   .convert(format.fourcc());
+    self->updateAdjusts();
 }
@@ -48,7 +48,14 @@ namespace AkVCam
             void setBaseFilter(BaseFilter *baseFilter);
             static HRESULT stateChanged(void *userData, FILTER_STATE state);
             void serverStateChanged(IpcBridge::ServerState state);
-            void frameReady(const VideoFrame &frame);
+            void frameReady(const std::string &deviceId,
+                            const VideoFramePtr &frame,
+                            uint64_t sequence);
+            void sliceReady(const std::string &deviceId,
+                            const VideoFrame &frame,
+                            uint64_t sequence,
+                            int firstLine,
+                            int lines);
             void setPicture(const std::string &picture);
             void setBroadcasting(const std::string &broadcaster);
             void setControls(const std::map<std::string, int> &controls);